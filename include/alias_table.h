@@ -0,0 +1,42 @@
+#ifndef MANTARAY_ALIAS_TABLE_H
+#define MANTARAY_ALIAS_TABLE_H
+
+#include "manta_math.h"
+
+#include <vector>
+
+namespace manta {
+
+    // Samples an index in proportion to a set of weights in constant time (Vose's
+    // alias method). Every bin keeps the probability of its own index and the index
+    // that fills the rest of the bin.
+    class AliasTable {
+    public:
+        AliasTable();
+        ~AliasTable();
+
+        // Weights don't have to be normalized, if all weights are zero the
+        // distribution is uniform
+        void build(const math::real *weights, int count);
+        void destroy();
+
+        // Returns -1 if the table is empty. If uRemapped is given it is set to a new
+        // uniform sample in [0, 1) that can be used for another decision.
+        int sample(math::real u, math::real *pmf, math::real *uRemapped = nullptr) const;
+        math::real pmf(int index) const { return m_bins[index].pmf; }
+
+        int getSize() const { return (int)m_bins.size(); }
+
+    protected:
+        struct Bin {
+            math::real q;
+            math::real pmf;
+            int alias;
+        };
+
+        std::vector<Bin> m_bins;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_ALIAS_TABLE_H */
@@ -15,6 +15,9 @@ namespace manta {
         virtual math::Vector L(const IntersectionPoint &ref, const math::Vector &wi) const;
 
         virtual bool intersect(const math::Vector &src, const math::Vector &dir, math::real *depth) const;
+        virtual bool getBounds(AABB *bounds) const;
+        virtual math::real getPower() const;
+        virtual bool getLightBounds(LightBounds *bounds) const;
 
         math::real getArea() const;
 
@@ -50,6 +50,10 @@ namespace manta {
 
         math::Vector transformToImagePlane(const math::Vector2 coordinates) const;
 
+        // Offset of the differential rays in pixels, every pixel is covered by several
+        // samples so each one only accounts for part of it
+        math::real getDifferentialScale() const;
+
     protected:
         Sampler *m_sampler;
 
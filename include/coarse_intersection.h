@@ -11,6 +11,9 @@ namespace manta {
     struct CoarseIntersection {
         SceneObject *sceneObject;
         const SceneGeometry *sceneGeometry;
+
+        // Geometry that was hit when sceneGeometry is an instance of it
+        const SceneGeometry *instancedGeometry;
         math::real depth;
         int faceHint;
         int subdivisionHint;
@@ -15,6 +15,10 @@ namespace manta {
     class ImagePlane;
 
     class ComplexMap2D {
+    public:
+        // Number of columns transformed together by the vertical FFT pass
+        static const int ColumnBlockSize = 8;
+
     public:
         ComplexMap2D();
         ~ComplexMap2D();
@@ -38,8 +42,7 @@ namespace manta {
         void normalize(ComplexMap2D *target) const;
 
         void fft(ComplexMap2D *target) const;
-        void fft_multithreaded(ComplexMap2D *target, int threadCount, 
-            bool inverse = false) const;
+        void fft_multithreaded(ComplexMap2D *target, bool inverse = false) const;
         void fftHorizontal(ComplexMap2D *target, bool inverse, int startRow, int endRow) const;
         void fftVertical(ComplexMap2D *target, bool inverse, int startColumn, 
             int endColumn) const;
@@ -54,7 +54,7 @@ namespace manta {
         void doOp(ComplexMap2D *input, ComplexMap2D *target) {
             switch (T_Op) {
             case ComplexMapOperation::Fft:
-                input->fft_multithreaded(target, 12);
+                input->fft_multithreaded(target);
                 break;
             case ComplexMapOperation::DftToCft:
                 input->cft(target, getAuxInputReal(0), getAuxInputReal(1));
@@ -0,0 +1,42 @@
+#ifndef MANTARAY_COUNTER_RNG_H
+#define MANTARAY_COUNTER_RNG_H
+
+#include <stdint.h>
+
+namespace manta {
+
+    // Philox-2x32-10 bijection, from Salmon et al., "Parallel Random Numbers: As Easy
+    // as 1, 2, 3" (2011). Every (counter, key) pair maps to an independent random value
+    // so a stream needs no state other than its position.
+    inline uint32_t philox2x32(uint32_t c0, uint32_t c1, uint32_t key) {
+        for (int i = 0; i < 10; i++) {
+            const uint64_t product = (uint64_t)0xD256D193u * c0;
+            c0 = (uint32_t)(product >> 32) ^ key ^ c1;
+            c1 = (uint32_t)product;
+            key += 0x9E3779B9u;
+        }
+
+        return c0;
+    }
+
+    // Stream of random numbers identified by a key and a sub-stream, for instance a
+    // pixel and one of its samples. Copying a stream copies its position.
+    struct CounterRng {
+        uint32_t key;
+        uint32_t stream;
+        uint32_t counter;
+
+        void seed(uint32_t streamKey, uint32_t subStream = 0) {
+            key = streamKey;
+            stream = subStream;
+            counter = 0;
+        }
+
+        uint32_t next() {
+            return philox2x32(counter++, stream, key);
+        }
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_COUNTER_RNG_H */
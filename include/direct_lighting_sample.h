@@ -0,0 +1,59 @@
+#ifndef MANTARAY_DIRECT_LIGHTING_SAMPLE_H
+#define MANTARAY_DIRECT_LIGHTING_SAMPLE_H
+
+#include "manta_math.h"
+
+namespace manta {
+
+    // Direct lighting estimate whose visibility has not been tested yet. Each shadow ray
+    // decides whether its contribution is part of the estimate.
+    struct DirectLightingSample {
+        static const int MaxShadowRays = 2;
+
+        struct ShadowRay {
+            math::Vector origin;
+            math::Vector direction;
+            math::real maxDepth;
+
+            // Added to the estimate if nothing blocks the shadow ray
+            math::Vector contribution;
+        };
+
+        ShadowRay shadowRays[MaxShadowRays];
+        int shadowRayCount;
+
+        // Applied to the sum of all unoccluded contributions
+        math::real scale;
+
+        void reset() {
+            shadowRayCount = 0;
+            scale = (math::real)1.0;
+        }
+
+        ShadowRay *addShadowRay() {
+            return &shadowRays[shadowRayCount++];
+        }
+
+        math::Vector evaluate(int occludedMask) const {
+            math::Vector Ld = math::constants::Zero;
+            for (int i = 0; i < shadowRayCount; i++) {
+                if ((occludedMask & (0x1 << i)) == 0) {
+                    Ld = math::add(Ld, shadowRays[i].contribution);
+                }
+            }
+
+            return math::mul(math::loadScalar(scale), Ld);
+        }
+    };
+
+    // BSDF sample that continued a path. Emission found by the new ray is weighted
+    // against light sampling at the vertex that took the sample.
+    struct ScatteringSample {
+        math::Vector position;
+        math::Vector normal;
+        math::real pdf;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_DIRECT_LIGHTING_SAMPLE_H */
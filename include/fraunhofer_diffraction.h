@@ -56,7 +56,7 @@ namespace manta {
         void normalize();
 
         void generateMap(const CftEstimator2D *estimator, const Settings *settings, 
-            int threadCount, VectorMap2D *target) const;
+            VectorMap2D *target) const;
         void _generateMap(const CftEstimator2D *estimator, const Settings *settings, 
             int startRow, int endRow, VectorMap2D *target) const;
 
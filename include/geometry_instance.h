@@ -0,0 +1,66 @@
+#ifndef MANTARAY_GEOMETRY_INSTANCE_H
+#define MANTARAY_GEOMETRY_INSTANCE_H
+
+#include "scene_geometry.h"
+
+#include "runtime_statistics.h"
+
+namespace manta {
+
+    // Places shared geometry (and its acceleration structure) in the scene through an
+    // affine transform. Rays are moved into object space for traversal and the resulting
+    // intersection is moved back into world space.
+    class GeometryInstance : public SceneGeometry {
+    public:
+        GeometryInstance();
+        virtual ~GeometryInstance();
+
+        virtual bool findClosestIntersection(LightRay *ray, CoarseIntersection *intersection,
+            math::real minDepth, math::real maxDepth, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+        virtual void fineIntersection(const math::Vector &r, IntersectionPoint *p,
+            const CoarseIntersection *hint) const;
+        virtual bool fastIntersection(LightRay *ray) const;
+        virtual bool getBounds(AABB *bounds) const;
+        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
+
+        void setGeometry(const SceneGeometry *geometry) { m_geometry = geometry; }
+        const SceneGeometry *getGeometry() const { return m_geometry; }
+
+        // Transform from object space to world space, must be invertible
+        void setTransform(const math::Matrix &transform);
+        const math::Matrix &getTransform() const { return m_transform; }
+        const math::Matrix &getInverseTransform() const { return m_inverseTransform; }
+
+        math::Vector objectToWorldPoint(const math::Vector &p) const;
+        math::Vector objectToWorldDirection(const math::Vector &d) const;
+        math::Vector objectToWorldNormal(const math::Vector &n) const;
+
+        math::Vector worldToObjectPoint(const math::Vector &p) const;
+        math::Vector worldToObjectDirection(const math::Vector &d) const;
+        math::Vector worldToObjectNormal(const math::Vector &n) const;
+
+        // Moves the parametric surface data computed in object space into world space
+        void transformPartialDerivatives(IntersectionPoint *p) const;
+
+    protected:
+        virtual void _evaluate();
+        virtual void registerInputs();
+
+        piranha::pNodeInput m_geometryInput;
+        piranha::pNodeInput m_scaleInput;
+        piranha::pNodeInput m_rotationAxisInput;
+        piranha::pNodeInput m_rotationInput;
+
+    protected:
+        const SceneGeometry *m_geometry;
+
+        math::Matrix m_transform;
+        math::Matrix m_inverseTransform;
+
+        // Inverse transpose of the linear part
+        math::Matrix m_normalTransform;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_GEOMETRY_INSTANCE_H */
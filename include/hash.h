@@ -0,0 +1,28 @@
+#ifndef MANTARAY_HASH_H
+#define MANTARAY_HASH_H
+
+#include "memory_management.h"
+
+namespace manta {
+
+    typedef unsigned __int64 hash_value;
+
+    constexpr hash_value FnvOffsetBasis = 0xcbf29ce484222325ull;
+    constexpr hash_value FnvPrime = 0x100000001b3ull;
+
+    // 64-bit FNV-1a. Pass a previous result as the basis to hash discontiguous data.
+    inline hash_value fnv1a(const void *data, mem_size size, hash_value basis = FnvOffsetBasis) {
+        const unsigned char *bytes = (const unsigned char *)data;
+
+        hash_value hash = basis;
+        for (mem_size i = 0; i < size; i++) {
+            hash ^= (hash_value)bytes[i];
+            hash *= FnvPrime;
+        }
+
+        return hash;
+    }
+
+} /* namespace manta */
+
+#endif /* MANTARAY_HASH_H */
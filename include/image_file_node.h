@@ -5,19 +5,13 @@
 
 #include "vector_map_2d.h"
 #include "vector_map_2d_node_output.h"
+#include "tiled_texture.h"
 
 struct SDL_Surface;
 
 namespace manta {
 
     class ImageFileNode : public Node {
-    public:
-        struct Pixel {
-            unsigned char r;
-            unsigned char g;
-            unsigned char b;
-        };
-
     public:
         ImageFileNode();
         ~ImageFileNode();
@@ -28,16 +22,34 @@ namespace manta {
         void setCorrectGamma(bool correctGamma) { m_correctGamma = correctGamma; }
         bool getCorrectGamma() const { return m_correctGamma; }
 
-        const VectorMap2D *getMap() const { return &m_imageMap; }
+        // Tiled images are converted to a tiled texture file next to the source and
+        // their tiles are only loaded when sampled
+        void setTiled(bool tiled) { m_tiled = tiled; }
+        bool isTiled() const { return m_tiled; }
+
+        const VectorMap2D *getMap() const { return m_imageMap; }
+        const VectorMipmap *getMipmap() const { return m_mipmap; }
+
+        // Texels are stored as 8-bit values in the map, gamma correction is applied
+        // when they are sampled
+        static bool decodeFile(const std::string &filename, bool correctGamma, VectorMap2D *target);
+        static bool decodeJpeg(const void *data, mem_size size, bool correctGamma, VectorMap2D *target);
+        static bool decodeSurface(SDL_Surface *surface, bool correctGamma, VectorMap2D *target);
 
     protected:
-        static void getPixel(const SDL_Surface *surface, int x, int y, Pixel *pixel);
+        static VectorMap2D::Format getFormat(bool monochrome, bool correctGamma);
+
+        bool openTiledTexture(const Path &sourcePath, __int64 writeTime);
 
     protected:
-        VectorMap2D m_imageMap;
+        // Owned by the session's image cache
+        const VectorMap2D *m_imageMap;
+        const VectorMipmap *m_mipmap;
+        TiledTexture m_tiledTexture;
 
         std::string m_filename;
         bool m_correctGamma;
+        bool m_tiled;
 
     protected:
         virtual void _initialize();
@@ -50,6 +62,7 @@ namespace manta {
 
         piranha::pNodeInput m_filenameInput;
         piranha::pNodeInput m_correctGammaInput;
+        piranha::pNodeInput m_tiledInput;
     };
 
 } /* namespace manta */
@@ -17,7 +17,36 @@ namespace manta {
 
     class Filter;
 
+    // Private accumulation buffer covering a job rectangle plus the filter footprint.
+    // Workers splat into their own tile without synchronization and merge it into the
+    // image plane once per job.
+    struct ImagePlaneTile {
+        // Inclusive bounds in image plane coordinates
+        int left;
+        int top;
+        int right;
+        int bottom;
+
+        int width;
+        int height;
+
+        // Rows splatted into so far. Other workers may claim the rest of the job so
+        // rows are only cleared when first touched and only these are merged.
+        int touchedTop;
+        int touchedBottom;
+
+        math::Vector *values;
+        math::real *weights;
+    };
+
     class ImagePlane : public ObjectReferenceNode<ImagePlane> {
+    public:
+        // Side length of the image regions that are locked independently when merging
+        static const int LockRegionSize = 32;
+
+        // Jobs larger than this fall back to splatting directly into the image plane
+        static const int MaxTilePixels = 512 * 512;
+
     public:
         ImagePlane();
         ~ImagePlane();
@@ -47,6 +76,11 @@ namespace manta {
         void add(const math::Vector &v, int x, int y);
         void processSamples(ImageSample *samples, int sampleCount, StackAllocator *stack);
 
+        bool createTile(ImagePlaneTile *tile, int x0, int y0, int x1, int y1, StackAllocator *stack) const;
+        void addSamples(ImagePlaneTile *tile, ImageSample *samples, int sampleCount, StackAllocator *stack);
+        void mergeTile(const ImagePlaneTile *tile);
+        void freeTile(ImagePlaneTile *tile, StackAllocator *stack) const;
+
         void normalize();
 
         void setPreviewTarget(VectorMap2D *target) { m_previewTarget = target; }
@@ -82,7 +116,15 @@ namespace manta {
         VectorMap2D *m_previewTarget;
 
     protected:
-        std::mutex m_lock;
+        std::mutex *getRegionLock(int x, int y) const;
+        void updatePreview(int x, int y);
+
+        static void touchTileRows(ImagePlaneTile *tile, int top, int bottom);
+        static void clearTileRows(ImagePlaneTile *tile, int top, int bottom);
+
+        std::mutex *m_regionLocks;
+        int m_regionCountX;
+        int m_regionCountY;
     };
 
 } /* namespace manta */
@@ -9,6 +9,7 @@ namespace manta {
 
     class LightRay;
     class IntersectionPointManager;
+    class GeometryInstance;
 
     struct IntersectionPoint {
         math::Vector m_position;
@@ -36,6 +37,10 @@ namespace manta {
         const BSDF *m_bsdf = nullptr;
         int m_faceIndex = -1;
 
+        // Set when the surface belongs to instanced geometry, in which case the mesh
+        // data referenced above is in the instance's object space
+        const GeometryInstance *m_instance = nullptr;
+
     public:
         math::Vector u_basis;
         math::Vector v_basis;
@@ -55,6 +60,20 @@ namespace manta {
         void calculatePartialDerivatives();
         void offset(math::real du, math::real dv);
 
+    public:
+        // Change in position, texture coordinates and shading normal from one pixel to
+        // the next, only valid if the ray that hit the surface carried differentials
+        bool m_hasDifferentials = false;
+        math::Vector m_dpdx;
+        math::Vector m_dpdy;
+        math::Vector m_dtdx;
+        math::Vector m_dtdy;
+        math::Vector m_dndx;
+        math::Vector m_dndy;
+
+        void calculateDifferentials(const LightRay *ray);
+        math::real getTextureFootprint() const;
+
     public:
         void calculateCachedValues();
 
@@ -2,7 +2,8 @@
 #define MANTARAY_JOB_QUEUE_H
 
 #include <mutex>
-#include <queue>
+#include <deque>
+#include <atomic>
 
 namespace manta {
 
@@ -21,17 +22,59 @@ namespace manta {
         int samples;
     };
 
+    // Work-stealing job scheduler. Every worker owns a deque that it consumes from
+    // the front while idle workers steal from the back. Once all deques are empty,
+    // idle workers split the remaining rows of another worker's active job.
     class JobQueue {
+    public:
+        // Jobs with fewer remaining rows than this are never split
+        static const int MinSplitRows = 2;
+
+    protected:
+        struct WorkerQueue {
+            std::deque<Job> jobs;
+            std::mutex lock;
+
+            // Job currently being processed by the worker. Its remaining rows are
+            // packed as (next row, end row) so that rows can be claimed and split
+            // without taking the lock on the owning worker's side.
+            Job activeJob;
+            std::atomic<unsigned long long> activeRows;
+        };
+
     public:
         JobQueue();
         ~JobQueue();
 
+        void initialize(int workerCount);
+        void destroy();
+
+        // Jobs are distributed round-robin so that each worker starts with an even share
         void push(const Job &job);
-        bool pop(Job *job);
+
+        // Finds a new job for the worker and makes it the worker's active job
+        bool pop(Job *job, int workerId);
+
+        // Claims the next row of the worker's active job
+        bool claimRow(int workerId, int *row);
+
+        int getWorkerCount() const { return m_workerCount; }
 
     protected:
-        std::queue<Job> m_queue;
-        std::mutex m_queueLock;
+        bool steal(Job *job, int workerId);
+        bool split(Job *job, int workerId);
+        void setActiveJob(WorkerQueue *queue, const Job *job);
+
+        static unsigned long long packRows(int next, int end) {
+            return ((unsigned long long)(unsigned int)next << 32) | (unsigned int)end;
+        }
+
+        static int getNextRow(unsigned long long rows) { return (int)(rows >> 32); }
+        static int getEndRow(unsigned long long rows) { return (int)(rows & 0xFFFFFFFF); }
+
+        WorkerQueue *m_queues;
+        int m_workerCount;
+        int m_nextQueue;
     };
 
 } /* namespace manta */
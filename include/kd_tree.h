@@ -7,6 +7,10 @@
 #include "stack_list.h"
 #include "primitives.h"
 #include "runtime_statistics.h"
+#include "memory_mapped_file.h"
+#include "hash.h"
+#include "triangle_block.h"
+#include "ray_packet.h"
 
 #include <vector>
 #include <fstream>
@@ -14,6 +18,7 @@
 
 #define OPTIMIZED_KD_TREE_NODE (true)
 #define KD_TREE_WITH_BOUNDING_BOXES (false)
+#define KD_TREE_TRIANGLE_BLOCKS (ENABLE_TRIANGLE_BLOCKS)
 
 namespace manta {
 
@@ -135,7 +140,75 @@ namespace manta {
         math::real tmin, tmax;
     };
 
+    // Deferred far child of a packet traversal, only the lanes in laneMask visit it
+    struct KDPacketJob {
+        alignas(RAY_PACKET_WIDTH * sizeof(math::real)) math::real tmin[RAY_PACKET_WIDTH];
+        alignas(RAY_PACKET_WIDTH * sizeof(math::real)) math::real tmax[RAY_PACKET_WIDTH];
+        const KDTreeNode *node;
+        int laneMask;
+    };
+
+    // Intermediate node used by the parallel build before it is flattened
+    // into the final KDTreeNode array
+    struct KDBuildNode {
+        AABB bounds;
+        KDBuildNode *children[2];
+        std::vector<int> faces;
+        math::real split;
+        int axis;
+
+        inline bool isLeaf() const { return axis == 0x3; }
+    };
+
+    struct KDParallelWorkspace {
+        // Constants
+        Mesh *mesh;
+        const AABB *allFaceBounds;
+        int maxPrimitives;
+    };
+
+    // Header of the on-disk kd-tree cache. The node array starts at KDTree::CacheHeaderSize
+    // and is followed directly by the face list. headerChecksum covers the header only
+    // so that loading doesn't have to read the whole payload.
+    struct KDTreeCacheHeader {
+        char magic[8];
+        int version;
+        int nodeSize;
+
+        hash_value meshHash;
+        hash_value buildHash;
+        hash_value headerChecksum;
+        hash_value checksum;
+
+        int granularity;
+        int nodeCount;
+        int faceCount;
+        int padding;
+
+        math::real minPoint[3];
+        math::real maxPoint[3];
+    };
+
     class KDTree : public SceneGeometry {
+    public:
+        // Nodes with fewer primitives than this are never handed to the thread pool
+        static const int ParallelTaskThreshold = 4096;
+
+        // Nodes with more primitives than this use binned SAH instead of sorting
+        static const int BinnedSahThreshold = 1024;
+        static const int SahBinCount = 64;
+
+        // Bump whenever the node layout or the build algorithm changes
+        static const int CacheVersion = 2;
+        static const int CacheHeaderSize = 128;
+
+        enum class CacheStatus {
+            Loaded,
+            Missing,
+            Stale,
+            Corrupt
+        };
+
     public:
         KDTree();
         ~KDTree();
@@ -160,16 +233,22 @@ namespace manta {
             CoarseIntersection *intersection, math::real minDepth, 
             math::real maxDepth, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
         virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
+        virtual int findClosestIntersectionPacket(const RayPacket &packet, int laneMask,
+            CoarseIntersection *intersections, math::real minDepth, const math::real *maxDepth,
+            StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
         virtual math::Vector getClosestPoint(const CoarseIntersection *hint, 
             const math::Vector &p) const;
         virtual void fineIntersection(const math::Vector &r, IntersectionPoint *p, 
             const CoarseIntersection *hint) const;
         virtual bool fastIntersection(LightRay *ray) const;
+        virtual bool getBounds(AABB *bounds) const;
 
-        void analyzeWithProgress(Mesh *mesh, int maxSize);
+        void analyzeWithProgress(Mesh *mesh, int maxSize, bool parallel = false);
         void analyze(Mesh *mesh, int maxSize);
+        void analyzeParallel(Mesh *mesh, int maxSize);
 
         void setMesh(Mesh *mesh);
+        Mesh *getMesh() const { return m_mesh; }
 
         int createNode();
         int createNodeVolume();
@@ -177,20 +256,58 @@ namespace manta {
 
         void initLeaf(int node, const std::vector<int> &faces, const AABB &bounds, 
             KDTreeWorkspace *workspace);
+        void initFilteredLeaf(int node, const std::vector<int> &faces, KDTreeWorkspace *workspace);
 
         void writeToObjFile(const char *fname) const;
 
+        // The tree must be configured with the same width/center before loading. Loaded
+        // trees reference the mapped file directly until destroy() is called. The payload
+        // checksum is only verified on request since it reads every page of the file.
+        bool writeCacheFile(const char *fname, int granularity) const;
+        CacheStatus loadCacheFile(const char *fname, Mesh *mesh, int granularity, bool verifyPayload = false);
+
+        // Hash of everything other than the mesh that determines the built tree
+        hash_value computeBuildHash(int granularity) const;
+
         void setComplete(bool complete) { m_complete = complete; }
         bool isComplete() const { return m_complete; }
         void resetProgress() { m_progress = (math::real)0.0; }
         void setProgress(math::real progress) { m_progress = progress; }
-        void incrementProgress(math::real d) { m_progress = m_progress + d; }
+        void incrementProgress(math::real d);
         math::real getProgress() const { return m_progress; }
 
     protected:
         void _analyze(int currentNode, AABB *nodeBounds, const std::vector<int> &faces, 
             int badRefines, int depth, KDTreeWorkspace *workspace, math::real effort);
 
+        KDBuildNode *_analyzeParallel(const AABB &nodeBounds, std::vector<int> &faces,
+            int badRefines, int depth, KDParallelWorkspace *workspace, math::real effort);
+        bool findSplitSorted(const AABB &nodeBounds, const std::vector<int> &faces,
+            const KDParallelWorkspace *workspace, int *axis, math::real *split, math::real *cost) const;
+        bool findSplitBinned(const AABB &nodeBounds, const std::vector<int> &faces,
+            const KDParallelWorkspace *workspace, int *axis, math::real *split, math::real *cost) const;
+        void flattenBuildTree(const KDBuildNode *node, int currentNode, KDTreeWorkspace *workspace);
+        void destroyBuildTree(KDBuildNode *node);
+        void finalizeFaceList(const KDTreeWorkspace *workspace);
+        void initializeCacheHeader(KDTreeCacheHeader *header, hash_value meshHash, int granularity) const;
+
+        void buildTriangleBlocks();
+        void destroyTriangleBlocks();
+
+#if KD_TREE_TRIANGLE_BLOCKS
+        void initializeBlockRay(TriangleBlockRay *ray, const math::Vector &origin,
+            const math::Vector3 &shear, int kx, int ky, int kz) const;
+
+        // Tests all triangles of a leaf. If hit is null any hit between minDepth and
+        // maxDepth is accepted, otherwise the closest one is written to hit.
+        bool intersectLeafBlocks(int node, int primitiveCount, const TriangleBlockRay &ray,
+            math::real minDepth, math::real maxDepth, TriangleBlockHit *hit /**/ STATISTICS_PROTOTYPE) const;
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+        hash_value computeCacheChecksum() const;
+
+        // Checks that every child and face index read from a cache is in range
+        bool checkCacheIndices(int meshFaceCount) const;
+
         Mesh *m_mesh;
 
         AABB m_bounds;
@@ -209,9 +326,19 @@ namespace manta {
 
         math::real m_width;
 
+#if KD_TREE_TRIANGLE_BLOCKS
+        // Leaf triangles gathered into SIMD groups, indexed by m_leafBlockOffsets[node]
+        TriangleBlock *m_triangleBlocks;
+        int m_triangleBlockCount;
+        int *m_leafBlockOffsets;
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+
+        // Backing storage for trees loaded from the disk cache
+        MemoryMappedFile m_cacheFile;
+
         // Non-essential statistics
-        math::real m_progress;
-        bool m_complete;
+        std::atomic<math::real> m_progress;
+        std::atomic<bool> m_complete;
     };
 
 } /* namespace manta */
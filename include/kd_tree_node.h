@@ -27,6 +27,9 @@ namespace manta {
         piranha::pNodeInput m_centerInput;
         piranha::pNodeInput m_cacheKeyInput;
         piranha::pNodeInput m_overwriteCacheInput;
+        piranha::pNodeInput m_parallelBuildInput;
+        piranha::pNodeInput m_diskCacheInput;
+        piranha::pNodeInput m_verifyDiskCacheInput;
 
     protected:
         KDTree *m_kdTree;
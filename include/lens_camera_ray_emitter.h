@@ -22,8 +22,14 @@ namespace manta {
         void setLens(const Lens *lens) { m_lens = lens; }
         const Lens *getLens() const { return m_lens; }
 
+        // Each differential traces its own ray through the lens, so with differentials
+        // enabled every camera ray costs three lens traces instead of one
+        void setDifferentialsEnabled(bool enabled) { m_differentialsEnabled = enabled; }
+        bool getDifferentialsEnabled() const { return m_differentialsEnabled; }
+
     protected:
         const Lens *m_lens;
+        bool m_differentialsEnabled;
         Lens::LensScanHint m_lensHint;
     };
 
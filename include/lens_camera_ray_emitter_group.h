@@ -21,6 +21,9 @@ namespace manta {
         void setLens(const Lens *lens) { m_lens = lens; }
         const Lens *getLens() { return m_lens; }
 
+        void setRayDifferentials(bool enabled) { m_rayDifferentials = enabled; }
+        bool getRayDifferentials() const { return m_rayDifferentials; }
+
     protected:
         const Lens *m_lens;
 
@@ -32,10 +35,13 @@ namespace manta {
         virtual void registerInputs();
 
         piranha::pNodeInput m_lensInput;
+        piranha::pNodeInput m_rayDifferentialsInput;
 
     protected:
         math::real m_xIncrement;
         math::real m_yIncrement;
+
+        bool m_rayDifferentials;
     };
 
 } /* namespace manta */
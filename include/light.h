@@ -7,6 +7,8 @@
 namespace manta {
 
     class Scene;
+    struct AABB;
+    struct LightBounds;
 
     class Light : public ObjectReferenceNode<Light> {
     public:
@@ -20,6 +22,20 @@ namespace manta {
 
         virtual bool intersect(const math::Vector &src, const math::Vector &dir, math::real *depth) const;
 
+        // Returns false if the light is unbounded
+        virtual bool getBounds(AABB *bounds) const;
+
+        // Total emitted power, used to pick between lights
+        virtual math::real getPower() const;
+
+        // Returns false if the light can't be bounded, such lights are sampled
+        // separately from the light BVH
+        virtual bool getLightBounds(LightBounds *bounds) const;
+
+        // Emission of surface emitters is found by paths that hit the surface, so their
+        // BSDF samples are weighted outside of direct lighting
+        virtual bool isSurfaceEmitter() const { return false; }
+
     protected:
         virtual void _evaluate();
         virtual void registerInputs();
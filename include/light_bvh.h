@@ -0,0 +1,85 @@
+#ifndef MANTARAY_LIGHT_BVH_H
+#define MANTARAY_LIGHT_BVH_H
+
+#include "manta_math.h"
+#include "primitives.h"
+
+#include <vector>
+
+namespace manta {
+
+    // Conservative description of where a light (or group of lights) is and in which
+    // directions it emits
+    struct LightBounds {
+        AABB bounds;
+        math::real phi;
+
+        // Emission cone: every normal of the light is within acos(cosTheta_o) of w and
+        // light leaves each normal within acos(cosTheta_e)
+        math::Vector w;
+        math::real cosTheta_o;
+        math::real cosTheta_e;
+        bool twoSided;
+
+        // Upper bound of the contribution at p, n can be zero if the receiver has no
+        // orientation
+        math::real importance(const math::Vector &p, const math::Vector &n) const;
+
+        static LightBounds merge(const LightBounds &a, const LightBounds &b);
+    };
+
+    struct LightBVHNode {
+        LightBounds bounds;
+
+        // Leaf: index of the light
+        // Interior: index of the second child (first child follows the node)
+        int offset;
+        bool leaf;
+    };
+
+    // Picks a light in proportion to an estimate of its contribution at a shading point.
+    // Each node is chosen over its sibling by the importance of its bounds.
+    class LightBVH {
+    public:
+        static const int MaxDepth = 64;
+        static const int BucketCount = 12;
+
+    public:
+        LightBVH();
+        ~LightBVH();
+
+        // Lights without power are left out and are never sampled
+        void build(const LightBounds *lights, int count);
+        void destroy();
+
+        // Returns -1 if no light can contribute at p
+        int sample(const math::Vector &p, const math::Vector &n, math::real u, math::real *pmf) const;
+        math::real pmf(const math::Vector &p, const math::Vector &n, int light) const;
+
+        int getNodeCount() const { return (int)m_nodes.size(); }
+        bool isEmpty() const { return m_nodes.empty(); }
+
+    protected:
+        struct BuildEntry {
+            LightBounds bounds;
+            math::Vector centroid;
+            int light;
+        };
+
+        int buildNode(std::vector<BuildEntry> &entries, int start, int end,
+            unsigned __int64 bitTrail, int depth);
+        int findSplit(std::vector<BuildEntry> &entries, int start, int end, const LightBounds &bounds,
+            const AABB &centroidBounds);
+
+        static math::real cost(const LightBounds &bounds, const AABB &nodeBounds, int axis);
+
+        std::vector<LightBVHNode> m_nodes;
+
+        // Path from the root to every light, bit i is set if the second child is taken
+        // at depth i
+        std::vector<unsigned __int64> m_bitTrails;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_LIGHT_BVH_H */
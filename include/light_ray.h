@@ -33,6 +33,19 @@ namespace manta {
         void setImagePlaneLocation(const math::Vector2 &imagePlaneLocation) { m_imagePlaneLocation = imagePlaneLocation; }
         math::Vector2 getImagePlaneLocation() const { return m_imagePlaneLocation; }
 
+        // Rays offset by one pixel in x and y on the image plane, used to estimate
+        // the footprint of the ray on the surfaces it hits
+        void setDifferentials(
+            const math::Vector &dxSource, const math::Vector &dxDirection,
+            const math::Vector &dySource, const math::Vector &dyDirection);
+        void clearDifferentials() { m_hasDifferentials = false; }
+        bool hasDifferentials() const { return m_hasDifferentials; }
+
+        math::Vector getDxSource() const { return m_dxSource; }
+        math::Vector getDxDirection() const { return m_dxDirection; }
+        math::Vector getDySource() const { return m_dySource; }
+        math::Vector getDyDirection() const { return m_dyDirection; }
+
         void calculateTransformations();
 
         int getKX() const { return m_kx; }
@@ -63,6 +76,12 @@ namespace manta {
 
         math::real m_pdf;
 
+        bool m_hasDifferentials;
+        math::Vector m_dxSource;
+        math::Vector m_dxDirection;
+        math::Vector m_dySource;
+        math::Vector m_dyDirection;
+
         int m_kx, m_ky, m_kz;
         math::Vector3 m_shear;
         math::Vector m_permutedDirection;
@@ -0,0 +1,57 @@
+#ifndef MANTARAY_LIGHT_SAMPLER_H
+#define MANTARAY_LIGHT_SAMPLER_H
+
+#include "manta_math.h"
+#include "alias_table.h"
+#include "light_bvh.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace manta {
+
+    class Light;
+
+    // Chooses the light that next event estimation samples at a shading point
+    class LightSampler {
+    public:
+        enum class Strategy {
+            Uniform,
+            Power,
+            Spatial
+        };
+
+    public:
+        LightSampler();
+        ~LightSampler();
+
+        void build(Light *const *lights, int lightCount, Strategy strategy);
+        void destroy();
+
+        // Returns nullptr if no light can contribute at the shading point p with normal n
+        const Light *sample(const math::Vector &p, const math::Vector &n, math::real u, math::real *pmf) const;
+        math::real pmf(const math::Vector &p, const math::Vector &n, const Light *light) const;
+
+        Strategy getStrategy() const { return m_strategy; }
+        int getLightCount() const { return (int)m_lights.size(); }
+
+    protected:
+        Strategy m_strategy;
+
+        std::vector<Light *> m_lights;
+        std::unordered_map<const Light *, int> m_lightIndices;
+
+        // Power strategy
+        AliasTable m_powerTable;
+
+        // Spatial strategy, lights that can't be bounded are picked uniformly with a
+        // fixed probability
+        LightBVH m_bvh;
+        std::vector<int> m_unbounded;
+        std::vector<int> m_unboundedIndices;
+        math::real m_unboundedProbability;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_LIGHT_SAMPLER_H */
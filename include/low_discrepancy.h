@@ -0,0 +1,104 @@
+#ifndef MANTARAY_LOW_DISCREPANCY_H
+#define MANTARAY_LOW_DISCREPANCY_H
+
+#include "manta_math.h"
+
+#include <stdint.h>
+
+namespace manta {
+
+    inline uint32_t reverseBits32(uint32_t v) {
+        v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+        v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+        v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+        v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+        return (v >> 16) | (v << 16);
+    }
+
+    // Finalizer of MurmurHash3, used to derive independent seeds
+    inline uint32_t mixBits32(uint32_t v) {
+        v ^= v >> 16;
+        v *= 0x85ebca6bu;
+        v ^= v >> 13;
+        v *= 0xc2b2ae35u;
+        v ^= v >> 16;
+        return v;
+    }
+
+    inline uint32_t hashCombine32(uint32_t seed, uint32_t v) {
+        return mixBits32(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+    }
+
+    // First two dimensions of the Sobol sequence, which together form a (0,2)-sequence
+    inline uint32_t sobolSample0(uint32_t index) {
+        return reverseBits32(index);
+    }
+
+    inline uint32_t sobolSample1(uint32_t index) {
+        uint32_t result = 0;
+        for (uint32_t v = 0x80000000u; index != 0; index >>= 1, v ^= v >> 1) {
+            if ((index & 0x1) != 0) result ^= v;
+        }
+
+        return result;
+    }
+
+    // Hash based nested uniform (Owen) scrambling of a 0.32 fixed point value, from
+    // Burley, "Practical Hash-based Owen Scrambling" (2020)
+    inline uint32_t owenScramble(uint32_t v, uint32_t seed) {
+        v = reverseBits32(v);
+        v ^= v * 0x3d20adeau;
+        v += seed;
+        v *= (seed >> 16) | 1;
+        v ^= v * 0x05526c56u;
+        v ^= v * 0x53a22864u;
+        return reverseBits32(v);
+    }
+
+    // Random permutation of [0, length) evaluated one element at a time, from
+    // Kensler, "Correlated Multi-Jittered Sampling" (2013)
+    inline uint32_t permutationElement(uint32_t i, uint32_t length, uint32_t seed) {
+        uint32_t w = length - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+
+        do {
+            i ^= seed;
+            i *= 0xe170893du;
+            i ^= seed >> 16;
+            i ^= (i & w) >> 4;
+            i ^= seed >> 8;
+            i *= 0x0929eb3fu;
+            i ^= seed >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | seed >> 27;
+            i *= 0x6935fa69u;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303u;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3u;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3dfu;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= length);
+
+        return (i + seed) % length;
+    }
+
+    inline math::real fixedPointToReal(uint32_t v) {
+        const math::real f = v * (math::real)0x1p-32f;
+        return (f > (math::real)0.9999f) ? (math::real)0.9999f : f;
+    }
+
+    inline uint32_t realToFixedPoint(math::real f) {
+        const double scaled = (double)f * 4294967296.0;
+        return (scaled >= 4294967295.0) ? 0xFFFFFFFFu : (uint32_t)scaled;
+    }
+
+} /* namespace manta */
+
+#endif /* MANTARAY_LOW_DISCREPANCY_H */
@@ -207,6 +207,9 @@ namespace manta {
         } /* namespace constants */
 
         // Math functions
+        // Random numbers come from a per-thread counter-based stream, seeding it makes
+        // the sequence independent of which thread runs the code
+        void seedRandom(unsigned int key);
         Vector uniformRandom4(real range = (real)1.0);
         real uniformRandom(real range = (real)1.0);
         int uniformRandomInt(int range);
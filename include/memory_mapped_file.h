@@ -0,0 +1,35 @@
+#ifndef MANTARAY_MEMORY_MAPPED_FILE_H
+#define MANTARAY_MEMORY_MAPPED_FILE_H
+
+#include "memory_management.h"
+
+namespace manta {
+
+    // Read-only view of an entire file. Pages are mapped copy-on-write so that
+    // structures pointing into the view can never modify the file on disk. Empty
+    // files open successfully with no data and a size of zero.
+    class MemoryMappedFile {
+    public:
+        MemoryMappedFile();
+        ~MemoryMappedFile();
+
+        bool open(const char *fname);
+        void close();
+
+        bool isOpen() const { return m_open; }
+        void *getData() const { return m_data; }
+        mem_size getSize() const { return m_size; }
+
+    protected:
+        void *m_data;
+        mem_size m_size;
+        bool m_open;
+
+        // Platform specific handles
+        void *m_fileHandle;
+        void *m_mappingHandle;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_MEMORY_MAPPED_FILE_H */
@@ -7,6 +7,10 @@
 #include "manta_math.h"
 #include "primitives.h"
 #include "coarse_intersection.h"
+#include "hash.h"
+#include "memory_mapped_file.h"
+
+#include <string>
 
 #define ENABLE_FACE_AABB (false)
 
@@ -24,7 +28,52 @@ namespace manta {
         int subdivisionHint;
     };
 
+    // Header of the binary mesh cache. The arrays follow in the order faces, aux face
+    // data, material map, vertices, normals, texture coordinates and material names,
+    // each starting at a multiple of Mesh::CacheAlignment.
+    struct MeshCacheHeader {
+        char magic[8];
+        int version;
+        int faceSize;
+        int auxFaceSize;
+        int vectorSize;
+
+        // Identifies the version of the source file the cache was written from. The
+        // write time only has a resolution of a second so the contents are hashed too.
+        unsigned __int64 sourceSize;
+        __int64 sourceTime;
+        hash_value sourceHash;
+
+        int faceCount;
+        int vertexCount;
+        int normalCount;
+        int texCoordCount;
+        int materialCount;
+        int flags;
+
+        unsigned __int64 offsets[7];
+        unsigned __int64 fileSize;
+    };
+
     class Mesh : public SceneGeometry {
+    public:
+        // Bump whenever the layout of any of the cached arrays changes
+        static const int CacheVersion = 2;
+        static const int CacheHeaderSize = 192;
+        static const int CacheAlignment = 64;
+
+        enum class CacheStatus {
+            Loaded,
+            Missing,
+            Stale,
+            Corrupt
+        };
+
+        enum CacheFlag {
+            PerVertexNormals = 0x1,
+            UseTexCoords = 0x2
+        };
+
     public:
         Mesh();
         ~Mesh();
@@ -44,7 +93,8 @@ namespace manta {
         virtual void fineIntersection(const math::Vector &r, IntersectionPoint *p, 
             const CoarseIntersection *hint) const;
         virtual bool fastIntersection(LightRay *ray) const;
-        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const { return false; }
+        virtual bool getBounds(AABB *bounds) const;
+        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
 
         int getFaceCount() const { return m_triangleFaceCount + m_quadFaceCount; }
         int getTriangleFaceCount() const { return m_triangleFaceCount; }
@@ -86,6 +136,24 @@ namespace manta {
 
         void merge(const Mesh *mesh);
 
+        // Hash of the vertex positions and face indices, used to validate on-disk caches
+        hash_value computeContentHash() const;
+
+        void setSourcePath(const std::string &path) { m_sourcePath = path; }
+        const std::string &getSourcePath() const { return m_sourcePath; }
+
+        // Binary cache of a freshly loaded mesh (triangles only). Loading maps the file
+        // and points the mesh straight at it, any writes stay private to the process.
+        bool writeCacheFile(const char *fname,
+            unsigned __int64 sourceSize, __int64 sourceTime, hash_value sourceHash) const;
+        CacheStatus loadCacheFile(const char *fname,
+            unsigned __int64 sourceSize, __int64 sourceTime, hash_value sourceHash);
+        bool isCacheMapped() const { return m_cacheFile.isOpen(); }
+
+        // Hash of the size and the first and last blocks of a source file, cheap
+        // enough to compute on every load
+        static hash_value computeSourceHash(const char *fname);
+
         __forceinline bool rayTriangleIntersection(
             int faceIndex,
             math::real minDepth,
@@ -265,6 +333,29 @@ namespace manta {
             return found;
         }
 
+        // Any-hit version of the above for shadow rays, stops at the first blocking triangle
+        __forceinline bool occluded(const int *faceList, int faceCount, const LightRay *ray,
+            math::real maxDepth /**/ STATISTICS_PROTOTYPE) const
+        {
+            const math::Vector source = ray->getSource();
+            const math::Vector3 &shear = ray->getShear();
+            const int kx = ray->getKX();
+            const int ky = ray->getKY();
+            const int kz = ray->getKZ();
+
+            for (int i = 0; i < faceCount; i++) {
+                INCREMENT_COUNTER(RuntimeStatistics::Counter::TriangleTests);
+                if (rayTriangleIntersection(faceList[i], (math::real)0.0, maxDepth, source, shear, kx, ky, kz)) {
+                    return true;
+                }
+                else {
+                    INCREMENT_COUNTER(RuntimeStatistics::Counter::UnecessaryTriangleTests);
+                }
+            }
+
+            return false;
+        }
+
         bool checkFaceAABB(int faceIndex, const AABB &bounds) const;
         void calculateFaceAABB(int faceIndex, AABB *target) const;
 
@@ -272,6 +363,10 @@ namespace manta {
         bool checkFaceAABB(const math::Vector &v0, const math::Vector &v1, 
             const math::Vector &v2, const AABB &bounds) const;
 
+        static void computeCacheLayout(MeshCacheHeader *header, mem_size materialNamesSize);
+        static bool checkCacheIndices(const MeshCacheHeader &header, const char *data);
+        bool isInCacheFile(const void *p) const;
+
         Face *m_faces;
         AuxFaceData *m_auxFaceData;
         QuadFace *m_quadFaces;
@@ -283,6 +378,7 @@ namespace manta {
 
         int *m_materialMap;
         std::string *m_materials;
+        int m_materialCount;
 
         math::Vector *m_vertices;
         math::Vector *m_normals;
@@ -301,6 +397,12 @@ namespace manta {
 
         bool m_perVertexNormals;
         bool m_useTextureCoords;
+
+        // File the mesh was loaded from, empty if it was generated
+        std::string m_sourcePath;
+
+        // Backing storage for meshes loaded from the binary cache
+        MemoryMappedFile m_cacheFile;
     };
 
 } /* namespace manta */
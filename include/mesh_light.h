@@ -0,0 +1,74 @@
+#ifndef MANTARAY_MESH_LIGHT_H
+#define MANTARAY_MESH_LIGHT_H
+
+#include "light.h"
+
+#include "alias_table.h"
+#include "light_bvh.h"
+#include "primitives.h"
+
+#include <vector>
+
+namespace manta {
+
+    class Mesh;
+    class GeometryInstance;
+    class SceneObject;
+    class MaterialLibrary;
+
+    // Emissive faces of a mesh sampled as a light. Triangles are picked in proportion
+    // to their area so every point of the emitter has the same density.
+    class MeshLight : public Light {
+    public:
+        MeshLight();
+        ~MeshLight();
+
+        // Finds the faces whose material emits at the face's centroid. Returns false
+        // if there are none. Meshes placed by an instance are sampled in world space.
+        bool initialize(SceneObject *object, const Mesh *mesh, const GeometryInstance *instance, MaterialLibrary *library);
+        void destroy();
+
+        virtual math::Vector sampleIncoming(const IntersectionPoint &ref, const math::Vector2 &u, math::Vector *wi, math::real *pdf, math::real *depth) const;
+
+        virtual bool getBounds(AABB *bounds) const;
+        virtual math::real getPower() const { return m_power; }
+        virtual bool getLightBounds(LightBounds *bounds) const;
+        virtual bool isSurfaceEmitter() const { return true; }
+
+        // Density with respect to area of sampling the point, zero if the point isn't
+        // on one of the emissive faces
+        math::real pdfArea(const IntersectionPoint &p) const;
+
+        const Mesh *getMesh() const { return m_mesh; }
+        const GeometryInstance *getInstance() const { return m_instance; }
+        int getTriangleCount() const { return (int)m_triangles.size(); }
+        math::real getArea() const { return m_area; }
+
+    protected:
+        struct EmissiveTriangle {
+            int face;
+            math::real area;
+        };
+
+        Material *getMaterial(const IntersectionPoint &p) const;
+        math::Vector getVertex(int index) const;
+        void evaluatePoint(const EmissiveTriangle &triangle, math::real su, math::real sv,
+            const math::Vector &source, LightRay *ray, IntersectionPoint *p) const;
+
+        SceneObject *m_object;
+        const Mesh *m_mesh;
+        const GeometryInstance *m_instance;
+        MaterialLibrary *m_library;
+
+        std::vector<EmissiveTriangle> m_triangles;
+        std::vector<bool> m_emissive;
+        AliasTable m_distribution;
+
+        LightBounds m_bounds;
+        math::real m_area;
+        math::real m_power;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_MESH_LIGHT_H */
@@ -2,8 +2,11 @@
 #define MANTARAY_MIPMAP_H
 
 #include "standard_allocator.h"
+#include "vector_map_2d.h"
+#include "manta_math.h"
 
 #include <vector>
+#include <cmath>
 #include <assert.h>
 
 // For Intellisense only
@@ -44,7 +47,7 @@ namespace manta {
 
             int currentSize = (m_maxHeight < m_maxWidth) ? m_maxHeight : m_maxWidth;
             m_levels = calculateLevels(currentSize);
-            m_maps = StandardAllocator::Global()->allocate<Map>(m_levels, 16);
+            m_maps = StandardAllocator::Global()->allocate<Map>(m_levels, 16, MemoryTag::Texture);
             m_maps[0].copy(map);
 
             for (int i = 1; i < m_levels; i++) {
@@ -60,13 +63,22 @@ namespace manta {
             math::real t = v * m_maps[level].getHeight() - (math::real)0.5;
             int s0 = (int)std::floor(s), t0 = (int)std::floor(t);
             math::real ds = s - s0, dt = t - t0;
-            return discreteSample(level, s0, t0) * (1 - ds) * (1 - dt) +
-                discreteSample(level, s0, t0 + 1) * (1 - ds) * dt +
-                discreteSample(level, s0 + 1, t0) * ds * (1 - dt) +
-                discreteSample(level, s0 + 1, t0 + 1) * ds * dt;
+            return lerp(
+                lerp(discreteSample(level, s0, t0), discreteSample(level, s0 + 1, t0), ds),
+                lerp(discreteSample(level, s0, t0 + 1), discreteSample(level, s0 + 1, t0 + 1), ds),
+                dt);
         }
 
+        // Texture coordinates wrap around
         ValueType discreteSample(int level, int i, int j) const {
+            const int width = m_maps[level].getWidth();
+            const int height = m_maps[level].getHeight();
+
+            i %= width;
+            j %= height;
+            if (i < 0) i += width;
+            if (j < 0) j += height;
+
             return m_maps[level].get(i, j);
         }
 
@@ -82,7 +94,7 @@ namespace manta {
             else {
                 int iLevel = (int)std::floor(level);
                 math::real delta = level - iLevel;
-                return triangle(iLevel, u, v) * (1 - delta) + triangle(iLevel + 1, u, v) * delta;
+                return lerp(triangle(iLevel, u, v), triangle(iLevel + 1, u, v), delta);
             }
         }
 
@@ -91,7 +103,7 @@ namespace manta {
                 m_maps[i].destroy();
             }
 
-            StandardAllocator::Global()->aligned_free(m_maps, m_levels);
+            StandardAllocator::Global()->aligned_free(m_maps, m_levels, MemoryTag::Texture);
 
             m_maps = nullptr;
             m_levels = 0;
@@ -101,6 +113,23 @@ namespace manta {
             return m_levels;
         }
 
+        const Map *getLevel(int level) const {
+            return &m_maps[level];
+        }
+
+    protected:
+        template <typename T>
+        static T lerp(const T &a, const T &b, math::real s) {
+            return a * (1 - s) + b * s;
+        }
+
+        // Vectors can be SIMD types without arithmetic operators
+        static math::Vector lerp(const math::Vector &a, const math::Vector &b, math::real s) {
+            return math::add(
+                math::mul(a, math::loadScalar(1 - s)),
+                math::mul(b, math::loadScalar(s)));
+        }
+
     protected:
         Map *m_maps;
 
@@ -110,6 +139,8 @@ namespace manta {
         int m_levels;
     };
 
+    typedef Mipmap<VectorMap2D, math::Vector> VectorMipmap;
+
 } /* namespace manta */
 
 #endif /* MANTARAY_MIPMAP_H */
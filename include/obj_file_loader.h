@@ -3,7 +3,6 @@
 
 #include "manta_math.h"
 
-#include <istream>
 #include <vector>
 #include <string>
 #include <stdio.h>
@@ -33,16 +32,50 @@ namespace manta {
             int material;
         };
 
+    public:
+        // Files are split into chunks of roughly this size which are parsed in parallel
+        static constexpr size_t DefaultChunkSize = 4 * 1024 * 1024;
+
+    protected:
+        struct Chunk {
+            const char *begin;
+            const char *end;
+
+            // Number of elements defined in this chunk
+            int vertexCount;
+            int normalCount;
+            int texCoordCount;
+            int faceCount;
+            int materialCount;
+
+            // Last material selected in this chunk, either a local material index,
+            // NoMaterial or UnchangedMaterial
+            int lastMaterial;
+
+            // Elements defined before this chunk
+            int vertexOffset;
+            int normalOffset;
+            int texCoordOffset;
+            int faceOffset;
+            int materialOffset;
+            int startMaterial;
+        };
+
+        static constexpr int NoMaterial = -1;
+        static constexpr int UnchangedMaterial = -2;
+
     public:
         ObjFileLoader();
         ~ObjFileLoader();
 
         bool loadObjFile(const char *fname);
+        bool loadObjData(const char *data, size_t size, size_t chunkSize = DefaultChunkSize);
 
         unsigned int getVertexCount() const { return (unsigned int)m_vertices.size(); }
         unsigned int getFaceCount() const { return (unsigned int)m_faces.size(); }
         unsigned int getNormalCount() const { return (unsigned int)m_normals.size(); }
         unsigned int getTexCoordCount() const { return (unsigned int)m_texCoords.size(); }
+        unsigned int getMaterialCount() const { return (unsigned int)m_materials.size(); }
 
         ObjFace getFace(unsigned int i) const { return m_faces[i]; }
         math::Vector3 getVertex(unsigned int i) const { return m_vertices[i]; }
@@ -52,29 +85,24 @@ namespace manta {
 
         void destroy();
 
+        static bool parseReal(const char *begin, const char *end, math::real *target);
+        static bool parseInt(const char *begin, const char *end, int *target);
+
     protected:
-        bool loadObjFile(std::istream &stream);
-        //bool readVertexPosition(std::stringstream &s, math::Vector3 *vertex) const;
-        //bool readVertexNormal(std::stringstream &s, math::Vector3 *normal) const;
-        //bool readVertexTextureCoords(std::stringstream &s, math::Vector2 *texCoords) const;
-        //bool readFace(std::stringstream &s, ObjFace *face);
-        //bool readMaterial(std::stringstream &s);
-
-        static size_t getLine(std::istream &stream, char **buffer, size_t bufferSize);
-        static int readType(char *s, int index);
-        int readMaterial(char *s, int index);
-        static int readWhitespace(char *s, int index);
-        static int readUntil(char *s, char terminator, int index);
-        static int readUntilWhitespace(char *s, int index, bool includeEnd=true);
-        static int readVector3(char *s, math::Vector3 *target, int index);
-        static int readVector2(char *s, math::Vector2 *target, int index);
-        static int readFace(char *s, ObjFace *target, int index);
-        static int readSlashSeparatedSet(char *s, int *target, int *n, int index);
+        static void countChunk(Chunk *chunk);
+        bool parseChunk(const Chunk &chunk);
+
+        static const char *nextLine(const char *s, const char *end);
+        static const char *readWhitespace(const char *s, const char *end);
+        static const char *readToken(const char *s, const char *end);
+        static bool tokenEquals(const char *begin, const char *end, const char *ref);
         static bool isWhitespace(char c);
-        static bool clipCompare(char *s, const char *ref, int start, int end);
-        static std::string clip(char *s, int start, int end);
-        static bool parseReal(char *s, math::real *target, int start, int end);
-        static bool parseInt(char *s, int *target, int start, int end);
+
+        static const char *readVector3(const char *s, const char *end, math::Vector3 *target);
+        static const char *readVector2(const char *s, const char *end, math::Vector2 *target);
+        static int countFaceTriangles(const char *s, const char *end);
+        static const char *readFaceVertex(const char *s, const char *end, const int *counts, int *target);
+        static const char *readFace(const char *s, const char *end, const int *counts, int triangleCount, ObjFace *target);
 
     protected:
         std::vector<ObjFace> m_faces;
@@ -82,9 +110,6 @@ namespace manta {
         std::vector<math::Vector2> m_texCoords;
         std::vector<math::Vector3> m_normals;
         std::vector<ObjMaterial> m_materials;
-
-        unsigned int m_currentLine;
-        int m_currentMaterial;
     };
 
 } /* namespace manta */
@@ -27,6 +27,7 @@ namespace manta {
         piranha::pNodeInput m_defaultMaterial;
         piranha::pNodeInput m_cacheKey;
         piranha::pNodeInput m_overwriteCache;
+        piranha::pNodeInput m_diskCache;
 
         Mesh *m_mesh;
     };
@@ -53,7 +53,8 @@ namespace manta {
         virtual void fineIntersection(const math::Vector &r, IntersectionPoint *p, 
             const CoarseIntersection *hint) const;
         virtual bool fastIntersection(LightRay *ray) const;
-        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const { return false; }
+        virtual bool getBounds(AABB *bounds) const;
+        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
 
         void analyze(Mesh *mesh, int maxSize);
 
@@ -71,6 +72,8 @@ namespace manta {
             const math::Vector &ood, CoarseIntersection *intersection,
             math::real minDepth, math::real maxDepth, 
             StackAllocator *s /**/ STATISTICS_PROTOTYPE, bool skip = false) const;
+        bool occluded(const OctreeBV *leaf, const LightRay *ray, const math::Vector &ood,
+            math::real maxDepth /**/ STATISTICS_PROTOTYPE, bool skip = false) const;
 
         bool analyze(Mesh *mesh, OctreeBV *leaf, int maxSize, std::vector<int> &facePool);
         void shrink(OctreeBV *leaf);
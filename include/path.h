@@ -42,6 +42,10 @@ namespace manta {
         bool isAbsolute() const;
         bool exists() const;
 
+        // Both return 0 if the file cannot be queried
+        unsigned __int64 getFileSize() const;
+        __int64 getLastWriteTime() const;
+
     protected:
         boost::filesystem::path *m_path;
 
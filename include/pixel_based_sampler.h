@@ -20,6 +20,7 @@ namespace manta {
         virtual math::Vector2 generate2d();
 
         virtual bool startNextSample();
+        virtual bool supportsExtraSamples() const { return false; }
 
     protected:
         std::vector<std::vector<math::real>> m_1dSamples;
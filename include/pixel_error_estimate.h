@@ -0,0 +1,47 @@
+#ifndef MANTARAY_PIXEL_ERROR_ESTIMATE_H
+#define MANTARAY_PIXEL_ERROR_ESTIMATE_H
+
+#include "manta_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace manta {
+
+    // Running mean and variance (Welford) of the luminance of a pixel's samples
+    struct PixelErrorEstimate {
+        static constexpr math::real MinLuminance = (math::real)1E-3;
+
+        int count = 0;
+        math::real mean = (math::real)0.0;
+        math::real m2 = (math::real)0.0;
+
+        void reset() {
+            count = 0;
+            mean = m2 = (math::real)0.0;
+        }
+
+        void add(const math::Vector &L) {
+            const math::real y = (math::real)0.2126 * math::getX(L)
+                + (math::real)0.7152 * math::getY(L)
+                + (math::real)0.0722 * math::getZ(L);
+
+            ++count;
+            const math::real delta = y - mean;
+            mean += delta / count;
+            m2 += delta * (y - mean);
+        }
+
+        // Standard error of the mean relative to the mean itself
+        math::real relativeError() const {
+            if (count < 2) return math::constants::REAL_MAX;
+
+            const math::real variance = m2 / (count - 1);
+            const math::real standardError = std::sqrt(variance / count);
+            return standardError / std::max(std::abs(mean), MinLuminance);
+        }
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_PIXEL_ERROR_ESTIMATE_H */
@@ -0,0 +1,59 @@
+#ifndef MANTARAY_PMJ02_SAMPLER_H
+#define MANTARAY_PMJ02_SAMPLER_H
+
+#include "sampler.h"
+
+#include <memory>
+#include <vector>
+#include <random>
+
+namespace manta {
+
+    // Progressive multi-jittered (0,2) sampler, from Christensen et al., "Progressive
+    // Multi-Jittered Sample Sequences" (2018). A few sample sets are generated up front;
+    // each pixel dimension picks one of them, shuffles the sample order and applies a
+    // random digital shift, which keeps every elementary interval stratified.
+    class Pmj02Sampler : public Sampler {
+    public:
+        static const int SetCount = 4;
+        static const int MaxSetSize = 4096;
+        static const unsigned int TableSeed = 0x5eed;
+
+    public:
+        Pmj02Sampler();
+        virtual ~Pmj02Sampler();
+
+        void configure(int samplesPerPixel);
+
+        virtual void startPixelSession();
+        virtual bool startNextSample();
+
+        virtual math::real generate1d();
+        virtual math::Vector2 generate2d();
+
+        virtual Sampler *clone() const;
+
+        int getSetSize() const { return m_setSize; }
+        const math::Vector2 *getSet(int set) const { return &(*m_sets)[(size_t)set * m_setSize]; }
+
+        // Fills samples with a pmj02 sequence. count must be a power of two.
+        static void generateSequence(math::Vector2 *samples, int count, std::mt19937 &rng);
+
+    protected:
+        void lookup(uint32_t *x, uint32_t *y);
+
+        uint32_t m_pixelSeed;
+        int m_dimension;
+
+        // Tables are shared by every clone of a sampler since they only depend on the
+        // sample count
+        int m_setSize;
+        std::shared_ptr<const std::vector<math::Vector2>> m_sets;
+
+    protected:
+        virtual void _evaluate();
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_PMJ02_SAMPLER_H */
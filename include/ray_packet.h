@@ -0,0 +1,49 @@
+#ifndef MANTARAY_RAY_PACKET_H
+#define MANTARAY_RAY_PACKET_H
+
+#include "manta_math.h"
+#include "triangle_block.h"
+
+// Packets share the single precision SIMD helpers of the triangle blocks. Without them
+// packet queries fall back to tracing every ray on its own.
+#define ENABLE_RAY_PACKETS (ENABLE_TRIANGLE_BLOCKS)
+
+#if ENABLE_RAY_PACKETS
+#define RAY_PACKET_WIDTH (TRIANGLE_BLOCK_WIDTH)
+#else
+#define RAY_PACKET_WIDTH (4)
+#endif /* ENABLE_RAY_PACKETS */
+
+namespace manta {
+
+    class LightRay;
+
+#if ENABLE_RAY_PACKETS
+    typedef TriangleBlockSimd RayPacketSimd;
+#endif /* ENABLE_RAY_PACKETS */
+
+    // Group of rays traced together through the acceleration structures. Origins and
+    // inverse directions are stored as structure-of-arrays, one SIMD lane per ray.
+    // Lanes past the ray count duplicate the first ray so that they stay finite.
+    struct alignas(RAY_PACKET_WIDTH * sizeof(math::real)) RayPacket {
+        static const int Width = RAY_PACKET_WIDTH;
+
+        math::real origin[3][Width];
+        math::real inverseDirection[3][Width];
+
+        LightRay *rays[Width];
+        int count;
+
+        void initialize(LightRay *const *rays, int count);
+
+        int getLaneMask() const { return (0x1 << count) - 1; }
+
+        // True if the rays of all lanes in the mask agree on the sign of each direction
+        // component, which is required for a shared front-to-back traversal order
+        bool isCoherent(int laneMask) const;
+        bool isNegative(int lane, int axis) const { return inverseDirection[axis][lane] < 0; }
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_RAY_PACKET_H */
@@ -10,9 +10,15 @@
 #include "runtime_statistics.h"
 #include "vector_map_2d_node_output.h"
 #include "intersection_point_manager.h"
+#include "scene_bvh.h"
+#include "light_sampler.h"
+#include "direct_lighting_sample.h"
+#include "bxdf.h"
 
 #include <atomic>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 // Utilities for path recording
 #if ENABLE_PATH_RECORDING
@@ -42,7 +48,11 @@ namespace manta {
     class MaterialLibrary;
     class Sampler;
     class Light;
+    class MeshLight;
     class RenderPattern;
+    class Material;
+    class BSDF;
+    class WavefrontQueue;
 
     class RayTracer : public Node {
     public:
@@ -60,6 +70,10 @@ namespace manta {
             CameraRayEmitterGroup *rayEmitterGroup,
             ImagePlane *target);
 
+        // Builds the acceleration structure and light sampler of the scene, which
+        // traceAll and tracePixel do before any ray is traced
+        void prepareScene(const Scene *scene);
+
         int getThreadCount() const { return m_threadCount; }
 
         void configure(
@@ -77,6 +91,18 @@ namespace manta {
         math::Vector traceRay(const Scene *scene, LightRay *ray, int degree,
             IntersectionPointManager *manager, Sampler *sampler, StackAllocator *s
             /**/ PATH_RECORDER_DECL /**/ STATISTICS_PROTOTYPE) const;
+
+        // Traces up to RayPacket::Width coherent rays, the first intersection of all rays
+        // is found with a single packet query. Each ray uses its own sampler.
+        void tracePacket(const Scene *scene, LightRay *const *rays, int rayCount, math::Vector *L,
+            IntersectionPointManager *manager, Sampler *const *samplers, StackAllocator *s
+            /**/ PATH_RECORDER_DECL /**/ STATISTICS_PROTOTYPE) const;
+
+        // Traces all paths of the queue to completion. Instead of following one path at a
+        // time every stage (extend, shade, shadow and accumulate) runs over all paths that
+        // are waiting for it, and paths are shaded in order of their material.
+        void traceWavefront(const Scene *scene, WavefrontQueue *queue,
+            IntersectionPointManager *manager, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
         void incrementRayCompletion(const Job *job, int increment = 1);
 
         math::Vector uniformSampleOneLight(
@@ -84,7 +110,8 @@ namespace manta {
             const Scene *scene,
             Sampler *sampler,
             IntersectionPointManager *manager,
-            StackAllocator *stackAllocator) const;
+            StackAllocator *stackAllocator
+            /**/ STATISTICS_PROTOTYPE) const;
         math::Vector estimateDirect(
             IntersectionPoint *point,
             const math::Vector2 &uScattering,
@@ -93,9 +120,35 @@ namespace manta {
             const Scene *scene,
             Sampler *sampler,
             IntersectionPointManager *manager,
+            StackAllocator *stackAllocator
+            /**/ STATISTICS_PROTOTYPE) const;
+
+        // Same as uniformSampleOneLight and estimateDirect but the shadow rays are returned
+        // instead of being traced
+        void sampleOneLight(
+            IntersectionPoint *point,
+            const Scene *scene,
+            Sampler *sampler,
+            DirectLightingSample *sample,
             StackAllocator *stackAllocator) const;
+        // selectionPmf is the probability with which the light was chosen
+        void sampleDirect(
+            IntersectionPoint *point,
+            const math::Vector2 &uScattering,
+            const Light *light,
+            math::real selectionPmf,
+            const math::Vector2 &uLight,
+            DirectLightingSample *sample,
+            StackAllocator *stackAllocator) const;
+
+        // Returns a mask of the shadow rays that are blocked
+        int traceShadowRays(const Scene *scene, const DirectLightingSample &sample /**/ STATISTICS_PROTOTYPE) const;
         static math::real powerHeuristic(int nf, math::real f_pdf, int ng, math::real g_pdf);
 
+        // Differentials of the ray leaving a perfectly specular bounce in direction wi
+        void specularDifferentials(const IntersectionPoint *point, const math::Vector &wi,
+            RayFlags flags, LightRay *nextRay) const;
+
         void setDeterministicSeedMode(bool enable) { m_deterministicSeed = enable; }
         bool isDeterministicSeedMode() const { return m_deterministicSeed; }
 
@@ -108,6 +161,28 @@ namespace manta {
         Sampler *getSampler() const { return m_sampler; }
         void setSampler(Sampler *sampler) { m_sampler = sampler; }
 
+        // Adaptive sampling: pixels keep sampling past the sampler's sample count until
+        // the relative error of their mean drops below the threshold or the cap is hit
+        void setAdaptiveSampling(bool enable) { m_adaptiveSampling = enable; }
+        bool isAdaptiveSampling() const { return m_adaptiveSampling; }
+
+        void setAdaptiveMaxSamples(int samples) { m_adaptiveMaxSamples = samples; }
+        int getAdaptiveMaxSamples() const { return m_adaptiveMaxSamples; }
+
+        void setAdaptiveThreshold(math::real threshold) { m_adaptiveThreshold = threshold; }
+        math::real getAdaptiveThreshold() const { return m_adaptiveThreshold; }
+
+        // Packet tracing: camera rays of neighbouring pixels are traced together
+        void setPacketTracing(bool enable) { m_packetTracing = enable; }
+        bool isPacketTracing() const { return m_packetTracing; }
+
+        // Wavefront integrator: paths of neighbouring pixels are traced in stages
+        void setWavefront(bool enable) { m_wavefront = enable; }
+        bool isWavefront() const { return m_wavefront; }
+
+        void recordSampleCount(int x, int y, int samples);
+        const VectorMap2D *getSampleCountImage() const { return m_sampleCountImage; }
+
     protected:
         virtual void _evaluate();
         virtual void _initialize();
@@ -125,8 +200,17 @@ namespace manta {
         piranha::pNodeInput m_samplerInput;
         piranha::pNodeInput m_renderPatternInput;
         piranha::pNodeInput m_directLightSamplingEnableInput;
+        piranha::pNodeInput m_adaptiveSamplingInput;
+        piranha::pNodeInput m_adaptiveMaxSamplesInput;
+        piranha::pNodeInput m_adaptiveThresholdInput;
+        piranha::pNodeInput m_packetTracingInput;
+        piranha::pNodeInput m_wavefrontInput;
+        piranha::pNodeInput m_textureCacheBudgetInput;
+        piranha::pNodeInput m_hugePagesInput;
+        piranha::pNodeInput m_lightSamplingInput;
 
         VectorMap2DNodeOutput m_output;
+        VectorMap2DNodeOutput m_sampleCountOutput;
 
         Sampler *m_sampler;
         RenderPattern *m_renderPattern;
@@ -144,14 +228,45 @@ namespace manta {
         bool m_multithreaded;
         bool m_directLightSampling;
 
+        void initializeSampleCountImage(const CameraRayEmitterGroup *group);
+
         void createWorkers();
-        void startWorkers();
-        void waitForWorkers();
+        void runWorkers();
         void destroyWorkers();
 
     protected:
+        // Result of a closest hit query that has not been refined yet
+        struct PrimaryHit {
+            CoarseIntersection *intersection;
+            Light *light;
+            bool found;
+        };
+
+        math::Vector tracePath(const Scene *scene, LightRay *ray, const PrimaryHit *primaryHit,
+            IntersectionPointManager *manager, Sampler *sampler, StackAllocator *s
+            /**/ PATH_RECORDER_DECL /**/ STATISTICS_PROTOTYPE) const;
+
+        // Steps of a path that are shared by both integrators
+        bool addEmission(const IntersectionPoint &point, SceneObject *sceneObject, const math::Vector &beta,
+            RayFlags flags, const ScatteringSample &scattering, int bounces, Material **material, math::Vector *L) const;
+        bool scatter(IntersectionPoint *point, Sampler *sampler, int bounces, int *maxBounces,
+            math::Vector *beta, RayFlags *flags, ScatteringSample *scattering, LightRay *nextRay, StackAllocator *s) const;
+
+        // MIS weight of emission from a surface emitter that a BSDF sample found
+        math::real emissionWeight(const IntersectionPoint &point, SceneObject *sceneObject,
+            const ScatteringSample &scattering) const;
+
+        // Stages of the wavefront integrator
+        void extendPaths(const Scene *scene, WavefrontQueue *queue,
+            IntersectionPointManager *manager, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+        void shadePaths(const Scene *scene, WavefrontQueue *queue, StackAllocator *s) const;
+        void castShadowRays(const Scene *scene, WavefrontQueue *queue /**/ STATISTICS_PROTOTYPE) const;
+        void accumulateDirectLighting(WavefrontQueue *queue) const;
+
         void depthCull(const Scene *scene, LightRay *ray, SceneObject **closestObject,
             IntersectionPoint *point, StackAllocator *s, math::real startingDepth /**/ STATISTICS_PROTOTYPE) const;
+        void resolveIntersection(const LightRay *ray, const PrimaryHit &hit, SceneObject **closestObject,
+            IntersectionPoint *point, StackAllocator *s) const;
         void refineContact(const LightRay *ray, math::real depth, IntersectionPoint *point,
             SceneObject **closestObject, StackAllocator *s) const;
         bool occluded(const Scene *scene, const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
@@ -159,14 +274,45 @@ namespace manta {
         math::Vector m_backgroundColor;
         VectorMap2D *m_outputImage;
 
+        // Top-level acceleration structure, rebuilt for every render
+        SceneBVH m_sceneBVH;
+
+        // Picks the light sampled at each shading point, rebuilt for every render
+        LightSampler m_lightSampler;
+        LightSampler::Strategy m_lightSamplingStrategy;
+
+        // Emissive meshes found when a render starts, sampled along with the scene's lights
+        std::vector<MeshLight *> m_meshLights;
+        std::unordered_map<const SceneObject *, const MeshLight *> m_meshLightLookup;
+
+        void buildLights(const Scene *scene);
+        void destroyLights();
+
+    protected:
+        // Adaptive sampling
+        bool m_adaptiveSampling;
+        int m_adaptiveMaxSamples;
+        math::real m_adaptiveThreshold;
+
+        // Samples taken per pixel, scaled so that the largest possible count is 1
+        VectorMap2D *m_sampleCountImage;
+
+    protected:
+        // Packet tracing
+        bool m_packetTracing;
+
+    protected:
+        // Wavefront integrator
+        bool m_wavefront;
+
     protected:
         // Material library
         MaterialLibrary *m_materialManager;
 
     protected:
         // Statistics
-        int m_currentRay;
-        int m_lastRayPrint;
+        std::atomic<int> m_currentRay;
+        std::atomic<int> m_lastRayPrint;
         std::mutex m_outputLock;
 
         StackAllocator m_stack;
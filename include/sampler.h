@@ -4,8 +4,7 @@
 #include "object_reference_node.h"
 
 #include "manta_math.h"
-
-#include <random>
+#include "counter_rng.h"
 
 namespace manta {
 
@@ -17,6 +16,9 @@ namespace manta {
         virtual void startPixelSession();
         virtual bool startNextSample();
 
+        // Whether samples past getSamplesPerPixel() can be taken, for adaptive sampling
+        virtual bool supportsExtraSamples() const { return true; }
+
         virtual math::real generate1d() = 0;
         virtual math::Vector2 generate2d() = 0;
 
@@ -28,7 +30,11 @@ namespace manta {
         void setSamplesPerPixel(int samplesPerPixel) { m_samplesPerPixel = samplesPerPixel; }
         int getSamplesPerPixel() const { return m_samplesPerPixel; }
 
+        // Random numbers are keyed by the seed, the pixel, the pixel sample and the
+        // dimension so that they don't depend on which sampler instance draws them
         void seed(unsigned int seed);
+        void setPixelIndex(unsigned int pixelIndex);
+        uint32_t getPixelKey() const { return m_pixelKey; }
 
         int getCurrentPixelSample() const { return m_currentPixelSample; }
 
@@ -38,7 +44,11 @@ namespace manta {
         piranha::pNodeInput m_samplesPerPixelInput;
         int m_samplesPerPixel;
 
-        std::mt19937 m_rng;
+        uint32_t m_seed;
+        uint32_t m_pixelKey;
+
+        // Stream of the current pixel sample
+        CounterRng m_stream;
 
     protected:
         virtual void _evaluate();
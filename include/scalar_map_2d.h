@@ -29,7 +29,7 @@ namespace manta {
             m_width = width;
             m_height = height;
 
-            m_data = StandardAllocator::Global()->allocate<math::real>(m_width * m_height, 16);
+            m_data = StandardAllocator::Global()->allocate<math::real>(m_width * m_height, 16, MemoryTag::Texture);
 
             for (int i = 0; i < m_width * m_height; i++) {
                 m_data[i] = (math::real)0.0;
@@ -37,7 +37,7 @@ namespace manta {
         }
 
         void destroy() {
-            StandardAllocator::Global()->aligned_free(m_data, m_width * m_height);
+            StandardAllocator::Global()->aligned_free(m_data, m_width * m_height, MemoryTag::Texture);
 
             m_data = nullptr;
             m_width = 0;
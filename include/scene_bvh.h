@@ -0,0 +1,97 @@
+#ifndef MANTARAY_SCENE_BVH_H
+#define MANTARAY_SCENE_BVH_H
+
+#include "manta_math.h"
+#include "primitives.h"
+#include "runtime_statistics.h"
+
+#include <vector>
+
+namespace manta {
+
+    class Scene;
+    class SceneObject;
+    class Light;
+    class LightRay;
+    class StackAllocator;
+    struct CoarseIntersection;
+    struct RayPacket;
+
+    struct SceneBVHNode {
+        AABB bounds;
+
+        // Leaf: index of the first primitive
+        // Interior: index of the second child (first child follows the node)
+        int offset;
+        short primitiveCount;
+        short axis;
+
+        inline bool isLeaf() const { return primitiveCount > 0; }
+    };
+
+    struct SceneBVHPrimitive {
+        SceneObject *object;
+        Light *light;
+    };
+
+    // Top-level acceleration structure over all scene objects and lights. Each leaf
+    // references whole objects, whose own SceneGeometry handles the per-primitive query.
+    class SceneBVH {
+    public:
+        static const int MaxLeafPrimitives = 4;
+        static const int MaxDepth = 64;
+        static const int BucketCount = 12;
+
+    public:
+        SceneBVH();
+        ~SceneBVH();
+
+        void build(const Scene *scene);
+        void destroy();
+
+        // Returns true if anything closer than *depth was found. If the closest hit is a
+        // light then *light is set and intersection->sceneObject is cleared.
+        bool findClosestIntersection(LightRay *ray, CoarseIntersection *intersection,
+            Light **light, math::real *depth, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+        bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
+
+        // Packet version of findClosestIntersection, results are written per lane and the
+        // mask of lanes that found anything closer than depths[lane] is returned
+        int findClosestIntersectionPacket(const RayPacket &packet, CoarseIntersection *intersections,
+            Light **lights, math::real *depths, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+
+        int getNodeCount() const { return (int)m_nodes.size(); }
+        int getPrimitiveCount() const { return (int)m_primitives.size(); }
+        int getUnboundedCount() const { return (int)m_unbounded.size(); }
+
+    protected:
+        struct BuildEntry {
+            AABB bounds;
+            math::Vector centroid;
+            SceneBVHPrimitive primitive;
+        };
+
+        int buildNode(std::vector<BuildEntry> &entries, int start, int end, int depth);
+        int findSplit(std::vector<BuildEntry> &entries, int start, int end, int axis,
+            math::real cmin, math::real cmax, math::real area);
+        int createLeaf(std::vector<BuildEntry> &entries, int start, int end, const AABB &bounds);
+
+        bool intersectPrimitive(const SceneBVHPrimitive &primitive, LightRay *ray,
+            CoarseIntersection *intersection, Light **light, math::real *depth,
+            StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+        int intersectPrimitivePacket(const SceneBVHPrimitive &primitive, const RayPacket &packet,
+            int laneMask, CoarseIntersection *intersections, Light **lights, math::real *depths,
+            StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+        bool occludedPrimitive(const SceneBVHPrimitive &primitive, const math::Vector &p0,
+            const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
+
+        std::vector<SceneBVHNode> m_nodes;
+        std::vector<SceneBVHPrimitive> m_primitives;
+
+        // Objects/lights that cannot provide finite bounds are tested on every query
+        std::vector<SceneBVHPrimitive> m_unbounded;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_SCENE_BVH_H */
@@ -15,6 +15,8 @@ namespace manta {
     class IntersectionList;
     class SceneObject;
     class StackAllocator;
+    struct AABB;
+    struct RayPacket;
 
     class SceneGeometry : public ObjectReferenceNode<SceneGeometry> {
     public:
@@ -29,6 +31,15 @@ namespace manta {
             IntersectionPoint *p, const CoarseIntersection *hint) const = 0;
         virtual bool fastIntersection(LightRay *ray) const = 0;
 
+        // Closest hit query for the packet lanes in laneMask, returns the mask of lanes that
+        // were hit. The default implementation traces every lane on its own.
+        virtual int findClosestIntersectionPacket(const RayPacket &packet, int laneMask,
+            CoarseIntersection *intersections, math::real minDepth, const math::real *maxDepth,
+            StackAllocator *s /**/ STATISTICS_PROTOTYPE) const;
+
+        // Returns false if the geometry is unbounded
+        virtual bool getBounds(AABB *bounds) const;
+
         void setId(int id);
         int getId() const;
 
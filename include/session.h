@@ -1,6 +1,8 @@
 #ifndef MANTARAY_SESSION_H
 #define MANTARAY_SESSION_H
 
+#include "mipmap.h"
+
 #include <string>
 #include <vector>
 #include <mutex>
@@ -16,6 +18,14 @@ namespace manta {
     class Mesh;
 
     class Session {
+    public:
+        // Decoded image, reused for as long as its source file is unchanged
+        struct CachedImage {
+            VectorMap2D *map;
+            VectorMipmap *mipmap;
+            __int64 writeTime;
+        };
+
     public:
         Session();
         ~Session();
@@ -36,6 +46,13 @@ namespace manta {
         Mesh *getCachedMesh(const std::string &key);
         void putCachedMesh(const std::string &key, Mesh *mesh);
 
+        // Returns false if the image is not cached or the source was modified since.
+        // Images are decoded by several nodes at once so entries are returned by value,
+        // replaced entries stay alive until the session is destroyed since other nodes
+        // may still be using them.
+        bool getCachedImage(const std::string &key, __int64 writeTime, CachedImage *image);
+        void putCachedImage(const std::string &key, const CachedImage &image);
+
     protected:
         Console *m_console;
 
@@ -43,6 +60,13 @@ namespace manta {
         std::vector<PreviewNode *> m_previews;
         std::map<std::string, KDTree *> m_kdTreeCache;
         std::map<std::string, Mesh *> m_meshCache;
+
+        std::mutex m_imageCacheLock;
+        std::map<std::string, CachedImage> m_imageCache;
+        std::vector<CachedImage> m_replacedImages;
+
+    protected:
+        static void destroyImage(const CachedImage &image);
     };
 
 } /* namespace manta */
@@ -15,6 +15,38 @@ namespace manta {
         static void fft_child(const math::Complex *input, math::Complex *target, int n, int s);
     };
 
+    // Iterative in-place radix-4 FFT for power-of-two sizes. Plans hold the bit
+    // reversal and twiddle tables and are shared between all users of a size.
+    class FFTPlan {
+    public:
+        FFTPlan();
+        ~FFTPlan();
+
+        static const FFTPlan *get(int n);
+
+        void initialize(int n);
+        void destroy();
+
+        int getSize() const { return m_n; }
+        int getReversedIndex(int i) const { return m_bitReverse[i]; }
+
+        // Input and target may be the same buffer
+        void transform(const math::Complex *input, math::Complex *target, bool inverse) const;
+
+        // Data must already be in bit reversed order. The inverse transform is scaled by 1/n.
+        void execute(math::Complex *data, bool inverse) const;
+
+    protected:
+        int m_n;
+        int m_log2n;
+
+        int *m_bitReverse;
+
+        // W_2m^k for k < m is stored at index m - 1 + k, for all stages m = 1, 2, 4 ... n / 2
+        math::Complex *m_twiddles;
+        math::Complex *m_inverseTwiddles;
+    };
+
 } /* namespace manta */
 
 #endif /* MANTARAY_SIGNAL_PROCESSING_H */
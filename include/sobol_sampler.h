@@ -0,0 +1,35 @@
+#ifndef MANTARAY_SOBOL_SAMPLER_H
+#define MANTARAY_SOBOL_SAMPLER_H
+
+#include "sampler.h"
+
+namespace manta {
+
+    // Owen scrambled Sobol sampler. Every dimension is drawn from its own independently
+    // scrambled and shuffled copy of the 2D Sobol (0,2)-sequence, so any number of
+    // dimensions is available and every power-of-two prefix of a pixel's samples is
+    // stratified. Sample counts do not have to be powers of two.
+    class SobolSampler : public Sampler {
+    public:
+        SobolSampler();
+        virtual ~SobolSampler();
+
+        virtual void startPixelSession();
+        virtual bool startNextSample();
+
+        virtual math::real generate1d();
+        virtual math::Vector2 generate2d();
+
+        virtual Sampler *clone() const;
+
+    protected:
+        uint32_t nextDimensionSeed();
+        uint32_t shuffledIndex(uint32_t dimensionSeed) const;
+
+        uint32_t m_pixelSeed;
+        int m_dimension;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_SOBOL_SAMPLER_H */
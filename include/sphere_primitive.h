@@ -28,7 +28,8 @@ namespace manta {
         virtual void fineIntersection(const math::Vector &r, IntersectionPoint *p, 
             const CoarseIntersection *hint) const;
         virtual bool fastIntersection(LightRay *ray) const;
-        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const { return false; }
+        virtual bool getBounds(AABB *bounds) const;
+        virtual bool occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const;
 
         void detectIntersection(const LightRay *ray, IntersectionPoint *convex, 
             IntersectionPoint *concave) const;
@@ -8,49 +8,78 @@
 
 #include <iostream>
 
-#define ENABLE_BOUNDS_CHECKING (false)
 #define ENABLE_LEDGER (false)
 
+// Every chunk is followed by an inaccessible page so that writing past the end of the
+// arena faults immediately instead of corrupting the heap
+#ifdef _DEBUG
+#define ENABLE_GUARD_PAGES (true)
+#else
+#define ENABLE_GUARD_PAGES (false)
+#endif /* _DEBUG */
+
 namespace manta {
 
+    // Arena made of a list of chunks. Allocations are taken from the current chunk and
+    // a new chunk is added whenever one runs out, so consecutive allocations are only
+    // contiguous within a chunk. Chunks stay reserved when the arena is rewound and
+    // are reused by later allocations.
     class StackAllocator {
+    public:
+        static constexpr mem_size DefaultChunkSize = 1 * MB;
+
+    protected:
+        struct Chunk {
+            Chunk *previous;
+            Chunk *next;
+
+            char *base;
+            char *end;
+
+            // Capacity of all chunks before this one
+            mem_size offset;
+
+            // Size of the whole allocation including the header and guard page
+            mem_size allocationSize;
+        };
+
+    public:
+        // Position of the arena that it can be rewound to
+        struct Marker {
+            Chunk *chunk;
+            void *stackPointer;
+            int allocationLedger;
+        };
+
     public:
         StackAllocator();
         ~StackAllocator();
 
-        void initialize(mem_size size);
+        // chunkSize is the size of the first chunk and the minimum size of the others
+        void initialize(mem_size chunkSize);
+        void destroy();
 
         void *allocate(mem_size size, unsigned int alignment = 1) {
 #if ENABLE_LEDGER
             m_allocationLedger++;
 #endif /* ENABLE_LEDGER */
 
-            void *realAddress = m_stackPointer;
-
             // Find an aligned address
             mem_size stackPtr = (mem_size)m_stackPointer;
-            unsigned int mod = (alignment - stackPtr % alignment) % alignment;
-
-            void *basePointer = (void *)((char *)m_stackPointer + mod);
-            void *newObject = basePointer;
+            unsigned int mod = (unsigned int)((alignment - stackPtr % alignment) % alignment);
 
-#if ENABLE_BOUNDS_CHECKING
-            bool outOfMemory =
-                ((mem_size)((char *)newObject) - ((mem_size)(char *)m_buffer) + size) <= m_size;
-            assert(outOfMemory == false);
-
-            if (((mem_size)((char *)newObject) - ((mem_size)(char *)m_buffer) + size) > m_size) {
-                std::cout << "Out of memory! " << m_allocationLedger << std::endl;
+            char *newObject = (char *)m_stackPointer + mod;
+            if (m_current == nullptr || newObject + size > m_current->end) {
+                newObject = (char *)grow(size, alignment);
             }
-#endif
 
             // Update previous block pointers
-            m_stackPointer = (void *)((char *)basePointer + size);
+            m_stackPointer = (void *)(newObject + size);
 
-            if ((mem_size)m_stackPointer > (mem_size)m_maxStackPointer) 
-                m_maxStackPointer = m_stackPointer;
+            const mem_size usage = m_current->offset + (mem_size)((char *)m_stackPointer - m_current->base);
+            if (usage > m_maxUsage) m_maxUsage = usage;
 
-            return newObject;
+            return (void *)newObject;
         }
 
         void free(void *memory) {
@@ -59,25 +88,64 @@ namespace manta {
             assert(m_allocationLedger >= 0);
 #endif
 
-#if ENABLE_BOUNDS_CHECKING
-            assert((mem_size)memory < (mem_size)m_stackPointer);
-#endif
-
             // Return the stack pointer to the beginning of the block
-            m_stackPointer = memory;
+            if ((char *)memory >= m_current->base && (char *)memory < m_current->end) {
+                assert((mem_size)memory < (mem_size)m_stackPointer);
+                m_stackPointer = memory;
+            }
+            else {
+                rewindToAddress(memory);
+            }
+        }
+
+        Marker getMarker() const {
+            return { m_current, m_stackPointer, m_allocationLedger };
         }
 
-        mem_size getMaxUsage() const { return ((mem_size)m_maxStackPointer - (mem_size)m_buffer); }
+        // Releases everything that was allocated after the marker was taken
+        void rewind(const Marker &marker) {
+            m_current = marker.chunk;
+            m_stackPointer = marker.stackPointer;
+            m_allocationLedger = marker.allocationLedger;
+        }
+
+        mem_size getMaxUsage() const { return m_maxUsage; }
+        mem_size getReservedSize() const;
+        int getChunkCount() const;
 
     protected:
-        void *m_buffer;
+        void *grow(mem_size size, unsigned int alignment);
+        void rewindToAddress(void *memory);
+
+        Chunk *allocateChunk(mem_size capacity, Chunk *previous);
+        void freeChunk(Chunk *chunk);
+
+        Chunk *m_first;
+        Chunk *m_current;
         void *m_stackPointer;
 
-        mem_size m_size;
+        mem_size m_chunkSize;
 
         // Statistics counters
         int m_allocationLedger;
-        void *m_maxStackPointer;
+        mem_size m_maxUsage;
+    };
+
+    // Rewinds the allocator to where it was when the scope was opened
+    class StackScope {
+    public:
+        StackScope(StackAllocator *stack) {
+            m_stack = stack;
+            if (stack != nullptr) m_marker = stack->getMarker();
+        }
+
+        ~StackScope() {
+            if (m_stack != nullptr) m_stack->rewind(m_marker);
+        }
+
+    protected:
+        StackAllocator *m_stack;
+        StackAllocator::Marker m_marker;
     };
 
 } /* namespace manta */
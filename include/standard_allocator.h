@@ -1,8 +1,11 @@
 #ifndef MANTARAY_STANDARD_ALLOCATOR_H
 #define MANTARAY_STANDARD_ALLOCATOR_H
 
+#include "memory_management.h"
+
 #include <assert.h>
 #include <new>
+#include <atomic>
 
 #include <iostream>
 
@@ -10,7 +13,31 @@
 
 namespace manta {
 
+    // Subsystem that an allocation is accounted to
+    enum class MemoryTag {
+        General,
+        Mesh,
+        KDTree,
+        Texture,
+        Film,
+        FFT,
+
+        // Special label for tag count
+        Count
+    };
+
     class StandardAllocator {
+    public:
+        // Aligned allocations at least this large are backed by huge pages when enabled
+        static constexpr mem_size HugePageSize = 2 * 1024 * 1024;
+
+    protected:
+        struct Counters {
+            std::atomic<int> allocationLedger;
+            std::atomic<mem_size> currentUsage;
+            std::atomic<mem_size> maxUsage;
+        };
+
     public:
         StandardAllocator();
         ~StandardAllocator();
@@ -18,14 +45,8 @@ namespace manta {
         void initialize();
 
         template <typename t_alloc>
-        t_alloc *allocate(unsigned int n = 1, unsigned int alignment = 1) {
-#if MANTA_STD_ALLOC_ENABLE_LEDGER
-            m_allocationLedger++;
-#endif /* MANTA_STD_ALLOC_ENABLE_LEDGER */
-
-            unsigned int usage = sizeof(t_alloc) * n;
-            m_currentUsage += usage;
-            if (m_currentUsage > m_maxUsage) m_maxUsage = m_currentUsage;
+        t_alloc *allocate(mem_size n = 1, unsigned int alignment = 1, MemoryTag tag = MemoryTag::General) {
+            recordAllocation(sizeof(t_alloc) * n, tag);
             t_alloc *newObject;
 
             if (alignment == 1) {
@@ -37,13 +58,13 @@ namespace manta {
                 }
             }
             else {
-                void *buffer = _aligned_malloc(sizeof(t_alloc) * n, alignment);
+                void *buffer = allocateAligned(sizeof(t_alloc) * n, alignment);
                 if (n == 1) {
                     newObject = new (buffer) t_alloc;
                 }
                 else {
                     newObject = (t_alloc *)buffer;
-                    for (unsigned int i = 0; i < n; i++) {
+                    for (mem_size i = 0; i < n; i++) {
                         new ((t_alloc *)buffer + i) t_alloc;
                     }
                 }
@@ -53,16 +74,10 @@ namespace manta {
         }
 
         template <typename t_alloc>
-        void free(t_alloc *memory, int n = 1) {
+        void free(t_alloc *memory, mem_size n = 1, MemoryTag tag = MemoryTag::General) {
             if (memory == nullptr) return;
 
-#if MANTA_STD_ALLOC_ENABLE_LEDGER
-            m_allocationLedger--;
-            assert(m_allocationLedger >= 0);
-#endif /* MANTA_STD_ALLOC_ENABLE_LEDGER */
-            assert(m_currentUsage >= sizeof(t_alloc) * n);
-
-            m_currentUsage -= sizeof(t_alloc) * n;
+            recordFree(sizeof(t_alloc) * n, tag);
 
             if (n == 1) {
                 delete memory;
@@ -73,38 +88,49 @@ namespace manta {
         }
 
         template <typename t_alloc>
-        void aligned_free(t_alloc *memory, int n = 1) {
+        void aligned_free(t_alloc *memory, mem_size n = 1, MemoryTag tag = MemoryTag::General) {
             if (memory == nullptr) return;
 
-#if MANTA_STD_ALLOC_ENABLE_LEDGER
-            m_allocationLedger--;
-            assert(m_allocationLedger >= 0);
-#endif /* MANTA_STD_ALLOC_ENABLE_LEDGER */
-            assert(m_currentUsage >= sizeof(t_alloc));
+            recordFree(sizeof(t_alloc) * n, tag);
 
-            m_currentUsage -= sizeof(t_alloc) * n;
-
-            for (int i = 0; i < n; i++) {
+            for (mem_size i = 0; i < n; i++) {
                 memory[i].~t_alloc();
             }
 
-            _aligned_free((void *)memory);
+            freeAligned((void *)memory);
         }
 
-        unsigned int getMaxUsage() const { return m_maxUsage; }
+        void setHugePagesEnabled(bool enabled) { m_hugePagesEnabled = enabled; }
+        bool getHugePagesEnabled() const { return m_hugePagesEnabled; }
+
+        mem_size getMaxUsage() const { return m_total.maxUsage; }
+        mem_size getCurrentUsage() const { return m_total.currentUsage; }
+        int getLedger() const { return m_total.allocationLedger; }
 
-        int getLedger() const { return m_allocationLedger; }
-        unsigned int getCurrentUsage() const { return m_currentUsage; }
+        mem_size getMaxUsage(MemoryTag tag) const { return m_tags[(int)tag].maxUsage; }
+        mem_size getCurrentUsage(MemoryTag tag) const { return m_tags[(int)tag].currentUsage; }
+        int getLedger(MemoryTag tag) const { return m_tags[(int)tag].allocationLedger; }
+
+        static const char *getTagName(MemoryTag tag);
 
     protected:
-        // Statistics counters
-        int m_allocationLedger;
-        unsigned int m_currentUsage;
-        unsigned int m_maxUsage;
+        void recordAllocation(mem_size size, MemoryTag tag);
+        void recordFree(mem_size size, MemoryTag tag);
+
+        void *allocateAligned(mem_size size, unsigned int alignment);
+        void freeAligned(void *memory);
+
+        static void resetCounters(Counters *counters);
+        static void updateMaximum(std::atomic<mem_size> *maximum, mem_size value);
+
+        std::atomic<bool> m_hugePagesEnabled;
+
+        // Statistics counters, updated from every thread
+        Counters m_total;
+        Counters m_tags[(int)MemoryTag::Count];
 
     public:
         // Singleton implementation
-        static StandardAllocator *s_global;
         static StandardAllocator *Global();
     };
 
@@ -0,0 +1,88 @@
+#ifndef MANTARAY_TEXTURE_CACHE_H
+#define MANTARAY_TEXTURE_CACHE_H
+
+#include "memory_management.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace manta {
+
+    class TiledTexture;
+    class VectorMap2D;
+
+    // Least recently used set of texture tiles shared by all tiled textures. Tiles are
+    // handed out as shared pointers so that a tile that is evicted while another thread
+    // is still sampling it stays valid until that thread lets go of it.
+    class TextureCache {
+    public:
+        static const mem_size DefaultBudget = 512 * MB;
+
+        struct Statistics {
+            unsigned __int64 hits;
+            unsigned __int64 misses;
+            unsigned __int64 evictions;
+            mem_size usage;
+            mem_size maxUsage;
+        };
+
+    public:
+        TextureCache();
+        ~TextureCache();
+
+        static TextureCache *Global();
+
+        // The budget is split evenly over the shards and each shard is trimmed to its
+        // share on its own, so a texture whose tiles all hash to a few shards can be
+        // evicted before the total reaches the budget.
+        void setBudget(mem_size budget) { m_budget = budget; }
+        mem_size getBudget() const { return m_budget; }
+
+        std::shared_ptr<const VectorMap2D> getTile(const TiledTexture *texture, int tileIndex);
+
+        // Drops every tile of the texture
+        void purge(const TiledTexture *texture);
+        void clear();
+
+        Statistics getStatistics() const;
+        void resetStatistics();
+
+    protected:
+        struct Entry {
+            unsigned __int64 key;
+            std::shared_ptr<const VectorMap2D> tile;
+            mem_size size;
+        };
+
+        // Tiles are spread over independently locked shards so that threads missing on
+        // different tiles rarely wait for each other
+        struct Shard {
+            std::mutex lock;
+            std::list<Entry> lru;
+            std::unordered_map<unsigned __int64, std::list<Entry>::iterator> entries;
+            mem_size usage;
+        };
+
+        static const int ShardCount = 16;
+
+        void evict(Shard *shard, mem_size budget);
+        void remove(Shard *shard, std::list<Entry>::iterator entry);
+        void updateMaximum(mem_size value);
+
+    protected:
+        Shard m_shards[ShardCount];
+        std::atomic<mem_size> m_budget;
+
+        std::atomic<unsigned __int64> m_hits;
+        std::atomic<unsigned __int64> m_misses;
+        std::atomic<unsigned __int64> m_evictions;
+        std::atomic<mem_size> m_usage;
+        std::atomic<mem_size> m_maxUsage;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_TEXTURE_CACHE_H */
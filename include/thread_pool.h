@@ -0,0 +1,92 @@
+#ifndef MANTARAY_THREAD_POOL_H
+#define MANTARAY_THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <vector>
+
+namespace manta {
+
+    class ThreadPool;
+
+    // Set of tasks that are waited on together. A thread waiting on a group runs the
+    // group's queued tasks itself, so groups can be nested inside tasks without
+    // deadlocking the pool.
+    class TaskGroup {
+        friend class ThreadPool;
+
+    public:
+        TaskGroup();
+        TaskGroup(ThreadPool *pool);
+        ~TaskGroup();
+
+        void run(const std::function<void()> &task);
+        void wait();
+
+        int getPendingCount() const { return m_pending; }
+
+    protected:
+        ThreadPool *m_pool;
+        std::atomic<int> m_pending;
+    };
+
+    // Process-wide pool of threads shared by rendering, acceleration structure builds
+    // and signal processing. Everything that runs in parallel is queued here so that
+    // heavy nodes running back to back never oversubscribe the machine.
+    class ThreadPool {
+        friend class TaskGroup;
+
+    protected:
+        struct QueuedTask {
+            std::function<void()> task;
+            TaskGroup *group;
+        };
+
+    public:
+        ThreadPool();
+        ~ThreadPool();
+
+        static ThreadPool *Global();
+
+        // A thread count of 0 starts one thread per hardware thread. Reinitializing
+        // waits for all queued tasks to complete first and must not be done while
+        // other threads use the pool, the global pool is never reinitialized.
+        void initialize(int threadCount = 0);
+        void destroy();
+
+        int getThreadCount() const { return (int)m_threads.size(); }
+
+        // Splits [begin, end) into ranges of at least grainSize elements and runs
+        // them on the pool. Returns once every range has been processed.
+        void parallelFor(int begin, int end, int grainSize, const std::function<void(int, int)> &body);
+
+        // Index of the calling thread within its pool, or -1 if it is not a pool thread
+        static int getCurrentThreadIndex() { return s_threadIndex; }
+
+        static int getHardwareThreadCount();
+
+    protected:
+        void push(const std::function<void()> &task, TaskGroup *group);
+        void execute(QueuedTask &task);
+        void workerLoop(int index);
+
+        // Removes a queued task of the group, must be called with the lock held
+        bool takeTask(TaskGroup *group, QueuedTask *task);
+
+        std::vector<std::thread> m_threads;
+        std::deque<QueuedTask> m_tasks;
+        std::mutex m_lock;
+        std::condition_variable m_taskAvailable;
+        std::condition_variable m_taskCompleted;
+        bool m_stop;
+
+        static thread_local int s_threadIndex;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_THREAD_POOL_H */
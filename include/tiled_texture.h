@@ -0,0 +1,115 @@
+#ifndef MANTARAY_TILED_TEXTURE_H
+#define MANTARAY_TILED_TEXTURE_H
+
+#include "vector_map_2d.h"
+#include "memory_mapped_file.h"
+#include "manta_math.h"
+
+#include <memory>
+#include <vector>
+
+namespace manta {
+
+    class TextureCache;
+
+    // Header of a tiled texture file. Every mip level is split into square tiles that
+    // are stored level by level and row by row, each tile occupies the same number of
+    // bytes and tiles on the right and bottom edges are padded with the edge texels.
+    struct TiledTextureHeader {
+        char magic[8];
+        int version;
+        int format;
+        int tileSize;
+        int width;
+        int height;
+        int levels;
+
+        // Identifies the source file and how it was decoded
+        unsigned __int64 sourceSize;
+        __int64 sourceTime;
+        unsigned int sourceFlags;
+
+        unsigned __int64 fileSize;
+    };
+
+    // Mip-mapped texture that stays on disk, tiles are only brought into memory through
+    // a TextureCache when they are first sampled.
+    class TiledTexture {
+    public:
+        // Bump whenever the layout of the file changes
+        static const int CacheVersion = 1;
+        static const int CacheHeaderSize = 128;
+        static const int TileSize = 64;
+
+        enum class CacheStatus {
+            Loaded,
+            Missing,
+            Stale,
+            Corrupt
+        };
+
+    public:
+        TiledTexture();
+        ~TiledTexture();
+
+        static bool writeFile(const char *fname, const VectorMap2D *source,
+            unsigned __int64 sourceSize, __int64 sourceTime, unsigned int sourceFlags);
+
+        CacheStatus open(const char *fname, unsigned __int64 sourceSize, __int64 sourceTime,
+            unsigned int sourceFlags, TextureCache *cache);
+        void close();
+
+        bool isOpen() const { return m_file.isOpen(); }
+
+        math::Vector sample(math::real u, math::real v, math::real w) const;
+        math::Vector triangle(int level, math::real u, math::real v) const;
+        math::Vector discreteSample(int level, int i, int j) const;
+        math::Vector get(int i, int j) const { return discreteSample(0, i, j); }
+
+        int getWidth() const { return m_width; }
+        int getHeight() const { return m_height; }
+        int getLevels() const { return (int)m_levels.size(); }
+        int getTileCount() const { return m_tileCount; }
+        VectorMap2D::Format getFormat() const { return m_format; }
+
+        // Unique for the lifetime of the process, cache keys are built from it
+        unsigned int getId() const { return m_id; }
+
+        // Copies a tile out of the file, called by the cache on a miss
+        void readTile(int tileIndex, VectorMap2D *target) const;
+
+    protected:
+        struct Level {
+            int width;
+            int height;
+            int tilesX;
+            int tilesY;
+            int firstTile;
+        };
+
+        // Last tile used by a lookup, neighbouring texels usually share it
+        struct TileReference {
+            int index;
+            std::shared_ptr<const VectorMap2D> tile;
+        };
+
+        static void computeLevels(int width, int height, int levelCount, std::vector<Level> *levels, int *tileCount);
+
+        math::Vector texel(int level, int i, int j, TileReference *reference) const;
+
+    protected:
+        MemoryMappedFile m_file;
+        TextureCache *m_cache;
+
+        std::vector<Level> m_levels;
+        int m_tileCount;
+        int m_width;
+        int m_height;
+        VectorMap2D::Format m_format;
+
+        unsigned int m_id;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_TILED_TEXTURE_H */
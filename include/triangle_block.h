@@ -0,0 +1,157 @@
+#ifndef MANTARAY_TRIANGLE_BLOCK_H
+#define MANTARAY_TRIANGLE_BLOCK_H
+
+#include "manta_math.h"
+
+// Blocks require single precision SIMD math, otherwise the scalar path is used
+#define ENABLE_TRIANGLE_BLOCKS (MANTA_USE_SIMD && MANTA_PRECISION == MANTA_PRECISION_FLOAT)
+
+// SSE width, neither build configuration enables AVX
+#define TRIANGLE_BLOCK_WIDTH (4)
+
+#if ENABLE_TRIANGLE_BLOCKS
+
+namespace manta {
+
+    // Vertex positions of a group of triangles in structure-of-arrays form. Unused
+    // lanes are zero filled and masked off by faceCount.
+    template <int Width>
+    struct alignas(Width * sizeof(float)) TriangleBlock_t {
+        float v[3][3][Width]; // [vertex][axis][lane]
+        int faces[Width];
+        int faceCount;
+    };
+
+    typedef TriangleBlock_t<TRIANGLE_BLOCK_WIDTH> TriangleBlock;
+
+    // Per-ray constants of the watertight test, computed once per query
+    struct TriangleBlockRay {
+        float origin[3];
+        float sx, sy, sz;
+        int kx, ky, kz;
+    };
+
+    struct TriangleBlockHit {
+        float depth;
+        float u, v, w;
+        int face;
+    };
+
+    struct TriangleBlockSse {
+        typedef __m128 Register;
+        static const int Width = 4;
+
+        static __forceinline Register load(const float *p) { return _mm_load_ps(p); }
+        static __forceinline Register set(float s) { return _mm_set1_ps(s); }
+        static __forceinline Register zero() { return _mm_setzero_ps(); }
+        static __forceinline Register add(Register a, Register b) { return _mm_add_ps(a, b); }
+        static __forceinline Register sub(Register a, Register b) { return _mm_sub_ps(a, b); }
+        static __forceinline Register mul(Register a, Register b) { return _mm_mul_ps(a, b); }
+        static __forceinline Register min_(Register a, Register b) { return _mm_min_ps(a, b); }
+        static __forceinline Register max_(Register a, Register b) { return _mm_max_ps(a, b); }
+        static __forceinline Register lt(Register a, Register b) { return _mm_cmplt_ps(a, b); }
+        static __forceinline Register le(Register a, Register b) { return _mm_cmple_ps(a, b); }
+        static __forceinline Register and_(Register a, Register b) { return _mm_and_ps(a, b); }
+        static __forceinline Register or_(Register a, Register b) { return _mm_or_ps(a, b); }
+        static __forceinline Register andNot(Register a, Register b) { return _mm_andnot_ps(a, b); }
+        static __forceinline int mask(Register a) { return _mm_movemask_ps(a); }
+        static __forceinline void store(float *p, Register a) { _mm_store_ps(p, a); }
+    };
+
+    typedef TriangleBlockSse TriangleBlockSimd;
+
+    // Watertight ray/triangle test (see Mesh::rayTriangleIntersection) evaluated for
+    // every lane of the block at once. Returns a mask of the lanes that were hit between
+    // minDepth and maxDepth. If hit is not null the closest of them is written to it.
+    template <typename Simd>
+    __forceinline int intersectTriangleBlock(
+        const TriangleBlock_t<Simd::Width> &block,
+        const TriangleBlockRay &ray,
+        float minDepth,
+        float maxDepth,
+        TriangleBlockHit *hit)
+    {
+        typedef typename Simd::Register Register;
+
+        const Register sx = Simd::set(ray.sx);
+        const Register sy = Simd::set(ray.sy);
+        const Register sz = Simd::set(ray.sz);
+        const Register ox = Simd::set(ray.origin[ray.kx]);
+        const Register oy = Simd::set(ray.origin[ray.ky]);
+        const Register oz = Simd::set(ray.origin[ray.kz]);
+
+        // Translate, permute and shear all three vertices
+        Register px[3], py[3], pz[3];
+        for (int i = 0; i < 3; i++) {
+            pz[i] = Simd::sub(Simd::load(block.v[i][ray.kz]), oz);
+            px[i] = Simd::add(Simd::sub(Simd::load(block.v[i][ray.kx]), ox), Simd::mul(sx, pz[i]));
+            py[i] = Simd::add(Simd::sub(Simd::load(block.v[i][ray.ky]), oy), Simd::mul(sy, pz[i]));
+        }
+
+        const Register e0 = Simd::sub(Simd::mul(px[1], py[2]), Simd::mul(py[1], px[2]));
+        const Register e1 = Simd::sub(Simd::mul(px[2], py[0]), Simd::mul(py[2], px[0]));
+        const Register e2 = Simd::sub(Simd::mul(px[0], py[1]), Simd::mul(py[0], px[1]));
+
+        const Register zero = Simd::zero();
+        const Register anyNegative = Simd::or_(Simd::or_(Simd::lt(e0, zero), Simd::lt(e1, zero)), Simd::lt(e2, zero));
+        const Register anyPositive = Simd::or_(Simd::or_(Simd::lt(zero, e0), Simd::lt(zero, e1)), Simd::lt(zero, e2));
+        const Register mixedSigns = Simd::and_(anyNegative, anyPositive);
+
+        const Register det = Simd::add(Simd::add(e0, e1), e2);
+        const Register tScaled = Simd::add(Simd::add(
+            Simd::mul(e0, Simd::mul(pz[0], sz)),
+            Simd::mul(e1, Simd::mul(pz[1], sz))),
+            Simd::mul(e2, Simd::mul(pz[2], sz)));
+
+        const Register minScaled = Simd::mul(Simd::set(minDepth), det);
+        const Register maxScaled = Simd::mul(Simd::set(maxDepth), det);
+        const Register negativeHit = Simd::and_(Simd::and_(
+            Simd::lt(det, zero), Simd::lt(tScaled, zero)),
+            Simd::and_(Simd::le(maxScaled, tScaled), Simd::le(tScaled, minScaled)));
+        const Register positiveHit = Simd::and_(Simd::and_(
+            Simd::lt(zero, det), Simd::lt(zero, tScaled)),
+            Simd::and_(Simd::le(tScaled, maxScaled), Simd::le(minScaled, tScaled)));
+
+        const Register valid = Simd::andNot(mixedSigns, Simd::or_(negativeHit, positiveHit));
+        // Degenerate padding lanes are not reliable to reject when mul/sub get fused
+        const int mask = Simd::mask(valid) & ((0x1 << block.faceCount) - 1);
+        if (mask == 0 || hit == nullptr) return mask;
+
+        // Resolve the closest lane
+        alignas(16) float lanes[4][Simd::Width];
+        Simd::store(lanes[0], e0);
+        Simd::store(lanes[1], e1);
+        Simd::store(lanes[2], e2);
+        Simd::store(lanes[3], tScaled);
+
+        alignas(16) float dets[Simd::Width];
+        Simd::store(dets, det);
+
+        int closest = -1;
+        float closestDepth = 0.0f, closestInvDet = 0.0f;
+        for (int i = 0; i < Simd::Width; i++) {
+            if ((mask & (0x1 << i)) == 0) continue;
+
+            const float invDet = 1 / dets[i];
+            const float depth = lanes[3][i] * invDet;
+            if (closest == -1 || depth < closestDepth) {
+                closest = i;
+                closestDepth = depth;
+                closestInvDet = invDet;
+            }
+        }
+
+        hit->depth = closestDepth;
+        hit->u = lanes[0][closest] * closestInvDet;
+        hit->v = lanes[1][closest] * closestInvDet;
+        hit->w = lanes[2][closest] * closestInvDet;
+        hit->face = block.faces[closest];
+
+        return mask;
+    }
+
+} /* namespace manta */
+
+#endif /* ENABLE_TRIANGLE_BLOCKS */
+
+#endif /* MANTARAY_TRIANGLE_BLOCK_H */
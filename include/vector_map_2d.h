@@ -4,6 +4,7 @@
 #include "manta_math.h"
 
 #include "margins.h"
+#include "memory_management.h"
 
 namespace manta {
 
@@ -12,12 +13,27 @@ namespace manta {
     class ImagePlane;
 
     class VectorMap2D {
+    public:
+        // Layout of a single texel. Every format is decoded to a linear math::Vector
+        // on lookup, the compact formats only trade precision for memory.
+        enum class Format {
+            Vector,         // Four floats, 16 bytes
+            Half,           // Four half floats, 8 bytes
+            Srgb8,          // Four 8-bit channels, rgb is sRGB encoded and alpha is linear
+            Linear8,        // Four 8-bit linear channels
+            HalfMono,       // Single half float channel, 2 bytes
+            Srgb8Mono,      // Single 8-bit sRGB encoded channel
+            Linear8Mono     // Single 8-bit linear channel
+        };
+
     public:
         VectorMap2D();
         ~VectorMap2D();
 
         void initialize(int width, int height, 
             const math::Vector &value = math::constants::Zero);
+        void initialize(int width, int height, Format format,
+            const math::Vector &value = math::constants::Zero);
         void destroy();
 
         math::Vector sample(math::real u, math::real v) const;
@@ -26,10 +42,23 @@ namespace manta {
         math::Vector getClip(int u, int v) const;
         void set(const math::Vector &value, int u, int v);
 
+        // Stores 8-bit channels without converting them, only valid for the 8-bit formats.
+        // Single channel formats only keep r.
+        void setBytes(unsigned char r, unsigned char g, unsigned char b, unsigned char a, int u, int v);
+
+        // Encoded texels of a row, rows are tightly packed
+        unsigned char *getRawRow(int v) { return m_data + (mem_size)v * m_width * getTexelSize(m_format); }
+        const unsigned char *getRawRow(int v) const { return m_data + (mem_size)v * m_width * getTexelSize(m_format); }
+
         void fillByteBuffer(ImageByteBuffer *target, bool correctGamma) const;
 
         int getWidth() const { return m_width; }
         int getHeight() const { return m_height; }
+        Format getFormat() const { return m_format; }
+        mem_size getMemoryUsage() const { return (mem_size)m_width * m_height * getTexelSize(m_format); }
+
+        static int getTexelSize(Format format);
+        static int getChannelCount(Format format);
 
         void scale(const math::Vector &s);
         void applyGamma(math::real gamma);
@@ -41,11 +70,16 @@ namespace manta {
         int getSafeHeight() const;
 
         void roll(VectorMap2D *target) const;
+        void boxDownsample(VectorMap2D *target) const;
         void copy(const VectorMap2D *source);
         void copy(const ImagePlane *plane);
 
     protected:
-        math::Vector *m_data;
+        math::Vector decode(const unsigned char *texel) const;
+        void encode(const math::Vector &value, unsigned char *texel) const;
+
+        unsigned char *m_data;
+        Format m_format;
 
         int m_width;
         int m_height;
@@ -6,9 +6,12 @@
 #include "manta_math.h"
 #include "vector_map_2d.h"
 #include "intersection_point.h"
+#include "mipmap.h"
 
 namespace manta {
 
+    class TiledTexture;
+
     class VectorMap2DNodeOutput : public VectorNodeOutput {
     public:
         static const piranha::ChannelType VectorMap2dType;
@@ -24,11 +27,21 @@ namespace manta {
         const VectorMap2D *getMap() const { return m_map; }
         void setMap(const VectorMap2D *map);
 
+        // Used instead of the map when the surface has a texture footprint
+        const VectorMipmap *getMipmap() const { return m_mipmap; }
+        void setMipmap(const VectorMipmap *mipmap) { m_mipmap = mipmap; }
+
+        // Used instead of the map and the mipmap when the texture stays on disk
+        const TiledTexture *getTiledTexture() const { return m_tiledTexture; }
+        void setTiledTexture(const TiledTexture *texture) { m_tiledTexture = texture; }
+
     protected:
         virtual void _evaluateDimensions();
 
     protected:
         const VectorMap2D *m_map;
+        const VectorMipmap *m_mipmap;
+        const TiledTexture *m_tiledTexture;
     };
 
 } /* namespace manta */
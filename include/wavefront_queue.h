@@ -0,0 +1,93 @@
+#ifndef MANTARAY_WAVEFRONT_QUEUE_H
+#define MANTARAY_WAVEFRONT_QUEUE_H
+
+#include "manta_math.h"
+#include "light_ray.h"
+#include "intersection_point.h"
+#include "direct_lighting_sample.h"
+#include "bxdf.h"
+
+namespace manta {
+
+    class Sampler;
+    class SceneObject;
+    class Material;
+
+    // State of a single path traced by the wavefront integrator
+    struct PathState {
+        LightRay ray;
+        IntersectionPoint point;
+        DirectLightingSample directLighting;
+        ScatteringSample scattering;
+
+        math::Vector beta;
+        math::Vector L;
+
+        // Throughput of the vertex that sampled direct lighting
+        math::Vector directBeta;
+
+        Sampler *sampler;
+        SceneObject *sceneObject;
+        Material *material;
+
+        RayFlags flags;
+        int bounces;
+        int maxBounces;
+        int occludedMask;
+    };
+
+    // List of path indices waiting for the same stage
+    struct PathQueue {
+        int *indices;
+        int count;
+
+        void clear() { count = 0; }
+        void push(int path) { indices[count++] = path; }
+    };
+
+    // Per-worker storage of the wavefront integrator. Stages only move path indices
+    // between queues so that the path states stay in place.
+    class WavefrontQueue {
+    public:
+        WavefrontQueue();
+        ~WavefrontQueue();
+
+        void initialize(int capacity);
+        void destroy();
+
+        // Removes all paths
+        void clear();
+
+        // Copies the camera ray into a new path and returns its index, the rest of the
+        // path state is set up by the integrator
+        int addPath(const LightRay &ray, Sampler *sampler);
+
+        PathState *getPath(int index) { return &m_paths[index]; }
+        const PathState *getPath(int index) const { return &m_paths[index]; }
+
+        int getPathCount() const { return m_pathCount; }
+        int getCapacity() const { return m_capacity; }
+        bool isFull() const { return m_pathCount >= m_capacity; }
+
+        PathQueue *getExtendQueue() { return &m_extendQueue; }
+        PathQueue *getShadeQueue() { return &m_shadeQueue; }
+        PathQueue *getShadowQueue() { return &m_shadowQueue; }
+
+    protected:
+        PathState *m_paths;
+        int m_pathCount;
+        int m_capacity;
+
+        // Paths whose current ray has to be intersected with the scene
+        PathQueue m_extendQueue;
+
+        // Paths that hit a surface and have to be shaded
+        PathQueue m_shadeQueue;
+
+        // Paths with direct lighting that is waiting for its shadow rays
+        PathQueue m_shadowQueue;
+    };
+
+} /* namespace manta */
+
+#endif /* MANTARAY_WAVEFRONT_QUEUE_H */
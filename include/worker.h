@@ -7,8 +7,10 @@
 #include "runtime_statistics.h"
 #include "intersection_point_manager.h"
 #include "stratified_sampler.h"
+#include "pixel_error_estimate.h"
+#include "ray_packet.h"
+#include "wavefront_queue.h"
 
-#include <thread>
 #include <atomic>
 
 #if ENABLE_PATH_RECORDING
@@ -26,11 +28,23 @@
 namespace manta {
 
     struct Job;
+    struct ImagePlaneTile;
+    struct ImageSample;
     class CameraRayEmitterGroup;
     class Scene;
     class RayTracer;
+    class TaskGroup;
 
     class Worker {
+    public:
+        static const int SampleBufferCapacity = 0x1 << 7;
+
+        // Pixels traced together by the wavefront integrator
+        static const int WavefrontWidth = 64;
+        static const int MaxBatchWidth = (WavefrontWidth > RayPacket::Width)
+            ? WavefrontWidth
+            : RayPacket::Width;
+
     public:
         Worker();
         ~Worker();
@@ -38,11 +52,14 @@ namespace manta {
         void initialize(mem_size stackSize, RayTracer *rayTracer, int workerId, 
             bool deterministicSeed, const std::string &pathRecorderOutputDirectory,
             unsigned int seed);
-        void start(bool multithreaded = true);
-        void join();
+        // Queues the worker on the thread pool, or runs it on the calling thread if no
+        // task group is given
+        void start(TaskGroup *tasks = nullptr);
         void destroy();
 
         mem_size getMaxMemoryUsage() const { return m_maxMemoryUsage; }
+        mem_size getReservedMemory() const { return m_reservedMemory; }
+        int getMemoryChunkCount() const { return m_memoryChunkCount; }
         std::string getTreeName(int pixelIndex, int sample) const;
 
         const RuntimeStatistics *getStatistics() const { return &m_statistics; }
@@ -50,13 +67,29 @@ namespace manta {
     protected:
         void work();
         void doJob(const Job *job);
+        void tracePixel(const Job *job, ImagePlaneTile *tile, int x, int y);
+        void tracePixelBatch(const Job *job, ImagePlaneTile *tile, int startX, int y, int pixelCount);
+        void traceBatch(const Job *job, LightRay *const *rays, Sampler *const *samplers, int rayCount, math::Vector *L);
+        int getBatchWidth() const;
+        void seedPixel(Sampler *sampler, int pixelIndex);
+        bool startNextSample(Sampler *sampler, const PixelErrorEstimate &estimate);
+        void addSample(const Job *job, ImagePlaneTile *tile, const math::Vector2 &location, const math::Vector &intensity);
+        void flushSamples(const Job *job, ImagePlaneTile *tile, ImageSample *samples, int sampleCount);
 
         StackAllocator *m_stack;
         RayTracer *m_rayTracer;
 
         Sampler *m_sampler;
 
-        std::thread *m_thread;
+        // One sampler per batch lane, each pixel of a batch has its own sampler session
+        Sampler *m_laneSamplers[MaxBatchWidth];
+
+        // Path storage of the wavefront integrator
+        WavefrontQueue m_wavefront;
+
+        // Samples waiting to be written to the image plane
+        ImageSample *m_samples;
+        int m_sampleCount;
 
         IntersectionPointManager m_ipManager;
 
@@ -77,6 +110,8 @@ namespace manta {
     protected:
         // Statistics
         mem_size m_maxMemoryUsage;
+        mem_size m_reservedMemory;
+        int m_memoryChunkCount;
     };
 
 } /* namespace manta */
@@ -0,0 +1,89 @@
+#include "../include/alias_table.h"
+
+#include <algorithm>
+#include <cmath>
+
+manta::AliasTable::AliasTable() {
+    /* void */
+}
+
+manta::AliasTable::~AliasTable() {
+    /* void */
+}
+
+void manta::AliasTable::build(const math::real *weights, int count) {
+    m_bins.resize(count);
+    if (count == 0) return;
+
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += std::max(weights[i], (math::real)0.0);
+    }
+
+    for (int i = 0; i < count; i++) {
+        m_bins[i].pmf = (sum > 0)
+            ? (math::real)(std::max(weights[i], (math::real)0.0) / sum)
+            : (math::real)1.0 / count;
+        m_bins[i].alias = -1;
+    }
+
+    // Probabilities scaled so that a full bin has a value of one
+    std::vector<int> under, over;
+    std::vector<double> p(count);
+    for (int i = 0; i < count; i++) {
+        p[i] = (double)m_bins[i].pmf * count;
+        if (p[i] < 1) under.push_back(i);
+        else over.push_back(i);
+    }
+
+    while (!under.empty() && !over.empty()) {
+        const int small = under.back(); under.pop_back();
+        const int large = over.back(); over.pop_back();
+
+        m_bins[small].q = (math::real)p[small];
+        m_bins[small].alias = large;
+
+        // The excess of the large bin fills the rest of the small one
+        p[large] = (p[large] + p[small]) - 1;
+        if (p[large] < 1) under.push_back(large);
+        else over.push_back(large);
+    }
+
+    // Anything left is full up to rounding error
+    for (int i : under) m_bins[i].q = 1;
+    for (int i : over) m_bins[i].q = 1;
+}
+
+void manta::AliasTable::destroy() {
+    m_bins.clear();
+}
+
+int manta::AliasTable::sample(math::real u, math::real *pmf, math::real *uRemapped) const {
+    const int count = (int)m_bins.size();
+    if (count == 0) {
+        *pmf = 0;
+        return -1;
+    }
+
+    // The integer part of u picks the bin and the fraction decides between the bin's
+    // own index and its alias
+    const math::real scaled = u * count;
+    const int bin = std::min((int)scaled, count - 1);
+    const math::real up = std::min(scaled - bin, (math::real)1.0);
+
+    const bool own = up < m_bins[bin].q || m_bins[bin].alias < 0;
+    const int index = own
+        ? bin
+        : m_bins[bin].alias;
+    *pmf = m_bins[index].pmf;
+
+    if (uRemapped != nullptr) {
+        const math::real q = m_bins[bin].q;
+        const math::real remapped = own
+            ? ((q > 0) ? up / q : (math::real)0.0)
+            : (up - q) / (1 - q);
+        *uRemapped = std::min(remapped, std::nextafter((math::real)1.0, (math::real)0.0));
+    }
+
+    return index;
+}
@@ -1,5 +1,8 @@
 #include "../include/area_light.h"
 
+#include "../include/primitives.h"
+#include "../include/light_bvh.h"
+
 manta::AreaLight::AreaLight() {
     m_up = math::constants::YAxis;
     m_direction = math::constants::XAxis;
@@ -90,6 +93,39 @@ bool manta::AreaLight::intersect(const math::Vector &src, const math::Vector &di
     }
 }
 
+bool manta::AreaLight::getBounds(AABB *bounds) const {
+    const math::Vector right = math::normalize(math::cross(m_direction, m_up));
+    const math::Vector extents = math::add(
+        math::mul(math::abs(right), math::loadScalar(m_width / 2)),
+        math::mul(math::abs(m_up), math::loadScalar(m_height / 2)));
+
+    bounds->minPoint = math::sub(m_origin, extents);
+    bounds->maxPoint = math::add(m_origin, extents);
+
+    return true;
+}
+
+manta::math::real manta::AreaLight::getPower() const {
+    const math::real intensity = (
+        math::getX(m_intensity) +
+        math::getY(m_intensity) +
+        math::getZ(m_intensity)) / 3;
+
+    // Constant radiance leaving both sides
+    return intensity * getArea() * math::constants::PI * 2;
+}
+
+bool manta::AreaLight::getLightBounds(LightBounds *bounds) const {
+    getBounds(&bounds->bounds);
+    bounds->phi = getPower();
+    bounds->w = math::normalize(m_direction);
+    bounds->cosTheta_o = (math::real)1.0;
+    bounds->cosTheta_e = (math::real)0.0;
+    bounds->twoSided = true;
+
+    return true;
+}
+
 manta::math::real manta::AreaLight::getArea() const {
     return m_width * m_height;
 }
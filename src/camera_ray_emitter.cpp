@@ -1,6 +1,10 @@
 #include "../include/camera_ray_emitter.h"
 
 #include "../include/light_ray.h"
+#include "../include/sampler.h"
+
+#include <algorithm>
+#include <cmath>
 
 manta::CameraRayEmitter::CameraRayEmitter() {
     m_sampler = nullptr;
@@ -34,3 +38,12 @@ manta::math::Vector manta::CameraRayEmitter::transformToImagePlane(const math::V
 
     return imagePlaneT;
 }
+
+manta::math::real manta::CameraRayEmitter::getDifferentialScale() const {
+    const int samples = (m_sampler != nullptr)
+        ? m_sampler->getSamplesPerPixel()
+        : m_sampleCount;
+
+    if (samples <= 1) return (math::real)1.0;
+    else return std::max((math::real)0.125, (math::real)1.0 / std::sqrt((math::real)samples));
+}
@@ -6,8 +6,8 @@
 #include "../include/scalar_map_2d.h"
 #include "../include/image_plane.h"
 #include "../include/vector_map_2d.h"
+#include "../include/thread_pool.h"
 
-#include <thread>
 #include <assert.h>
 
 manta::ComplexMap2D::ComplexMap2D() {
@@ -26,7 +26,7 @@ void manta::ComplexMap2D::initialize(int width, int height, math::real value) {
     m_width = width;
     m_height = height;
 
-    m_data = StandardAllocator::Global()->allocate<math::Complex>(m_width * m_height, 16);
+    m_data = StandardAllocator::Global()->allocate<math::Complex>(m_width * m_height, 16, MemoryTag::FFT);
 
     for (int i = 0; i < m_width * m_height; i++) {
         m_data[i] = { (math::real)0.0, (math::real)0.0 };
@@ -34,7 +34,7 @@ void manta::ComplexMap2D::initialize(int width, int height, math::real value) {
 }
 
 void manta::ComplexMap2D::destroy() {
-    StandardAllocator::Global()->aligned_free(m_data, m_width * m_height);
+    StandardAllocator::Global()->aligned_free(m_data, m_width * m_height, MemoryTag::FFT);
 
     m_data = nullptr;
     m_width = 0;
@@ -134,206 +134,69 @@ void manta::ComplexMap2D::normalize(ComplexMap2D *target) const {
 void manta::ComplexMap2D::fft(ComplexMap2D *target) const {
     target->initialize(m_width, m_height);
 
-    const int width = m_width;
-    const int height = m_height;
-    const int minSpace = (width > height) ? width : height;
-
-    math::Complex *inputBuffer = StandardAllocator::Global()->allocate<math::Complex>(minSpace);
-    math::Complex *outputBuffer = StandardAllocator::Global()->allocate<math::Complex>(minSpace);
-
-    // Transform the rows
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            math::Complex val = get(i, j);
-            inputBuffer[i] = val;
-        }
-
-        NaiveFFT::fft(inputBuffer, outputBuffer, width);
-        for (int i = 0; i < width; i++) {
-            math::Complex result;
-            result = outputBuffer[i];
-
-            target->set(result, i, j);
-        }
-    }
-
-    // Transform the columns
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            math::Complex val = target->get(i, j);
-            inputBuffer[j] = val;
-        }
-
-        NaiveFFT::fft(inputBuffer, outputBuffer, height);
-        for (int j = 0; j < height; j++) {
-            math::Complex result;
-            result = outputBuffer[j];
-
-            target->set(result, i, j);
-        }
-    }
-
-    StandardAllocator::Global()->free(inputBuffer, minSpace);
-    StandardAllocator::Global()->free(outputBuffer, minSpace);
+    fftHorizontal(target, false, 0, m_height);
+    fftVertical(target, false, 0, m_width);
 }
 
-void manta::ComplexMap2D::fft_multithreaded(ComplexMap2D *target, int threadCount, bool inverse) const {
+void manta::ComplexMap2D::fft_multithreaded(ComplexMap2D *target, bool inverse) const {
     target->initialize(m_width, m_height);
 
-    int divVertical = m_height / threadCount;
-    int divHorizontal = m_width / threadCount;
-
-    if (divVertical == 0) divVertical = m_height;
-    if (divHorizontal == 0) divHorizontal = m_width;
-
-    std::thread **threads = StandardAllocator::Global()->allocate<std::thread *>(threadCount);
-
-    // Horizontal FFTs
-    for (int i = 0; i < threadCount; i++) {
-        const int start = i * divVertical;
-        int end = (i + 1) * divVertical;
-
-        if (end >= m_height || i == (threadCount - 1)) {
-            end = m_height;
-        }
-
-        if (start < end) {
-            threads[i] = new std::thread(&ComplexMap2D::fftHorizontal, this, target, inverse, start, end);
-        }
-        else {
-            threads[i] = nullptr;
-        }
-    }
-
-    // Wait for all threads to complete
-    for (int i = 0; i < threadCount; i++) {
-        if (threads[i] != nullptr) {
-            threads[i]->join();
-            delete threads[i];
-        }
-    }
-
-    // Vertical FFTs
-    for (int i = 0; i < threadCount; i++) {
-        const int start = i * divHorizontal;
-        int end = (i + 1) * divHorizontal;
-
-        if (end >= m_width || i == (threadCount - 1)) {
-            end = m_width;
-        }
-
-        if (start < end) {
-            threads[i] = new std::thread(&ComplexMap2D::fftVertical, this, target, inverse, start, end);
-        }
-        else {
-            threads[i] = nullptr;
-        }
-    }
-
-    // Wait for all threads to complete
-    for (int i = 0; i < threadCount; i++) {
-        if (threads[i] != nullptr) {
-            threads[i]->join();
-            delete threads[i];
-        }
-    }
+    // Rows have to be complete before the columns can be transformed
+    ThreadPool::Global()->parallelFor(0, m_height, 16, [=](int start, int end) {
+        fftHorizontal(target, inverse, start, end);
+    });
 
-    // Free temporary memory
-    StandardAllocator::Global()->free(threads, threadCount);
+    ThreadPool::Global()->parallelFor(0, m_width, 16, [=](int start, int end) {
+        fftVertical(target, inverse, start, end);
+    });
 }
 
 void manta::ComplexMap2D::fftHorizontal(ComplexMap2D *target, bool inverse, int startRow, int endRow) const {
-    math::Complex *inputBuffer = new math::Complex[m_width];
-    math::Complex *outputBuffer = new math::Complex[m_width];
+    const FFTPlan *plan = FFTPlan::get(m_width);
 
     for (int j = startRow; j < endRow; j++) {
-        for (int i = 0; i < m_width; i++) {
-            math::Complex val = get(i, j);
-            inputBuffer[i] = val;
-        }
-
-        if (!inverse) NaiveFFT::fft(inputBuffer, outputBuffer, m_width);
-        else NaiveFFT::fft_inverse(inputBuffer, outputBuffer, m_width);
-        for (int i = 0; i < m_width; i++) {
-            math::Complex result;
-            result = outputBuffer[i];
-
-            target->set(result, i, j);
-        }
+        plan->transform(m_data + j * m_width, target->m_data + j * m_width, inverse);
     }
-
-    delete[] inputBuffer;
-    delete[] outputBuffer;
 }
 
 void manta::ComplexMap2D::fftVertical(ComplexMap2D *target, bool inverse, int startColumn, int endColumn) const {
-    math::Complex *inputBuffer = new math::Complex[m_height];
-    math::Complex *outputBuffer = new math::Complex[m_height];
+    const FFTPlan *plan = FFTPlan::get(m_height);
+
+    // Columns are gathered in blocks so that every row access touches whole cache lines
+    const int blockSize = ColumnBlockSize;
+    math::Complex *buffer = StandardAllocator::Global()->allocate<math::Complex>(blockSize * m_height, 16, MemoryTag::FFT);
+
+    for (int i = startColumn; i < endColumn; i += blockSize) {
+        const int columns = (endColumn - i < blockSize) ? endColumn - i : blockSize;
 
-    for (int i = startColumn; i < endColumn; i++) {
         for (int j = 0; j < m_height; j++) {
-            math::Complex val = target->get(i, j);
-            inputBuffer[j] = val;
+            const math::Complex *row = target->m_data + j * m_width + i;
+            const int reversed = plan->getReversedIndex(j);
+            for (int c = 0; c < columns; c++) {
+                buffer[c * m_height + reversed] = row[c];
+            }
         }
 
-        if (!inverse) NaiveFFT::fft(inputBuffer, outputBuffer, m_height);
-        else NaiveFFT::fft_inverse(inputBuffer, outputBuffer, m_height);
-        for (int j = 0; j < m_height; j++) {
-            math::Complex result;
-            result = outputBuffer[j];
+        for (int c = 0; c < columns; c++) {
+            plan->execute(buffer + c * m_height, inverse);
+        }
 
-            target->set(result, i, j);
+        for (int j = 0; j < m_height; j++) {
+            math::Complex *row = target->m_data + j * m_width + i;
+            for (int c = 0; c < columns; c++) {
+                row[c] = buffer[c * m_height + j];
+            }
         }
     }
 
-    delete[] inputBuffer;
-    delete[] outputBuffer;
+    StandardAllocator::Global()->aligned_free(buffer, blockSize * m_height, MemoryTag::FFT);
 }
 
 void manta::ComplexMap2D::inverseFft(ComplexMap2D *target) const {
     target->initialize(m_width, m_height);
 
-    int width = m_width;
-    int height = m_height;
-    int minSpace = (width > height) ? width : height;
-
-    math::Complex *inputBuffer = StandardAllocator::Global()->allocate<math::Complex>(minSpace);
-    math::Complex *outputBuffer = StandardAllocator::Global()->allocate<math::Complex>(minSpace);
-
-    // Transform the rows
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            math::Complex val = get(i, j);
-            inputBuffer[i] = val;
-        }
-
-        NaiveFFT::fft_inverse(inputBuffer, outputBuffer, width);
-        for (int i = 0; i < width; i++) {
-            math::Complex result;
-            result = outputBuffer[i];
-
-            target->set(result, i, j);
-        }
-    }
-
-    // Transform the columns
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            math::Complex val = target->get(i, j);
-            inputBuffer[j] = val;
-        }
-
-        NaiveFFT::fft_inverse(inputBuffer, outputBuffer, height);
-        for (int j = 0; j < height; j++) {
-            math::Complex result;
-            result = outputBuffer[j];
-
-            target->set(result, i, j);
-        }
-    }
-
-    StandardAllocator::Global()->free(inputBuffer, minSpace);
-    StandardAllocator::Global()->free(outputBuffer, minSpace);
+    fftHorizontal(target, true, 0, m_height);
+    fftVertical(target, true, 0, m_width);
 }
 
 void manta::ComplexMap2D::cft(ComplexMap2D *target, math::real_d physicalWidth, math::real_d physicalHeight) const {
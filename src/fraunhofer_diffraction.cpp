@@ -8,13 +8,12 @@
 #include "../include/color.h"
 #include "../include/cmf_table.h"
 #include "../include/mipmap.h"
+#include "../include/thread_pool.h"
 
 // Temp
 #include "../include/texture_node.h"
 #include "../include/intersection_point.h"
 
-#include <thread>
-
 manta::FraunhoferDiffraction::FraunhoferDiffraction() {
     m_colorTable = nullptr;
     m_sourceSpectrum = nullptr;
@@ -132,7 +131,7 @@ void manta::FraunhoferDiffraction::generate(
     apertureFunction.destroy();
 
     m_diffractionPattern.initialize(outputResolution, outputResolution);
-    generateMap(&estimator, &settings, 12, &m_diffractionPattern);
+    generateMap(&estimator, &settings, &m_diffractionPattern);
     estimator.destroy();
 
     normalize();
@@ -215,50 +214,13 @@ void manta::FraunhoferDiffraction::setDefaultSettings(Settings *settings) {
 void manta::FraunhoferDiffraction::generateMap(
     const CftEstimator2D *estimator,
     const Settings *settings,
-    int threadCount,
     VectorMap2D *target) const
 {
     const int size = target->getHeight();
 
-    int div = size / threadCount;
-    if (div == 0) div = size;
-
-    std::thread **threads = StandardAllocator::Global()->allocate<std::thread *>(threadCount);
-
-    // Distribute to threads
-    for (int i = 0; i < threadCount; i++) {
-        const int start = i * div;
-        int end = (i + 1) * div;
-
-        if (end >= size || i == (threadCount - 1)) {
-            end = size;
-        }
-
-        if (start < end) {
-            threads[i] = new std::thread(
-                &FraunhoferDiffraction::_generateMap,
-                this,
-                estimator,
-                settings,
-                start,
-                end,
-                target);
-        }
-        else {
-            threads[i] = nullptr;
-        }
-    }
-
-    // Wait for all threads to complete
-    for (int i = 0; i < threadCount; i++) {
-        if (threads[i] != nullptr) {
-            threads[i]->join();
-            delete threads[i];
-        }
-    }
-
-    // Free temporary memory
-    StandardAllocator::Global()->free(threads, threadCount);
+    ThreadPool::Global()->parallelFor(0, size, 1, [=](int start, int end) {
+        _generateMap(estimator, settings, start, end, target);
+    });
 }
 
 void manta::FraunhoferDiffraction::_generateMap(
@@ -289,6 +251,9 @@ void manta::FraunhoferDiffraction::_generateMap(
     for (int i = startRow; i < endRow; i++) {
         const math::real_d x = i * sdx - scx;
 
+        // Every row has its own stream so the map doesn't depend on how rows are split
+        math::seedRandom((unsigned int)i);
+
         for (int j = 0; j < res; j++) {
             const math::real_d y = j * sdy - scy;
             spectrum.clear();
@@ -0,0 +1,261 @@
+#include "../include/geometry_instance.h"
+
+#include "../include/light_ray.h"
+#include "../include/intersection_point.h"
+#include "../include/coarse_intersection.h"
+#include "../include/primitives.h"
+#include "../include/vector_node_output.h"
+
+namespace manta {
+
+    // Distance of the offset points from the surface, the same that meshes use
+    constexpr math::real InstanceSurfaceOffset = (math::real)1E-4;
+
+} /* namespace manta */
+
+manta::GeometryInstance::GeometryInstance() {
+    m_geometry = nullptr;
+
+    m_geometryInput = nullptr;
+    m_scaleInput = nullptr;
+    m_rotationAxisInput = nullptr;
+    m_rotationInput = nullptr;
+
+    setTransform(math::loadIdentity());
+}
+
+manta::GeometryInstance::~GeometryInstance() {
+    /* void */
+}
+
+void manta::GeometryInstance::setTransform(const math::Matrix &transform) {
+    m_transform = transform;
+
+    // Invert the linear part using the cofactors of its rows
+    const math::Vector r0 = math::mask(transform.rows[0], math::constants::MaskOffW);
+    const math::Vector r1 = math::mask(transform.rows[1], math::constants::MaskOffW);
+    const math::Vector r2 = math::mask(transform.rows[2], math::constants::MaskOffW);
+
+    const math::Vector c0 = math::cross(r1, r2);
+    const math::Vector c1 = math::cross(r2, r0);
+    const math::Vector c2 = math::cross(r0, r1);
+
+    const math::Vector inv_det = math::div(math::constants::One, math::dot(r0, c0));
+
+    m_normalTransform = math::loadMatrix(
+        math::mul(c0, inv_det),
+        math::mul(c1, inv_det),
+        math::mul(c2, inv_det),
+        math::constants::IdentityRow4);
+
+    const math::Matrix linearInverse = math::transpose(m_normalTransform);
+    const math::Vector translation = math::getTranslationPart(transform);
+
+    m_inverseTransform = math::matMult(
+        linearInverse, math::translationTransform(math::negate3(translation)));
+}
+
+manta::math::Vector manta::GeometryInstance::objectToWorldPoint(const math::Vector &p) const {
+    return math::mask(
+        math::matMult(m_transform, math::extendVector(p)), math::constants::MaskOffW);
+}
+
+manta::math::Vector manta::GeometryInstance::objectToWorldDirection(const math::Vector &d) const {
+    return math::matMult(m_transform, math::mask(d, math::constants::MaskOffW));
+}
+
+manta::math::Vector manta::GeometryInstance::objectToWorldNormal(const math::Vector &n) const {
+    return math::matMult(m_normalTransform, math::mask(n, math::constants::MaskOffW));
+}
+
+manta::math::Vector manta::GeometryInstance::worldToObjectPoint(const math::Vector &p) const {
+    return math::mask(
+        math::matMult(m_inverseTransform, math::extendVector(p)), math::constants::MaskOffW);
+}
+
+manta::math::Vector manta::GeometryInstance::worldToObjectDirection(const math::Vector &d) const {
+    return math::matMult(m_inverseTransform, math::mask(d, math::constants::MaskOffW));
+}
+
+manta::math::Vector manta::GeometryInstance::worldToObjectNormal(const math::Vector &n) const {
+    // The transpose of the normal transform is the forward linear part
+    return math::matMult(
+        math::transpose(m_normalTransform), math::mask(n, math::constants::MaskOffW));
+}
+
+bool manta::GeometryInstance::findClosestIntersection(LightRay *ray,
+        CoarseIntersection *intersection, math::real minDepth,
+        math::real maxDepth, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const
+{
+    const math::Vector d = worldToObjectDirection(ray->getDirection());
+    const math::real scale = math::getScalar(math::magnitude(d));
+
+    LightRay localRay;
+    localRay.setSource(worldToObjectPoint(ray->getSource()));
+    localRay.setDirection(math::div(d, math::loadScalar(scale)));
+    localRay.resetCache();
+    localRay.calculateTransformations();
+
+    if (!m_geometry->fastIntersection(&localRay)) return false;
+
+    // Distances along the object space ray are scaled by the length of the transformed direction
+    const bool found = m_geometry->findClosestIntersection(
+        &localRay, intersection, minDepth * scale, maxDepth * scale, s /**/ STATISTICS_PARAM_INPUT);
+
+    if (found) {
+        intersection->depth /= scale;
+        intersection->instancedGeometry = intersection->sceneGeometry;
+        intersection->sceneGeometry = this;
+    }
+
+    return found;
+}
+
+bool manta::GeometryInstance::occluded(const math::Vector &p0, const math::Vector &d,
+    math::real maxDepth /**/ STATISTICS_PROTOTYPE) const
+{
+    const math::Vector d_obj = worldToObjectDirection(d);
+    const math::real scale = math::getScalar(math::magnitude(d_obj));
+
+    return m_geometry->occluded(
+        worldToObjectPoint(p0),
+        math::div(d_obj, math::loadScalar(scale)),
+        maxDepth * scale /**/ STATISTICS_PARAM_INPUT);
+}
+
+void manta::GeometryInstance::fineIntersection(const math::Vector &r, IntersectionPoint *p,
+    const CoarseIntersection *hint) const
+{
+    CoarseIntersection localHint = *hint;
+    localHint.sceneGeometry = hint->instancedGeometry;
+
+    p->m_instance = nullptr;
+    p->m_mesh = nullptr;
+    m_geometry->fineIntersection(worldToObjectPoint(r), p, &localHint);
+
+    p->m_position = objectToWorldPoint(p->m_position);
+    p->m_faceNormal = math::normalize(objectToWorldNormal(p->m_faceNormal));
+    p->m_vertexNormal = math::normalize(objectToWorldNormal(p->m_vertexNormal));
+
+    // Offset points are generated from the world space surface since not every geometry
+    // writes them, and so that their distance from the surface doesn't depend on the
+    // scale of the instance. Which one the ray arrived from is resolved by the caller
+    // from the ray direction, as for any other geometry.
+    const math::Vector offset = math::mul(p->m_faceNormal, math::loadScalar(InstanceSurfaceOffset));
+    p->m_inside = math::sub(p->m_position, offset);
+    p->m_outside = math::add(p->m_position, offset);
+
+    p->m_depth = hint->depth;
+    p->m_instance = this;
+
+    // An explicit default material overrides the materials of the shared geometry
+    if (m_defaultMaterialIndex != -1) {
+        p->m_material = m_defaultMaterialIndex;
+    }
+
+    // Only meshes provide partial derivatives
+    if (p->m_mesh != nullptr) {
+        transformPartialDerivatives(p);
+    }
+}
+
+void manta::GeometryInstance::transformPartialDerivatives(IntersectionPoint *p) const {
+    const math::Vector u_basis = objectToWorldDirection(p->u_basis);
+    const math::Vector v_basis = objectToWorldDirection(p->v_basis);
+    const math::real lengthU = math::getScalar(math::magnitude(u_basis));
+    const math::real lengthV = math::getScalar(math::magnitude(v_basis));
+
+    p->p0 = objectToWorldPoint(p->p0);
+    p->n0 = objectToWorldNormal(p->n0);
+
+    if (lengthU > (math::real)0.0) {
+        const math::Vector inv_u = math::loadScalar((math::real)1.0 / lengthU);
+
+        p->u_basis = math::mul(u_basis, inv_u);
+        p->u *= lengthU;
+        p->dtdu = math::mul(p->dtdu, inv_u);
+        p->dndu = math::mul(objectToWorldNormal(p->dndu), inv_u);
+    }
+
+    if (lengthV > (math::real)0.0) {
+        const math::Vector inv_v = math::loadScalar((math::real)1.0 / lengthV);
+
+        p->v_basis = math::mul(v_basis, inv_v);
+        p->v *= lengthV;
+        p->dtdv = math::mul(p->dtdv, inv_v);
+        p->dndv = math::mul(objectToWorldNormal(p->dndv), inv_v);
+    }
+}
+
+bool manta::GeometryInstance::fastIntersection(LightRay *ray) const {
+    return true;
+}
+
+bool manta::GeometryInstance::getBounds(AABB *bounds) const {
+    AABB localBounds;
+    if (m_geometry == nullptr || !m_geometry->getBounds(&localBounds)) return false;
+
+    const math::Vector corners[2] = { localBounds.minPoint, localBounds.maxPoint };
+
+    for (int i = 0; i < 8; ++i) {
+        const math::Vector corner = objectToWorldPoint(math::loadVector(
+            math::getX(corners[i & 0x1]),
+            math::getY(corners[(i >> 1) & 0x1]),
+            math::getZ(corners[(i >> 2) & 0x1])));
+
+        if (i == 0) {
+            bounds->minPoint = bounds->maxPoint = corner;
+        }
+        else {
+            bounds->minPoint = math::componentMin(bounds->minPoint, corner);
+            bounds->maxPoint = math::componentMax(bounds->maxPoint, corner);
+        }
+    }
+
+    return true;
+}
+
+void manta::GeometryInstance::_evaluate() {
+    SceneGeometry::_evaluate();
+
+    SceneGeometry *geometry = getObject<SceneGeometry>(m_geometryInput);
+
+    math::Vector scale, rotationAxis;
+    static_cast<VectorNodeOutput *>(m_scaleInput)->sample(nullptr, (void *)&scale);
+    static_cast<VectorNodeOutput *>(m_rotationAxisInput)->sample(nullptr, (void *)&rotationAxis);
+
+    piranha::native_float rotation;
+    m_rotationInput->fullCompute((void *)&rotation);
+
+    math::Matrix transform = math::matMult(
+        math::translationTransform(m_position),
+        math::matMult(
+            math::rotationTransform(rotationAxis, (float)rotation),
+            math::scaleTransform(scale)));
+
+    // Instances of instances are flattened so that only a single transform is applied
+    // during traversal
+    const GeometryInstance *instance = dynamic_cast<const GeometryInstance *>(geometry);
+    if (instance != nullptr) {
+        transform = math::matMult(transform, instance->getTransform());
+        m_geometry = instance->getGeometry();
+
+        if (m_defaultMaterialIndex == -1) {
+            m_defaultMaterialIndex = instance->m_defaultMaterialIndex;
+        }
+    }
+    else {
+        m_geometry = geometry;
+    }
+
+    setTransform(transform);
+}
+
+void manta::GeometryInstance::registerInputs() {
+    SceneGeometry::registerInputs();
+
+    registerInput(&m_geometryInput, "geometry");
+    registerInput(&m_scaleInput, "scale");
+    registerInput(&m_rotationAxisInput, "rotation_axis");
+    registerInput(&m_rotationInput, "rotation");
+}
@@ -1,19 +1,29 @@
 #include "../include/image_file_node.h"
 
-#include "../include/rgb_space.h"
-#include "../include/standard_allocator.h"
 #include "../include/vector_map_2d.h"
+#include "../include/memory_mapped_file.h"
+#include "../include/thread_pool.h"
+#include "../include/session.h"
+#include "../include/texture_cache.h"
+#include "../include/console.h"
 #include "../include/path.h"
 
 #include <SDL_image.h>
+#include <turbojpeg.h>
 #include <assert.h>
+#include <atomic>
 
 manta::ImageFileNode::ImageFileNode() {
     m_filename = "";
     m_correctGamma = true;
+    m_tiled = false;
+
+    m_imageMap = nullptr;
+    m_mipmap = nullptr;
 
     m_correctGammaInput = nullptr;
     m_filenameInput = nullptr;
+    m_tiledInput = nullptr;
 }
 
 manta::ImageFileNode::~ImageFileNode() {
@@ -29,6 +39,10 @@ void manta::ImageFileNode::_evaluate() {
         m_correctGammaInput->fullCompute((void *)&m_correctGamma);
     }
 
+    if (m_tiledInput != nullptr) {
+        m_tiledInput->fullCompute((void *)&m_tiled);
+    }
+
     if (m_filenameInput != nullptr) {
         std::string rawFilename;
         static_cast<piranha::NodeOutput *>(m_filenameInput)->fullCompute((void *)&rawFilename);
@@ -40,66 +54,98 @@ void manta::ImageFileNode::_evaluate() {
         m_filename = finalPath.toString();
     }
 
-    SDL_Surface *image;
-    image = IMG_Load(m_filename.c_str());
+    const Path sourcePath(m_filename);
+    const __int64 writeTime = sourcePath.getLastWriteTime();
+    const std::string cacheKey = m_filename + (m_correctGamma ? ":srgb" : ":linear");
+
+    // Tiled textures stay on disk, if the tiled copy can't be written the image is
+    // loaded as usual
+    if (m_tiled && openTiledTexture(sourcePath, writeTime)) {
+        m_imageMap = nullptr;
+        m_mipmap = nullptr;
 
-    if (image == nullptr) {
-        throwError("Image: " + m_filename + " could not be opened or was not found");
+        m_output.setTiledTexture(&m_tiledTexture);
         return;
     }
 
-    // Create a temporary pixel buffer
-    Pixel **pixelData = StandardAllocator::Global()->allocate<Pixel *>(image->h);
-    for (int i = 0; i < image->h; i++) {
-        pixelData[i] = StandardAllocator::Global()->allocate<Pixel>(image->w);;
-    }
+    // Scripts that are run again reuse images decoded by previous runs
+    Session::CachedImage image;
+    if (!Session::get().getCachedImage(cacheKey, writeTime, &image)) {
+        VectorMap2D *map = new VectorMap2D;
+        if (!decodeFile(m_filename, m_correctGamma, map)) {
+            delete map;
 
-    for (int j = 0; j < image->h; j++) {
-        for (int i = 0; i < image->w; i++) {
-            getPixel(image, i, j, &pixelData[j][i]);
+            throwError("Image: " + m_filename + " could not be opened or decoded");
+            return;
         }
+
+        // The mip chain is built once and shared by every lookup
+        VectorMipmap *mipmap = new VectorMipmap;
+        mipmap->initialize(map);
+
+        image.map = map;
+        image.mipmap = mipmap;
+        image.writeTime = writeTime;
+        Session::get().putCachedImage(cacheKey, image);
     }
 
-    m_imageMap.initialize(image->w, image->h);
+    m_imageMap = image.map;
+    m_mipmap = image.mipmap;
 
-    for (int j = 0; j < image->h; j++) {
-        for (int i = 0; i < image->w; i++) {
-            Pixel &pixel = pixelData[j][i];
+    m_output.setMap(m_imageMap);
+    m_output.setMipmap(m_mipmap);
+}
 
-            math::real r = pixel.r / (math::real)255.0;
-            math::real g = pixel.g / (math::real)255.0;
-            math::real b = pixel.b / (math::real)255.0;
+bool manta::ImageFileNode::openTiledTexture(const Path &sourcePath, __int64 writeTime) {
+    // The tiled copy lives next to the source file and is only converted once. Its name
+    // keeps the source extension and the gamma mode so that images that only differ in
+    // those don't overwrite each other's copies.
+    Path parentPath;
+    sourcePath.getParentPath(&parentPath);
+    const std::string tiledFile = parentPath.append(
+        sourcePath.getStem() + sourcePath.getExtension()
+        + (m_correctGamma ? ".srgb" : ".linear") + ".mrtex").toString();
 
-            if (m_correctGamma) {
-                // Default to SRGB
-                // TODO: make gamma correction generic
-                r = (math::real)RgbSpace::srgb.inverseGammaSrgb(r);
-                g = (math::real)RgbSpace::srgb.inverseGammaSrgb(g);
-                b = (math::real)RgbSpace::srgb.inverseGammaSrgb(b);
-            }
+    const unsigned __int64 sourceSize = sourcePath.getFileSize();
+    const unsigned int sourceFlags = m_correctGamma ? 1 : 0;
 
-            m_imageMap.set(math::loadVector(r, g, b), i, j);
-        }
-    }
+    TiledTexture::CacheStatus status = m_tiledTexture.open(
+        tiledFile.c_str(), sourceSize, writeTime, sourceFlags, TextureCache::Global());
+    if (status == TiledTexture::CacheStatus::Loaded) return true;
+
+    Session::get().getConsole()->out("Converting image to tiled texture: " + tiledFile + "\n");
+
+    VectorMap2D map;
+    if (!decodeFile(m_filename, m_correctGamma, &map)) return false;
+
+    const bool written = TiledTexture::writeFile(tiledFile.c_str(), &map, sourceSize, writeTime, sourceFlags);
+    map.destroy();
 
-    // Free pixel data
-    for (int i = 0; i < image->h; i++) {
-        StandardAllocator::Global()->free(pixelData[i], image->w);
+    if (written) {
+        status = m_tiledTexture.open(
+            tiledFile.c_str(), sourceSize, writeTime, sourceFlags, TextureCache::Global());
     }
-    StandardAllocator::Global()->free(pixelData, image->h);
 
-    SDL_FreeSurface(image);
+    if (status != TiledTexture::CacheStatus::Loaded) {
+        Session::get().getConsole()->out("Could not write tiled texture: " + tiledFile + "\n");
+        return false;
+    }
 
-    m_output.setMap(&m_imageMap);
+    return true;
 }
 
 void manta::ImageFileNode::_destroy() {
-    m_imageMap.destroy();
+    // Images stay in the session's cache
+    m_imageMap = nullptr;
+    m_mipmap = nullptr;
+
+    m_tiledTexture.close();
 }
 
 void manta::ImageFileNode::registerInputs() {
     registerInput(&m_correctGammaInput, "correct_gamma");
     registerInput(&m_filenameInput, "filename");
+    registerInput(&m_tiledInput, "tiled");
 }
 
 void manta::ImageFileNode::registerOutputs() {
@@ -107,17 +153,159 @@ void manta::ImageFileNode::registerOutputs() {
     registerOutput(&m_output, "__out");
 }
 
-void manta::ImageFileNode::getPixel(const SDL_Surface *surface, int x, int y, Pixel *pixelOut) {
-    Uint8 *pixel = (Uint8 *)surface->pixels;
-    pixel += (y * (size_t)surface->pitch) + (x * sizeof(Uint8) * surface->format->BytesPerPixel);
-
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-    pixelOut->r = pixel[0];
-    pixelOut->g = pixel[1];
-    pixelOut->b = pixel[2];
-#else
-    pixelOut->r = pixel[0];
-    pixelOut->g = pixel[1];
-    pixelOut->b = pixel[2];
-#endif /* SDL_BYTEORDER == SDL_BIG_ENDIAN */
+manta::VectorMap2D::Format manta::ImageFileNode::getFormat(bool monochrome, bool correctGamma) {
+    // TODO: make gamma correction generic, sRGB is assumed for now
+    if (monochrome) {
+        return correctGamma
+            ? VectorMap2D::Format::Srgb8Mono
+            : VectorMap2D::Format::Linear8Mono;
+    }
+    else {
+        return correctGamma
+            ? VectorMap2D::Format::Srgb8
+            : VectorMap2D::Format::Linear8;
+    }
+}
+
+bool manta::ImageFileNode::decodeFile(const std::string &filename, bool correctGamma, VectorMap2D *target) {
+    MemoryMappedFile file;
+    if (!file.open(filename.c_str())) return false;
+
+    // JPEGs are decoded directly, turbojpeg rejects the ones it cannot convert to RGB
+    // (CMYK for instance) and those are left to SDL
+    const unsigned char *data = (const unsigned char *)file.getData();
+    bool decoded = false;
+    if (file.getSize() > 2 && data[0] == 0xFF && data[1] == 0xD8) {
+        decoded = decodeJpeg(data, file.getSize(), correctGamma, target);
+    }
+
+    if (!decoded) {
+        SDL_Surface *surface = IMG_Load_RW(SDL_RWFromConstMem(data, (int)file.getSize()), 1);
+        if (surface != nullptr) {
+            decoded = decodeSurface(surface, correctGamma, target);
+            SDL_FreeSurface(surface);
+        }
+    }
+
+    file.close();
+
+    return decoded;
+}
+
+bool manta::ImageFileNode::decodeJpeg(const void *data, mem_size size, bool correctGamma, VectorMap2D *target) {
+    tjhandle tjInstance = tjInitDecompress();
+    if (tjInstance == nullptr) return false;
+
+    const unsigned char *jpegBuffer = (const unsigned char *)data;
+    int width, height, subsampling, colorspace;
+    int result = tjDecompressHeader3(
+        tjInstance, jpegBuffer, (unsigned long)size, &width, &height, &subsampling, &colorspace);
+    if (result != 0 || (colorspace != TJCS_GRAY && colorspace != TJCS_YCbCr && colorspace != TJCS_RGB)) {
+        tjDestroy(tjInstance);
+        return false;
+    }
+
+    // Decoded straight into the map, RGBX fills the alpha channel with 255
+    const bool monochrome = (colorspace == TJCS_GRAY);
+    const int pixelFormat = monochrome ? TJPF_GRAY : TJPF_RGBX;
+    target->initialize(width, height, getFormat(monochrome, correctGamma));
+
+    result = tjDecompress2(
+        tjInstance, jpegBuffer, (unsigned long)size, target->getRawRow(0),
+        width, width * tjPixelSize[pixelFormat], height, pixelFormat, 0);
+    tjDestroy(tjInstance);
+
+    if (result != 0) {
+        target->destroy();
+        return false;
+    }
+
+    return true;
+}
+
+bool manta::ImageFileNode::decodeSurface(SDL_Surface *surface, bool correctGamma, VectorMap2D *target) {
+    // Palettized surfaces (greyscale PNGs for instance) are read through their palette,
+    // anything that is not plain RGB or RGBA is converted first
+    SDL_Surface *converted = nullptr;
+    const SDL_Palette *palette = surface->format->palette;
+    if (palette != nullptr && surface->format->BytesPerPixel == 1) {
+        /* void */
+    }
+    else if (surface->format->format != SDL_PIXELFORMAT_RGB24 &&
+        surface->format->format != SDL_PIXELFORMAT_RGBA32)
+    {
+        converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+        if (converted == nullptr) return false;
+
+        surface = converted;
+        palette = nullptr;
+    }
+
+    const int width = surface->w;
+    const int height = surface->h;
+    const int bytesPerPixel = surface->format->BytesPerPixel;
+    const unsigned char *pixels = (const unsigned char *)surface->pixels;
+    const size_t pitch = (size_t)surface->pitch;
+
+    // Maps that only hold grey values (roughness, bump or mask maps) keep a single channel
+    bool monochrome = true;
+    if (palette != nullptr) {
+        for (int i = 0; i < palette->ncolors && monochrome; i++) {
+            const SDL_Color &c = palette->colors[i];
+            monochrome = (c.r == c.g && c.r == c.b);
+        }
+    }
+    else {
+        std::atomic<bool> colored(false);
+        ThreadPool::Global()->parallelFor(0, height, 16, [&](int start, int end) {
+            for (int j = start; j < end && !colored; j++) {
+                const unsigned char *row = pixels + j * pitch;
+                for (int i = 0; i < width; i++) {
+                    const unsigned char *pixel = row + i * bytesPerPixel;
+                    if (pixel[0] != pixel[1] || pixel[0] != pixel[2]) {
+                        colored = true;
+                        break;
+                    }
+                }
+            }
+        });
+
+        monochrome = !colored;
+    }
+
+    target->initialize(width, height, getFormat(monochrome, correctGamma));
+
+    const int texelSize = VectorMap2D::getTexelSize(target->getFormat());
+    ThreadPool::Global()->parallelFor(0, height, 16, [&](int start, int end) {
+        for (int j = start; j < end; j++) {
+            const unsigned char *row = pixels + j * pitch;
+            unsigned char *texel = target->getRawRow(j);
+
+            for (int i = 0; i < width; i++, texel += texelSize) {
+                const unsigned char *pixel = row + i * bytesPerPixel;
+
+                if (palette != nullptr) {
+                    const SDL_Color &c = palette->colors[pixel[0]];
+                    texel[0] = c.r;
+                    if (!monochrome) {
+                        texel[1] = c.g;
+                        texel[2] = c.b;
+                        texel[3] = c.a;
+                    }
+                }
+                else {
+                    texel[0] = pixel[0];
+                    if (!monochrome) {
+                        texel[1] = pixel[1];
+                        texel[2] = pixel[2];
+                        texel[3] = (bytesPerPixel == 4) ? pixel[3] : 255;
+                    }
+                }
+            }
+        }
+    });
+
+    if (converted != nullptr) SDL_FreeSurface(converted);
+
+    return true;
 }
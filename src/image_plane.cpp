@@ -8,6 +8,7 @@
 
 #include <assert.h>
 #include <iostream>
+#include <algorithm>
 
 manta::ImagePlane::ImagePlane() {
     m_width = 0;
@@ -31,11 +32,16 @@ manta::ImagePlane::ImagePlane() {
     m_windowTop = 0;
     m_windowLeft = 0;
     m_windowRight = 0;
+
+    m_regionLocks = nullptr;
+    m_regionCountX = 0;
+    m_regionCountY = 0;
 }
 
 manta::ImagePlane::~ImagePlane() {
     assert(m_buffer == nullptr);
     assert(m_sampleWeightSums == nullptr);
+    assert(m_regionLocks == nullptr);
 }
 
 void manta::ImagePlane::initialize(int width, int height) {
@@ -47,8 +53,8 @@ void manta::ImagePlane::initialize(int width, int height) {
 
     const int pixelCount = width * height;
 
-    m_buffer = (math::Vector *)_aligned_malloc(sizeof(math::Vector) * pixelCount, 16);
-    m_sampleWeightSums = StandardAllocator::Global()->allocate <math::real>(pixelCount);
+    m_buffer = StandardAllocator::Global()->allocate<math::Vector>(pixelCount, 16, MemoryTag::Film);
+    m_sampleWeightSums = StandardAllocator::Global()->allocate<math::real>(pixelCount, 1, MemoryTag::Film);
 
     assert(m_buffer != nullptr);
 
@@ -57,6 +63,10 @@ void manta::ImagePlane::initialize(int width, int height) {
         m_sampleWeightSums[i] = (math::real)0.0;
     }
 
+    m_regionCountX = (width + LockRegionSize - 1) / LockRegionSize;
+    m_regionCountY = (height + LockRegionSize - 1) / LockRegionSize;
+    m_regionLocks = new std::mutex[m_regionCountX * m_regionCountY];
+
     m_windowLeft = 0;
     m_windowRight = width - 1;
     m_windowTop = 0;
@@ -64,12 +74,17 @@ void manta::ImagePlane::initialize(int width, int height) {
 }
 
 void manta::ImagePlane::destroy() {
-    if (m_buffer != nullptr) _aligned_free(m_buffer);
-    if (m_sampleWeightSums != nullptr) StandardAllocator::Global()->free(m_sampleWeightSums);
+    const int pixelCount = m_width * m_height;
+    StandardAllocator::Global()->aligned_free(m_buffer, pixelCount, MemoryTag::Film);
+    StandardAllocator::Global()->free(m_sampleWeightSums, pixelCount, MemoryTag::Film);
+    if (m_regionLocks != nullptr) delete[] m_regionLocks;
 
     // Reset member variables
     m_buffer = nullptr;
     m_sampleWeightSums = nullptr;
+    m_regionLocks = nullptr;
+    m_regionCountX = 0;
+    m_regionCountY = 0;
     m_width = 0;
     m_height = 0;    
 }
@@ -137,13 +152,18 @@ void manta::ImagePlane::processSamples(ImageSample *samples, int sampleCount, St
         int x, y;
     };
 
-    Block *blocks = (Block *)stack->allocate(sizeof(Block), 16);
+    // Every sample touches at most this many pixels, the rounding of the footprint
+    // below can add up to two pixels on each axis
+    const math::Vector2 extents = m_filter->getExtents();
+    const int maxFootprint =
+        ((int)ceil(2 * extents.x) + 4) * ((int)ceil(2 * extents.y) + 4);
+
+    Block *blocks = (Block *)stack->allocate(sizeof(Block) * sampleCount * maxFootprint, 16);
     Block *currentBlock = blocks;
 
     int blockCount = 0;
     for (int i = 0; i < sampleCount; i++) {
         const ImageSample &sample = samples[i];
-        const math::Vector2 extents = m_filter->getExtents();
         const int left = (int)(floor(sample.imagePlaneLocation.x - extents.x));
         const int right = (int)(ceil(sample.imagePlaneLocation.x + extents.x) + (math::real)0.5);
         const int top = (int)(floor(sample.imagePlaneLocation.y - extents.y));
@@ -172,31 +192,186 @@ void manta::ImagePlane::processSamples(ImageSample *samples, int sampleCount, St
         }
     }
 
-    std::unique_lock<std::mutex> lock(m_lock);
+    assert(blockCount <= sampleCount * maxFootprint);
+
+    // Consecutive blocks usually fall in the same region so the lock is held across them
+    std::mutex *heldLock = nullptr;
     for (int i = 0; i < blockCount; i++) {
         const Block &block = blocks[i];
+
+        std::mutex *regionLock = getRegionLock(block.x, block.y);
+        if (regionLock != heldLock) {
+            if (heldLock != nullptr) heldLock->unlock();
+            regionLock->lock();
+            heldLock = regionLock;
+        }
         
         math::Vector &value = m_buffer[block.y * m_width + block.x];
         math::real &weightSum = m_sampleWeightSums[block.y * m_width + block.x];
 
         value = math::add(value, block.value);
         weightSum += block.weight;
+
+        updatePreview(block.x, block.y);
     }
 
-    if (m_previewTarget != nullptr) {
-        for (int i = 0; i < blockCount; ++i) {
-            const Block &block = blocks[i];
+    if (heldLock != nullptr) heldLock->unlock();
+
+    stack->free(blocks);
+}
+
+bool manta::ImagePlane::createTile(
+    ImagePlaneTile *tile, int x0, int y0, int x1, int y1, StackAllocator *stack) const 
+{
+    // Samples are jittered by up to half a pixel and the footprint is rounded outwards
+    const math::Vector2 extents = m_filter->getExtents();
+    const int marginX = (int)ceil(extents.x) + 2;
+    const int marginY = (int)ceil(extents.y) + 2;
+
+    tile->left = std::max(x0 - marginX, 0);
+    tile->top = std::max(y0 - marginY, 0);
+    tile->right = std::min(x1 + marginX, m_width - 1);
+    tile->bottom = std::min(y1 + marginY, m_height - 1);
+    tile->width = tile->right - tile->left + 1;
+    tile->height = tile->bottom - tile->top + 1;
+    tile->touchedTop = tile->bottom + 1;
+    tile->touchedBottom = tile->top - 1;
+
+    tile->values = nullptr;
+    tile->weights = nullptr;
+
+    if (tile->width <= 0 || tile->height <= 0) return false;
+
+    const int pixelCount = tile->width * tile->height;
+    if (pixelCount > MaxTilePixels) return false;
+
+    tile->values = (math::Vector *)stack->allocate(sizeof(math::Vector) * pixelCount, 16);
+    tile->weights = (math::real *)stack->allocate(sizeof(math::real) * pixelCount, 16);
+
+    return true;
+}
+
+void manta::ImagePlane::addSamples(
+    ImagePlaneTile *tile, ImageSample *samples, int sampleCount, StackAllocator *stack) 
+{
+    const math::Vector2 extents = m_filter->getExtents();
+
+    for (int i = 0; i < sampleCount; i++) {
+        const ImageSample &sample = samples[i];
+        const int left = std::max((int)(floor(sample.imagePlaneLocation.x - extents.x)), 0);
+        const int right = std::min((int)(ceil(sample.imagePlaneLocation.x + extents.x) + (math::real)0.5), m_width - 1);
+        const int top = std::max((int)(floor(sample.imagePlaneLocation.y - extents.y)), 0);
+        const int bottom = std::min((int)(ceil(sample.imagePlaneLocation.y + extents.y) + (math::real)0.5), m_height - 1);
+
+        if (left < tile->left || right > tile->right || top < tile->top || bottom > tile->bottom) {
+            // Footprint leaks outside of the tile, take the synchronized path instead
+            processSamples(samples + i, 1, stack);
+            continue;
+        }
+
+        touchTileRows(tile, top, bottom);
+
+        for (int y = top; y <= bottom; y++) {
+            for (int x = left; x <= right; x++) {
+                const math::Vector2 p(
+                    sample.imagePlaneLocation.x - (math::real)x,
+                    sample.imagePlaneLocation.y - (math::real)y
+                );
 
-            const math::Vector value = m_buffer[block.y * m_width + block.x];
-            const math::real weightSum = m_sampleWeightSums[block.y * m_width + block.x];
+                if (FAST_ABS(p.x) > extents.x || FAST_ABS(p.y) > extents.y) continue;
+
+                const math::Vector weight = m_filter->evaluate(p);
+                const int index = (y - tile->top) * tile->width + (x - tile->left);
 
-            if (weightSum != 0) {
-                m_previewTarget->set(math::div(value, math::loadScalar(weightSum)), block.x, block.y);
+                tile->values[index] = math::add(tile->values[index], math::mul(weight, sample.intensity));
+                tile->weights[index] += math::getScalar(weight);
             }
         }
     }
+}
 
-    stack->free(blocks);
+void manta::ImagePlane::mergeTile(const ImagePlaneTile *tile) {
+    if (tile->touchedTop > tile->touchedBottom) return;
+
+    // Only the regions overlapped by the touched rows are locked, one at a time
+    const int regionLeft = tile->left / LockRegionSize;
+    const int regionRight = tile->right / LockRegionSize;
+    const int regionTop = tile->touchedTop / LockRegionSize;
+    const int regionBottom = tile->touchedBottom / LockRegionSize;
+
+    for (int ry = regionTop; ry <= regionBottom; ry++) {
+        for (int rx = regionLeft; rx <= regionRight; rx++) {
+            const int x0 = std::max(rx * LockRegionSize, tile->left);
+            const int x1 = std::min((rx + 1) * LockRegionSize - 1, tile->right);
+            const int y0 = std::max(ry * LockRegionSize, tile->touchedTop);
+            const int y1 = std::min((ry + 1) * LockRegionSize - 1, tile->touchedBottom);
+
+            std::lock_guard<std::mutex> lock(m_regionLocks[ry * m_regionCountX + rx]);
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    const int index = (y - tile->top) * tile->width + (x - tile->left);
+
+                    math::Vector &value = m_buffer[y * m_width + x];
+                    value = math::add(value, tile->values[index]);
+                    m_sampleWeightSums[y * m_width + x] += tile->weights[index];
+
+                    updatePreview(x, y);
+                }
+            }
+        }
+    }
+}
+
+void manta::ImagePlane::freeTile(ImagePlaneTile *tile, StackAllocator *stack) const {
+    if (tile->values != nullptr) stack->free((void *)tile->values);
+
+    tile->values = nullptr;
+    tile->weights = nullptr;
+}
+
+void manta::ImagePlane::touchTileRows(ImagePlaneTile *tile, int top, int bottom) {
+    // The touched rows always stay contiguous, so only the rows they grow by are new
+    if (tile->touchedTop > tile->touchedBottom) {
+        clearTileRows(tile, top, bottom);
+        tile->touchedTop = top;
+        tile->touchedBottom = bottom;
+        return;
+    }
+
+    if (top < tile->touchedTop) {
+        clearTileRows(tile, top, tile->touchedTop - 1);
+        tile->touchedTop = top;
+    }
+
+    if (bottom > tile->touchedBottom) {
+        clearTileRows(tile, tile->touchedBottom + 1, bottom);
+        tile->touchedBottom = bottom;
+    }
+}
+
+void manta::ImagePlane::clearTileRows(ImagePlaneTile *tile, int top, int bottom) {
+    const int begin = (top - tile->top) * tile->width;
+    const int end = (bottom - tile->top + 1) * tile->width;
+
+    for (int i = begin; i < end; i++) {
+        tile->values[i] = math::constants::Zero;
+        tile->weights[i] = (math::real)0.0;
+    }
+}
+
+std::mutex *manta::ImagePlane::getRegionLock(int x, int y) const {
+    return &m_regionLocks[(y / LockRegionSize) * m_regionCountX + (x / LockRegionSize)];
+}
+
+void manta::ImagePlane::updatePreview(int x, int y) {
+    if (m_previewTarget == nullptr) return;
+
+    const math::Vector value = m_buffer[y * m_width + x];
+    const math::real weightSum = m_sampleWeightSums[y * m_width + x];
+
+    if (weightSum != 0) {
+        m_previewTarget->set(math::div(value, math::loadScalar(weightSum)), x, y);
+    }
 }
 
 void manta::ImagePlane::normalize() {
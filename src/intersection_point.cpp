@@ -1,6 +1,11 @@
 #include "../include/intersection_point.h"
 
 #include "../include/mesh.h"
+#include "../include/geometry_instance.h"
+#include "../include/light_ray.h"
+
+#include <algorithm>
+#include <cmath>
 
 void manta::IntersectionPoint::calculateCachedValues() {
     // Generate basis vectors
@@ -19,8 +24,16 @@ void manta::IntersectionPoint::calculatePartialDerivatives() {
     const math::Vector p1 = *m_mesh->getVertex(face->v);
     const math::Vector p2 = *m_mesh->getVertex(face->w);
 
+    // Mesh data of instanced geometry is in object space
+    math::Vector position = m_position;
+    math::Vector faceNormal = m_faceNormal;
+    if (m_instance != nullptr) {
+        position = m_instance->worldToObjectPoint(m_position);
+        faceNormal = math::normalize(m_instance->worldToObjectNormal(m_faceNormal));
+    }
+
     const math::Vector basis_u = math::normalize(math::sub(p1, p0));
-    const math::Vector basis_v = math::cross(m_faceNormal, basis_u);
+    const math::Vector basis_v = math::cross(faceNormal, basis_u);
 
     const math::Vector p1p0 = math::sub(p1, p0);
     const math::Vector p2p0 = math::sub(p2, p0);
@@ -85,7 +98,7 @@ void manta::IntersectionPoint::calculatePartialDerivatives() {
     }
 
     // Parametric coordinates
-    const math::Vector pp0 = math::sub(m_position, p0);
+    const math::Vector pp0 = math::sub(position, p0);
     const math::real u = math::getScalar(math::dot(pp0, basis_u));
     const math::real v = math::getScalar(math::dot(pp0, basis_v));
 
@@ -103,6 +116,10 @@ void manta::IntersectionPoint::calculatePartialDerivatives() {
     this->dtdv = dtdv;
     this->dndu = dndu;
     this->dndv = dndv;
+
+    if (m_instance != nullptr) {
+        m_instance->transformPartialDerivatives(this);
+    }
 }
 
 void manta::IntersectionPoint::offset(math::real du_s, math::real dv_s) {
@@ -125,6 +142,64 @@ void manta::IntersectionPoint::offset(math::real du_s, math::real dv_s) {
         math::add(math::mul(du, this->dtdu), math::mul(dv, this->dtdv)));
 }
 
+void manta::IntersectionPoint::calculateDifferentials(const LightRay *ray) {
+    m_hasDifferentials = false;
+    if (ray == nullptr || !ray->hasDifferentials()) return;
+
+    // Intersect the offset rays with the tangent plane at the intersection
+    const math::Vector d = math::dot(m_faceNormal, m_position);
+
+    const math::real dxCos = math::getScalar(math::dot(m_faceNormal, ray->getDxDirection()));
+    const math::real dyCos = math::getScalar(math::dot(m_faceNormal, ray->getDyDirection()));
+    if (std::abs(dxCos) < (math::real)1E-8 || std::abs(dyCos) < (math::real)1E-8) return;
+
+    const math::Vector tx = math::div(
+        math::sub(d, math::dot(m_faceNormal, ray->getDxSource())), math::loadScalar(dxCos));
+    const math::Vector ty = math::div(
+        math::sub(d, math::dot(m_faceNormal, ray->getDySource())), math::loadScalar(dyCos));
+
+    const math::Vector px = math::add(ray->getDxSource(), math::mul(ray->getDxDirection(), tx));
+    const math::Vector py = math::add(ray->getDySource(), math::mul(ray->getDyDirection(), ty));
+
+    m_dpdx = math::sub(px, m_position);
+    m_dpdy = math::sub(py, m_position);
+
+    if (m_mesh != nullptr) {
+        // Project onto the parametric basis of the face
+        const math::Vector dudx = math::dot(m_dpdx, u_basis);
+        const math::Vector dvdx = math::dot(m_dpdx, v_basis);
+        const math::Vector dudy = math::dot(m_dpdy, u_basis);
+        const math::Vector dvdy = math::dot(m_dpdy, v_basis);
+
+        m_dtdx = math::add(math::mul(dtdu, dudx), math::mul(dtdv, dvdx));
+        m_dtdy = math::add(math::mul(dtdu, dudy), math::mul(dtdv, dvdy));
+        m_dndx = math::add(math::mul(dndu, dudx), math::mul(dndv, dvdx));
+        m_dndy = math::add(math::mul(dndu, dudy), math::mul(dndv, dvdy));
+
+        // Normals are flipped when the surface is hit from behind
+        if (m_direction == MediaInterface::Direction::Out) {
+            m_dndx = math::negate(m_dndx);
+            m_dndy = math::negate(m_dndy);
+        }
+    }
+    else {
+        m_dtdx = m_dtdy = math::constants::Zero;
+        m_dndx = m_dndy = math::constants::Zero;
+    }
+
+    m_hasDifferentials = true;
+}
+
+manta::math::real manta::IntersectionPoint::getTextureFootprint() const {
+    if (!m_hasDifferentials) return (math::real)0.0;
+
+    const math::real width = std::max({
+        std::abs(math::getX(m_dtdx)), std::abs(math::getY(m_dtdx)),
+        std::abs(math::getX(m_dtdy)), std::abs(math::getY(m_dtdy)) });
+
+    return 2 * width;
+}
+
 manta::math::Vector manta::IntersectionPoint::worldToLocal(const math::Vector &i) const {
     return math::loadVector(
         math::getScalar(math::dot(i, m_vertexU)),
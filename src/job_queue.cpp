@@ -1,32 +1,142 @@
 #include "../include/job_queue.h"
 
+#include <assert.h>
+
 manta::JobQueue::JobQueue() {
-    /* void */
+    m_queues = nullptr;
+    m_workerCount = 0;
+    m_nextQueue = 0;
 }
 
 manta::JobQueue::~JobQueue() {
-    /* void */
+    destroy();
+}
+
+void manta::JobQueue::initialize(int workerCount) {
+    destroy();
+
+    assert(workerCount > 0);
+
+    m_workerCount = workerCount;
+    m_nextQueue = 0;
+    m_queues = new WorkerQueue[workerCount];
+
+    for (int i = 0; i < workerCount; i++) {
+        m_queues[i].activeRows = packRows(1, 0);
+    }
+}
+
+void manta::JobQueue::destroy() {
+    delete[] m_queues;
+    m_queues = nullptr;
+    m_workerCount = 0;
+    m_nextQueue = 0;
 }
 
 void manta::JobQueue::push(const Job &job) {
-    m_queueLock.lock();
-    m_queue.push(job);
-    m_queueLock.unlock();
+    if (m_queues == nullptr) initialize(1);
+
+    WorkerQueue &queue = m_queues[m_nextQueue];
+    m_nextQueue = (m_nextQueue + 1) % m_workerCount;
+
+    std::lock_guard<std::mutex> lock(queue.lock);
+    queue.jobs.push_back(job);
+}
+
+bool manta::JobQueue::pop(Job *job, int workerId) {
+    if (m_queues == nullptr) return false;
+
+    WorkerQueue &queue = m_queues[workerId];
+
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (!queue.jobs.empty()) {
+            *job = queue.jobs.front();
+            queue.jobs.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) found = steal(job, workerId);
+    if (!found) found = split(job, workerId);
+    if (!found) return false;
+
+    setActiveJob(&queue, job);
+    return true;
 }
 
-bool manta::JobQueue::pop(Job *job) {
-    bool result;
+bool manta::JobQueue::claimRow(int workerId, int *row) {
+    std::atomic<unsigned long long> &activeRows = m_queues[workerId].activeRows;
+
+    unsigned long long rows = activeRows.load();
+    while (true) {
+        const int next = getNextRow(rows);
+        const int end = getEndRow(rows);
+        if (next > end) return false;
 
-    m_queueLock.lock();
-    if (m_queue.empty()) {
-        result = false;
+        if (activeRows.compare_exchange_weak(rows, packRows(next + 1, end))) {
+            *row = next;
+            return true;
+        }
     }
-    else {
-        *job = m_queue.front();
-        m_queue.pop();
-        result = true;
+}
+
+bool manta::JobQueue::steal(Job *job, int workerId) {
+    for (int i = 1; i < m_workerCount; i++) {
+        WorkerQueue &victim = m_queues[(workerId + i) % m_workerCount];
+
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.jobs.empty()) {
+            *job = victim.jobs.back();
+            victim.jobs.pop_back();
+            return true;
+        }
     }
-    m_queueLock.unlock();
 
-    return result;
+    return false;
+}
+
+bool manta::JobQueue::split(Job *job, int workerId) {
+    // Pick the active job with the most remaining rows
+    int victimId = -1;
+    int mostRows = MinSplitRows - 1;
+    for (int i = 1; i < m_workerCount; i++) {
+        const int candidate = (workerId + i) % m_workerCount;
+        const unsigned long long rows = m_queues[candidate].activeRows.load();
+        const int remaining = getEndRow(rows) - getNextRow(rows) + 1;
+
+        if (remaining > mostRows) {
+            mostRows = remaining;
+            victimId = candidate;
+        }
+    }
+
+    if (victimId == -1) return false;
+
+    WorkerQueue &victim = m_queues[victimId];
+
+    // The lock keeps the owner from replacing its active job while it is being split
+    std::lock_guard<std::mutex> lock(victim.lock);
+
+    unsigned long long rows = victim.activeRows.load();
+    while (true) {
+        const int next = getNextRow(rows);
+        const int end = getEndRow(rows);
+        if (end - next + 1 < MinSplitRows) return false;
+
+        const int middle = next + (end - next + 1) / 2;
+        if (victim.activeRows.compare_exchange_weak(rows, packRows(next, middle - 1))) {
+            *job = victim.activeJob;
+            job->startY = middle;
+            job->endY = end;
+            return true;
+        }
+    }
+}
+
+void manta::JobQueue::setActiveJob(WorkerQueue *queue, const Job *job) {
+    std::lock_guard<std::mutex> lock(queue->lock);
+    queue->activeJob = *job;
+    queue->activeRows = packRows(job->startY, job->endY);
 }
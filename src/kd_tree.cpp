@@ -8,13 +8,54 @@
 #include "../include/vector_node_output.h"
 #include "../include/session.h"
 #include "../include/console.h"
+#include "../include/thread_pool.h"
 
 #include <algorithm>
-#include <thread>
 #include <stdlib.h>
 #include <chrono>
+#include <string.h>
+
+namespace manta {
+
+    constexpr char KdTreeCacheMagic[8] = { 'M', 'R', 'K', 'D', 'T', 'R', 'E', 'E' };
+    static_assert(sizeof(KDTreeCacheHeader) <= KDTree::CacheHeaderSize, "Cache header does not fit");
+
+    // Build parameters, every one of them is part of the disk cache key
+    constexpr int KdMaxBuildDepth = 45;
+    constexpr math::real KdIntersectionCost = 50;
+    constexpr math::real KdTraversalCost = 50;
+    constexpr math::real KdEmptyBonus = 0.0;
+
+    inline hash_value kdCacheHeaderChecksum(const KDTreeCacheHeader &header) {
+        KDTreeCacheHeader copy = header;
+        copy.headerChecksum = 0;
+
+        return fnv1a((const void *)&copy, sizeof(KDTreeCacheHeader));
+    }
+
+    // Surface area heuristic cost of splitting a node at position t along the given axis
+    inline math::real kdSplitCost(
+        const AABB &nodeBounds, const math::Vector &d, math::real invTotalSA,
+        int axis, math::real t, int nBelow, int nAbove)
+    {
+        const int otherAxis0 = (axis + 1) % 3, otherAxis1 = (axis + 2) % 3;
+        const math::real belowSA = 2 * (math::get(d, otherAxis0) * math::get(d, otherAxis1) +
+            (t - math::get(nodeBounds.minPoint, axis)) *
+            (math::get(d, otherAxis0) + math::get(d, otherAxis1)));
+        const math::real aboveSA = 2 * (math::get(d, otherAxis0) * math::get(d, otherAxis1) +
+            (math::get(nodeBounds.maxPoint, axis) - t) *
+            (math::get(d, otherAxis0) + math::get(d, otherAxis1)));
+
+        const math::real pBelow = belowSA * invTotalSA;
+        const math::real pAbove = aboveSA * invTotalSA;
+        const math::real eb = (nAbove == 0 || nBelow == 0) ? KdEmptyBonus : 0;
+        return KdTraversalCost + KdIntersectionCost * (1 - eb) * (pBelow * nBelow + pAbove * nAbove);
+    }
+
+} /* namespace manta */
 
 manta::KDTree::KDTree() {
+    m_mesh = nullptr;
     m_nodes = nullptr;
     m_nodeVolumes = nullptr;
     m_nodeCapacity = 0;
@@ -26,6 +67,12 @@ manta::KDTree::KDTree() {
     m_faceList = nullptr;
     m_faceCount = 0;
 
+#if KD_TREE_TRIANGLE_BLOCKS
+    m_triangleBlocks = nullptr;
+    m_triangleBlockCount = 0;
+    m_leafBlockOffsets = nullptr;
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+
     m_progress = (math::real)0.0;
     m_complete = false;
 }
@@ -71,21 +118,34 @@ void manta::KDTree::configure(math::real width, const math::Vector &position) {
 }
 
 void manta::KDTree::destroy() {
+    destroyTriangleBlocks();
+
+    if (m_cacheFile.isOpen()) {
+        // Node and face arrays point into the mapped file and are not owned by the tree
+        m_cacheFile.close();
+
+        m_nodes = nullptr;
+        m_nodeCount = 0;
+        m_nodeCapacity = 0;
+        m_faceList = nullptr;
+        m_faceCount = 0;
+    }
+
     if (m_faceList != nullptr) {
-        StandardAllocator::Global()->free(m_faceList, m_faceCount);
+        StandardAllocator::Global()->free(m_faceList, m_faceCount, MemoryTag::KDTree);
         m_faceList = nullptr;
         m_faceCount = 0;
     }
 
     if (m_nodes != nullptr) {
-        StandardAllocator::Global()->free(m_nodes, m_nodeCapacity);
+        StandardAllocator::Global()->free(m_nodes, m_nodeCapacity, MemoryTag::KDTree);
         m_nodes = nullptr;
         m_nodeCapacity = 0;
         m_nodeCount = 0;
     }
 
     if (m_nodeVolumes != nullptr) {
-        StandardAllocator::Global()->aligned_free(m_nodeVolumes, m_volumeCapacity);
+        StandardAllocator::Global()->aligned_free(m_nodeVolumes, m_volumeCapacity, MemoryTag::KDTree);
         m_nodeVolumes = nullptr;
         m_volumeCount = 0;
         m_volumeCapacity = 0;
@@ -112,6 +172,11 @@ bool manta::KDTree::findClosestIntersection(
     math::real closestHit = std::min(tmax, maxDepth);
     if (closestHit < tmin) return false;
 
+#if KD_TREE_TRIANGLE_BLOCKS
+    TriangleBlockRay blockRay;
+    initializeBlockRay(&blockRay, ray->getSource(), ray->getShear(), ray->getKX(), ray->getKY(), ray->getKZ());
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+
     bool hit = false;
     const KDTreeNode *node = &m_nodes[0];
     while (true) {
@@ -168,8 +233,6 @@ bool manta::KDTree::findClosestIntersection(
                     INCREMENT_COUNTER(RuntimeStatistics::Counter::KdEmptyLeafNodeTraversals);
                 }
 
-                const int *faceList = &m_faceList[node->getObjectOffset()];
-
 #if KD_TREE_WITH_BOUNDING_BOXES
                 INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvTests);
                 const KDBoundingVolume &bv = m_nodeVolumes[node->getObjectOffset()];
@@ -177,10 +240,28 @@ bool manta::KDTree::findClosestIntersection(
                 if (bv.bounds.rayIntersect(*ray, &t0, &t1)) {
                     INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
 #endif /* KD_TREE_WITH_BOUNDING_BOXES */
+#if KD_TREE_TRIANGLE_BLOCKS
+                    TriangleBlockHit blockHit;
+                    if (intersectLeafBlocks((int)(node - m_nodes), primitiveCount, blockRay, minDepth, closestHit, &blockHit /**/ STATISTICS_PARAM_INPUT)) {
+                        intersection->depth = blockHit.depth;
+                        intersection->faceHint = blockHit.face;
+                        intersection->subdivisionHint = -1;
+                        intersection->sceneGeometry = m_mesh;
+
+                        intersection->su = blockHit.u;
+                        intersection->sv = blockHit.v;
+                        intersection->sw = blockHit.w;
+
+                        hit = true;
+                        closestHit = blockHit.depth;
+                    }
+#else
+                    const int *faceList = &m_faceList[node->getObjectOffset()];
                     if (m_mesh->findClosestIntersection(faceList, primitiveCount, ray, intersection, minDepth, closestHit /**/ STATISTICS_PARAM_INPUT)) {
                         hit = true;
                         closestHit = intersection->depth;
                     }
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
 #if KD_TREE_WITH_BOUNDING_BOXES
                 }
 #endif /* KD_TREE_WITH_BOUNDING_BOXES */
@@ -201,6 +282,189 @@ bool manta::KDTree::findClosestIntersection(
     return hit;
 }
 
+int manta::KDTree::findClosestIntersectionPacket(
+    const RayPacket &packet,
+    int laneMask,
+    CoarseIntersection *intersections,
+    math::real minDepth,
+    const math::real *maxDepth,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+#if ENABLE_RAY_PACKETS
+    typedef RayPacketSimd Simd;
+    typedef Simd::Register Register;
+    constexpr int Width = RayPacket::Width;
+
+    // Single rays and rays that disagree on the traversal order are traced on their own
+    if ((laneMask & (laneMask - 1)) == 0 || !packet.isCoherent(laneMask)) {
+        return SceneGeometry::findClosestIntersectionPacket(
+            packet, laneMask, intersections, minDepth, maxDepth, s /**/ STATISTICS_PARAM_INPUT);
+    }
+
+    alignas(Width * sizeof(math::real)) math::real tmin[Width];
+    alignas(Width * sizeof(math::real)) math::real tmax[Width];
+    alignas(Width * sizeof(math::real)) math::real closestHit[Width];
+
+    int active = 0;
+    int firstLane = -1;
+    for (int i = 0; i < Width; i++) {
+        tmin[i] = tmax[i] = closestHit[i] = (math::real)0.0;
+        if ((laneMask & (0x1 << i)) == 0) continue;
+        if (!m_bounds.rayIntersect(*packet.rays[i], &tmin[i], &tmax[i])) continue;
+
+        closestHit[i] = std::min(tmax[i], maxDepth[i]);
+        if (closestHit[i] < tmin[i]) continue;
+
+        active |= (0x1 << i);
+        if (firstLane == -1) firstLane = i;
+    }
+
+    if (active == 0) return 0;
+
+#if KD_TREE_TRIANGLE_BLOCKS
+    TriangleBlockRay blockRays[Width];
+    for (int i = 0; i < Width; i++) {
+        if ((active & (0x1 << i)) == 0) continue;
+
+        const LightRay *ray = packet.rays[i];
+        initializeBlockRay(&blockRays[i], ray->getSource(), ray->getShear(), ray->getKX(), ray->getKY(), ray->getKZ());
+    }
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+
+    const bool negative[3] = {
+        packet.isNegative(firstLane, 0),
+        packet.isNegative(firstLane, 1),
+        packet.isNegative(firstLane, 2)
+    };
+
+    constexpr int MAX_DEPTH = 64;
+    KDPacketJob jobs[MAX_DEPTH];
+    int currentJob = 0;
+
+    int hitMask = 0;
+    const KDTreeNode *node = &m_nodes[0];
+    while (true) {
+        if (!node->isLeaf()) {
+            INCREMENT_COUNTER(RuntimeStatistics::Counter::KdInnerNodeTraversals);
+
+            const int axis = node->getSplitAxis();
+            const Register tPlane = Simd::mul(
+                Simd::sub(Simd::set(node->getSplit()), Simd::load(packet.origin[axis])),
+                Simd::load(packet.inverseDirection[axis]));
+            const Register tminV = Simd::load(tmin);
+            const Register tmaxV = Simd::load(tmax);
+
+            // A NaN plane distance (ray parallel to and starting on the plane) fails both
+            // comparisons, so such lanes only visit the near child
+            const int nearMask = active & ~Simd::mask(Simd::lt(tPlane, tminV));
+            const int farMask = active & Simd::mask(Simd::le(tPlane, tmaxV));
+
+            const KDTreeNode *nearChild, *farChild;
+            if (negative[axis]) {
+                nearChild = &m_nodes[node->getAboveChild()];
+                farChild = node + 1;
+            }
+            else {
+                nearChild = node + 1;
+                farChild = &m_nodes[node->getAboveChild()];
+            }
+
+            // min/max return their second operand for NaN inputs which keeps the
+            // existing range for those lanes
+            if (farMask == 0) {
+                node = nearChild;
+                active = nearMask;
+            }
+            else if (nearMask == 0) {
+                Simd::store(tmin, Simd::max_(tPlane, tminV));
+
+                node = farChild;
+                active = farMask;
+            }
+            else {
+                // Add far child to queue
+                KDPacketJob &job = jobs[currentJob++];
+                job.node = farChild;
+                job.laneMask = farMask;
+                Simd::store(job.tmin, Simd::max_(tPlane, tminV));
+                Simd::store(job.tmax, tmaxV);
+
+                Simd::store(tmax, Simd::min_(tPlane, tmaxV));
+
+                node = nearChild;
+                active = nearMask;
+            }
+        }
+        else {
+            INCREMENT_COUNTER(RuntimeStatistics::Counter::KdLeafNodeTraversals);
+
+            const int primitiveCount = node->getPrimitiveCount();
+            if (primitiveCount == 0) {
+                INCREMENT_COUNTER(RuntimeStatistics::Counter::KdEmptyLeafNodeTraversals);
+            }
+
+            for (int i = 0; i < Width && primitiveCount > 0; i++) {
+                if ((active & (0x1 << i)) == 0) continue;
+
+                CoarseIntersection *intersection = &intersections[i];
+                if (primitiveCount == 1) {
+                    if (m_mesh->findClosestIntersection(&node->singleObject, primitiveCount, packet.rays[i], intersection, minDepth, closestHit[i] /**/ STATISTICS_PARAM_INPUT)) {
+                        hitMask |= (0x1 << i);
+                        closestHit[i] = intersection->depth;
+                    }
+                }
+                else {
+#if KD_TREE_TRIANGLE_BLOCKS
+                    TriangleBlockHit blockHit;
+                    if (intersectLeafBlocks((int)(node - m_nodes), primitiveCount, blockRays[i], minDepth, closestHit[i], &blockHit /**/ STATISTICS_PARAM_INPUT)) {
+                        intersection->depth = blockHit.depth;
+                        intersection->faceHint = blockHit.face;
+                        intersection->subdivisionHint = -1;
+                        intersection->sceneGeometry = m_mesh;
+
+                        intersection->su = blockHit.u;
+                        intersection->sv = blockHit.v;
+                        intersection->sw = blockHit.w;
+
+                        hitMask |= (0x1 << i);
+                        closestHit[i] = blockHit.depth;
+                    }
+#else
+                    const int *faceList = &m_faceList[node->getObjectOffset()];
+                    if (m_mesh->findClosestIntersection(faceList, primitiveCount, packet.rays[i], intersection, minDepth, closestHit[i] /**/ STATISTICS_PARAM_INPUT)) {
+                        hitMask |= (0x1 << i);
+                        closestHit[i] = intersection->depth;
+                    }
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+                }
+            }
+
+            // Resume with the deferred nodes, dropping lanes that already have a closer hit
+            active = 0;
+            while (active == 0 && currentJob > 0) {
+                const KDPacketJob &job = jobs[--currentJob];
+                active = job.laneMask &
+                    ~Simd::mask(Simd::lt(Simd::load(closestHit), Simd::load(job.tmin)));
+
+                if (active != 0) {
+                    node = job.node;
+                    Simd::store(tmin, Simd::load(job.tmin));
+                    Simd::store(tmax, Simd::load(job.tmax));
+                }
+            }
+
+            if (active == 0) break;
+        }
+    }
+
+    return hitMask;
+#else
+    return SceneGeometry::findClosestIntersectionPacket(
+        packet, laneMask, intersections, minDepth, maxDepth, s /**/ STATISTICS_PARAM_INPUT);
+#endif /* ENABLE_RAY_PACKETS */
+}
+
 bool manta::KDTree::occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const {
     constexpr int MAX_DEPTH = 64;
     KDJob jobs[MAX_DEPTH];
@@ -223,6 +487,11 @@ bool manta::KDTree::occluded(const math::Vector &p0, const math::Vector &d, math
     math::real tmax = maxDepth;
     math::real tmin = -math::constants::REAL_MAX;
 
+#if KD_TREE_TRIANGLE_BLOCKS
+    TriangleBlockRay blockRay;
+    initializeBlockRay(&blockRay, p0, shear, kx, ky, kz);
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+
     const KDTreeNode *node = &m_nodes[0];
     while (true) {
         if (!node->isLeaf()) {
@@ -297,6 +566,11 @@ bool manta::KDTree::occluded(const math::Vector &p0, const math::Vector &d, math
                 if (bv.bounds.rayIntersect(*ray, &t0, &t1)) {
                     INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
 #endif /* KD_TREE_WITH_BOUNDING_BOXES */
+#if KD_TREE_TRIANGLE_BLOCKS
+                    if (intersectLeafBlocks((int)(node - m_nodes), primitiveCount, blockRay, tmin, tmax, nullptr /**/ STATISTICS_PARAM_INPUT)) {
+                        return true;
+                    }
+#else
                     const int *faceList = &m_faceList[node->getObjectOffset()];
                     for (int i = 0; i < primitiveCount; ++i) {
                         if (m_mesh->rayTriangleIntersection(
@@ -315,6 +589,7 @@ bool manta::KDTree::occluded(const math::Vector &p0, const math::Vector &d, math
                             INCREMENT_COUNTER(RuntimeStatistics::Counter::UnecessaryTriangleTests);
                         }
                     }
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
 #if KD_TREE_WITH_BOUNDING_BOXES
                 }
 #endif /* KD_TREE_WITH_BOUNDING_BOXES */
@@ -345,12 +620,29 @@ bool manta::KDTree::fastIntersection(LightRay *ray) const {
     return true;
 }
 
-void manta::KDTree::analyzeWithProgress(Mesh *mesh, int maxSize) {
+bool manta::KDTree::getBounds(AABB *bounds) const {
+    *bounds = m_bounds;
+
+    // Nothing outside of the mesh can be hit so clip the tree extents to it
+    AABB meshBounds;
+    if (m_mesh != nullptr && m_mesh->getBounds(&meshBounds)) {
+        bounds->minPoint = math::componentMax(bounds->minPoint, meshBounds.minPoint);
+        bounds->maxPoint = math::componentMin(bounds->maxPoint, meshBounds.maxPoint);
+    }
+
+    return true;
+}
+
+void manta::KDTree::analyzeWithProgress(Mesh *mesh, int maxSize, bool parallel) {
     auto startTime = std::chrono::system_clock::now();
 
     showConsoleCursor(false);
 
-    std::thread thread(&KDTree::analyze, this, mesh, maxSize);
+    TaskGroup build;
+    build.run([=]() {
+        if (parallel) analyzeParallel(mesh, maxSize);
+        else analyze(mesh, maxSize);
+    });
 
     while (!isComplete()) {
         std::stringstream ss;
@@ -359,8 +651,8 @@ void manta::KDTree::analyzeWithProgress(Mesh *mesh, int maxSize) {
         sleep(20);    
     }
 
-    // Wait for the thread to finish
-    thread.join();
+    // Wait for the build to finish
+    build.wait();
 
     std::stringstream ss;
     ss << "Generating KD tree... " << (math::real)100.0 << "%                    \r" << std::endl;
@@ -377,8 +669,6 @@ void manta::KDTree::analyzeWithProgress(Mesh *mesh, int maxSize) {
 }
 
 void manta::KDTree::analyze(Mesh *mesh, int maxSize) {
-    constexpr int MAX_DEPTH = 45;
-
     setComplete(false);
     resetProgress();
 
@@ -395,11 +685,11 @@ void manta::KDTree::analyze(Mesh *mesh, int maxSize) {
     workspace.maxPrimitives = maxSize;
     
     for (int i = 0; i < 3; i++) {
-        workspace.edges[i] = StandardAllocator::Global()->allocate<KDBoundEdge>(mesh->getFaceCount() * 2);
+        workspace.edges[i] = StandardAllocator::Global()->allocate<KDBoundEdge>(mesh->getFaceCount() * 2, 1, MemoryTag::KDTree);
     }
 
     // Generate bounds for all faces
-    workspace.allFaceBounds = StandardAllocator::Global()->allocate<AABB>(nFaces, 16);
+    workspace.allFaceBounds = StandardAllocator::Global()->allocate<AABB>(nFaces, 16, MemoryTag::KDTree);
     for (int i = 0; i < nFaces; i++) {
         mesh->calculateFaceAABB(i, &workspace.allFaceBounds[i]);
     }
@@ -409,23 +699,70 @@ void manta::KDTree::analyze(Mesh *mesh, int maxSize) {
     topNodeBounds.maxPoint = math::loadScalar(m_width);
 
     int badRefines = 0;
-    _analyze(0, &topNodeBounds, faces, badRefines, MAX_DEPTH, &workspace, (math::real)1.0);
+    _analyze(0, &topNodeBounds, faces, badRefines, KdMaxBuildDepth, &workspace, (math::real)1.0);
 
-    // Copy faces into a new array
-    int totalFaces = (int)workspace.faces.size();
+    finalizeFaceList(&workspace);
+    buildTriangleBlocks();
 
-    m_faceList = StandardAllocator::Global()->allocate<int>(totalFaces);
-    m_faceCount = totalFaces;
-    for (int i = 0; i < totalFaces; i++) {
-        m_faceList[i] = workspace.faces[i];
+    // Destroy all allocated memory
+    for (int i = 0; i < 3; i++) {
+        StandardAllocator::Global()->free(workspace.edges[i], mesh->getFaceCount() * 2, MemoryTag::KDTree);
     }
 
-    // Destroy all allocated memory
+    StandardAllocator::Global()->aligned_free(workspace.allFaceBounds, nFaces, MemoryTag::KDTree);
+
+    setProgress((math::real)1.0);
+    setComplete(true);
+}
+
+void manta::KDTree::analyzeParallel(Mesh *mesh, int maxSize) {
+    setComplete(false);
+    resetProgress();
+
+    m_mesh = mesh;
+
+    const int nFaces = mesh->getFaceCount();
+    std::vector<int> faces(nFaces);
+    for (int i = 0; i < nFaces; i++) {
+        faces[i] = i;
+    }
+
+    // Generate bounds for all faces
+    AABB *allFaceBounds = StandardAllocator::Global()->allocate<AABB>(nFaces, 16, MemoryTag::KDTree);
+    ThreadPool::Global()->parallelFor(0, nFaces, 1024, [=](int start, int end) {
+        for (int i = start; i < end; i++) {
+            mesh->calculateFaceAABB(i, &allFaceBounds[i]);
+        }
+    });
+
+    KDParallelWorkspace parallelWorkspace;
+    parallelWorkspace.mesh = mesh;
+    parallelWorkspace.allFaceBounds = allFaceBounds;
+    parallelWorkspace.maxPrimitives = maxSize;
+
+    AABB topNodeBounds;
+    topNodeBounds.minPoint = math::loadScalar(-m_width);
+    topNodeBounds.maxPoint = math::loadScalar(m_width);
+
+    KDBuildNode *root =
+        _analyzeParallel(topNodeBounds, faces, 0, KdMaxBuildDepth, &parallelWorkspace, (math::real)1.0);
+
+    // Flatten into the same depth-first layout that the sequential build produces
+    KDTreeWorkspace workspace;
+    workspace.mesh = mesh;
+    workspace.maxPrimitives = maxSize;
+    workspace.allFaceBounds = allFaceBounds;
     for (int i = 0; i < 3; i++) {
-        StandardAllocator::Global()->free(workspace.edges[i], mesh->getFaceCount() * 2);
+        workspace.edges[i] = nullptr;
     }
 
-    StandardAllocator::Global()->aligned_free(workspace.allFaceBounds, nFaces);
+    flattenBuildTree(root, 0, &workspace);
+    destroyBuildTree(root);
+
+    finalizeFaceList(&workspace);
+    buildTriangleBlocks();
+
+    StandardAllocator::Global()->aligned_free(allFaceBounds, nFaces, MemoryTag::KDTree);
 
     setProgress((math::real)1.0);
     setComplete(true);
@@ -433,6 +770,16 @@ void manta::KDTree::analyze(Mesh *mesh, int maxSize) {
 
 void manta::KDTree::setMesh(Mesh *mesh) {
     m_mesh = mesh;
+
+    // Blocks hold copies of the vertex data so they have to follow the mesh
+    if (m_nodes != nullptr) buildTriangleBlocks();
+}
+
+void manta::KDTree::incrementProgress(math::real d) {
+    math::real current = m_progress;
+    while (!m_progress.compare_exchange_weak(current, current + d)) {
+        /* void */
+    }
 }
 
 void manta::KDTree::_analyze(
@@ -444,10 +791,6 @@ void manta::KDTree::_analyze(
     KDTreeWorkspace *workspace,
     math::real effort)
 {
-    constexpr math::real intersectionCost = 50;
-    constexpr math::real traversalCost = 50;
-    constexpr math::real emptyBonus = 0.0;
-
     createNode();
 
     // Debug only
@@ -463,7 +806,7 @@ void manta::KDTree::_analyze(
 
     int bestAxis = -1, bestOffset = -1;
     math::real bestCost = math::constants::REAL_MAX;
-    math::real oldCost = intersectionCost * primitiveCount;
+    math::real oldCost = KdIntersectionCost * primitiveCount;
     math::real totalSA = nodeBounds->surfaceArea();
     math::real invTotalSA = 1 / totalSA;
     math::Vector d = math::sub(nodeBounds->maxPoint, nodeBounds->minPoint);
@@ -502,8 +845,8 @@ retry_split:
 
             math::real pBelow = belowSA * invTotalSA;
             math::real pAbove = aboveSA * invTotalSA;
-            math::real eb = (nAbove == 0 || nBelow == 0) ? emptyBonus : 0;
-            math::real cost = traversalCost + intersectionCost * (1 - eb) * (pBelow * nBelow + pAbove * nAbove);
+            math::real eb = (nAbove == 0 || nBelow == 0) ? KdEmptyBonus : 0;
+            math::real cost = KdTraversalCost + KdIntersectionCost * (1 - eb) * (pBelow * nBelow + pAbove * nAbove);
 
             if (cost < bestCost) {
                 bestCost = cost;
@@ -558,19 +901,268 @@ retry_split:
     _analyze(aboveChild, &bounds1, primitives1, badRefines, depth - 1, workspace, effort1 * effort);
 }
 
+manta::KDBuildNode *manta::KDTree::_analyzeParallel(
+    const AABB &nodeBounds,
+    std::vector<int> &faces,
+    int badRefines,
+    int depth,
+    KDParallelWorkspace *workspace,
+    math::real effort)
+{
+    KDBuildNode *node = new KDBuildNode;
+    node->bounds = nodeBounds;
+    node->children[0] = node->children[1] = nullptr;
+    node->split = (math::real)0.0;
+    node->axis = 0x3;
+
+    const int primitiveCount = (int)faces.size();
+
+    int bestAxis = -1;
+    math::real split = (math::real)0.0;
+    math::real bestCost = math::constants::REAL_MAX;
+    bool makeLeaf = (primitiveCount <= workspace->maxPrimitives || depth == 0);
+
+    if (!makeLeaf) {
+        const bool found = (primitiveCount > BinnedSahThreshold)
+            ? findSplitBinned(nodeBounds, faces, workspace, &bestAxis, &split, &bestCost)
+            : findSplitSorted(nodeBounds, faces, workspace, &bestAxis, &split, &bestCost);
+
+        const math::real oldCost = KdIntersectionCost * primitiveCount;
+        if (bestCost > oldCost) ++badRefines;
+        if ((bestCost > 4 * oldCost && primitiveCount < workspace->maxPrimitives) || !found || badRefines == 3) {
+            makeLeaf = true;
+        }
+    }
+
+    if (makeLeaf) {
+        // Leaves are filtered here so that the sequential flattening pass stays cheap
+        for (int face : faces) {
+            if (m_mesh->checkFaceAABB(face, nodeBounds)) {
+                node->faces.push_back(face);
+            }
+        }
+
+        incrementProgress(effort);
+        return node;
+    }
+
+    // Classify primitives
+    std::vector<int> primitives0;
+    std::vector<int> primitives1;
+    for (int face : faces) {
+        const AABB &bounds = workspace->allFaceBounds[face];
+        const math::real faceMin = math::get(bounds.minPoint, bestAxis);
+        const math::real faceMax = math::get(bounds.maxPoint, bestAxis);
+
+        if (faceMin < split) primitives0.push_back(face);
+        if (faceMax > split) primitives1.push_back(face);
+
+        // Faces lying exactly on the split plane are kept on both sides
+        if (faceMin >= split && faceMax <= split) {
+            primitives0.push_back(face);
+            primitives1.push_back(face);
+        }
+    }
+
+    // The parent face list is no longer needed
+    std::vector<int>().swap(faces);
+
+    node->axis = bestAxis;
+    node->split = split;
+
+    AABB bounds0 = nodeBounds, bounds1 = nodeBounds;
+    math::set(bounds0.maxPoint, bestAxis, split);
+    math::set(bounds1.minPoint, bestAxis, split);
+
+    const int totalPrimitives = (int)primitives0.size() + (int)primitives1.size();
+    const math::real effort0 = (math::real)primitives0.size() / totalPrimitives;
+    const math::real effort1 = (math::real)1.0 - effort0;
+
+    if (primitiveCount >= ParallelTaskThreshold) {
+        // The first child is handed to the pool while this thread builds the second
+        TaskGroup tasks;
+        tasks.run([&]() {
+            node->children[0] = _analyzeParallel(
+                bounds0, primitives0, badRefines, depth - 1, workspace, effort0 * effort);
+        });
+
+        node->children[1] = _analyzeParallel(
+            bounds1, primitives1, badRefines, depth - 1, workspace, effort1 * effort);
+
+        tasks.wait();
+    }
+    else {
+        node->children[0] = _analyzeParallel(
+            bounds0, primitives0, badRefines, depth - 1, workspace, effort0 * effort);
+        node->children[1] = _analyzeParallel(
+            bounds1, primitives1, badRefines, depth - 1, workspace, effort1 * effort);
+    }
+
+    return node;
+}
+
+bool manta::KDTree::findSplitSorted(
+    const AABB &nodeBounds,
+    const std::vector<int> &faces,
+    const KDParallelWorkspace *workspace,
+    int *bestAxis,
+    math::real *split,
+    math::real *bestCost) const
+{
+    const int primitiveCount = (int)faces.size();
+    const math::Vector d = math::sub(nodeBounds.maxPoint, nodeBounds.minPoint);
+    AABB totalBounds = nodeBounds;
+    const math::real invTotalSA = 1 / totalBounds.surfaceArea();
+
+    std::vector<KDBoundEdge> edges(2 * primitiveCount);
+
+    *bestAxis = -1;
+    *bestCost = math::constants::REAL_MAX;
+
+    int axis = math::maxDimension3(d);
+    for (int retries = 0; retries < 3; retries++, axis = (axis + 1) % 3) {
+        // Initialize edges
+        for (int i = 0; i < primitiveCount; i++) {
+            const int primitiveIndex = faces[i];
+            const AABB &bounds = workspace->allFaceBounds[primitiveIndex];
+            edges[2 * i] = KDBoundEdge(math::get(bounds.minPoint, axis), primitiveIndex, true); // Start
+            edges[2 * i + 1] = KDBoundEdge(math::get(bounds.maxPoint, axis), primitiveIndex, false); // End
+        }
+
+        std::sort(edges.begin(), edges.end(),
+            [](const KDBoundEdge &e0, const KDBoundEdge &e1) -> bool {
+            if (e0.t == e1.t) return (int)e0.edgeType < (int)e1.edgeType;
+            else return e0.t < e1.t;
+        });
+
+        int nBelow = 0, nAbove = primitiveCount;
+        for (int i = 0; i < 2 * primitiveCount; i++) {
+            if (edges[i].edgeType == KDBoundEdge::EdgeType::End) --nAbove;
+            const math::real edgeT = edges[i].t;
+            if (edgeT > math::get(nodeBounds.minPoint, axis) && edgeT < math::get(nodeBounds.maxPoint, axis)) {
+                const math::real cost = kdSplitCost(nodeBounds, d, invTotalSA, axis, edgeT, nBelow, nAbove);
+                if (cost < *bestCost) {
+                    *bestCost = cost;
+                    *bestAxis = axis;
+                    *split = edgeT;
+                }
+            }
+            if (edges[i].edgeType == KDBoundEdge::EdgeType::Start) ++nBelow;
+        }
+
+        if (*bestAxis != -1) return true;
+    }
+
+    return false;
+}
+
+bool manta::KDTree::findSplitBinned(
+    const AABB &nodeBounds,
+    const std::vector<int> &faces,
+    const KDParallelWorkspace *workspace,
+    int *bestAxis,
+    math::real *split,
+    math::real *bestCost) const
+{
+    const int primitiveCount = (int)faces.size();
+    const math::Vector d = math::sub(nodeBounds.maxPoint, nodeBounds.minPoint);
+    AABB totalBounds = nodeBounds;
+    const math::real invTotalSA = 1 / totalBounds.surfaceArea();
+
+    *bestAxis = -1;
+    *bestCost = math::constants::REAL_MAX;
+
+    int axis = math::maxDimension3(d);
+    for (int retries = 0; retries < 3; retries++, axis = (axis + 1) % 3) {
+        const math::real nodeMin = math::get(nodeBounds.minPoint, axis);
+        const math::real width = math::get(d, axis);
+        if (width <= (math::real)0.0) continue;
+
+        // Count the primitives that start and end in each bin
+        int starts[SahBinCount] = { 0 };
+        int ends[SahBinCount] = { 0 };
+
+        const math::real scale = SahBinCount / width;
+        for (int face : faces) {
+            const AABB &bounds = workspace->allFaceBounds[face];
+            const int startBin = (int)((math::get(bounds.minPoint, axis) - nodeMin) * scale);
+            const int endBin = (int)((math::get(bounds.maxPoint, axis) - nodeMin) * scale);
+
+            starts[std::min(std::max(startBin, 0), SahBinCount - 1)]++;
+            ends[std::min(std::max(endBin, 0), SahBinCount - 1)]++;
+        }
+
+        // Evaluate the split cost at every interior bin boundary
+        int nBelow = 0, nAbove = primitiveCount;
+        for (int i = 1; i < SahBinCount; i++) {
+            nBelow += starts[i - 1];
+            nAbove -= ends[i - 1];
+
+            const math::real t = nodeMin + i * (width / SahBinCount);
+            const math::real cost = kdSplitCost(nodeBounds, d, invTotalSA, axis, t, nBelow, nAbove);
+            if (cost < *bestCost) {
+                *bestCost = cost;
+                *bestAxis = axis;
+                *split = t;
+            }
+        }
+
+        if (*bestAxis != -1) return true;
+    }
+
+    return false;
+}
+
+void manta::KDTree::flattenBuildTree(const KDBuildNode *node, int currentNode, KDTreeWorkspace *workspace) {
+    createNode();
+
+    // Debug only
+    m_nodeBounds.push_back(node->bounds);
+
+    if (node->isLeaf()) {
+        initFilteredLeaf(currentNode, node->faces, workspace);
+        return;
+    }
+
+    flattenBuildTree(node->children[0], currentNode + 1, workspace);
+    const int aboveChild = m_nodeCount;
+    m_nodes[currentNode].initInterior(node->axis, aboveChild, node->split);
+    flattenBuildTree(node->children[1], aboveChild, workspace);
+}
+
+void manta::KDTree::destroyBuildTree(KDBuildNode *node) {
+    if (node == nullptr) return;
+
+    destroyBuildTree(node->children[0]);
+    destroyBuildTree(node->children[1]);
+
+    delete node;
+}
+
+void manta::KDTree::finalizeFaceList(const KDTreeWorkspace *workspace) {
+    // Copy faces into a new array
+    const int totalFaces = (int)workspace->faces.size();
+
+    m_faceList = StandardAllocator::Global()->allocate<int>(totalFaces, 1, MemoryTag::KDTree);
+    m_faceCount = totalFaces;
+    for (int i = 0; i < totalFaces; i++) {
+        m_faceList[i] = workspace->faces[i];
+    }
+}
+
 int manta::KDTree::createNode() {
     if (m_nodeCount == m_nodeCapacity) {
         int newSize = 1;
         if (m_nodeCapacity > 0) newSize = m_nodeCapacity * 2;
 
-        KDTreeNode *newNodes = StandardAllocator::Global()->allocate<KDTreeNode>(newSize);
+        KDTreeNode *newNodes = StandardAllocator::Global()->allocate<KDTreeNode>(newSize, 1, MemoryTag::KDTree);
         if (m_nodeCount > 0) {
             // Copy old nodes
             memcpy((void *)newNodes, (void *)m_nodes, sizeof(KDTreeNode) * m_nodeCount);
         }
 
         if (m_nodeCapacity > 0) {
-            StandardAllocator::Global()->free(m_nodes, m_nodeCapacity);
+            StandardAllocator::Global()->free(m_nodes, m_nodeCapacity, MemoryTag::KDTree);
         }
 
         m_nodes = newNodes;
@@ -586,14 +1178,14 @@ int manta::KDTree::createNodeVolume() {
         int newSize = 1;
         if (m_volumeCapacity > 0) newSize = m_volumeCapacity * 2;
 
-        KDBoundingVolume *newVolumes = StandardAllocator::Global()->allocate<KDBoundingVolume>(newSize, 16);
+        KDBoundingVolume *newVolumes = StandardAllocator::Global()->allocate<KDBoundingVolume>(newSize, 16, MemoryTag::KDTree);
         if (m_nodeCount > 0) {
             // Copy old nodes
             memcpy((void *)newVolumes, (void *)m_nodeVolumes, sizeof(KDBoundingVolume) * m_volumeCount);
         }
 
         if (m_volumeCapacity > 0) {
-            StandardAllocator::Global()->aligned_free(m_nodeVolumes, m_volumeCapacity);
+            StandardAllocator::Global()->aligned_free(m_nodeVolumes, m_volumeCapacity, MemoryTag::KDTree);
         }
 
         m_nodeVolumes = newVolumes;
@@ -609,60 +1201,49 @@ void manta::KDTree::initLeaf(
     const AABB &bounds,
     KDTreeWorkspace *workspace)
 {
-    int primitiveCount = (int)faces.size();
-    int filteredPrimitiveCount = 0;
-    int newNodeVolume = createNodeVolume();
-
     constexpr bool ENABLE_FILTERING = true;
 
-    bool *filtered = (primitiveCount > 0)
-        ? new bool[primitiveCount]
-        : nullptr;
-
-    int singleFace = -1;
-
     // Filter faces
-    if (primitiveCount > 0) {
-        for (int i = 0; i < primitiveCount; i++) {
-            if (ENABLE_FILTERING && !m_mesh->checkFaceAABB(faces[i], bounds)) {
-                filtered[i] = true;
-            }
-            else {
-                filtered[i] = false;
-                filteredPrimitiveCount++;
-                singleFace = faces[i];
-            }
+    std::vector<int> filteredFaces;
+    for (int face : faces) {
+        if (!ENABLE_FILTERING || m_mesh->checkFaceAABB(face, bounds)) {
+            filteredFaces.push_back(face);
         }
     }
 
-    if (filteredPrimitiveCount == 1) {
-        m_nodes[node].initLeaf(1, singleFace);
+    initFilteredLeaf(node, filteredFaces, workspace);
+}
+
+void manta::KDTree::initFilteredLeaf(
+    int node,
+    const std::vector<int> &faces,
+    KDTreeWorkspace *workspace)
+{
+    const int primitiveCount = (int)faces.size();
+    const int newNodeVolume = createNodeVolume();
+
+    if (primitiveCount == 1) {
+        m_nodes[node].initLeaf(1, faces[0]);
     }
     else {
         // Initialize the new volume
         KDBoundingVolume &volume = m_nodeVolumes[newNodeVolume];
 
-        m_nodes[node].initLeaf(filteredPrimitiveCount, (int)workspace->faces.size());
+        m_nodes[node].initLeaf(primitiveCount, (int)workspace->faces.size());
 
         // Add all primitives to the list
-        for (int i = 0; i < primitiveCount; i++) {
-            if (!filtered[i]) {
-                workspace->faces.push_back(faces[i]);
-            }
-        }
+        workspace->faces.insert(workspace->faces.end(), faces.begin(), faces.end());
 
 #if KD_TREE_WITH_BOUNDING_BOXES
         // Merge all bounds
-        volume.bounds = workspace->allFaceBounds[faces[0]];
-        for (int i = 1; i < primitiveCount; i++) {
-            if (!filtered[i]) {
+        if (primitiveCount > 0) {
+            volume.bounds = workspace->allFaceBounds[faces[0]];
+            for (int i = 1; i < primitiveCount; i++) {
                 volume.bounds.merge(workspace->allFaceBounds[faces[i]]);
             }
         }
 #endif /* KD_TREE_WITH_BOUNDING_BOXES */
     }
-
-    if (filtered != nullptr) delete[] filtered;
 }
 
 void manta::KDTree::writeToObjFile(const char *fname) const {
@@ -714,3 +1295,278 @@ void manta::KDTree::writeToObjFile(const char *fname) const {
 
     f.close();
 }
+
+bool manta::KDTree::writeCacheFile(const char *fname, int granularity) const {
+    if (m_mesh == nullptr || m_nodes == nullptr) return false;
+
+    KDTreeCacheHeader header;
+    initializeCacheHeader(&header, m_mesh->computeContentHash(), granularity);
+    header.nodeCount = m_nodeCount;
+    header.faceCount = m_faceCount;
+    header.checksum = computeCacheChecksum();
+    header.headerChecksum = kdCacheHeaderChecksum(header);
+
+    char headerBlock[CacheHeaderSize];
+    memset(headerBlock, 0, CacheHeaderSize);
+    memcpy(headerBlock, &header, sizeof(KDTreeCacheHeader));
+
+    std::ofstream file(fname, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    file.write(headerBlock, CacheHeaderSize);
+    file.write((const char *)m_nodes, sizeof(KDTreeNode) * m_nodeCount);
+    file.write((const char *)m_faceList, sizeof(int) * m_faceCount);
+    file.close();
+
+    return !file.fail();
+}
+
+manta::KDTree::CacheStatus manta::KDTree::loadCacheFile(const char *fname, Mesh *mesh, int granularity, bool verifyPayload) {
+    destroy();
+
+    if (!m_cacheFile.open(fname)) return CacheStatus::Missing;
+
+    const char *data = (const char *)m_cacheFile.getData();
+    const mem_size size = m_cacheFile.getSize();
+
+    if (size < CacheHeaderSize || memcmp(data, KdTreeCacheMagic, sizeof(KdTreeCacheMagic)) != 0) {
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    KDTreeCacheHeader header;
+    memcpy(&header, data, sizeof(KDTreeCacheHeader));
+
+    if (kdCacheHeaderChecksum(header) != header.headerChecksum) {
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    // Anything that would produce a different tree invalidates the cache
+    KDTreeCacheHeader expected;
+    initializeCacheHeader(&expected, mesh->computeContentHash(), granularity);
+
+    const bool stale =
+        header.version != expected.version ||
+        header.nodeSize != expected.nodeSize ||
+        header.meshHash != expected.meshHash ||
+        header.buildHash != expected.buildHash ||
+        header.granularity != expected.granularity ||
+        memcmp(header.minPoint, expected.minPoint, sizeof(header.minPoint)) != 0 ||
+        memcmp(header.maxPoint, expected.maxPoint, sizeof(header.maxPoint)) != 0;
+    if (stale) {
+        m_cacheFile.close();
+        return CacheStatus::Stale;
+    }
+
+    const mem_size expectedSize = (mem_size)CacheHeaderSize
+        + (mem_size)sizeof(KDTreeNode) * header.nodeCount
+        + (mem_size)sizeof(int) * header.faceCount;
+    if (header.nodeCount <= 0 || header.faceCount < 0 || size != expectedSize) {
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    m_nodes = (KDTreeNode *)(data + CacheHeaderSize);
+    m_nodeCount = m_nodeCapacity = header.nodeCount;
+    m_faceList = (int *)(data + CacheHeaderSize + sizeof(KDTreeNode) * header.nodeCount);
+    m_faceCount = header.faceCount;
+
+    // Indices are always checked since traversal follows them blindly, the checksum
+    // also catches damage to split positions but has to hash the whole file
+    if (!checkCacheIndices(mesh->getFaceCount())
+        || (verifyPayload && computeCacheChecksum() != header.checksum))
+    {
+        destroy();
+        return CacheStatus::Corrupt;
+    }
+
+    m_mesh = mesh;
+    buildTriangleBlocks();
+
+    setProgress((math::real)1.0);
+    setComplete(true);
+
+    return CacheStatus::Loaded;
+}
+
+void manta::KDTree::initializeCacheHeader(KDTreeCacheHeader *header, hash_value meshHash, int granularity) const {
+    memset(header, 0, sizeof(KDTreeCacheHeader));
+
+    memcpy(header->magic, KdTreeCacheMagic, sizeof(KdTreeCacheMagic));
+    header->version = CacheVersion;
+    header->nodeSize = (int)sizeof(KDTreeNode);
+    header->meshHash = meshHash;
+    header->buildHash = computeBuildHash(granularity);
+    header->granularity = granularity;
+
+    header->minPoint[0] = math::getX(m_bounds.minPoint);
+    header->minPoint[1] = math::getY(m_bounds.minPoint);
+    header->minPoint[2] = math::getZ(m_bounds.minPoint);
+    header->maxPoint[0] = math::getX(m_bounds.maxPoint);
+    header->maxPoint[1] = math::getY(m_bounds.maxPoint);
+    header->maxPoint[2] = math::getZ(m_bounds.maxPoint);
+}
+
+manta::hash_value manta::KDTree::computeBuildHash(int granularity) const {
+    const int version = CacheVersion;
+    const int maxDepth = KdMaxBuildDepth;
+    const math::real costs[] = { KdIntersectionCost, KdTraversalCost, KdEmptyBonus };
+    const math::real bounds[] = {
+        math::getX(m_bounds.minPoint), math::getY(m_bounds.minPoint), math::getZ(m_bounds.minPoint),
+        math::getX(m_bounds.maxPoint), math::getY(m_bounds.maxPoint), math::getZ(m_bounds.maxPoint)
+    };
+
+    hash_value hash = fnv1a((const void *)&version, sizeof(int));
+    hash = fnv1a((const void *)&granularity, sizeof(int), hash);
+    hash = fnv1a((const void *)&maxDepth, sizeof(int), hash);
+    hash = fnv1a((const void *)costs, sizeof(costs), hash);
+    return fnv1a((const void *)bounds, sizeof(bounds), hash);
+}
+
+manta::hash_value manta::KDTree::computeCacheChecksum() const {
+    const hash_value nodeHash = fnv1a((const void *)m_nodes, sizeof(KDTreeNode) * m_nodeCount);
+    return fnv1a((const void *)m_faceList, sizeof(int) * m_faceCount, nodeHash);
+}
+
+bool manta::KDTree::checkCacheIndices(int meshFaceCount) const {
+    for (int i = 0; i < m_nodeCount; i++) {
+        const KDTreeNode &node = m_nodes[i];
+
+        if (node.isLeaf()) {
+            const int primitiveCount = node.getPrimitiveCount();
+            if (primitiveCount == 1) {
+                if (node.singleObject < 0 || node.singleObject >= meshFaceCount) return false;
+            }
+            else {
+                const int offset = node.getObjectOffset();
+                if (primitiveCount < 0 || offset < 0 || offset > m_faceCount - primitiveCount) return false;
+            }
+        }
+        else {
+            // Children always come after their parent, which also rules out cycles
+            const int aboveChild = node.getAboveChild();
+            if (node.getSplitAxis() < 0 || node.getSplitAxis() > 2 || i + 1 >= m_nodeCount) return false;
+            if (aboveChild <= i || aboveChild >= m_nodeCount) return false;
+        }
+    }
+
+    for (int i = 0; i < m_faceCount; i++) {
+        if (m_faceList[i] < 0 || m_faceList[i] >= meshFaceCount) return false;
+    }
+
+    return true;
+}
+
+void manta::KDTree::buildTriangleBlocks() {
+#if KD_TREE_TRIANGLE_BLOCKS
+    destroyTriangleBlocks();
+
+    if (m_mesh == nullptr || m_nodes == nullptr) return;
+
+    constexpr int Width = TRIANGLE_BLOCK_WIDTH;
+
+    // Single primitive leaves keep using the scalar test
+    m_leafBlockOffsets = StandardAllocator::Global()->allocate<int>(m_nodeCount, 1, MemoryTag::KDTree);
+    m_triangleBlockCount = 0;
+    for (int i = 0; i < m_nodeCount; i++) {
+        const KDTreeNode &node = m_nodes[i];
+        if (node.isLeaf() && node.getPrimitiveCount() > 1) {
+            m_leafBlockOffsets[i] = m_triangleBlockCount;
+            m_triangleBlockCount += (node.getPrimitiveCount() + Width - 1) / Width;
+        }
+        else {
+            m_leafBlockOffsets[i] = -1;
+        }
+    }
+
+    if (m_triangleBlockCount == 0) return;
+
+    m_triangleBlocks = StandardAllocator::Global()->allocate<TriangleBlock>(
+        m_triangleBlockCount, (unsigned int)alignof(TriangleBlock), MemoryTag::KDTree);
+    memset(m_triangleBlocks, 0, sizeof(TriangleBlock) * m_triangleBlockCount);
+
+    for (int i = 0; i < m_nodeCount; i++) {
+        if (m_leafBlockOffsets[i] == -1) continue;
+
+        const KDTreeNode &node = m_nodes[i];
+        const int *faceList = &m_faceList[node.getObjectOffset()];
+        const int primitiveCount = node.getPrimitiveCount();
+
+        for (int j = 0; j < primitiveCount; j++) {
+            TriangleBlock &block = m_triangleBlocks[m_leafBlockOffsets[i] + j / Width];
+            const int lane = j % Width;
+            if (lane == 0) {
+                block.faceCount = std::min(Width, primitiveCount - j);
+                for (int k = 0; k < Width; k++) block.faces[k] = -1;
+            }
+
+            const Face *face = m_mesh->getFace(faceList[j]);
+            for (int v = 0; v < 3; v++) {
+                const math::Vector &vertex = *m_mesh->getVertex(face->indices[v]);
+                block.v[v][0][lane] = math::getX(vertex);
+                block.v[v][1][lane] = math::getY(vertex);
+                block.v[v][2][lane] = math::getZ(vertex);
+            }
+
+            block.faces[lane] = faceList[j];
+        }
+    }
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+}
+
+void manta::KDTree::destroyTriangleBlocks() {
+#if KD_TREE_TRIANGLE_BLOCKS
+    if (m_triangleBlocks != nullptr) {
+        StandardAllocator::Global()->aligned_free(m_triangleBlocks, m_triangleBlockCount, MemoryTag::KDTree);
+    }
+
+    if (m_leafBlockOffsets != nullptr) {
+        StandardAllocator::Global()->free(m_leafBlockOffsets, m_nodeCount, MemoryTag::KDTree);
+    }
+
+    m_triangleBlocks = nullptr;
+    m_triangleBlockCount = 0;
+    m_leafBlockOffsets = nullptr;
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
+}
+
+#if KD_TREE_TRIANGLE_BLOCKS
+void manta::KDTree::initializeBlockRay(TriangleBlockRay *ray, const math::Vector &origin,
+    const math::Vector3 &shear, int kx, int ky, int kz) const 
+{
+    ray->origin[0] = math::getX(origin);
+    ray->origin[1] = math::getY(origin);
+    ray->origin[2] = math::getZ(origin);
+    ray->sx = shear.x;
+    ray->sy = shear.y;
+    ray->sz = shear.z;
+    ray->kx = kx;
+    ray->ky = ky;
+    ray->kz = kz;
+}
+
+bool manta::KDTree::intersectLeafBlocks(int node, int primitiveCount, const TriangleBlockRay &ray,
+    math::real minDepth, math::real maxDepth, TriangleBlockHit *hit /**/ STATISTICS_PROTOTYPE) const 
+{
+    if (primitiveCount == 0) return false;
+
+    const TriangleBlock *blocks = &m_triangleBlocks[m_leafBlockOffsets[node]];
+    const int blockCount = (primitiveCount + TRIANGLE_BLOCK_WIDTH - 1) / TRIANGLE_BLOCK_WIDTH;
+
+    bool found = false;
+    math::real currentMaxDepth = maxDepth;
+    for (int i = 0; i < blockCount; i++) {
+        INCREMENT_COUNTER_EXPLICIT(RuntimeStatistics::Counter::TriangleTests, blocks[i].faceCount);
+
+        const int mask = intersectTriangleBlock<TriangleBlockSimd>(blocks[i], ray, minDepth, currentMaxDepth, hit);
+        if (mask == 0) continue;
+        else if (hit == nullptr) return true;
+
+        found = true;
+        currentMaxDepth = hit->depth;
+    }
+
+    return found;
+}
+#endif /* KD_TREE_TRIANGLE_BLOCKS */
@@ -3,9 +3,13 @@
 #include "../include/session.h"
 #include "../include/kd_tree.h"
 #include "../include/console.h"
+#include "../include/path.h"
 
 #include "../include/mesh.h"
 
+#include <iomanip>
+#include <sstream>
+
 manta::KdTreeNode::KdTreeNode() {
     m_kdTree = nullptr;
 
@@ -15,6 +19,9 @@ manta::KdTreeNode::KdTreeNode() {
     m_centerInput = nullptr;
     m_cacheKeyInput = nullptr;
     m_overwriteCacheInput = nullptr;
+    m_parallelBuildInput = nullptr;
+    m_diskCacheInput = nullptr;
+    m_verifyDiskCacheInput = nullptr;
 }
 
 manta::KdTreeNode::~KdTreeNode() {
@@ -32,12 +39,18 @@ void manta::KdTreeNode::_evaluate() {
     piranha::native_int granularity;
     piranha::native_string cacheKey;
     piranha::native_bool overwriteCache;
+    piranha::native_bool parallelBuild;
+    piranha::native_bool diskCache;
+    piranha::native_bool verifyDiskCache;
     math::Vector center;
 
     m_widthInput->fullCompute((void *)&width);
     m_granularityInput->fullCompute((void *)&granularity);
     m_cacheKeyInput->fullCompute((void *)&cacheKey);
     m_overwriteCacheInput->fullCompute((void *)&overwriteCache);
+    m_parallelBuildInput->fullCompute((void *)&parallelBuild);
+    m_diskCacheInput->fullCompute((void *)&diskCache);
+    m_verifyDiskCacheInput->fullCompute((void *)&verifyDiskCache);
     static_cast<VectorNodeOutput *>(m_centerInput)->sample(nullptr, (void *)&center);
 
     m_kdTree = overwriteCache
@@ -47,7 +60,41 @@ void manta::KdTreeNode::_evaluate() {
     if (m_kdTree == nullptr) {
         m_kdTree = new KDTree;
         m_kdTree->configure((math::real)width, center);
-        m_kdTree->analyzeWithProgress(mesh, granularity);
+
+        // The disk cache lives next to the file the mesh was loaded from. Trees built
+        // with different parameters get their own file.
+        std::string cacheFile;
+        if (diskCache && !mesh->getSourcePath().empty()) {
+            const Path meshPath(mesh->getSourcePath());
+            Path parentPath;
+            meshPath.getParentPath(&parentPath);
+
+            std::stringstream name;
+            name << meshPath.getStem() << "." << std::hex << std::setw(16) << std::setfill('0')
+                << m_kdTree->computeBuildHash(granularity) << ".kdcache";
+
+            cacheFile = parentPath.append(name.str()).toString();
+        }
+
+        KDTree::CacheStatus status = KDTree::CacheStatus::Missing;
+        if (!cacheFile.empty() && !overwriteCache) {
+            status = m_kdTree->loadCacheFile(cacheFile.c_str(), mesh, granularity, verifyDiskCache);
+        }
+
+        if (status == KDTree::CacheStatus::Loaded) {
+            manta::Session::get().getConsole()->out("Loaded kd-tree from disk cache: " + cacheFile + "\n");
+        }
+        else {
+            if (status == KDTree::CacheStatus::Stale || status == KDTree::CacheStatus::Corrupt) {
+                manta::Session::get().getConsole()->out("Disk cache is invalid, rebuilding: " + cacheFile + "\n");
+            }
+
+            m_kdTree->analyzeWithProgress(mesh, granularity, parallelBuild);
+
+            if (!cacheFile.empty() && !m_kdTree->writeCacheFile(cacheFile.c_str(), granularity)) {
+                manta::Session::get().getConsole()->out("Could not write disk cache: " + cacheFile + "\n");
+            }
+        }
 
         manta::Session::get().putCachedKdTree(cacheKey, m_kdTree);
     }
@@ -77,5 +124,8 @@ void manta::KdTreeNode::registerInputs() {
     registerInput(&m_granularityInput, "granularity");
     registerInput(&m_cacheKeyInput, "cache_key");
     registerInput(&m_overwriteCacheInput, "overwrite_cache");
+    registerInput(&m_parallelBuildInput, "parallel_build");
+    registerInput(&m_diskCacheInput, "disk_cache");
+    registerInput(&m_verifyDiskCacheInput, "verify_disk_cache");
     registerInput(&m_meshInput, "mesh");
 }
@@ -25,6 +25,8 @@
 #include "../include/lambertian_brdf.h"
 #include "../include/stratified_sampler.h"
 #include "../include/random_sampler.h"
+#include "../include/sobol_sampler.h"
+#include "../include/pmj02_sampler.h"
 #include "../include/standard_camera_ray_emitter_group.h"
 #include "../include/ray_tracer.h"
 #include "../include/image_output_node.h"
@@ -32,6 +34,7 @@
 #include "../include/unary_node.h"
 #include "../include/mesh_merge_node.h"
 #include "../include/sphere_primitive.h"
+#include "../include/geometry_instance.h"
 #include "../include/srgb_node.h"
 #include "../include/image_file_node.h"
 #include "../include/circular_aperture.h"
@@ -210,12 +213,18 @@ void manta::LanguageRules::registerBuiltinNodeTypes() {
         "__mantaray__stratified_sampler");
     registerBuiltinType<RandomSampler>(
         "__mantaray__random_sampler");
+    registerBuiltinType<SobolSampler>(
+        "__mantaray__sobol_sampler");
+    registerBuiltinType<Pmj02Sampler>(
+        "__mantaray__pmj02_sampler");
     registerBuiltinType<StandardCameraRayEmitterGroup>(
         "__mantaray__standard_camera");
     registerBuiltinType<ImageOutputNode>(
         "__mantaray__image_output");
     registerBuiltinType<SpherePrimitive>(
         "__mantaray__sphere");
+    registerBuiltinType<GeometryInstance>(
+        "__mantaray__instance");
     registerBuiltinType<SrgbNode>(
         "__mantaray__srgb");
     registerBuiltinType<ACESFittedNode>(
@@ -6,6 +6,7 @@
 
 manta::LensCameraRayEmitter::LensCameraRayEmitter() {
     m_lens = nullptr;
+    m_differentialsEnabled = true;
 }
 
 manta::LensCameraRayEmitter::~LensCameraRayEmitter() {
@@ -31,4 +32,29 @@ void manta::LensCameraRayEmitter::generateRay(LightRay *ray) const {
         math::Vector2(
             -(p_u.x - (math::real)0.5) + (math::real)m_pixelX,
             (p_u.y - (math::real)0.5) + (math::real)m_pixelY));
+
+    if (!m_differentialsEnabled || !result) {
+        ray->clearDifferentials();
+        return;
+    }
+
+    // Differential rays go through the same point on the aperture. They can't be
+    // cached since both the sensor and aperture points change with every sample.
+    const math::real scale = getDifferentialScale();
+    const math::Vector dxPosition = transformToImagePlane(
+        math::Vector2(p_u.x - (math::real)0.5 + scale, p_u.y - (math::real)0.5));
+    const math::Vector dyPosition = transformToImagePlane(
+        math::Vector2(p_u.x - (math::real)0.5, p_u.y - (math::real)0.5 + scale));
+
+    LightRay dxRay, dyRay;
+    if (m_lens->generateOutgoingRay(dxPosition, &m_lensHint, &dxRay, l_u)
+        && m_lens->generateOutgoingRay(dyPosition, &m_lensHint, &dyRay, l_u))
+    {
+        ray->setDifferentials(
+            dxRay.getSource(), dxRay.getDirection(),
+            dyRay.getSource(), dyRay.getDirection());
+    }
+    else {
+        ray->clearDifferentials();
+    }
 }
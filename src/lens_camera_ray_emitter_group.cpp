@@ -7,6 +7,9 @@ manta::LensCameraRayEmitterGroup::LensCameraRayEmitterGroup() {
     m_lens = nullptr;
     m_xIncrement = (math::real)0;
     m_yIncrement = (math::real)0;
+    m_rayDifferentials = true;
+
+    m_rayDifferentialsInput = nullptr;
 }
 
 manta::LensCameraRayEmitterGroup::~LensCameraRayEmitterGroup() {
@@ -48,6 +51,7 @@ manta::CameraRayEmitter *manta::LensCameraRayEmitterGroup::
     newEmitter->setUp(m_lens->getSensorUp());
     newEmitter->setPixelIncrement(math::Vector2(m_xIncrement, m_yIncrement));
     newEmitter->setImagePlaneCoordinates(ix, iy);
+    newEmitter->setDifferentialsEnabled(m_rayDifferentials);
 
     return (CameraRayEmitter *)newEmitter;
 }
@@ -59,7 +63,11 @@ void manta::LensCameraRayEmitterGroup::_initialize() {
 void manta::LensCameraRayEmitterGroup::_evaluate() {
     const Lens *lens = getObject<Lens>(m_lensInput);
 
+    bool rayDifferentials;
+    m_rayDifferentialsInput->fullCompute((void *)&rayDifferentials);
+
     setLens(lens);
+    setRayDifferentials(rayDifferentials);
     setOutput(this);
 
     configure();
@@ -71,4 +79,5 @@ void manta::LensCameraRayEmitterGroup::_destroy() {
 
 void manta::LensCameraRayEmitterGroup::registerInputs() {
     registerInput(&m_lensInput, "lens");
+    registerInput(&m_rayDifferentialsInput, "ray_differentials");
 }
@@ -26,6 +26,18 @@ bool manta::Light::intersect(const math::Vector &src, const math::Vector &dir, m
     return false;
 }
 
+bool manta::Light::getBounds(AABB *bounds) const {
+    return false;
+}
+
+manta::math::real manta::Light::getPower() const {
+    return (math::real)1.0;
+}
+
+bool manta::Light::getLightBounds(LightBounds *bounds) const {
+    return false;
+}
+
 void manta::Light::_evaluate() {
     piranha::native_string name;
     m_nameInput->fullCompute((void *)&name);
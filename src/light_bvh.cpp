@@ -0,0 +1,364 @@
+#include "../include/light_bvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace manta {
+
+    static const math::real OneMinusEpsilon = std::nextafter((math::real)1.0, (math::real)0.0);
+
+    inline math::real safeSqrt(math::real x) {
+        return std::sqrt(std::max(x, (math::real)0.0));
+    }
+
+    inline math::real safeAcos(math::real x) {
+        return std::acos(std::min(std::max(x, (math::real)-1.0), (math::real)1.0));
+    }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+    inline math::real cosSubClamped(math::real sin_a, math::real cos_a, math::real sin_b, math::real cos_b) {
+        if (cos_a > cos_b) return (math::real)1.0;
+        else return cos_a * cos_b + sin_a * sin_b;
+    }
+
+    inline math::real sinSubClamped(math::real sin_a, math::real cos_a, math::real sin_b, math::real cos_b) {
+        if (cos_a > cos_b) return (math::real)0.0;
+        else return sin_a * cos_b - cos_a * sin_b;
+    }
+
+    // Rotates v by theta around the unit axis k (Rodrigues' formula)
+    inline math::Vector rotate(const math::Vector &v, const math::Vector &k, math::real theta) {
+        const math::real c = std::cos(theta), s = std::sin(theta);
+        return math::add(
+            math::add(
+                math::mul(v, math::loadScalar(c)),
+                math::mul(math::cross(k, v), math::loadScalar(s))),
+            math::mul(k, math::mul(math::dot(k, v), math::loadScalar(1 - c))));
+    }
+
+} /* namespace manta */
+
+manta::math::real manta::LightBounds::importance(const math::Vector &p, const math::Vector &n) const {
+    const math::Vector center = math::mul(math::add(bounds.minPoint, bounds.maxPoint), math::loadScalar((math::real)0.5));
+    const math::Vector d = math::sub(p, center);
+    const math::real radius = (math::real)0.5 * math::getScalar(math::magnitude(math::sub(bounds.maxPoint, bounds.minPoint)));
+
+    // Distances are clamped so that points inside the bounds don't blow up
+    const math::real centerDistanceSquared = math::getScalar(math::magnitudeSquared3(d));
+    const math::real distanceSquared = std::max(centerDistanceSquared, radius);
+
+    // Any direction can reach a point inside the bounding sphere
+    if (centerDistanceSquared <= radius * radius) return phi / distanceSquared;
+
+    const math::Vector wi = math::normalize(d);
+
+    math::real cosTheta_w = math::getScalar(math::dot(w, wi));
+    if (twoSided) cosTheta_w = std::abs(cosTheta_w);
+    const math::real sinTheta_w = safeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    // Cone of directions subtended by the bounding sphere as seen from p
+    const math::real cosTheta_b = safeSqrt(1 - radius * radius / centerDistanceSquared);
+    const math::real sinTheta_b = safeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // Smallest angle between wi and any emitting normal, minus the spread of the bounds
+    const math::real sinTheta_o = safeSqrt(1 - cosTheta_o * cosTheta_o);
+    const math::real cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    const math::real sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    const math::real cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= cosTheta_e) return 0;
+
+    math::real result = phi * cosThetap / distanceSquared;
+
+    // Incident cosine at the receiver
+    if (math::getScalar(math::magnitudeSquared3(n)) > 0) {
+        const math::real cosTheta_i = std::abs(math::getScalar(math::dot(wi, n)));
+        const math::real sinTheta_i = safeSqrt(1 - cosTheta_i * cosTheta_i);
+        result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+
+    return std::max(result, (math::real)0.0);
+}
+
+manta::LightBounds manta::LightBounds::merge(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0) return b;
+    else if (b.phi == 0) return a;
+
+    LightBounds result;
+    result.bounds = a.bounds;
+    result.bounds.merge(b.bounds);
+    result.phi = a.phi + b.phi;
+    result.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+    result.twoSided = a.twoSided || b.twoSided;
+
+    // Smallest cone that contains both emission cones
+    const math::real theta_a = safeAcos(a.cosTheta_o);
+    const math::real theta_b = safeAcos(b.cosTheta_o);
+    const math::real theta_d = safeAcos(math::getScalar(math::dot(a.w, b.w)));
+
+    if (std::min(theta_d + theta_b, math::constants::PI) <= theta_a) {
+        result.w = a.w;
+        result.cosTheta_o = a.cosTheta_o;
+        return result;
+    }
+    else if (std::min(theta_d + theta_a, math::constants::PI) <= theta_b) {
+        result.w = b.w;
+        result.cosTheta_o = b.cosTheta_o;
+        return result;
+    }
+
+    const math::real theta_o = (theta_a + theta_d + theta_b) / 2;
+    const math::Vector axis = math::cross(a.w, b.w);
+    if (theta_o >= math::constants::PI || math::getScalar(math::magnitudeSquared3(axis)) == 0) {
+        result.w = a.w;
+        result.cosTheta_o = (math::real)-1.0;
+        return result;
+    }
+
+    result.w = math::normalize(rotate(a.w, math::normalize(axis), theta_o - theta_a));
+    result.cosTheta_o = std::cos(theta_o);
+
+    return result;
+}
+
+manta::LightBVH::LightBVH() {
+    /* void */
+}
+
+manta::LightBVH::~LightBVH() {
+    /* void */
+}
+
+void manta::LightBVH::build(const LightBounds *lights, int count) {
+    destroy();
+
+    m_bitTrails.resize(count, 0);
+
+    std::vector<BuildEntry> entries;
+    for (int i = 0; i < count; i++) {
+        if (lights[i].phi <= 0) continue;
+
+        BuildEntry entry;
+        entry.bounds = lights[i];
+        entry.centroid = math::mul(
+            math::add(lights[i].bounds.minPoint, lights[i].bounds.maxPoint), math::loadScalar((math::real)0.5));
+        entry.light = i;
+        entries.push_back(entry);
+    }
+
+    if (entries.empty()) return;
+
+    m_nodes.reserve(2 * entries.size());
+    buildNode(entries, 0, (int)entries.size(), 0, 0);
+}
+
+void manta::LightBVH::destroy() {
+    m_nodes.clear();
+    m_bitTrails.clear();
+}
+
+int manta::LightBVH::sample(const math::Vector &p, const math::Vector &n, math::real u, math::real *pmf) const {
+    *pmf = 0;
+    if (m_nodes.empty()) return -1;
+
+    math::real nodePmf = 1;
+    int nodeIndex = 0;
+    while (!m_nodes[nodeIndex].leaf) {
+        const LightBVHNode &node = m_nodes[nodeIndex];
+        const math::real c0 = m_nodes[nodeIndex + 1].bounds.importance(p, n);
+        const math::real c1 = m_nodes[node.offset].bounds.importance(p, n);
+        if (c0 == 0 && c1 == 0) return -1;
+
+        // u is remapped to [0, 1) so that it can be reused further down
+        const math::real p0 = c0 / (c0 + c1);
+        if (u < p0) {
+            u = std::min(u / p0, OneMinusEpsilon);
+            nodePmf *= p0;
+            nodeIndex = nodeIndex + 1;
+        }
+        else {
+            u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+            nodePmf *= 1 - p0;
+            nodeIndex = node.offset;
+        }
+    }
+
+    // A single light at the root is only tested here
+    if (nodeIndex == 0 && m_nodes[0].bounds.importance(p, n) == 0) return -1;
+
+    *pmf = nodePmf;
+    return m_nodes[nodeIndex].offset;
+}
+
+manta::math::real manta::LightBVH::pmf(const math::Vector &p, const math::Vector &n, int light) const {
+    if (m_nodes.empty() || light < 0 || light >= (int)m_bitTrails.size()) return 0;
+
+    unsigned __int64 bitTrail = m_bitTrails[light];
+    math::real nodePmf = 1;
+    int nodeIndex = 0;
+    while (!m_nodes[nodeIndex].leaf) {
+        const LightBVHNode &node = m_nodes[nodeIndex];
+        const math::real c0 = m_nodes[nodeIndex + 1].bounds.importance(p, n);
+        const math::real c1 = m_nodes[node.offset].bounds.importance(p, n);
+        if (c0 == 0 && c1 == 0) return 0;
+
+        if ((bitTrail & 0x1) == 0) {
+            nodePmf *= c0 / (c0 + c1);
+            nodeIndex = nodeIndex + 1;
+        }
+        else {
+            nodePmf *= c1 / (c0 + c1);
+            nodeIndex = node.offset;
+        }
+
+        bitTrail >>= 1;
+    }
+
+    // Lights without power are not part of the tree
+    if (m_nodes[nodeIndex].offset != light) return 0;
+    if (nodeIndex == 0 && m_nodes[0].bounds.importance(p, n) == 0) return 0;
+
+    return nodePmf;
+}
+
+int manta::LightBVH::buildNode(
+    std::vector<BuildEntry> &entries, int start, int end, unsigned __int64 bitTrail, int depth)
+{
+    const int nodeIndex = (int)m_nodes.size();
+    m_nodes.push_back(LightBVHNode());
+
+    if (end - start == 1) {
+        m_nodes[nodeIndex].bounds = entries[start].bounds;
+        m_nodes[nodeIndex].offset = entries[start].light;
+        m_nodes[nodeIndex].leaf = true;
+        m_bitTrails[entries[start].light] = bitTrail;
+
+        return nodeIndex;
+    }
+
+    LightBounds bounds = entries[start].bounds;
+    AABB centroidBounds;
+    centroidBounds.minPoint = centroidBounds.maxPoint = entries[start].centroid;
+    for (int i = start + 1; i < end; i++) {
+        bounds = LightBounds::merge(bounds, entries[i].bounds);
+        centroidBounds.minPoint = math::componentMin(centroidBounds.minPoint, entries[i].centroid);
+        centroidBounds.maxPoint = math::componentMax(centroidBounds.maxPoint, entries[i].centroid);
+    }
+
+    // The bit trail only has room for 64 levels, once a balanced split is the only way
+    // to stay within that the heuristic is skipped
+    int balancedDepth = depth;
+    for (int count = end - start; count > 1; count = (count + 1) / 2) balancedDepth++;
+
+    int mid = (balancedDepth < MaxDepth - 1)
+        ? findSplit(entries, start, end, bounds, centroidBounds)
+        : -1;
+    if (mid == -1) mid = (start + end) / 2;
+
+    m_nodes[nodeIndex].bounds = bounds;
+    m_nodes[nodeIndex].leaf = false;
+
+    buildNode(entries, start, mid, bitTrail, depth + 1);
+    const int secondChild = buildNode(entries, mid, end, bitTrail | (1ull << depth), depth + 1);
+    m_nodes[nodeIndex].offset = secondChild;
+
+    return nodeIndex;
+}
+
+int manta::LightBVH::findSplit(
+    std::vector<BuildEntry> &entries, int start, int end, const LightBounds &bounds,
+    const AABB &centroidBounds)
+{
+    // Binned surface area orientation heuristic, every axis is tried
+    struct Bucket {
+        int count;
+        LightBounds bounds;
+    };
+
+    math::real minCost = math::constants::REAL_MAX;
+    int minCostAxis = -1, minCostBucket = -1;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const math::real cmin = math::get(centroidBounds.minPoint, axis);
+        const math::real cmax = math::get(centroidBounds.maxPoint, axis);
+        if (cmax == cmin) continue;
+
+        Bucket buckets[BucketCount];
+        for (int i = 0; i < BucketCount; i++) buckets[i].count = 0;
+
+        const math::real scale = BucketCount / (cmax - cmin);
+        for (int i = start; i < end; i++) {
+            int b = (int)((math::get(entries[i].centroid, axis) - cmin) * scale);
+            b = std::min(b, BucketCount - 1);
+
+            if (buckets[b].count == 0) buckets[b].bounds = entries[i].bounds;
+            else buckets[b].bounds = LightBounds::merge(buckets[b].bounds, entries[i].bounds);
+            buckets[b].count++;
+        }
+
+        for (int i = 0; i < BucketCount - 1; i++) {
+            LightBounds b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int j = 0; j <= i; j++) {
+                if (buckets[j].count == 0) continue;
+                b0 = (count0 == 0) ? buckets[j].bounds : LightBounds::merge(b0, buckets[j].bounds);
+                count0 += buckets[j].count;
+            }
+
+            for (int j = i + 1; j < BucketCount; j++) {
+                if (buckets[j].count == 0) continue;
+                b1 = (count1 == 0) ? buckets[j].bounds : LightBounds::merge(b1, buckets[j].bounds);
+                count1 += buckets[j].count;
+            }
+
+            if (count0 == 0 || count1 == 0) continue;
+
+            const math::real splitCost = cost(b0, bounds.bounds, axis) + cost(b1, bounds.bounds, axis);
+            if (splitCost < minCost) {
+                minCost = splitCost;
+                minCostAxis = axis;
+                minCostBucket = i;
+            }
+        }
+    }
+
+    if (minCostAxis == -1) return -1;
+
+    const int axis = minCostAxis;
+    const math::real cmin = math::get(centroidBounds.minPoint, axis);
+    const math::real scale = BucketCount / (math::get(centroidBounds.maxPoint, axis) - cmin);
+
+    BuildEntry *midEntry = std::partition(
+        entries.data() + start, entries.data() + end,
+        [=](const BuildEntry &entry) {
+            int b = (int)((math::get(entry.centroid, axis) - cmin) * scale);
+            b = std::min(b, BucketCount - 1);
+            return b <= minCostBucket;
+        });
+
+    const int mid = (int)(midEntry - entries.data());
+    return (mid == start || mid == end)
+        ? -1
+        : mid;
+}
+
+manta::math::real manta::LightBVH::cost(const LightBounds &bounds, const AABB &nodeBounds, int axis) {
+    // Solid angle measure of the emission cone widened by the emission spread
+    const math::real theta_o = safeAcos(bounds.cosTheta_o);
+    const math::real theta_e = safeAcos(bounds.cosTheta_e);
+    const math::real theta_w = std::min(theta_o + theta_e, math::constants::PI);
+    const math::real sinTheta_o = safeSqrt(1 - bounds.cosTheta_o * bounds.cosTheta_o);
+    const math::real M_omega =
+        2 * math::constants::PI * (1 - bounds.cosTheta_o) +
+        math::constants::PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+            2 * theta_o * sinTheta_o + bounds.cosTheta_o);
+
+    // Thin slabs are penalized when split along their short axis
+    const math::Vector diagonal = math::sub(nodeBounds.maxPoint, nodeBounds.minPoint);
+    const math::real extent = math::get(diagonal, axis);
+    const math::real Kr = (extent > 0)
+        ? std::max(std::max(math::getX(diagonal), math::getY(diagonal)), math::getZ(diagonal)) / extent
+        : (math::real)1.0;
+
+    AABB lightBounds = bounds.bounds;
+    return bounds.phi * M_omega * Kr * lightBounds.surfaceArea();
+}
@@ -11,6 +11,10 @@ manta::LightRay::LightRay() {
     m_permutedDirection = math::constants::Zero;
     m_source = math::constants::Zero;
 
+    m_hasDifferentials = false;
+    m_dxSource = m_dySource = math::constants::Zero;
+    m_dxDirection = m_dyDirection = math::constants::Zero;
+
     resetCache();
 }
 
@@ -18,6 +22,17 @@ manta::LightRay::~LightRay() {
     /* void */
 }
 
+void manta::LightRay::setDifferentials(
+    const math::Vector &dxSource, const math::Vector &dxDirection,
+    const math::Vector &dySource, const math::Vector &dyDirection)
+{
+    m_dxSource = dxSource;
+    m_dxDirection = dxDirection;
+    m_dySource = dySource;
+    m_dyDirection = dyDirection;
+    m_hasDifferentials = true;
+}
+
 void manta::LightRay::calculateTransformations() {
     m_kz = math::maxDimension3(math::abs(m_direction));
     m_kx = (m_kz + 1) % 3;
@@ -0,0 +1,123 @@
+#include "../include/light_sampler.h"
+
+#include "../include/light.h"
+
+#include <algorithm>
+#include <cmath>
+
+manta::LightSampler::LightSampler() {
+    m_strategy = Strategy::Uniform;
+    m_unboundedProbability = 0;
+}
+
+manta::LightSampler::~LightSampler() {
+    /* void */
+}
+
+void manta::LightSampler::build(Light *const *lights, int lightCount, Strategy strategy) {
+    destroy();
+
+    m_strategy = strategy;
+
+    for (int i = 0; i < lightCount; i++) {
+        m_lights.push_back(lights[i]);
+        m_lightIndices[lights[i]] = i;
+    }
+
+    if (strategy == Strategy::Power) {
+        std::vector<math::real> power(lightCount);
+        for (int i = 0; i < lightCount; i++) {
+            power[i] = m_lights[i]->getPower();
+        }
+
+        m_powerTable.build(power.data(), lightCount);
+    }
+    else if (strategy == Strategy::Spatial) {
+        std::vector<LightBounds> bounds(lightCount);
+        m_unboundedIndices.resize(lightCount, -1);
+        for (int i = 0; i < lightCount; i++) {
+            if (!m_lights[i]->getLightBounds(&bounds[i])) {
+                // Left out of the BVH
+                bounds[i].phi = 0;
+
+                m_unboundedIndices[i] = (int)m_unbounded.size();
+                m_unbounded.push_back(i);
+            }
+        }
+
+        m_bvh.build(bounds.data(), lightCount);
+
+        // The BVH as a whole is picked as often as any one unbounded light
+        const int choices = (int)m_unbounded.size() + (m_bvh.isEmpty() ? 0 : 1);
+        m_unboundedProbability = (choices > 0)
+            ? (math::real)m_unbounded.size() / choices
+            : (math::real)0.0;
+    }
+}
+
+void manta::LightSampler::destroy() {
+    m_lights.clear();
+    m_lightIndices.clear();
+    m_powerTable.destroy();
+    m_bvh.destroy();
+    m_unbounded.clear();
+    m_unboundedIndices.clear();
+    m_unboundedProbability = 0;
+}
+
+const manta::Light *manta::LightSampler::sample(
+    const math::Vector &p, const math::Vector &n, math::real u, math::real *pmf) const
+{
+    *pmf = 0;
+
+    const int lightCount = (int)m_lights.size();
+    if (lightCount == 0) return nullptr;
+
+    if (m_strategy == Strategy::Uniform) {
+        *pmf = (math::real)1.0 / lightCount;
+        return m_lights[std::min((int)(u * lightCount), lightCount - 1)];
+    }
+    else if (m_strategy == Strategy::Power) {
+        const int index = m_powerTable.sample(u, pmf);
+        return (*pmf > 0) ? m_lights[index] : nullptr;
+    }
+    else {
+        if (u < m_unboundedProbability) {
+            const int unboundedCount = (int)m_unbounded.size();
+            const int index = std::min((int)(u / m_unboundedProbability * unboundedCount), unboundedCount - 1);
+
+            *pmf = m_unboundedProbability / unboundedCount;
+            return m_lights[m_unbounded[index]];
+        }
+
+        const math::real uBvh = std::min(
+            (u - m_unboundedProbability) / (1 - m_unboundedProbability),
+            std::nextafter((math::real)1.0, (math::real)0.0));
+
+        math::real bvhPmf;
+        const int index = m_bvh.sample(p, n, uBvh, &bvhPmf);
+        if (index == -1) return nullptr;
+
+        *pmf = bvhPmf * (1 - m_unboundedProbability);
+        return m_lights[index];
+    }
+}
+
+manta::math::real manta::LightSampler::pmf(const math::Vector &p, const math::Vector &n, const Light *light) const {
+    auto index = m_lightIndices.find(light);
+    if (index == m_lightIndices.end()) return 0;
+
+    if (m_strategy == Strategy::Uniform) {
+        return (math::real)1.0 / m_lights.size();
+    }
+    else if (m_strategy == Strategy::Power) {
+        return m_powerTable.pmf(index->second);
+    }
+    else {
+        if (m_unboundedIndices[index->second] != -1) {
+            return m_unboundedProbability / m_unbounded.size();
+        }
+
+        return m_bvh.pmf(p, n, index->second) * (1 - m_unboundedProbability);
+    }
+}
@@ -4,25 +4,30 @@
 #if MANTA_PRECISION == MANTA_PRECISION_FLOAT
 
 #include "../include/manta_math.h"
+#include "../include/counter_rng.h"
 
 #include <math.h>
-#include <random>
 
 namespace math = manta::math;
 
+static thread_local manta::CounterRng t_randomStream = { 0, 0, 0 };
+
 manta::math::real manta::math::get(const Vector &v, int index) {
     return v.m128_f32[index];
 }
 
+void manta::math::seedRandom(unsigned int key) {
+    t_randomStream.seed(key);
+}
+
 math::Vector manta::math::uniformRandom4(real range) {
-    real r = (rand() % RAND_MAX) / ((real)(RAND_MAX - 1));
+    real r = t_randomStream.next() * 0x1p-32f;
     return loadScalar(range * r);
 }
 
 math::real manta::math::uniformRandom(real range) {
     static constexpr math::real MAX_RAND = 0.9999f;
-    //return 0.5f;
-    real r = (rand() % RAND_MAX) / ((real)(RAND_MAX - 1));
+    real r = t_randomStream.next() * 0x1p-32f;
 
     // Limit the random number such that it is less than 1
     // This approach will be made more robust in future versions
@@ -34,8 +39,7 @@ math::real manta::math::uniformRandom(real range) {
 }
 
 int manta::math::uniformRandomInt(int range) {
-    //return 5 % range;
-    return rand() % range;
+    return (int)(t_randomStream.next() % (unsigned int)range);
 }
 
 math::Generic math::loadScalar(real s) {
@@ -3,9 +3,12 @@
 #if MANTA_USE_SIMD == false
 
 #include <manta_math.h>
+#include "../include/counter_rng.h"
 
 namespace math = manta::math;
 
+static thread_local manta::CounterRng t_randomStream = { 0, 0, 0 };
+
 math::Generic math::loadScalar(math::real s) {
     return { s, s, s, s };
 }
@@ -199,13 +202,17 @@ math::Vector math::quatTransform(const Quaternion &q, const Vector &vec) {
     return { transformed.qx, transformed.qy, transformed.qz, transformed.qw };
 }
 
+void math::seedRandom(unsigned int key) {
+    t_randomStream.seed(key);
+}
+
 math::Vector math::uniformRandom4(math::real range) {
-    real r = (rand() % RAND_MAX) / ((real)(RAND_MAX - 1));
+    real r = (real)(t_randomStream.next() * (1.0 / 4294967296.0));
     return loadScalar(r * range);
 }
 
 math::real math::uniformRandom(math::real range) {
-    real r = (rand() % RAND_MAX) / ((real)(RAND_MAX - 1));
+    real r = (real)(t_randomStream.next() * (1.0 / 4294967296.0));
     return r * range;
 }
 
@@ -0,0 +1,118 @@
+#include "../include/memory_mapped_file.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+
+manta::MemoryMappedFile::MemoryMappedFile() {
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+
+    m_fileHandle = nullptr;
+    m_mappingHandle = nullptr;
+}
+
+manta::MemoryMappedFile::~MemoryMappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool manta::MemoryMappedFile::open(const char *fname) {
+    close();
+
+    HANDLE file = CreateFile(fname, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // Empty files can't be mapped
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        m_open = true;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_fileHandle = (void *)file;
+    m_mappingHandle = (void *)mapping;
+    m_data = data;
+    m_size = (mem_size)size.QuadPart;
+    m_open = true;
+
+    return true;
+}
+
+void manta::MemoryMappedFile::close() {
+    if (m_data != nullptr) UnmapViewOfFile(m_data);
+    if (m_mappingHandle != nullptr) CloseHandle((HANDLE)m_mappingHandle);
+    if (m_fileHandle != nullptr) CloseHandle((HANDLE)m_fileHandle);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+    m_fileHandle = nullptr;
+    m_mappingHandle = nullptr;
+}
+#else
+bool manta::MemoryMappedFile::open(const char *fname) {
+    close();
+
+    const int file = ::open(fname, O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        ::close(file);
+        return false;
+    }
+
+    // Empty files can't be mapped
+    if (info.st_size == 0) {
+        ::close(file);
+        m_open = true;
+        return true;
+    }
+
+    void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    ::close(file);
+
+    if (data == MAP_FAILED) return false;
+
+    m_data = data;
+    m_size = (mem_size)info.st_size;
+    m_open = true;
+
+    return true;
+}
+
+void manta::MemoryMappedFile::close() {
+    if (m_data != nullptr) munmap(m_data, (size_t)m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+#endif /* _WIN32 */
@@ -11,6 +11,17 @@
 #include "../include/runtime_statistics.h"
 
 #include <map>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+
+namespace manta {
+
+    constexpr char MeshCacheMagic[8] = { 'M', 'R', 'M', 'E', 'S', 'H', '0', '0' };
+    static_assert(sizeof(MeshCacheHeader) <= Mesh::CacheHeaderSize, "Cache header does not fit");
+
+} /* namespace manta */
 
 manta::Mesh::Mesh() {
     CHECK_ALIGNMENT(this, 16);
@@ -24,6 +35,9 @@ manta::Mesh::Mesh() {
     m_vertices = nullptr;
     m_normals = nullptr;
     m_textureCoords = nullptr;
+    m_materialMap = nullptr;
+    m_materials = nullptr;
+    m_materialCount = 0;
 
 #if ENABLE_FACE_AABB
     m_faceBounds = nullptr;
@@ -59,15 +73,15 @@ void manta::Mesh::initialize(int faceCount, int vertexCount, int normalCount, in
     // By default assume there are no quads in the mesh
     m_quadFaces = nullptr;
     m_auxQuadFaceData = nullptr;
-    m_faces = StandardAllocator::Global()->allocate<Face>(faceCount);
-    m_auxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(faceCount);
-    m_vertices = StandardAllocator::Global()->allocate<math::Vector>(vertexCount, 16);
-    m_materialMap = StandardAllocator::Global()->allocate<int>(faceCount);
+    m_faces = StandardAllocator::Global()->allocate<Face>(faceCount, 1, MemoryTag::Mesh);
+    m_auxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(faceCount, 1, MemoryTag::Mesh);
+    m_vertices = StandardAllocator::Global()->allocate<math::Vector>(vertexCount, 16, MemoryTag::Mesh);
+    m_materialMap = StandardAllocator::Global()->allocate<int>(faceCount, 1, MemoryTag::Mesh);
     m_normals = (normalCount > 0)
-        ? StandardAllocator::Global()->allocate<math::Vector>(normalCount, 16)
+        ? StandardAllocator::Global()->allocate<math::Vector>(normalCount, 16, MemoryTag::Mesh)
         : nullptr;
     m_textureCoords = (texCoordCount > 0)
-        ? StandardAllocator::Global()->allocate<math::Vector>(texCoordCount, 16)
+        ? StandardAllocator::Global()->allocate<math::Vector>(texCoordCount, 16, MemoryTag::Mesh)
         : nullptr;
 
     m_quadFaceCount = 0;
@@ -78,19 +92,23 @@ void manta::Mesh::initialize(int faceCount, int vertexCount, int normalCount, in
 }
 
 void manta::Mesh::destroy() {
-    if (m_faces != nullptr) StandardAllocator::Global()->free(m_faces, m_triangleFaceCount);
-    if (m_auxFaceData != nullptr) StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount);
-    if (m_quadFaces != nullptr) StandardAllocator::Global()->free(m_quadFaces, m_quadFaceCount);
-    if (m_auxQuadFaceData != nullptr) StandardAllocator::Global()->free(m_auxQuadFaceData, m_quadFaceCount);
-    if (m_vertices != nullptr) StandardAllocator::Global()->aligned_free(m_vertices, m_vertexCount);
-    if (m_normals != nullptr) StandardAllocator::Global()->aligned_free(m_normals, m_normalCount);
-    if (m_textureCoords != nullptr) StandardAllocator::Global()->aligned_free(m_textureCoords, m_texCoordCount);
+    // Arrays that point into the binary cache are released with the mapping
+    if (m_faces != nullptr && !isInCacheFile(m_faces)) StandardAllocator::Global()->free(m_faces, m_triangleFaceCount, MemoryTag::Mesh);
+    if (m_auxFaceData != nullptr && !isInCacheFile(m_auxFaceData)) StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount, MemoryTag::Mesh);
+    if (m_quadFaces != nullptr) StandardAllocator::Global()->free(m_quadFaces, m_quadFaceCount, MemoryTag::Mesh);
+    if (m_auxQuadFaceData != nullptr) StandardAllocator::Global()->free(m_auxQuadFaceData, m_quadFaceCount, MemoryTag::Mesh);
+    if (m_vertices != nullptr && !isInCacheFile(m_vertices)) StandardAllocator::Global()->aligned_free(m_vertices, m_vertexCount, MemoryTag::Mesh);
+    if (m_normals != nullptr && !isInCacheFile(m_normals)) StandardAllocator::Global()->aligned_free(m_normals, m_normalCount, MemoryTag::Mesh);
+    if (m_textureCoords != nullptr && !isInCacheFile(m_textureCoords)) StandardAllocator::Global()->aligned_free(m_textureCoords, m_texCoordCount, MemoryTag::Mesh);
 
 #if ENABLE_FACE_AABB
-    if (m_faceBounds != nullptr) StandardAllocator::Global()->free(m_faceBounds, m_triangleFaceCount);
+    if (m_faceBounds != nullptr) StandardAllocator::Global()->free(m_faceBounds, m_triangleFaceCount, MemoryTag::Mesh);
     m_faceBounds = nullptr;
 #endif /* ENABLE_FACE_AABB */
 
+    if (isInCacheFile(m_materialMap)) m_materialMap = nullptr;
+    m_cacheFile.close();
+
     m_faces = nullptr;
     m_auxFaceData = nullptr;
     m_quadFaces = nullptr;
@@ -117,18 +135,18 @@ void manta::Mesh::filterDegenerateFaces() {
         }
     }
 
-    Face *newFaces = StandardAllocator::Global()->allocate<Face>(actualFaceCount);
-    AuxFaceData *newAuxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(actualFaceCount);
-    int *newMaterialMap = StandardAllocator::Global()->allocate<int>(actualFaceCount);
+    Face *newFaces = StandardAllocator::Global()->allocate<Face>(actualFaceCount, 1, MemoryTag::Mesh);
+    AuxFaceData *newAuxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(actualFaceCount, 1, MemoryTag::Mesh);
+    int *newMaterialMap = StandardAllocator::Global()->allocate<int>(actualFaceCount, 1, MemoryTag::Mesh);
     for (int i = 0; i < actualFaceCount; i++) {
         newFaces[i] = m_faces[i];
         newAuxFaceData[i] = m_auxFaceData[i];
         newMaterialMap[i] = m_materialMap[i];
     }
 
-    StandardAllocator::Global()->free(m_faces, m_triangleFaceCount);
-    StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount);
-    StandardAllocator::Global()->free(m_materialMap, m_triangleFaceCount);
+    if (!isInCacheFile(m_faces)) StandardAllocator::Global()->free(m_faces, m_triangleFaceCount, MemoryTag::Mesh);
+    if (!isInCacheFile(m_auxFaceData)) StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount, MemoryTag::Mesh);
+    if (!isInCacheFile(m_materialMap)) StandardAllocator::Global()->free(m_materialMap, m_triangleFaceCount, MemoryTag::Mesh);
 
     m_faces = newFaces;
     m_auxFaceData = newAuxFaceData;
@@ -154,7 +172,7 @@ void manta::Mesh::findQuads() {
     std::vector<NewQuad> newQuads;
 
     int originalTriangleCount = m_triangleFaceCount;
-    bool *usedFlags = StandardAllocator::Global()->allocate<bool>(m_triangleFaceCount);
+    bool *usedFlags = StandardAllocator::Global()->allocate<bool>(m_triangleFaceCount, 1, MemoryTag::Mesh);
 
     for (int i = 0; i < m_vertexCount; i++) {
         adj.push_back(std::vector<int>());
@@ -246,8 +264,8 @@ void manta::Mesh::findQuads() {
     // Generate new quadfaces
     m_quadFaceCount = (int)newQuads.size();
 
-    m_quadFaces = StandardAllocator::Global()->allocate<QuadFace>(m_quadFaceCount);
-    m_auxQuadFaceData = StandardAllocator::Global()->allocate<QuadAuxFaceData>(m_quadFaceCount);
+    m_quadFaces = StandardAllocator::Global()->allocate<QuadFace>(m_quadFaceCount, 1, MemoryTag::Mesh);
+    m_auxQuadFaceData = StandardAllocator::Global()->allocate<QuadAuxFaceData>(m_quadFaceCount, 1, MemoryTag::Mesh);
 
     for (int i = 0; i < m_quadFaceCount; i++) {
         NewQuad &w = newQuads[i];
@@ -301,25 +319,25 @@ void manta::Mesh::findQuads() {
 #endif /* ENABLE_FACE_AABB */
 
     m_triangleFaceCount = (int)newTrianglesTemp.size();
-    Face *newFaces = StandardAllocator::Global()->allocate<Face>(m_triangleFaceCount);
-    AuxFaceData *newAuxData = StandardAllocator::Global()->allocate<AuxFaceData>(m_triangleFaceCount);
+    Face *newFaces = StandardAllocator::Global()->allocate<Face>(m_triangleFaceCount, 1, MemoryTag::Mesh);
+    AuxFaceData *newAuxData = StandardAllocator::Global()->allocate<AuxFaceData>(m_triangleFaceCount, 1, MemoryTag::Mesh);
 
     for (int i = 0; i < m_triangleFaceCount; i++) {
         newFaces[i] = newTrianglesTemp[i];
         newAuxData[i] = newAuxFaceDataTemp[i];
     }
 
-    StandardAllocator::Global()->free(m_faces, originalTriangleCount);
-    StandardAllocator::Global()->free(m_auxFaceData, originalTriangleCount);
+    if (!isInCacheFile(m_faces)) StandardAllocator::Global()->free(m_faces, originalTriangleCount, MemoryTag::Mesh);
+    if (!isInCacheFile(m_auxFaceData)) StandardAllocator::Global()->free(m_auxFaceData, originalTriangleCount, MemoryTag::Mesh);
 
 #if ENABLE_FACE_AABB
-    AABB *newFaceBounds = StandardAllocator::Global()->allocate<AABB>(m_triangleFaceCount);
+    AABB *newFaceBounds = StandardAllocator::Global()->allocate<AABB>(m_triangleFaceCount, 1, MemoryTag::Mesh);
 
     for (int i = 0; i < m_triangleFaceCount; i++) {
         newFaceBounds[i] = newFaceBoundsTemp[i];
     }
 
-    StandardAllocator::Global()->free(m_faceBounds, originalTriangleCount);
+    StandardAllocator::Global()->free(m_faceBounds, originalTriangleCount, MemoryTag::Mesh);
     m_faceBounds = newFaceBounds;
 #endif /* ENABLE_FACE_AABB */
 
@@ -327,12 +345,12 @@ void manta::Mesh::findQuads() {
     m_auxFaceData = newAuxData;
 
     // Clean up temporary memory
-    StandardAllocator::Global()->free(usedFlags, originalTriangleCount);
+    StandardAllocator::Global()->free(usedFlags, originalTriangleCount, MemoryTag::Mesh);
 }
 
 #if ENABLE_FACE_AABB
 void manta::Mesh::computeBounds() {
-    m_faceBounds = StandardAllocator::Global()->allocate<AABB>(m_triangleFaceCount);
+    m_faceBounds = StandardAllocator::Global()->allocate<AABB>(m_triangleFaceCount, 1, MemoryTag::Mesh);
 
     for (int i = 0; i < m_triangleFaceCount; i++) {
         int face = i;
@@ -390,6 +408,37 @@ bool manta::Mesh::findClosestIntersection(
     return found;
 }
 
+bool manta::Mesh::occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const {
+    LightRay ray;
+    ray.setSource(p0);
+    ray.setDirection(d);
+    ray.calculateTransformations();
+
+    if (!fastIntersection(&ray)) return false;
+
+    const math::Vector3 &shear = ray.getShear();
+    const int kx = ray.getKX();
+    const int ky = ray.getKY();
+    const int kz = ray.getKZ();
+
+    for (int i = 0; i < m_triangleFaceCount; i++) {
+        INCREMENT_COUNTER(RuntimeStatistics::Counter::TriangleTests);
+        if (rayTriangleIntersection(i, (math::real)0.0, maxDepth, p0, shear, kx, ky, kz)) {
+            return true;
+        }
+    }
+
+    CoarseCollisionOutput output;
+    for (int i = 0; i < m_quadFaceCount; i++) {
+        INCREMENT_COUNTER(RuntimeStatistics::Counter::QuadTests);
+        if (detectQuadIntersection(i, (math::real)0.0, maxDepth, &ray, &output)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void manta::Mesh::fineIntersection(const math::Vector &r, IntersectionPoint *p, const CoarseIntersection *hint) const {
     const int faceIndex = hint->faceHint;
 
@@ -509,6 +558,7 @@ void manta::Mesh::fineIntersection(const math::Vector &r, IntersectionPoint *p,
     p->m_material = material;
     p->m_mesh = this;
     p->m_faceIndex = faceIndex;
+    p->m_instance = nullptr;
 
     p->calculatePartialDerivatives();
 }
@@ -539,6 +589,39 @@ bool manta::Mesh::fastIntersection(LightRay *ray) const {
     else return true;
 }
 
+bool manta::Mesh::getBounds(AABB *bounds) const {
+    if (m_vertexCount == 0) return false;
+
+    bounds->minPoint = bounds->maxPoint = m_vertices[0];
+    for (int i = 1; i < m_vertexCount; i++) {
+        bounds->minPoint = math::componentMin(bounds->minPoint, m_vertices[i]);
+        bounds->maxPoint = math::componentMax(bounds->maxPoint, m_vertices[i]);
+    }
+
+    return true;
+}
+
+manta::hash_value manta::Mesh::computeContentHash() const {
+    const int counts[] = { m_vertexCount, m_triangleFaceCount, m_quadFaceCount };
+    hash_value hash = fnv1a((const void *)counts, sizeof(counts));
+
+    for (int i = 0; i < m_vertexCount; i++) {
+        const math::real position[] = {
+            math::getX(m_vertices[i]), math::getY(m_vertices[i]), math::getZ(m_vertices[i]) };
+        hash = fnv1a((const void *)position, sizeof(position), hash);
+    }
+
+    if (m_triangleFaceCount > 0) {
+        hash = fnv1a((const void *)m_faces, sizeof(Face) * m_triangleFaceCount, hash);
+    }
+
+    if (m_quadFaceCount > 0) {
+        hash = fnv1a((const void *)m_quadFaces, sizeof(QuadFace) * m_quadFaceCount, hash);
+    }
+
+    return hash;
+}
+
 void manta::Mesh::loadObjFileData(ObjFileLoader *data, unsigned int globalId) {
     initialize(data->getFaceCount(), data->getVertexCount(), data->getNormalCount(), data->getTexCoordCount());
 
@@ -558,7 +641,8 @@ void manta::Mesh::loadObjFileData(ObjFileLoader *data, unsigned int globalId) {
         }
     }
 
-    m_materials = StandardAllocator::Global()->allocate<std::string>((int)materialNames.size());
+    m_materialCount = (int)materialNames.size();
+    m_materials = StandardAllocator::Global()->allocate<std::string>(m_materialCount, 1, MemoryTag::Mesh);
     for (int i = 0; i < materialNames.size(); ++i) {
         m_materials[i] = materialNames[i];
     }
@@ -616,6 +700,237 @@ void manta::Mesh::loadObjFileData(ObjFileLoader *data, unsigned int globalId) {
 #endif /* ENABLE_FACE_AABB */
 }
 
+bool manta::Mesh::writeCacheFile(const char *fname,
+    unsigned __int64 sourceSize, __int64 sourceTime, hash_value sourceHash) const
+{
+    // Quads are generated after loading so they are never part of the cache
+    if (m_faces == nullptr || m_quadFaceCount > 0) return false;
+
+    std::string materialNames;
+    for (int i = 0; i < m_materialCount; i++) {
+        const int length = (int)m_materials[i].size();
+        materialNames.append((const char *)&length, sizeof(int));
+        materialNames.append(m_materials[i]);
+    }
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(MeshCacheHeader));
+    memcpy(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+    header.version = CacheVersion;
+    header.faceSize = (int)sizeof(Face);
+    header.auxFaceSize = (int)sizeof(AuxFaceData);
+    header.vectorSize = (int)sizeof(math::Vector);
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.sourceHash = sourceHash;
+    header.faceCount = m_triangleFaceCount;
+    header.vertexCount = m_vertexCount;
+    header.normalCount = m_normalCount;
+    header.texCoordCount = m_texCoordCount;
+    header.materialCount = m_materialCount;
+    header.flags = (m_perVertexNormals ? PerVertexNormals : 0) | (m_useTextureCoords ? UseTexCoords : 0);
+    computeCacheLayout(&header, materialNames.size());
+
+    const void *sections[] = {
+        m_faces, m_auxFaceData, m_materialMap, m_vertices, m_normals, m_textureCoords, materialNames.data() };
+    const mem_size sectionEnds[] = {
+        header.offsets[0] + sizeof(Face) * m_triangleFaceCount,
+        header.offsets[1] + sizeof(AuxFaceData) * m_triangleFaceCount,
+        header.offsets[2] + sizeof(int) * m_triangleFaceCount,
+        header.offsets[3] + sizeof(math::Vector) * m_vertexCount,
+        header.offsets[4] + sizeof(math::Vector) * m_normalCount,
+        header.offsets[5] + sizeof(math::Vector) * m_texCoordCount,
+        header.fileSize };
+
+    std::ofstream file(fname, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) return false;
+
+    char headerBlock[CacheHeaderSize];
+    memset(headerBlock, 0, CacheHeaderSize);
+    memcpy(headerBlock, &header, sizeof(MeshCacheHeader));
+    file.write(headerBlock, CacheHeaderSize);
+
+    const char padding[CacheAlignment] = {};
+    mem_size position = CacheHeaderSize;
+    for (int i = 0; i < 7; i++) {
+        file.write(padding, header.offsets[i] - position);
+
+        const mem_size size = sectionEnds[i] - header.offsets[i];
+        if (size > 0) file.write((const char *)sections[i], size);
+        position = sectionEnds[i];
+    }
+
+    file.close();
+
+    return !file.fail();
+}
+
+manta::Mesh::CacheStatus manta::Mesh::loadCacheFile(const char *fname,
+    unsigned __int64 sourceSize, __int64 sourceTime, hash_value sourceHash)
+{
+    destroy();
+
+    if (!m_cacheFile.open(fname)) return CacheStatus::Missing;
+
+    char *data = (char *)m_cacheFile.getData();
+    const mem_size size = m_cacheFile.getSize();
+
+    if (size < CacheHeaderSize || memcmp(data, MeshCacheMagic, sizeof(MeshCacheMagic)) != 0) {
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(MeshCacheHeader));
+
+    const bool stale =
+        header.version != CacheVersion ||
+        header.faceSize != (int)sizeof(Face) ||
+        header.auxFaceSize != (int)sizeof(AuxFaceData) ||
+        header.vectorSize != (int)sizeof(math::Vector) ||
+        header.sourceSize != sourceSize ||
+        header.sourceTime != sourceTime ||
+        header.sourceHash != sourceHash;
+    if (stale) {
+        m_cacheFile.close();
+        return CacheStatus::Stale;
+    }
+
+    // The layout is fully determined by the counts, anything else is a damaged file
+    MeshCacheHeader expected = header;
+    const bool validCounts = header.faceCount >= 0 && header.vertexCount >= 0 && header.normalCount >= 0
+        && header.texCoordCount >= 0 && header.materialCount >= 0 && header.fileSize >= header.offsets[6];
+    if (validCounts) computeCacheLayout(&expected, (mem_size)(header.fileSize - header.offsets[6]));
+
+    if (!validCounts || header.fileSize != size ||
+        memcmp(expected.offsets, header.offsets, sizeof(header.offsets)) != 0)
+    {
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    std::string *materials = StandardAllocator::Global()->allocate<std::string>(header.materialCount, 1, MemoryTag::Mesh);
+    mem_size position = header.offsets[6];
+    for (int i = 0; i < header.materialCount; i++) {
+        int length = -1;
+        if (position + sizeof(int) <= size) memcpy(&length, data + position, sizeof(int));
+        position += sizeof(int);
+
+        if (length < 0 || position + length > size) {
+            StandardAllocator::Global()->free(materials, header.materialCount, MemoryTag::Mesh);
+            m_cacheFile.close();
+            return CacheStatus::Corrupt;
+        }
+
+        materials[i].assign(data + position, length);
+        position += length;
+    }
+
+    // Indices are used without any further checks so a damaged file must not get past
+    // this point
+    if (!checkCacheIndices(header, data)) {
+        StandardAllocator::Global()->free(materials, header.materialCount, MemoryTag::Mesh);
+        m_cacheFile.close();
+        return CacheStatus::Corrupt;
+    }
+
+    m_faces = (Face *)(data + header.offsets[0]);
+    m_auxFaceData = (AuxFaceData *)(data + header.offsets[1]);
+    m_materialMap = (int *)(data + header.offsets[2]);
+    m_vertices = (math::Vector *)(data + header.offsets[3]);
+    m_normals = (header.normalCount > 0) ? (math::Vector *)(data + header.offsets[4]) : nullptr;
+    m_textureCoords = (header.texCoordCount > 0) ? (math::Vector *)(data + header.offsets[5]) : nullptr;
+    m_quadFaces = nullptr;
+    m_auxQuadFaceData = nullptr;
+
+    m_materials = materials;
+    m_materialCount = header.materialCount;
+
+    m_triangleFaceCount = header.faceCount;
+    m_quadFaceCount = 0;
+    m_vertexCount = header.vertexCount;
+    m_normalCount = header.normalCount;
+    m_texCoordCount = header.texCoordCount;
+
+    m_perVertexNormals = (header.flags & PerVertexNormals) != 0;
+    m_useTextureCoords = (header.flags & UseTexCoords) != 0;
+
+#if ENABLE_FACE_AABB
+    computeBounds();
+#endif /* ENABLE_FACE_AABB */
+
+    return CacheStatus::Loaded;
+}
+
+void manta::Mesh::computeCacheLayout(MeshCacheHeader *header, mem_size materialNamesSize) {
+    const mem_size sizes[] = {
+        sizeof(Face) * (mem_size)header->faceCount,
+        sizeof(AuxFaceData) * (mem_size)header->faceCount,
+        sizeof(int) * (mem_size)header->faceCount,
+        sizeof(math::Vector) * (mem_size)header->vertexCount,
+        sizeof(math::Vector) * (mem_size)header->normalCount,
+        sizeof(math::Vector) * (mem_size)header->texCoordCount,
+        materialNamesSize };
+
+    mem_size offset = CacheHeaderSize;
+    for (int i = 0; i < 7; i++) {
+        offset = (offset + CacheAlignment - 1) / CacheAlignment * CacheAlignment;
+        header->offsets[i] = offset;
+        offset += sizes[i];
+    }
+
+    header->fileSize = offset;
+}
+
+bool manta::Mesh::checkCacheIndices(const MeshCacheHeader &header, const char *data) {
+    const Face *faces = (const Face *)(data + header.offsets[0]);
+    const AuxFaceData *auxFaceData = (const AuxFaceData *)(data + header.offsets[1]);
+    const int *materialMap = (const int *)(data + header.offsets[2]);
+
+    for (int i = 0; i < header.faceCount; i++) {
+        for (int j = 0; j < 3; j++) {
+            const int vertex = faces[i].indices[j];
+            if (vertex < 0 || vertex >= header.vertexCount) return false;
+
+            // Normals and texture coordinates are optional per face and marked with -1
+            const AuxData &aux = auxFaceData[i].data[j];
+            if ((header.flags & PerVertexNormals) && (aux.n < -1 || aux.n >= header.normalCount)) return false;
+            if ((header.flags & UseTexCoords) && (aux.t < -1 || aux.t >= header.texCoordCount)) return false;
+        }
+
+        if (materialMap[i] < -1 || materialMap[i] >= header.materialCount) return false;
+    }
+
+    return true;
+}
+
+manta::hash_value manta::Mesh::computeSourceHash(const char *fname) {
+    constexpr std::streamoff BlockSize = 64 * 1024;
+
+    std::ifstream file(fname, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return 0;
+
+    const std::streamoff size = file.tellg();
+    hash_value hash = fnv1a((const void *)&size, sizeof(size));
+
+    std::vector<char> block((size_t)std::min(size, BlockSize));
+    const std::streamoff offsets[] = { 0, std::max(size - BlockSize, (std::streamoff)0) };
+    for (std::streamoff offset : offsets) {
+        file.seekg(offset);
+        file.read(block.data(), (std::streamsize)block.size());
+        hash = fnv1a((const void *)block.data(), (mem_size)file.gcount(), hash);
+    }
+
+    return hash;
+}
+
+bool manta::Mesh::isInCacheFile(const void *p) const {
+    if (!m_cacheFile.isOpen() || p == nullptr) return false;
+
+    const char *begin = (const char *)m_cacheFile.getData();
+    return (const char *)p >= begin && (const char *)p < begin + m_cacheFile.getSize();
+}
+
 void manta::Mesh::bindMaterialLibrary(MaterialLibrary *library, int defaultMaterialIndex) {
     for (int i = 0; i < m_triangleFaceCount; ++i) {
         if (i == 260877) {
@@ -623,7 +938,6 @@ void manta::Mesh::bindMaterialLibrary(MaterialLibrary *library, int defaultMater
         }
 
         const int materialIndex = m_materialMap[i];
-        const std::string &materialName = m_materials[materialIndex];
 
         // Resolve the material reference
         if (materialIndex == -1) {
@@ -631,7 +945,7 @@ void manta::Mesh::bindMaterialLibrary(MaterialLibrary *library, int defaultMater
         }
         else {
             if (library != nullptr) {
-                Material *material = library->searchByName(materialName);
+                Material *material = library->searchByName(m_materials[materialIndex]);
                 if (material != nullptr) {
                     m_auxFaceData[i].material = material->getIndex();
                 }
@@ -661,14 +975,14 @@ void manta::Mesh::merge(const Mesh *mesh) {
     AABB *newFaceBounds = nullptr;
 
     if (newFaceCount > 0) {
-        newFaces = StandardAllocator::Global()->allocate<Face>(newFaceCount);
-        newAuxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(newFaceCount);
-        newFaceBounds = StandardAllocator::Global()->allocate<AABB>(newFaceCount);
+        newFaces = StandardAllocator::Global()->allocate<Face>(newFaceCount, 1, MemoryTag::Mesh);
+        newAuxFaceData = StandardAllocator::Global()->allocate<AuxFaceData>(newFaceCount, 1, MemoryTag::Mesh);
+        newFaceBounds = StandardAllocator::Global()->allocate<AABB>(newFaceCount, 1, MemoryTag::Mesh);
     }
 
-    if (newVertexCount > 0) newVerts = StandardAllocator::Global()->allocate<math::Vector>(newVertexCount, 16);
-    if (newNormalCount > 0) newNormals = StandardAllocator::Global()->allocate<math::Vector>(newNormalCount, 16);
-    if (newTexCoordCount > 0) newTexCoords = StandardAllocator::Global()->allocate<math::Vector>(newTexCoordCount, 16);
+    if (newVertexCount > 0) newVerts = StandardAllocator::Global()->allocate<math::Vector>(newVertexCount, 16, MemoryTag::Mesh);
+    if (newNormalCount > 0) newNormals = StandardAllocator::Global()->allocate<math::Vector>(newNormalCount, 16, MemoryTag::Mesh);
+    if (newTexCoordCount > 0) newTexCoords = StandardAllocator::Global()->allocate<math::Vector>(newTexCoordCount, 16, MemoryTag::Mesh);
 
     if (newFaceCount > 0) {
         memcpy((void *)newFaces, (void *)m_faces, sizeof(Face) * m_triangleFaceCount);
@@ -727,14 +1041,14 @@ void manta::Mesh::merge(const Mesh *mesh) {
         newTexCoords[i + m_texCoordCount] = *mesh->getTexCoord(i);
     }
 
-    if (m_faces != nullptr) StandardAllocator::Global()->free(m_faces, m_triangleFaceCount);
-    if (m_auxFaceData != nullptr) StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount);
-    if (m_vertices != nullptr) StandardAllocator::Global()->aligned_free(m_vertices, m_vertexCount);
-    if (m_normals != nullptr) StandardAllocator::Global()->aligned_free(m_normals, m_normalCount);
-    if (m_textureCoords != nullptr) StandardAllocator::Global()->aligned_free(m_textureCoords, m_texCoordCount);
+    if (m_faces != nullptr && !isInCacheFile(m_faces)) StandardAllocator::Global()->free(m_faces, m_triangleFaceCount, MemoryTag::Mesh);
+    if (m_auxFaceData != nullptr && !isInCacheFile(m_auxFaceData)) StandardAllocator::Global()->free(m_auxFaceData, m_triangleFaceCount, MemoryTag::Mesh);
+    if (m_vertices != nullptr && !isInCacheFile(m_vertices)) StandardAllocator::Global()->aligned_free(m_vertices, m_vertexCount, MemoryTag::Mesh);
+    if (m_normals != nullptr && !isInCacheFile(m_normals)) StandardAllocator::Global()->aligned_free(m_normals, m_normalCount, MemoryTag::Mesh);
+    if (m_textureCoords != nullptr && !isInCacheFile(m_textureCoords)) StandardAllocator::Global()->aligned_free(m_textureCoords, m_texCoordCount, MemoryTag::Mesh);
 
 #if ENABLE_FACE_AABB
-    if (m_faceBounds != nullptr) StandardAllocator::Global()->free(m_faceBounds, m_triangleFaceCount);
+    if (m_faceBounds != nullptr) StandardAllocator::Global()->free(m_faceBounds, m_triangleFaceCount, MemoryTag::Mesh);
     m_faceBounds = newFaceBounds;
 #endif /* ENABLE_FACE_AABB */
 
@@ -0,0 +1,246 @@
+#include "../include/mesh_light.h"
+
+#include "../include/mesh.h"
+#include "../include/geometry_instance.h"
+#include "../include/scene_object.h"
+#include "../include/material.h"
+#include "../include/material_library.h"
+#include "../include/light_ray.h"
+#include "../include/coarse_intersection.h"
+#include "../include/intersection_point_manager.h"
+
+#include <algorithm>
+
+manta::MeshLight::MeshLight() {
+    m_object = nullptr;
+    m_mesh = nullptr;
+    m_instance = nullptr;
+    m_library = nullptr;
+
+    m_bounds.phi = 0;
+    m_area = 0;
+    m_power = 0;
+}
+
+manta::MeshLight::~MeshLight() {
+    /* void */
+}
+
+bool manta::MeshLight::initialize(
+    SceneObject *object, const Mesh *mesh, const GeometryInstance *instance, MaterialLibrary *library)
+{
+    destroy();
+
+    m_object = object;
+    m_mesh = mesh;
+    m_instance = instance;
+    m_library = library;
+
+    // Quads are left out, no loader produces them
+    const int faceCount = mesh->getTriangleFaceCount();
+    m_emissive.resize(mesh->getFaceCount(), false);
+
+    std::vector<math::real> areas;
+    IntersectionPoint p;
+    LightRay ray;
+    for (int i = 0; i < faceCount; i++) {
+        const Face *face = mesh->getFace(i);
+        const math::Vector v0 = getVertex(face->u);
+        const math::Vector v1 = getVertex(face->v);
+        const math::Vector v2 = getVertex(face->w);
+
+        // Affine transforms keep points that are uniform over a triangle uniform, so
+        // instanced faces are weighted by their world space area
+        const math::Vector cross = math::cross(math::sub(v1, v0), math::sub(v2, v0));
+        const math::real area = (math::real)0.5 * math::getScalar(math::magnitude(cross));
+        if (area <= 0) continue;
+
+        // Emission is evaluated at the centroid as seen from in front of the face
+        const math::Vector normal = math::normalize(cross);
+        const math::Vector centroid = math::div(math::add(math::add(v0, v1), v2), math::loadScalar((math::real)3.0));
+
+        EmissiveTriangle triangle;
+        triangle.face = i;
+        triangle.area = area;
+
+        const math::real third = (math::real)1.0 / 3;
+        evaluatePoint(triangle, third, third, math::add(centroid, normal), &ray, &p);
+
+        // Ids that rendering never generates so that nothing cached here is reused
+        p.m_id = INVALID_CACHE_KEY - 1 - i;
+        p.m_threadId = 0;
+
+        Material *material = getMaterial(p);
+        if (material == nullptr) continue;
+
+        const math::Vector emission = material->getEmission(p);
+        if (math::getScalar(math::maxComponent(emission)) <= 0) continue;
+
+        const math::real intensity = (math::getX(emission) + math::getY(emission) + math::getZ(emission)) / 3;
+
+        LightBounds bounds;
+        bounds.bounds.minPoint = math::componentMin(math::componentMin(v0, v1), v2);
+        bounds.bounds.maxPoint = math::componentMax(math::componentMax(v0, v1), v2);
+        bounds.phi = std::max(intensity, (math::real)0.0) * area * math::constants::PI * 2;
+        bounds.w = normal;
+        bounds.cosTheta_o = (math::real)1.0;
+        bounds.cosTheta_e = (math::real)0.0;
+        bounds.twoSided = true;
+
+        m_bounds = LightBounds::merge(m_bounds, bounds);
+        m_emissive[i] = true;
+        m_triangles.push_back(triangle);
+        areas.push_back(area);
+
+        m_area += area;
+        m_power += bounds.phi;
+    }
+
+    if (m_triangles.empty()) {
+        destroy();
+        return false;
+    }
+
+    m_distribution.build(areas.data(), (int)areas.size());
+
+    return true;
+}
+
+void manta::MeshLight::destroy() {
+    m_triangles.clear();
+    m_emissive.clear();
+    m_distribution.destroy();
+
+    m_bounds.phi = 0;
+    m_area = 0;
+    m_power = 0;
+}
+
+manta::math::Vector manta::MeshLight::sampleIncoming(
+    const IntersectionPoint &ref,
+    const math::Vector2 &u,
+    math::Vector *wi,
+    math::real *pdf,
+    math::real *depth) const
+{
+    *pdf = 0;
+
+    math::real trianglePmf, uTriangle;
+    const int index = m_distribution.sample(u.x, &trianglePmf, &uTriangle);
+    if (index == -1) return math::constants::Zero;
+
+    // Uniform point on the triangle
+    const math::real r = std::sqrt(uTriangle);
+
+    LightRay ray;
+    IntersectionPoint p;
+    evaluatePoint(m_triangles[index], 1 - r, u.y * r, ref.m_position, &ray, &p);
+    p.m_manager = ref.m_manager;
+    p.m_threadId = ref.m_threadId;
+    p.m_id = (ref.m_manager != nullptr)
+        ? ref.m_manager->generateId()
+        : INVALID_CACHE_KEY;
+
+    const math::Vector d = math::sub(p.m_position, ref.m_position);
+    const math::real distanceSquared = math::getScalar(math::magnitudeSquared3(d));
+    if (distanceSquared == 0) return math::constants::Zero;
+
+    const math::real distance = std::sqrt(distanceSquared);
+    *wi = math::div(d, math::loadScalar(distance));
+
+    const math::real cosTheta = std::abs(math::getScalar(math::dot(p.m_faceNormal, *wi)));
+    if (cosTheta == 0) return math::constants::Zero;
+
+    // Triangles are picked by area so the density is the same over the whole emitter
+    *pdf = distanceSquared / (cosTheta * m_area);
+
+    // The shadow ray has to stop short of the emitting face, which would block it
+    *depth = distance - std::max((math::real)1E-4, distance * (math::real)1E-4);
+
+    Material *material = getMaterial(p);
+    return (material != nullptr)
+        ? material->getEmission(p)
+        : math::constants::Zero;
+}
+
+bool manta::MeshLight::getBounds(AABB *bounds) const {
+    if (m_triangles.empty()) return false;
+
+    *bounds = m_bounds.bounds;
+    return true;
+}
+
+bool manta::MeshLight::getLightBounds(LightBounds *bounds) const {
+    if (m_triangles.empty()) return false;
+
+    *bounds = m_bounds;
+    return true;
+}
+
+manta::math::real manta::MeshLight::pdfArea(const IntersectionPoint &p) const {
+    if (p.m_mesh != m_mesh || p.m_instance != m_instance) return 0;
+    else if (p.m_faceIndex < 0 || p.m_faceIndex >= (int)m_emissive.size()) return 0;
+    else if (!m_emissive[p.m_faceIndex]) return 0;
+    else return 1 / m_area;
+}
+
+manta::Material *manta::MeshLight::getMaterial(const IntersectionPoint &p) const {
+    if (p.m_material == -1) return m_object->getDefaultMaterial();
+    else if (m_library != nullptr) return m_library->getMaterial(p.m_material);
+    else return nullptr;
+}
+
+manta::math::Vector manta::MeshLight::getVertex(int index) const {
+    const math::Vector v = *m_mesh->getVertex(index);
+    return (m_instance != nullptr)
+        ? m_instance->objectToWorldPoint(v)
+        : v;
+}
+
+void manta::MeshLight::evaluatePoint(
+    const EmissiveTriangle &triangle,
+    math::real su,
+    math::real sv,
+    const math::Vector &source,
+    LightRay *ray,
+    IntersectionPoint *p) const
+{
+    const Face *face = m_mesh->getFace(triangle.face);
+    const math::real sw = 1 - su - sv;
+
+    const math::Vector position = math::add(
+        math::add(
+            math::mul(getVertex(face->u), math::loadScalar(su)),
+            math::mul(getVertex(face->v), math::loadScalar(sv))),
+        math::mul(getVertex(face->w), math::loadScalar(sw)));
+
+    // Same surface data as if a ray from the source had hit the face
+    const math::Vector d = math::sub(position, source);
+    ray->setSource(source);
+    ray->setDirection(math::normalize(d));
+
+    CoarseIntersection hint;
+    hint.sceneObject = m_object;
+    hint.sceneGeometry = (m_instance != nullptr) ? (const SceneGeometry *)m_instance : m_mesh;
+    hint.instancedGeometry = (m_instance != nullptr) ? m_mesh : nullptr;
+    hint.depth = math::getScalar(math::magnitude(d));
+    hint.faceHint = triangle.face;
+    hint.subdivisionHint = 0;
+    hint.globalHint = triangle.face;
+    hint.su = su;
+    hint.sv = sv;
+    hint.sw = sw;
+    hint.valid = true;
+
+    *p = IntersectionPoint();
+    p->m_lightRay = ray;
+    p->m_intersection = true;
+    p->m_valid = true;
+    hint.sceneGeometry->fineIntersection(position, p, &hint);
+
+    if (math::getScalar(math::dot(p->m_faceNormal, ray->getDirection())) > 0) {
+        p->m_faceNormal = math::negate(p->m_faceNormal);
+        p->m_vertexNormal = math::negate(p->m_vertexNormal);
+        std::swap(p->m_inside, p->m_outside);
+    }
+}
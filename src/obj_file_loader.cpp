@@ -1,46 +1,15 @@
 #include "../include/obj_file_loader.h"
 
+#include "../include/memory_mapped_file.h"
 #include "../include/standard_allocator.h"
+#include "../include/thread_pool.h"
 
-#include <fstream>
-#include <sstream>
-#include <cctype>
-#include <functional>
-#include <string>
-
-// Taken from https://www.oreilly.com/library/view/c-cookbook/0596007612/ch04s07.html
-template<typename T>
-void split(const std::basic_string<T>& s, T c, std::vector<std::basic_string<T> >& v) {
-    typename std::basic_string<T>::size_type i = 0;
-    typename std::basic_string<T>::size_type j = s.find(c);
-
-    if (j == std::basic_string<T>::npos) {
-        v.push_back(std::string(s));
-        return;
-    }
-
-    while (j != std::basic_string<T>::npos) {
-        v.push_back(s.substr(i, j - i));
-        i = ++j;
-        j = s.find(c, j);
-
-        if (j == std::basic_string<T>::npos)
-            v.push_back(s.substr(i, s.length()));
-    }
-}
-
-bool isWhitespace(const std::string &s) {
-    for (int i = 0; i < s.length(); i++) {
-        if (!std::isspace(s[i])) {
-            return false;
-        }
-    }
-    return true;
-}
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
 
 manta::ObjFileLoader::ObjFileLoader() {
-    m_currentLine = 0;
-    m_currentMaterial = -1;
+    /* void */
 }
 
 manta::ObjFileLoader::~ObjFileLoader() {
@@ -48,557 +17,378 @@ manta::ObjFileLoader::~ObjFileLoader() {
 }
 
 bool manta::ObjFileLoader::loadObjFile(const char *fname) {
-    std::fstream file(fname, std::ios::in);
-
-    if (file.is_open()) {
-        const bool result = loadObjFile(file);
-        file.close();
-        return result;
-    }
-    else {
+    MemoryMappedFile file;
+    if (!file.open(fname)) {
         // The file could not be loaded
         return false;
     }
-}
-
-bool manta::ObjFileLoader::loadObjFile(std::istream &stream) {
-#define CHECK_INDEX(index) if ((index) == -1) { delete[] buffer; return false; } 
-
-    m_currentLine = 0;
-    m_currentMaterial = -1;
-
-    size_t bufferSize = 4;
-    char *buffer = new char[bufferSize];
-
-    std::string line;
-    
-    while (stream.peek() != -1) {
-        ++m_currentLine;
-
-        /*
-        for (int i = 0;; ++i) {
-            if (i >= bufferSize) {
-                char *oldBuffer = buffer;
-                buffer = new char[(size_t)bufferSize * 2];
-
-                memcpy(buffer, oldBuffer, (size_t)bufferSize * sizeof(char));
-
-                delete[] oldBuffer;
-                bufferSize *= 2;
-            }
 
-            const char c = fgetc(fp);
-            if (c == '\n' || feof(fp)) {
-                buffer[i] = '\0';
-                break;
-            }
-            buffer[i] = c;
-        }*/
-
-        bufferSize = getLine(stream, &buffer, bufferSize);
-
-        /*
-        if (line.size() >= bufferSize) {
-            delete[] buffer;
-
-            bufferSize = (int)line.size() + 1;
-            buffer = new char[(size_t)bufferSize];
-        }
-
-        strcpy_s(buffer, bufferSize, line.c_str());*/
-
-        int index = readWhitespace(buffer, 0);
-        CHECK_INDEX(index);
-
-        int e0 = index, e1;
-        index = readType(buffer, index);
-        CHECK_INDEX(index);
-        e1 = index;
-
-        // Skip this line if it's a comment
-        if (buffer[e0] == '#') continue;
-        else if (clipCompare(buffer, "v", e0, e1)) {
-            // Create a new vertex
-            math::Vector3 newVertex;
-            index = readVector3(buffer, &newVertex, index);
-            CHECK_INDEX(index);
-            m_vertices.push_back(newVertex);
-        }
-        else if (clipCompare(buffer, "f", e0, e1)) {
-            // Read a face
-            ObjFace newFace;
-            newFace.material = m_currentMaterial;
-            index = readFace(buffer, &newFace, index);
-            CHECK_INDEX(index);
-            m_faces.push_back(newFace);
-        }
-        else if (clipCompare(buffer, "vt", e0, e1)) {
-            // Read a texture coordinate
-            math::Vector2 texCoords;
-            index = readVector2(buffer, &texCoords, index);
-            CHECK_INDEX(index);
-            m_texCoords.push_back(texCoords);
-        }
-        else if (clipCompare(buffer, "vn", e0, e1)) {
-            // Read a normal value
-            math::Vector3 normal;
-            index = readVector3(buffer, &normal, index);
-            CHECK_INDEX(index);
-            m_normals.push_back(normal);
-        }
-        else if (clipCompare(buffer, "usemtl", e0, e1)) {
-            // Use a new material
-            index = readMaterial(buffer, index);
-            CHECK_INDEX(index);
-        }
-    }
-
-    delete[] buffer;
-
-    return true;
+    return loadObjData((const char *)file.getData(), (size_t)file.getSize());
 }
 
-/*
-bool manta::ObjFileLoader::readVertexPosition(std::stringstream &s, math::Vector3 *vertex) const {
-    s >> vertex->x;
-    if (s.fail()) {
-        return false;
-    }
-
-    s >> vertex->y;
-    if (s.fail()) {
-        return false;
-    }
+bool manta::ObjFileLoader::loadObjData(const char *data, size_t size, size_t chunkSize) {
+    // Split the file at line boundaries
+    std::vector<Chunk> chunks;
+    const char *dataEnd = data + size;
+    const char *chunkBegin = data;
+    while (chunkBegin < dataEnd) {
+        const char *chunkEnd = (size_t)(dataEnd - chunkBegin) > chunkSize
+            ? nextLine(chunkBegin + chunkSize, dataEnd)
+            : dataEnd;
+
+        Chunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(chunk);
+
+        chunkBegin = chunkEnd;
+    }
+
+    const int chunkCount = (int)chunks.size();
+    ThreadPool::Global()->parallelFor(0, chunkCount, 1, [&](int start, int end) {
+        for (int i = start; i < end; i++) countChunk(&chunks[i]);
+    });
+
+    // Elements are numbered in file order so every chunk starts where the previous
+    // one left off
+    int vertexCount = 0, normalCount = 0, texCoordCount = 0, faceCount = 0, materialCount = 0;
+    int currentMaterial = NoMaterial;
+    for (Chunk &chunk : chunks) {
+        chunk.vertexOffset = vertexCount;
+        chunk.normalOffset = normalCount;
+        chunk.texCoordOffset = texCoordCount;
+        chunk.faceOffset = faceCount;
+        chunk.materialOffset = materialCount;
+        chunk.startMaterial = currentMaterial;
+
+        if (chunk.lastMaterial == NoMaterial) currentMaterial = NoMaterial;
+        else if (chunk.lastMaterial != UnchangedMaterial) {
+            currentMaterial = chunk.materialOffset + chunk.lastMaterial;
+        }
 
-    s >> vertex->z;
-    if (s.fail()) {
-        return false;
+        vertexCount += chunk.vertexCount;
+        normalCount += chunk.normalCount;
+        texCoordCount += chunk.texCoordCount;
+        faceCount += chunk.faceCount;
+        materialCount += chunk.materialCount;
     }
 
-    if (!s.eof()) {
-        return false;
-    }
-    else {
-        return true;
-    }
-}
+    m_vertices.resize(vertexCount);
+    m_normals.resize(normalCount);
+    m_texCoords.resize(texCoordCount);
+    m_faces.resize(faceCount);
+    m_materials.resize(materialCount);
 
-bool manta::ObjFileLoader::readVertexNormal(std::stringstream &s, math::Vector3 *vertex) const {
-    s >> vertex->x;
-    if (s.fail()) {
-        return false;
-    }
+    std::vector<char> results(chunkCount, 0);
+    ThreadPool::Global()->parallelFor(0, chunkCount, 1, [&](int start, int end) {
+        for (int i = start; i < end; i++) results[i] = parseChunk(chunks[i]) ? 1 : 0;
+    });
 
-    s >> vertex->y;
-    if (s.fail()) {
-        return false;
+    for (int i = 0; i < chunkCount; i++) {
+        if (results[i] == 0) return false;
     }
 
-    s >> vertex->z;
-    if (s.fail()) {
-        return false;
-    }
-
-    if (!s.eof()) {
-        return false;
-    }
-    else {
-        return true;
-    }
+    return true;
 }
 
-bool manta::ObjFileLoader::readVertexTextureCoords(std::stringstream &s, math::Vector2 *texCoords) const {
-    s >> texCoords->x;
-    if (s.fail()) {
-        return false;
-    }
-
-    s >> texCoords->y;
-    if (s.fail()) {
-        return false;
-    }
-
-    if (!s.eof()) {
-        return false;
-    }
-    else {
-        return true;
+void manta::ObjFileLoader::countChunk(Chunk *chunk) {
+    chunk->vertexCount = 0;
+    chunk->normalCount = 0;
+    chunk->texCoordCount = 0;
+    chunk->faceCount = 0;
+    chunk->materialCount = 0;
+    chunk->lastMaterial = UnchangedMaterial;
+
+    const char *end = chunk->end;
+    for (const char *line = chunk->begin; line < end; line = nextLine(line, end)) {
+        const char *e0 = readWhitespace(line, end);
+        const char *e1 = readToken(e0, end);
+
+        if (tokenEquals(e0, e1, "v")) ++chunk->vertexCount;
+        else if (tokenEquals(e0, e1, "f")) chunk->faceCount += countFaceTriangles(e1, end);
+        else if (tokenEquals(e0, e1, "vt")) ++chunk->texCoordCount;
+        else if (tokenEquals(e0, e1, "vn")) ++chunk->normalCount;
+        else if (tokenEquals(e0, e1, "usemtl")) {
+            const char *m0 = readWhitespace(e1, end);
+            const char *m1 = readToken(m0, end);
+
+            if (tokenEquals(m0, m1, "None")) chunk->lastMaterial = NoMaterial;
+            else chunk->lastMaterial = chunk->materialCount++;
+        }
     }
 }
 
-bool manta::ObjFileLoader::readFace(std::stringstream &s, ObjFace *face) {
-    size_t nParameters = 0;
-    int vertexIndex = 0;
-
-    // Initialize all indices
-    // NOTE: 0 corresponds to -1 since the indices will be transformed later
-    for (int i = 0; i < 3; i++) {
-        face->vt[i] = 0;
-        face->vn[i] = 0;
-        face->v[i] = 0;
-    }
-
-    while (!s.eof()) {
-        std::string group;
-        s >> group;
-
-        std::vector<std::string> elements;
-        split(group, '/', elements);
-
-        if (nParameters == 0) nParameters = elements.size();
-        else {
-            if (nParameters != elements.size()) {
-                return false;
-            }
+bool manta::ObjFileLoader::parseChunk(const Chunk &chunk) {
+    int vertex = chunk.vertexOffset;
+    int normal = chunk.normalOffset;
+    int texCoord = chunk.texCoordOffset;
+    int face = chunk.faceOffset;
+    int material = chunk.materialOffset;
+    int currentMaterial = chunk.startMaterial;
+
+    const char *end = chunk.end;
+    for (const char *line = chunk.begin; line < end; line = nextLine(line, end)) {
+        const char *e0 = readWhitespace(line, end);
+        const char *e1 = readToken(e0, end);
+
+        if (tokenEquals(e0, e1, "v")) {
+            if (readVector3(e1, end, &m_vertices[vertex++]) == nullptr) return false;
         }
+        else if (tokenEquals(e0, e1, "f")) {
+            const int counts[] = { vertex, texCoord, normal };
+            const int triangleCount = countFaceTriangles(e1, end);
 
-        if (nParameters >= 1) {        
-            std::stringstream ss = std::stringstream(elements[0]);
-            ss >> face->v[vertexIndex];
-            if (ss.fail()) {
-                return false;
+            if (readFace(e1, end, counts, triangleCount, &m_faces[face]) == nullptr) return false;
+            for (int i = 0; i < triangleCount; ++i) {
+                m_faces[face++].material = currentMaterial;
             }
         }
-        if (nParameters >= 2) {
-            if (!isWhitespace(elements[1])) {
-                std::stringstream ss = std::stringstream(elements[1]);
-                ss >> face->vt[vertexIndex];
-                if (ss.fail()) {
-                    return false;
-                }
-            }
+        else if (tokenEquals(e0, e1, "vt")) {
+            if (readVector2(e1, end, &m_texCoords[texCoord++]) == nullptr) return false;
         }
-        if (nParameters == 3) {
-            if (!isWhitespace(elements[2])) {
-                std::stringstream ss = std::stringstream(elements[2]);
-                ss >> face->vn[vertexIndex];
-                if (ss.fail()) {
-                    return false;
-                }
-            }
+        else if (tokenEquals(e0, e1, "vn")) {
+            if (readVector3(e1, end, &m_normals[normal++]) == nullptr) return false;
         }
-        if (nParameters > 3) { return false; }
+        else if (tokenEquals(e0, e1, "usemtl")) {
+            const char *m0 = readWhitespace(e1, end);
+            const char *m1 = readToken(m0, end);
 
-        vertexIndex++;
+            if (tokenEquals(m0, m1, "None")) {
+                currentMaterial = NoMaterial;
+            }
+            else {
+                m_materials[material].name = std::string(m0, m1);
+                currentMaterial = material++;
+            }
+        }
     }
 
     return true;
 }
 
-bool manta::ObjFileLoader::readMaterial(std::stringstream &s) {
-    std::string materialName;
-    s >> materialName;
-
-    if (s.fail()) {
-        return false;
-    }
-
-    if (materialName == "None") {
-        m_currentMaterial = -1;
-    }
-    else {
-        ObjMaterial newMaterial;
-        newMaterial.name = materialName;
-        m_materials.push_back(newMaterial);
-        m_currentMaterial = m_materials.size() - 1;
-    }
-    
-    return true;
+const char *manta::ObjFileLoader::nextLine(const char *s, const char *end) {
+    const char *newLine = (const char *)memchr(s, '\n', end - s);
+    return (newLine == nullptr)
+        ? end
+        : newLine + 1;
 }
-*/
-
-/*
-void manta::ObjFileLoader::getLine(std::istream &stream, std::string &target) {
-    target.clear();
-
-    std::istream::sentry se(stream, true);
-    std::streambuf *sb = stream.rdbuf();
-
-    if (se) {
-        for (;;) {
-            const int c = sb->sbumpc();
-            switch (c) {
-            case '\n':
-                return;
-            case '\r':
-                if (sb->sgetc() == '\n') sb->sbumpc();
-                return;
-            case EOF:
-                if (target.empty()) stream.setstate(std::ios::eofbit);
-                return;
-            default:
-                target += static_cast<char>(c);
-            }
-        }
-    }
-}*/
 
-size_t manta::ObjFileLoader::getLine(std::istream &stream, char **buffer, size_t bufferSize) {
-    std::istream::sentry se(stream, true);
-    std::streambuf *sb = stream.rdbuf();
-
-    char *&target = *buffer;
+const char *manta::ObjFileLoader::readWhitespace(const char *s, const char *end) {
+    while (s < end && *s != '\n' && isWhitespace(*s)) ++s;
+    return s;
+}
 
-    if (se) {
-        for (int i = 0;; ++i) {
-            if (i == bufferSize - 2) {
-                char *newBuffer = new char[bufferSize * 2];
-                memcpy(newBuffer, target, bufferSize);
-                delete[] target;
+const char *manta::ObjFileLoader::readToken(const char *s, const char *end) {
+    while (s < end && !isWhitespace(*s)) ++s;
+    return s;
+}
 
-                target = newBuffer;
-                bufferSize *= 2;
-            }
+bool manta::ObjFileLoader::tokenEquals(const char *begin, const char *end, const char *ref) {
+    const size_t length = strlen(ref);
+    return (size_t)(end - begin) == length && memcmp(begin, ref, length) == 0;
+}
 
-            const int c = sb->sbumpc();
-            switch (c) {
-            case '\n':
-                target[i] = 0;
-                return bufferSize;
-            case '\r':
-                target[i] = 0;
-                if (sb->sgetc() == '\n') sb->sbumpc();
-                return bufferSize;
-            case EOF:
-                target[i] = 0;
-                if (i == 0) stream.setstate(std::ios::eofbit);
-                return bufferSize;
-            default:
-                (*buffer)[i] = static_cast<char>(c);
-            }
-        }
-    }
-    else {
-        return bufferSize;
+bool manta::ObjFileLoader::isWhitespace(char c) {
+    switch (c) {
+    case ' ':
+    case '\n':
+    case '\r':
+    case '\t':
+        return true;
+    default:
+        return false;
     }
 }
 
-int manta::ObjFileLoader::readType(char *s, int index) {
-    index = readWhitespace(s, index);
-    if (index == -1) return -1;
+const char *manta::ObjFileLoader::readVector3(const char *s, const char *end, math::Vector3 *target) {
+    for (int i = 0; i < 3; ++i) {
+        const char *e0 = readWhitespace(s, end);
+        s = readToken(e0, end);
 
-    index = readUntilWhitespace(s, index);
-    if (index == -1) return -1;
+        if (!parseReal(e0, s, &target->vec[i])) return nullptr;
+    }
 
-    return index;
+    return s;
 }
 
-int manta::ObjFileLoader::readMaterial(char *s, int index) {
-    index = readWhitespace(s, index);
-    if (index == -1) return -1;
-
-    int e0 = index, e1;
-    index = readUntilWhitespace(s, index);
-    if (index == -1) return -1;
-    e1 = index;
+const char *manta::ObjFileLoader::readVector2(const char *s, const char *end, math::Vector2 *target) {
+    for (int i = 0; i < 2; ++i) {
+        const char *e0 = readWhitespace(s, end);
+        s = readToken(e0, end);
 
-    if (clipCompare(s, "None", e0, e1)) {
-        m_currentMaterial = -1;
-    }
-    else {
-        ObjMaterial newMaterial;
-        newMaterial.name = clip(s, e0, e1);
-        m_materials.push_back(newMaterial);
-        m_currentMaterial = (int)m_materials.size() - 1;
+        if (!parseReal(e0, s, &target->vec[i])) return nullptr;
     }
 
-    return index;
+    return s;
 }
 
-int manta::ObjFileLoader::readWhitespace(char *s, int index) {
-    int i = index;
-    for (; s[i] != 0; ++i) {
-        if (!isWhitespace(s[i])) {
-            return i;
-        }
-    }
-
-    return i;
-}
+int manta::ObjFileLoader::countFaceTriangles(const char *s, const char *end) {
+    int vertexCount = 0;
+    while (true) {
+        const char *e0 = readWhitespace(s, end);
+        s = readToken(e0, end);
+        if (e0 == s) break;
 
-int manta::ObjFileLoader::readUntil(char *s, char terminator, int index) {
-    for (int i = index; s[i] != 0; ++i) {
-        if (s[i] == terminator) {
-            return i;
-        }
+        ++vertexCount;
     }
 
-    return -1;
+    // Faces with fewer than three vertices still take a slot so that the parse fails
+    // on them instead of running out of faces
+    return (vertexCount > 3) ? vertexCount - 2 : 1;
 }
 
-int manta::ObjFileLoader::readUntilWhitespace(char *s, int index, bool includeEnd) {
-    int i = index;
-    for (; s[i] != 0; ++i) {
-        if (isWhitespace(s[i])) {
-            return i;
-        }
-    }
+const char *manta::ObjFileLoader::readFaceVertex(const char *s, const char *end, const int *counts, int *target) {
+    const char *e0 = readWhitespace(s, end);
+    s = readToken(e0, end);
+    if (e0 == s) return nullptr;
 
-    return includeEnd
-        ? i
-        : -1;
-}
+    // Vertex, texture coordinate and normal indices separated by '/', missing
+    // trailing indices are left at -1
+    target[0] = target[1] = target[2] = -1;
+    const char *element = e0;
+    for (int j = 0; j < 3; ++j) {
+        const char *separator = (const char *)memchr(element, '/', s - element);
+        const char *elementEnd = (separator == nullptr) ? s : separator;
 
-int manta::ObjFileLoader::readVector3(char *s, math::Vector3 *target, int index) {
-    int e0, e1;
+        if (!parseInt(element, elementEnd, &target[j])) return nullptr;
 
-    index = readWhitespace(s, index);
-    if (index == -1) return -1;
+        // Relative indices count back from the last element defined so far
+        if (target[j] < 0) target[j] += counts[j] + 1;
 
-    for (int i = 0; i < 3; ++i) {
-        e0 = index;
-        index = readUntilWhitespace(s, index);
-        if (index == -1) return -1;
-        e1 = index;
-
-        if (!parseReal(s, &target->vec[i], e0, e1)) return -1;
-        index = readWhitespace(s, index);
-        if (index == -1) return -1;
+        if (separator == nullptr) break;
+        else if (j == 2) return nullptr;
+        element = separator + 1;
     }
 
-    return index;
+    return s;
 }
 
-int manta::ObjFileLoader::readVector2(char *s, math::Vector2 *target, int index) {
-    int e0, e1;
-
-    index = readWhitespace(s, index);
-    if (index == -1) return -1;
+const char *manta::ObjFileLoader::readFace(
+    const char *s, const char *end, const int *counts, int triangleCount, ObjFace *target)
+{
+    // Polygons are split into a fan of triangles around the first vertex
+    int first[3], previous[3], current[3];
+    for (int i = 0; i < triangleCount + 2; ++i) {
+        s = readFaceVertex(s, end, counts, current);
+        if (s == nullptr) return nullptr;
+
+        if (i == 0) memcpy(first, current, sizeof(first));
+        else if (i >= 2) {
+            ObjFace &face = target[i - 2];
+            const int *vertices[] = { first, previous, current };
+            for (int j = 0; j < 3; ++j) {
+                face.v[j] = vertices[j][0];
+                face.vt[j] = vertices[j][1];
+                face.vn[j] = vertices[j][2];
+            }
+        }
 
-    for (int i = 0; i < 2; ++i) {
-        e0 = index;
-        index = readUntilWhitespace(s, index);
-        if (index == -1) return -1;
-        e1 = index;
-
-        if (!parseReal(s, &target->vec[i], e0, e1)) return -1;
-        index = readWhitespace(s, index);
-        if (index == -1) return -1;
+        memcpy(previous, current, sizeof(previous));
     }
 
-    return index;
+    return s;
 }
 
-int manta::ObjFileLoader::readFace(char *s, ObjFace *target, int index) {
-    for (int i = 0; i < 3; ++i) {
-        int v[3] = {-1, -1, -1};
-        int n;
-        index = readSlashSeparatedSet(s, v, &n, index);
-        if (index == -1) return -1;
-
-        target->v[i] = v[0];
-        target->vt[i] = v[1];
-        target->vn[i] = v[2];
+bool manta::ObjFileLoader::parseReal(const char *begin, const char *end, math::real *target) {
+    static const double PowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char *s = begin;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
+
+    // Only the first 19 significant digits fit in the mantissa, the rest only
+    // affect the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int significantDigits = 0;
+    bool anyDigits = false;
+
+    for (; s < end && *s >= '0' && *s <= '9'; ++s) {
+        anyDigits = true;
+        if (significantDigits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            if (mantissa != 0) ++significantDigits;
+        }
+        else ++exponent;
     }
 
-    return index;
-}
-
-int manta::ObjFileLoader::readSlashSeparatedSet(char *s, int *target, int *n, int index) {
-    int e0, e1;
-
-    index = readWhitespace(s, index);
-    if (index == -1) return -1;
-
-    *n = 0;
-
-    for (int i = 0;; ++i) {
-        e0 = index;
-        const int s0 = readUntil(s, '/', index);
-        const int s1 = readUntilWhitespace(s, index);
-        
-        bool done = false;
-        if (s0 == -1 || s0 > s1) {
-            done = true;
-            index = s1;
-        }
-        else {
-            index = s0;
+    if (s < end && *s == '.') {
+        for (++s; s < end && *s >= '0' && *s <= '9'; ++s) {
+            anyDigits = true;
+            if (significantDigits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                if (mantissa != 0) ++significantDigits;
+                --exponent;
+            }
         }
+    }
 
-        if (index == -1) return -1;
-        e1 = index;
-
-        ++(*n);
-        if (!parseInt(s, &target[i], e0, e1)) return -1;
+    if (!anyDigits) {
+        // Infinity and NaN are rare enough to leave to the C library
+        char buffer[32];
+        const size_t length = (size_t)(end - begin);
+        if (length == 0 || length >= sizeof(buffer)) return false;
 
-        // Read '/'
-        if (!done) ++index;
-        else break;
+        memcpy(buffer, begin, length);
+        buffer[length] = '\0';
 
-        index = readWhitespace(s, index);
-        if (index == -1) return -1;
-    }
-
-    return index;
-}
+        char *e;
+        const double result = strtod(buffer, &e);
+        if (*e != '\0') return false;
 
-bool manta::ObjFileLoader::isWhitespace(char c) {
-    switch (c) {
-    case ' ':
-    case '\n':
-    case '\r':
-    case '\t':
+        *target = (math::real)result;
         return true;
-    default:
-        return false;
     }
-}
-
-bool manta::ObjFileLoader::clipCompare(char *s, const char *ref, int start, int end) {
-    const char prev = s[end];
-    s[end] = '\0';
-    const bool eq = (strcmp(s, ref) == 0);
-    s[end] = prev;
 
-    return eq;
-}
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        ++s;
 
-std::string manta::ObjFileLoader::clip(char *s, int start, int end) {
-    const char prev = s[end];
-    s[end] = '\0';
-    const std::string result = std::string(&s[start]);
-    s[end] = prev;
+        bool negativeExponent = false;
+        if (s < end && (*s == '-' || *s == '+')) negativeExponent = (*s++ == '-');
+        if (s == end || *s < '0' || *s > '9') return false;
 
-    return result;
-}
-
-bool manta::ObjFileLoader::parseReal(char *s, math::real *target, int start, int end) {
-    const char prev = s[end];
-    s[end] = '\0';
+        int e = 0;
+        for (; s < end && *s >= '0' && *s <= '9'; ++s) {
+            if (e < 10000) e = e * 10 + (*s - '0');
+        }
 
-    char *e;
-    double result = std::strtod(s + start, &e);
-    char last = *e;
+        exponent += negativeExponent ? -e : e;
+    }
 
-    s[end] = prev;
-    *target = (math::real)result;
+    if (s != end) return false;
 
-    if (last != '\0') {
-        return false;
+    double result = (double)mantissa;
+    if (exponent < 0) {
+        result = (exponent >= -22)
+            ? result / PowersOfTen[-exponent]
+            : result / pow(10.0, -exponent);
     }
-    else {
-        return true;
+    else if (exponent > 0) {
+        result = (exponent <= 22)
+            ? result * PowersOfTen[exponent]
+            : result * pow(10.0, exponent);
     }
-}
-
-bool manta::ObjFileLoader::parseInt(char *s, int *target, int start, int end) {
-    const char prev = s[end];
-    s[end] = '\0';
 
-    char *e;
-    long result = std::strtol(s + start, &e, 10);
-    char last = *e;
+    *target = (math::real)(negative ? -result : result);
+    return true;
+}
 
-    s[end] = prev;
-    *target = (int)result;
+bool manta::ObjFileLoader::parseInt(const char *begin, const char *end, int *target) {
+    const char *s = begin;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) negative = (*s++ == '-');
 
-    if (last != '\0') {
-        return false;
-    }
-    else {
-        return true;
+    // An empty index, as in "1//2", reads as 0
+    int result = 0;
+    for (; s < end; ++s) {
+        if (*s < '0' || *s > '9') return false;
+        result = result * 10 + (*s - '0');
     }
+
+    *target = negative ? -result : result;
+    return true;
 }
 
 void manta::ObjFileLoader::destroy() {
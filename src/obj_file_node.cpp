@@ -19,6 +19,7 @@ manta::ObjFileNode::ObjFileNode() : ObjectReferenceNode<Mesh>() {
     m_defaultMaterial = nullptr;
     m_cacheKey = nullptr;
     m_overwriteCache = nullptr;
+    m_diskCache = nullptr;
 }
 
 manta::ObjFileNode::~ObjFileNode() {
@@ -34,11 +35,13 @@ void manta::ObjFileNode::_evaluate() {
     piranha::native_string defaultMaterial;
     piranha::native_string cacheKey;
     piranha::native_bool overrideCache;
+    piranha::native_bool diskCache;
 
     m_filename->fullCompute((void *)&filename);
     m_defaultMaterial->fullCompute((void *)&defaultMaterial);
     m_cacheKey->fullCompute((void *)&cacheKey);
     m_overwriteCache->fullCompute((void *)&overrideCache);
+    m_diskCache->fullCompute((void *)&diskCache);
 
     Path resolvedPath;
     const Path filePath(filename.c_str());
@@ -56,29 +59,65 @@ void manta::ObjFileNode::_evaluate() {
 
     Mesh *mesh = Session::get().getCachedMesh(cacheKey);
     if (mesh == nullptr || overrideCache) {
-        auto startTime = std::chrono::system_clock::now();
-        manta::Session::get().getConsole()->out("Loading object file: " + resolvedPath.toString() + "\n");
-
-        ObjFileLoader loader;
-        const bool result = loader.loadObjFile(resolvedPath.toString().c_str());
-        if (!result) {
-            manta::Session::get().getConsole()->out("Error loading object file: " + resolvedPath.toString() + "\n");
-            throwError("Could not open .obj file: " + resolvedPath.toString());
-            return;
+        mesh = new Mesh;
+
+        // The binary cache lives next to the source file
+        std::string cacheFile;
+        if (diskCache) {
+            Path parentPath;
+            resolvedPath.getParentPath(&parentPath);
+
+            cacheFile = parentPath.append(resolvedPath.getStem() + ".mrmesh").toString();
+        }
+
+        const unsigned __int64 sourceSize = resolvedPath.getFileSize();
+        const __int64 sourceTime = resolvedPath.getLastWriteTime();
+        const hash_value sourceHash = Mesh::computeSourceHash(resolvedPath.toString().c_str());
+
+        Mesh::CacheStatus status = Mesh::CacheStatus::Missing;
+        if (!cacheFile.empty() && !overrideCache) {
+            status = mesh->loadCacheFile(cacheFile.c_str(), sourceSize, sourceTime, sourceHash);
         }
 
-        auto endTime = std::chrono::system_clock::now();
-        std::chrono::duration<double> timeElapsed = endTime - startTime;
-        std::stringstream ss;
-        ss << "Loading took: " << timeElapsed.count() << "s" << "\n";
+        if (status == Mesh::CacheStatus::Loaded) {
+            manta::Session::get().getConsole()->out("Loaded mesh from disk cache: " + cacheFile + "\n");
+        }
+        else {
+            if (status == Mesh::CacheStatus::Stale || status == Mesh::CacheStatus::Corrupt) {
+                manta::Session::get().getConsole()->out("Disk cache is invalid, reloading: " + cacheFile + "\n");
+            }
 
-        manta::Session::get().getConsole()->out(ss.str());
+            auto startTime = std::chrono::system_clock::now();
+            manta::Session::get().getConsole()->out("Loading object file: " + resolvedPath.toString() + "\n");
 
-        mesh = new Mesh;
-        mesh->loadObjFileData(&loader);
+            ObjFileLoader loader;
+            const bool result = loader.loadObjFile(resolvedPath.toString().c_str());
+            if (!result) {
+                delete mesh;
+
+                manta::Session::get().getConsole()->out("Error loading object file: " + resolvedPath.toString() + "\n");
+                throwError("Could not open .obj file: " + resolvedPath.toString());
+                return;
+            }
+
+            auto endTime = std::chrono::system_clock::now();
+            std::chrono::duration<double> timeElapsed = endTime - startTime;
+            std::stringstream ss;
+            ss << "Loading took: " << timeElapsed.count() << "s" << "\n";
+
+            manta::Session::get().getConsole()->out(ss.str());
+
+            mesh->loadObjFileData(&loader);
+
+            // Free memory used by object file
+            loader.destroy();
+
+            if (!cacheFile.empty() && !mesh->writeCacheFile(cacheFile.c_str(), sourceSize, sourceTime, sourceHash)) {
+                manta::Session::get().getConsole()->out("Could not write disk cache: " + cacheFile + "\n");
+            }
+        }
 
-        // Free memory used by object file
-        loader.destroy();
+        mesh->setSourcePath(resolvedPath.toString());
 
         Session::get().putCachedMesh(cacheKey, mesh);
     }
@@ -102,4 +141,5 @@ void manta::ObjFileNode::registerInputs() {
     registerInput(&m_defaultMaterial, "default_material");
     registerInput(&m_cacheKey, "cache_key");
     registerInput(&m_overwriteCache, "overwrite_cache");
+    registerInput(&m_diskCache, "disk_cache");
 }
@@ -53,6 +53,15 @@ bool manta::Octree::findClosestIntersection(
     return findClosestIntersection(&m_tree, ray, ood, intersection, minDepth, maxDepth, s /**/ STATISTICS_PARAM_INPUT, true);
 }
 
+bool manta::Octree::occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const {
+    LightRay ray;
+    ray.setSource(p0);
+    ray.setDirection(d);
+    ray.calculateTransformations();
+
+    return occluded(&m_tree, &ray, ray.getInverseDirection(), maxDepth /**/ STATISTICS_PARAM_INPUT, true);
+}
+
 void manta::Octree::fineIntersection(const math::Vector &r, IntersectionPoint *p, const CoarseIntersection *hint) const {
     hint->sceneGeometry->fineIntersection(r, p, hint);
 }
@@ -61,6 +70,13 @@ bool manta::Octree::fastIntersection(LightRay *ray) const {
     return true;
 }
 
+bool manta::Octree::getBounds(AABB *bounds) const {
+    bounds->minPoint = m_tree.minPoint;
+    bounds->maxPoint = m_tree.maxPoint;
+
+    return true;
+}
+
 void manta::Octree::analyze(Mesh *mesh, int maxSize) {
     std::vector<int> allFaces;
     int faceCount = mesh->getFaceCount();
@@ -222,6 +238,36 @@ bool manta::Octree::findClosestIntersection(
     return found;
 }
 
+bool manta::Octree::occluded(
+    const OctreeBV *leaf,
+    const LightRay *ray,
+    const math::Vector &ood,
+    math::real maxDepth
+    /**/ STATISTICS_PROTOTYPE, bool skip) const
+{
+    math::real rayDepth = math::constants::REAL_MAX;
+
+    INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvTests);
+    if (!skip && !AABBIntersect(leaf, ray, &rayDepth, ood)) return false;
+
+    INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
+    if (!skip && rayDepth > maxDepth) return false;
+
+    if (leaf->faceCount > 0) {
+        if (m_mesh->occluded(m_faceLists[leaf->faceList], leaf->faceCount, ray, maxDepth /**/ STATISTICS_PARAM_INPUT)) {
+            return true;
+        }
+    }
+
+    const int childCount = leaf->childCount;
+    const OctreeBV *childList = m_childLists[leaf->childList];
+    for (int i = 0; i < childCount; i++) {
+        if (occluded(&childList[i], ray, ood, maxDepth /**/ STATISTICS_PARAM_INPUT)) return true;
+    }
+
+    return false;
+}
+
 bool manta::Octree::analyze(Mesh *mesh, OctreeBV *leaf, int maxSize, std::vector<int> &facePool) {
     Face *faces = mesh->getFaces();
     math::Vector *vertices = mesh->getVertices();
@@ -85,3 +85,17 @@ bool manta::Path::isAbsolute() const {
 bool manta::Path::exists() const {
     return boost::filesystem::exists(*m_path);
 }
+
+unsigned __int64 manta::Path::getFileSize() const {
+    boost::system::error_code error;
+    const boost::uintmax_t size = boost::filesystem::file_size(*m_path, error);
+
+    return error ? 0 : (unsigned __int64)size;
+}
+
+__int64 manta::Path::getLastWriteTime() const {
+    boost::system::error_code error;
+    const std::time_t time = boost::filesystem::last_write_time(*m_path, error);
+
+    return error ? 0 : (__int64)time;
+}
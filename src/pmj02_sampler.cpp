@@ -0,0 +1,218 @@
+#include "../include/pmj02_sampler.h"
+
+#include "../include/low_discrepancy.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+manta::Pmj02Sampler::Pmj02Sampler() {
+    m_pixelSeed = 0;
+    m_dimension = 0;
+    m_setSize = 0;
+}
+
+manta::Pmj02Sampler::~Pmj02Sampler() {
+    /* void */
+}
+
+void manta::Pmj02Sampler::configure(int samplesPerPixel) {
+    setSamplesPerPixel(samplesPerPixel);
+
+    m_setSize = 1;
+    while (m_setSize < samplesPerPixel && m_setSize < MaxSetSize) m_setSize *= 2;
+
+    // The tables only depend on the sample count so that every clone agrees
+    std::mt19937 rng(TableSeed);
+    std::vector<math::Vector2> *sets = new std::vector<math::Vector2>((size_t)SetCount * m_setSize);
+    for (int i = 0; i < SetCount; i++) {
+        generateSequence(&(*sets)[(size_t)i * m_setSize], m_setSize, rng);
+    }
+
+    m_sets.reset(sets);
+}
+
+void manta::Pmj02Sampler::startPixelSession() {
+    Sampler::startPixelSession();
+
+    m_pixelSeed = getPixelKey();
+    m_dimension = 0;
+}
+
+bool manta::Pmj02Sampler::startNextSample() {
+    m_dimension = 0;
+
+    return Sampler::startNextSample();
+}
+
+manta::math::real manta::Pmj02Sampler::generate1d() {
+    uint32_t x, y;
+    lookup(&x, &y);
+
+    return fixedPointToReal(x);
+}
+
+manta::math::Vector2 manta::Pmj02Sampler::generate2d() {
+    uint32_t x, y;
+    lookup(&x, &y);
+
+    return math::Vector2(fixedPointToReal(x), fixedPointToReal(y));
+}
+
+manta::Sampler *manta::Pmj02Sampler::clone() const {
+    Pmj02Sampler *newSampler = new Pmj02Sampler;
+    newSampler->setSamplesPerPixel(m_samplesPerPixel);
+    newSampler->m_setSize = m_setSize;
+    newSampler->m_sets = m_sets;
+
+    return newSampler;
+}
+
+void manta::Pmj02Sampler::lookup(uint32_t *x, uint32_t *y) {
+    const uint32_t seed = hashCombine32(m_pixelSeed, (uint32_t)m_dimension++);
+
+    // Sample counts beyond the table size reuse the table with a different scramble
+    const uint32_t round = (uint32_t)(m_currentPixelSample / m_setSize);
+    const uint32_t roundSeed = hashCombine32(seed, round);
+
+    // Owen scrambling the index keeps every power-of-two prefix on an aligned block of
+    // the table, each of which is stratified in the same way as the whole sequence
+    const uint32_t index = owenScramble(
+        (uint32_t)(m_currentPixelSample % m_setSize), roundSeed) & (uint32_t)(m_setSize - 1);
+
+    const int set = (int)(hashCombine32(roundSeed, 1) % SetCount);
+    const math::Vector2 &s = (*m_sets)[(size_t)set * m_setSize + index];
+
+    // Flipping the same bits of every sample maps each elementary interval onto another
+    *x = realToFixedPoint(s.x) ^ hashCombine32(roundSeed, 2);
+    *y = realToFixedPoint(s.y) ^ hashCombine32(roundSeed, 3);
+}
+
+void manta::Pmj02Sampler::generateSequence(math::Vector2 *samples, int count, std::mt19937 &rng) {
+    assert((count & (count - 1)) == 0);
+
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+    // Occupied strata of every elementary interval shape for the current sample count
+    std::vector<bool> occupied;
+    int log2Count = 0, totalCount = 0;
+
+    auto stratum = [&](double x, double y, int shape) {
+        const int xStrata = 1 << shape;
+        const int yStrata = totalCount >> shape;
+        const int xi = std::min((int)(x * xStrata), xStrata - 1);
+        const int yi = std::min((int)(y * yStrata), yStrata - 1);
+        return (size_t)shape * totalCount + (size_t)xi * yStrata + yi;
+    };
+
+    auto markStrata = [&](double x, double y) {
+        for (int shape = 0; shape <= log2Count; shape++) occupied[stratum(x, y, shape)] = true;
+    };
+
+    auto resetStrata = [&](int newCount, int existing) {
+        totalCount = newCount;
+        for (log2Count = 0; (1 << log2Count) < newCount; log2Count++);
+
+        occupied.assign((size_t)(log2Count + 1) * totalCount, false);
+        for (int i = 0; i < existing; i++) markStrata(samples[i].x, samples[i].y);
+    };
+
+    // Random position in a fine stratum, rounded to the stored precision without leaving it
+    auto jitter = [&](int cell) {
+        const math::real upper = (math::real)((double)(cell + 1) / totalCount);
+        const math::real v = (math::real)((cell + dist(rng)) / totalCount);
+        return (double)((v < upper) ? v : std::nextafter(upper, (math::real)0.0));
+    };
+
+    // Places a sample in one quadrant of a cell of an n x n grid. Only the finest strata
+    // matter for validity so the free ones are enumerated instead of rejection sampling.
+    std::vector<int> freeColumns, freeRows, candidates;
+    auto generatePoint = [&](int i, int xCell, int yCell, int xHalf, int yHalf, int n) {
+        const int span = totalCount / (2 * n);
+        const int x0 = (2 * xCell + xHalf) * span;
+        const int y0 = (2 * yCell + yHalf) * span;
+
+        freeColumns.clear();
+        freeRows.clear();
+        for (int j = 0; j < span; j++) {
+            if (!occupied[(size_t)log2Count * totalCount + x0 + j]) freeColumns.push_back(x0 + j);
+            if (!occupied[y0 + j]) freeRows.push_back(y0 + j);
+        }
+
+        candidates.clear();
+        for (int xi : freeColumns) {
+            for (int yi : freeRows) {
+                bool valid = true;
+                for (int shape = 1; shape < log2Count && valid; shape++) {
+                    const int yShift = shape, xShift = log2Count - shape;
+                    const size_t index = (size_t)shape * totalCount +
+                        (size_t)(xi >> xShift) * (totalCount >> shape) + (yi >> yShift);
+                    valid = !occupied[index];
+                }
+
+                if (valid) candidates.push_back(xi * totalCount + yi);
+            }
+        }
+
+        assert(!candidates.empty());
+        const int chosen = candidates.empty()
+            ? (x0 * totalCount + y0)
+            : candidates[rng() % candidates.size()];
+
+        const double x = jitter(chosen / totalCount);
+        const double y = jitter(chosen % totalCount);
+
+        markStrata(x, y);
+        samples[i].x = (math::real)x;
+        samples[i].y = (math::real)y;
+    };
+
+    auto cellOf = [](const math::Vector2 &s, int n, int *xCell, int *yCell, int *xHalf, int *yHalf) {
+        const double x = s.x * (double)n, y = s.y * (double)n;
+        *xCell = std::min((int)x, n - 1);
+        *yCell = std::min((int)y, n - 1);
+        *xHalf = std::min((int)(2 * (x - *xCell)), 1);
+        *yHalf = std::min((int)(2 * (y - *yCell)), 1);
+    };
+
+    samples[0].x = (math::real)dist(rng);
+    samples[0].y = (math::real)dist(rng);
+
+    int n = 1;
+    for (int N = 1; N < count; N *= 4, n *= 2) {
+        // Even step: fill the quadrant diagonally opposite each existing sample
+        resetStrata(2 * N, N);
+        for (int i = 0; i < N; i++) {
+            int xCell, yCell, xHalf, yHalf;
+            cellOf(samples[i], n, &xCell, &yCell, &xHalf, &yHalf);
+            generatePoint(N + i, xCell, yCell, 1 - xHalf, 1 - yHalf, n);
+        }
+
+        if (2 * N >= count) break;
+
+        // Odd step: fill the two remaining quadrants, first one of them in every cell
+        resetStrata(4 * N, 2 * N);
+        std::vector<int> xHalves(N), yHalves(N);
+        for (int i = 0; i < N; i++) {
+            int xCell, yCell, xHalf, yHalf;
+            cellOf(samples[i], n, &xCell, &yCell, &xHalf, &yHalf);
+
+            if (dist(rng) < 0.5) xHalves[i] = 1 - xHalf, yHalves[i] = yHalf;
+            else xHalves[i] = xHalf, yHalves[i] = 1 - yHalf;
+
+            generatePoint(2 * N + i, xCell, yCell, xHalves[i], yHalves[i], n);
+        }
+
+        for (int i = 0; i < N; i++) {
+            int xCell, yCell, xHalf, yHalf;
+            cellOf(samples[i], n, &xCell, &yCell, &xHalf, &yHalf);
+            generatePoint(3 * N + i, xCell, yCell, 1 - xHalves[i], 1 - yHalves[i], n);
+        }
+    }
+}
+
+void manta::Pmj02Sampler::_evaluate() {
+    Sampler::_evaluate();
+
+    configure(m_samplesPerPixel);
+}
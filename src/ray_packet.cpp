@@ -0,0 +1,40 @@
+#include "../include/ray_packet.h"
+
+#include "../include/light_ray.h"
+
+#include <assert.h>
+
+void manta::RayPacket::initialize(LightRay *const *rays, int count) {
+    assert(count > 0 && count <= Width);
+
+    this->count = count;
+
+    for (int i = 0; i < Width; i++) {
+        LightRay *ray = rays[(i < count) ? i : 0];
+        this->rays[i] = ray;
+
+        const math::Vector source = ray->getSource();
+        const math::Vector ood = ray->getInverseDirection();
+        for (int axis = 0; axis < 3; axis++) {
+            origin[axis][i] = math::get(source, axis);
+            inverseDirection[axis][i] = math::get(ood, axis);
+        }
+    }
+}
+
+bool manta::RayPacket::isCoherent(int laneMask) const {
+    int first = -1;
+    for (int i = 0; i < count; i++) {
+        if ((laneMask & (0x1 << i)) == 0) continue;
+        else if (first == -1) {
+            first = i;
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (isNegative(i, axis) != isNegative(first, axis)) return false;
+        }
+    }
+
+    return true;
+}
@@ -24,14 +24,24 @@
 #include "../include/sampler.h"
 #include "../include/console.h"
 #include "../include/light.h"
+#include "../include/mesh_light.h"
+#include "../include/mesh.h"
+#include "../include/kd_tree.h"
+#include "../include/geometry_instance.h"
 #include "../include/render_pattern.h"
 #include "../include/spiral_render_pattern.h"
+#include "../include/ray_packet.h"
+#include "../include/wavefront_queue.h"
+#include "../include/thread_pool.h"
+#include "../include/texture_cache.h"
 
 #include <iostream>
 #include <thread>
 #include <chrono>
 #include <sstream>
 #include <stack>
+#include <algorithm>
+#include <random>
 
 manta::RayTracer::RayTracer() {
     m_multithreadedInput = nullptr;
@@ -47,6 +57,24 @@ manta::RayTracer::RayTracer() {
     m_workers = nullptr;
     m_renderPattern = nullptr;
     m_directLightSamplingEnableInput = nullptr;
+    m_adaptiveSamplingInput = nullptr;
+    m_adaptiveMaxSamplesInput = nullptr;
+    m_adaptiveThresholdInput = nullptr;
+    m_packetTracingInput = nullptr;
+    m_wavefrontInput = nullptr;
+    m_textureCacheBudgetInput = nullptr;
+    m_hugePagesInput = nullptr;
+    m_lightSamplingInput = nullptr;
+    m_sampleCountImage = nullptr;
+
+    m_adaptiveSampling = false;
+    m_adaptiveMaxSamples = 0;
+    m_adaptiveThreshold = (math::real)0.05;
+
+    m_packetTracing = false;
+    m_wavefront = false;
+
+    m_lightSamplingStrategy = LightSampler::Strategy::Spatial;
 
     m_directLightSampling = true;
     m_deterministicSeed = false;
@@ -72,12 +100,21 @@ void manta::RayTracer::traceAll(const Scene *scene, CameraRayEmitterGroup *group
     // Set up the emitter group
     group->configure();
 
+    // Build the top-level acceleration structure
+    prepareScene(scene);
+
+    TextureCache::Global()->resetStatistics();
+
+    initializeSampleCountImage(group);
+
     // Create jobs
     RenderPattern::PatternParameters params;
     params.group = group;
     params.scene = scene;
     params.target = target;
 
+    m_jobQueue.initialize(m_threadCount);
+
     if (m_renderPattern == nullptr) {
         SpiralRenderPattern renderPattern;
         renderPattern.setBlockWidth(64);
@@ -93,8 +130,7 @@ void manta::RayTracer::traceAll(const Scene *scene, CameraRayEmitterGroup *group
 
     // Create and start all threads
     createWorkers();
-    startWorkers();
-    waitForWorkers();
+    runWorkers();
 
     target->normalize();
 
@@ -139,6 +175,18 @@ void manta::RayTracer::traceAll(const Scene *scene, CameraRayEmitterGroup *group
     ss_out <<        "Total processing time:               " << diff.count() << " s" << std::endl;
     ss_out <<        "------------------------------------------------" << std::endl;
     ss_out <<        "Standard allocator peak usage:       " << StandardAllocator::Global()->getMaxUsage() / (double)MB << " MB" << std::endl;
+    for (int i = 0; i < (int)MemoryTag::Count; i++) {
+        const MemoryTag tag = (MemoryTag)i;
+        if (StandardAllocator::Global()->getMaxUsage(tag) == 0) continue;
+
+        std::stringstream ss;
+        ss <<            "    " << StandardAllocator::getTagName(tag) << ":";
+        ss_out << ss.str();
+        for (int j = 0; j < (37 - ss.str().length()); j++) {
+            ss_out << " ";
+        }
+        ss_out << StandardAllocator::Global()->getMaxUsage(tag) / (double)MB << " MB" << std::endl;
+    }
     ss_out <<        "Main allocator peak usage:           " << m_stack.getMaxUsage() / (double)MB << " MB" << std::endl;
     unsigned __int64 totalUsage = m_stack.getMaxUsage() + StandardAllocator::Global()->getMaxUsage();
     for (int i = 0; i < m_threadCount; i++) {
@@ -148,11 +196,25 @@ void manta::RayTracer::traceAll(const Scene *scene, CameraRayEmitterGroup *group
         for (int j = 0; j < (37 - ss.str().length()); j++) {
             ss_out << " ";
         }
-        ss_out << m_workers[i].getMaxMemoryUsage() / (double)MB << " MB" << std::endl;
+        ss_out << m_workers[i].getMaxMemoryUsage() / (double)MB << " MB"
+            << " (" << m_workers[i].getReservedMemory() / (double)MB << " MB reserved in "
+            << m_workers[i].getMemoryChunkCount() << " chunks)" << std::endl;
         totalUsage += m_workers[i].getMaxMemoryUsage();
     }
     ss_out <<        "                                     -----------" << std::endl;
     ss_out <<        "Total memory usage:                  " << totalUsage / (double)MB << " MB" << std::endl;
+
+    const TextureCache::Statistics textureCache = TextureCache::Global()->getStatistics();
+    if (textureCache.hits + textureCache.misses > 0) {
+        const unsigned __int64 lookups = textureCache.hits + textureCache.misses;
+        ss_out <<    "------------------------------------------------" << std::endl;
+        ss_out <<    "Texture cache hits:                  " << textureCache.hits
+            << " (" << 100.0 * textureCache.hits / lookups << "%)" << std::endl;
+        ss_out <<    "Texture cache misses:                " << textureCache.misses << std::endl;
+        ss_out <<    "Texture cache evictions:             " << textureCache.evictions << std::endl;
+        ss_out <<    "Texture cache peak usage:            " << textureCache.maxUsage / (double)MB << " MB"
+            << " (" << TextureCache::Global()->getBudget() / (double)MB << " MB budget)" << std::endl;
+    }
     ss_out <<        "================================================" << std::endl;
 
     Session::get().getConsole()->out(ss_out.str());
@@ -165,6 +227,10 @@ void manta::RayTracer::tracePixel(int px, int py, const Scene *scene, CameraRayE
     group->initialize();
     target->initialize(group->getResolutionX(), group->getResolutionY());
 
+    prepareScene(scene);
+
+    initializeSampleCountImage(group);
+
     // Create the singular job for the pixel
     Job job;
     job.scene = scene;
@@ -175,18 +241,37 @@ void manta::RayTracer::tracePixel(int px, int py, const Scene *scene, CameraRayE
     job.startY = py;
     job.endY = py;
 
+    m_jobQueue.initialize(m_threadCount);
     m_jobQueue.push(job);
 
     // Create and start all threads
     createWorkers();
-    startWorkers();
-    waitForWorkers();
+    runWorkers();
+}
+
+void manta::RayTracer::prepareScene(const Scene *scene) {
+    m_sceneBVH.build(scene);
+    buildLights(scene);
 }
 
 void manta::RayTracer::configure(mem_size stackSize, mem_size workerStackSize, int threadCount, bool multithreaded) {
     m_stack.initialize(stackSize);
     m_multithreaded = multithreaded;
-    m_threadCount = threadCount;
+
+    // The render shares the process-wide pool, which is never resized. An explicit
+    // thread count only limits how many workers are queued on it.
+    if (multithreaded) {
+        const int poolThreads = ThreadPool::Global()->getThreadCount();
+        m_threadCount = (threadCount > 0)
+            ? std::min(threadCount, poolThreads)
+            : poolThreads;
+    }
+    else {
+        m_threadCount = (threadCount > 0)
+            ? threadCount
+            : 1;
+    }
+
     m_workerStackSize = workerStackSize;
 }
 
@@ -196,42 +281,66 @@ void manta::RayTracer::destroy() {
         delete m_outputImage;
     }
 
+    if (m_sampleCountImage != nullptr) {
+        m_sampleCountImage->destroy();
+        delete m_sampleCountImage;
+        m_sampleCountImage = nullptr;
+    }
+
     destroyWorkers();
+    m_sceneBVH.destroy();
+    destroyLights();
 }
 
 void manta::RayTracer::incrementRayCompletion(const Job *job, int increment) {
-    m_outputLock.lock();
-    
     const int emitterCount = job->group->getResolutionX() * job->group->getResolutionY();
-    m_currentRay += increment;
+    const int currentRay = m_currentRay.fetch_add(increment) + increment;
 
     // Print in increments of 1000 or the last 1000 one by one
-    if ((m_currentRay - m_lastRayPrint) > 1000 || m_currentRay >= (emitterCount - 1000)) {
-        std::stringstream ss;
-        ss << "Pixel " << m_currentRay << "/" << emitterCount << "                      \r";
-        Session::get().getConsole()->out(ss.str());
+    if ((currentRay - m_lastRayPrint) > 1000 || currentRay >= (emitterCount - 1000)) {
+        // Intermediate updates are skipped if another worker is already printing
+        if (currentRay >= emitterCount) m_outputLock.lock();
+        else if (!m_outputLock.try_lock()) return;
+
+        if (currentRay > m_lastRayPrint) {
+            std::stringstream ss;
+            ss << "Pixel " << currentRay << "/" << emitterCount << "                      \r";
+            Session::get().getConsole()->out(ss.str());
 
-        m_lastRayPrint = m_currentRay;
+            m_lastRayPrint = currentRay;
+        }
+
+        m_outputLock.unlock();
     }
+}
+
+void manta::RayTracer::initializeSampleCountImage(const CameraRayEmitterGroup *group) {
+    if (m_sampleCountImage == nullptr) m_sampleCountImage = new VectorMap2D;
+    else m_sampleCountImage->destroy();
 
-    m_outputLock.unlock();
+    m_sampleCountImage->initialize(group->getResolutionX(), group->getResolutionY());
 }
 
-manta::math::Vector manta::RayTracer::uniformSampleOneLight(IntersectionPoint *point, const Scene *scene, Sampler *sampler, IntersectionPointManager *manager, StackAllocator *stackAllocator) const {
-    const int lightCount = scene->getLightCount();
-    if (lightCount == 0) return math::constants::Zero;
-    const int light_i = std::min((int)(sampler->generate1d() * lightCount), lightCount - 1);
+void manta::RayTracer::recordSampleCount(int x, int y, int samples) {
+    int maxSamples = m_sampler->getSamplesPerPixel();
+    if (m_adaptiveSampling) maxSamples = std::max(maxSamples, m_adaptiveMaxSamples);
 
-    Light *light = scene->getLight(light_i);
+    // Each pixel is only ever written by the worker that traced it
+    m_sampleCountImage->set(math::loadScalar((math::real)samples / std::max(maxSamples, 1)), x, y);
+}
 
-    const math::Vector2 uLight = sampler->generate2d();
-    const math::Vector2 uScattering = sampler->generate2d();
+manta::math::Vector manta::RayTracer::uniformSampleOneLight(
+    IntersectionPoint *point,
+    const Scene *scene,
+    Sampler *sampler,
+    IntersectionPointManager *manager,
+    StackAllocator *stackAllocator
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    DirectLightingSample sample;
+    sampleOneLight(point, scene, sampler, &sample, stackAllocator);
 
-    const math::Vector l_n = math::loadScalar((math::real)lightCount);
-    return math::mul(
-        l_n,
-        estimateDirect(point, uScattering, light, uLight, scene, sampler, manager, stackAllocator)
-    );
+    return sample.evaluate(traceShadowRays(scene, sample /**/ STATISTICS_PARAM_INPUT));
 }
 
 manta::math::Vector manta::RayTracer::estimateDirect(
@@ -242,12 +351,51 @@ manta::math::Vector manta::RayTracer::estimateDirect(
     const Scene *scene,
     Sampler *sampler,
     IntersectionPointManager *manager,
-    StackAllocator *stackAllocator /**/
-    STATISTICS_PROTOTYPE) const
+    StackAllocator *stackAllocator
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    DirectLightingSample sample;
+    sample.reset();
+    sampleDirect(point, uScattering, light, (math::real)1.0, uLight, &sample, stackAllocator);
+
+    return sample.evaluate(traceShadowRays(scene, sample /**/ STATISTICS_PARAM_INPUT));
+}
+
+void manta::RayTracer::sampleOneLight(
+    IntersectionPoint *point,
+    const Scene *scene,
+    Sampler *sampler,
+    DirectLightingSample *sample,
+    StackAllocator *stackAllocator) const
 {
+    sample->reset();
+
+    // Dimensions are always consumed so that the sample sequence doesn't depend on
+    // whether a light was found
+    math::real selectionPmf;
+    const Light *light = m_lightSampler.sample(point->m_position, point->m_vertexNormal, sampler->generate1d(), &selectionPmf);
+
+    const math::Vector2 uLight = sampler->generate2d();
+    const math::Vector2 uScattering = sampler->generate2d();
+
+    if (light == nullptr || selectionPmf == 0) return;
+
+    sampleDirect(point, uScattering, light, selectionPmf, uLight, sample, stackAllocator);
+}
+
+void manta::RayTracer::sampleDirect(
+    IntersectionPoint *point,
+    const math::Vector2 &uScattering,
+    const Light *light,
+    math::real selectionPmf,
+    const math::Vector2 &uLight,
+    DirectLightingSample *sample,
+    StackAllocator *stackAllocator) const
+{
+    // The BSDF sample only counts if it hits the chosen light, so both strategies are
+    // conditioned on the light selection and their densities include its probability
     math::Vector wi;
     math::real lightPdf = 0, scatteringPdf = 0;
-    math::Vector Ld = math::constants::Zero;
     math::real depth;
     math::Vector Li = light->sampleIncoming(*point, uLight, &wi, &lightPdf, &depth);
 
@@ -255,57 +403,68 @@ manta::math::Vector manta::RayTracer::estimateDirect(
     if (lightPdf > 0) {
         f = point->m_bsdf->f(point, point->m_lightRay->getDirection(), math::negate(wi), true);
         scatteringPdf = point->m_bsdf->pdf(point, point->m_lightRay->getDirection(), math::negate(wi));
+
+        // Nothing is added if the BSDF can't scatter towards the light
         if (scatteringPdf != 0) {
-            const math::Vector p0 = (math::getScalar(math::dot(wi, point->m_vertexNormal)) > 0)
+            // Surfaces are also found by the path's own scattered ray, which doesn't
+            // depend on the light selection
+            const math::real w = light->isSurfaceEmitter()
+                ? powerHeuristic(1, selectionPmf * lightPdf, 1, scatteringPdf)
+                : powerHeuristic(1, selectionPmf * lightPdf, 1, selectionPmf * scatteringPdf);
+
+            DirectLightingSample::ShadowRay *shadowRay = sample->addShadowRay();
+            shadowRay->origin = (math::getScalar(math::dot(wi, point->m_vertexNormal)) > 0)
                 ? point->m_outside
                 : point->m_inside;
-            const bool occluded = this->occluded(scene, p0, wi, depth /**/ STATISTICS_PARAM_INPUT);
-            if (occluded) {
-                Li = math::constants::Zero;
-            }
+            shadowRay->direction = wi;
+            shadowRay->maxDepth = depth;
+            shadowRay->contribution = math::mul(f, math::mul(Li, math::loadScalar(w / (selectionPmf * lightPdf))));
         }
-        else {
-            Li = math::constants::Zero;
-        }
-
-        const math::real w = powerHeuristic(1, lightPdf, 1, scatteringPdf);
-        Ld = math::add(Ld, math::mul(f, math::mul(Li, math::loadScalar(w / lightPdf))));
     }
 
+    // The other half of the estimate is added when the path hits the surface
+    if (light->isSurfaceEmitter()) return;
+
     RayFlags flags = RayFlag::None;
     f = point->m_bsdf->sampleF(point, uScattering, math::negate(point->m_lightRay->getDirection()), &wi, &scatteringPdf, &flags, stackAllocator, true);
     f = math::mask(f, math::constants::MaskOffW);
     if (scatteringPdf > 0 && (flags & RayFlag::Delta) == 0) {
         lightPdf = light->pdfIncoming(*point, wi);
         if (lightPdf == 0) {
-            return Ld;
+            return;
         }
 
-        const math::real weight = powerHeuristic(1, scatteringPdf, 1, lightPdf);
+        const math::real weight = powerHeuristic(1, selectionPmf * scatteringPdf, 1, selectionPmf * lightPdf);
         depth = math::constants::REAL_MAX;
         if (light->intersect(point->m_position, wi, &depth)) {
             const math::Vector p0 = ((flags & RayFlag::Transmission) > 0)
                 ? point->m_inside
                 : point->m_outside;
-            const bool occluded = this->occluded(scene, p0, wi, depth /**/ STATISTICS_PARAM_INPUT);
 
-            if (!occluded) {
-                // TODO: inputs are technically wrong
-                IntersectionPoint p;
-                p.m_position = p0;
-                Li = light->L(p, wi);
-            }
-            else {
-                Li = math::constants::Zero;
-            }
+            // TODO: inputs are technically wrong
+            IntersectionPoint p;
+            p.m_position = p0;
+            Li = light->L(p, wi);
 
-            Ld = math::add(
-                Ld,
-                math::mul(math::mul(f, Li), math::loadScalar(weight / scatteringPdf)));
+            DirectLightingSample::ShadowRay *shadowRay = sample->addShadowRay();
+            shadowRay->origin = p0;
+            shadowRay->direction = wi;
+            shadowRay->maxDepth = depth;
+            shadowRay->contribution = math::mul(math::mul(f, Li), math::loadScalar(weight / (selectionPmf * scatteringPdf)));
         }
     }
+}
 
-    return Ld;
+int manta::RayTracer::traceShadowRays(const Scene *scene, const DirectLightingSample &sample /**/ STATISTICS_PROTOTYPE) const {
+    int occludedMask = 0;
+    for (int i = 0; i < sample.shadowRayCount; i++) {
+        const DirectLightingSample::ShadowRay &shadowRay = sample.shadowRays[i];
+        if (occluded(scene, shadowRay.origin, shadowRay.direction, shadowRay.maxDepth /**/ STATISTICS_PARAM_INPUT)) {
+            occludedMask |= 0x1 << i;
+        }
+    }
+
+    return occludedMask;
 }
 
 manta::math::real manta::RayTracer::powerHeuristic(int nf, math::real f_pdf, int ng, math::real g_pdf) {
@@ -314,11 +473,107 @@ manta::math::real manta::RayTracer::powerHeuristic(int nf, math::real f_pdf, int
     return (f * f) / (f * f + g * g);
 }
 
+manta::math::real manta::RayTracer::emissionWeight(
+    const IntersectionPoint &point,
+    SceneObject *sceneObject,
+    const ScatteringSample &scattering) const
+{
+    auto meshLight = m_meshLightLookup.find(sceneObject);
+    if (meshLight == m_meshLightLookup.end()) return (math::real)1.0;
+
+    const math::real areaPdf = meshLight->second->pdfArea(point);
+    if (areaPdf == 0) return (math::real)1.0;
+
+    const math::Vector d = math::sub(point.m_position, scattering.position);
+    const math::real distanceSquared = math::getScalar(math::magnitudeSquared3(d));
+    const math::real cosTheta = std::abs(math::getScalar(math::dot(point.m_faceNormal, point.m_lightRay->getDirection())));
+    if (cosTheta == 0) return (math::real)1.0;
+
+    // Density with which the previous vertex would have sampled this point as a light
+    const math::real lightPdf =
+        m_lightSampler.pmf(scattering.position, scattering.normal, meshLight->second)
+        * areaPdf * distanceSquared / cosTheta;
+
+    return powerHeuristic(1, scattering.pdf, 1, lightPdf);
+}
+
+void manta::RayTracer::buildLights(const Scene *scene) {
+    destroyLights();
+
+    std::vector<Light *> lights;
+    for (int i = 0; i < scene->getLightCount(); i++) {
+        lights.push_back(scene->getLight(i));
+    }
+
+    // Emissive meshes are only sampled directly if there is direct lighting at all
+    int triangleCount = 0;
+    if (m_directLightSampling) {
+        for (int i = 0; i < scene->getSceneObjectCount(); i++) {
+            SceneObject *object = scene->getSceneObject(i);
+
+            // Instanced meshes are sampled through their transform, hits on them are
+            // MIS weighted against these samples in emissionWeight
+            const SceneGeometry *geometry = object->getGeometry();
+            const GeometryInstance *instance = dynamic_cast<const GeometryInstance *>(geometry);
+            if (instance != nullptr) geometry = instance->getGeometry();
+
+            const Mesh *mesh = nullptr;
+            if (const KDTree *kdTree = dynamic_cast<const KDTree *>(geometry)) {
+                mesh = kdTree->getMesh();
+            }
+            else {
+                mesh = dynamic_cast<const Mesh *>(geometry);
+            }
+
+            if (mesh == nullptr) continue;
+
+            MeshLight *meshLight = new MeshLight;
+            if (!meshLight->initialize(object, mesh, instance, m_materialManager)) {
+                delete meshLight;
+                continue;
+            }
+
+            triangleCount += meshLight->getTriangleCount();
+            m_meshLights.push_back(meshLight);
+            m_meshLightLookup[object] = meshLight;
+            lights.push_back(meshLight);
+        }
+    }
+
+    if (!m_meshLights.empty()) {
+        std::stringstream ss;
+        ss << "Sampling " << triangleCount << " emissive faces of " << m_meshLights.size() << " meshes" << "\n";
+        Session::get().getConsole()->out(ss.str());
+    }
+
+    m_lightSampler.build(lights.data(), (int)lights.size(), m_lightSamplingStrategy);
+}
+
+void manta::RayTracer::destroyLights() {
+    m_lightSampler.destroy();
+
+    for (MeshLight *meshLight : m_meshLights) {
+        meshLight->destroy();
+        delete meshLight;
+    }
+
+    m_meshLights.clear();
+    m_meshLightLookup.clear();
+}
+
 void manta::RayTracer::_evaluate() {
     piranha::native_int threadCount;
     piranha::native_bool multithreaded;
     piranha::native_bool deterministicSeed;
     piranha::native_bool enableDirectLightSampling;
+    piranha::native_bool adaptiveSampling;
+    piranha::native_int adaptiveMaxSamples;
+    piranha::native_float adaptiveThreshold;
+    piranha::native_bool packetTracing;
+    piranha::native_bool wavefront;
+    piranha::native_int textureCacheBudget;
+    piranha::native_bool hugePages;
+    piranha::native_string lightSampling;
     CameraRayEmitterGroup *camera;
     Scene *scene;
 
@@ -326,9 +581,41 @@ void manta::RayTracer::_evaluate() {
     static_cast<piranha::NodeOutput *>(m_threadCountInput)->fullCompute((void *)&threadCount);
     static_cast<piranha::NodeOutput *>(m_deterministicSeedInput)->fullCompute((void *)&deterministicSeed);
     static_cast<piranha::NodeOutput *>(m_directLightSamplingEnableInput)->fullCompute((void *)&enableDirectLightSampling);
+    static_cast<piranha::NodeOutput *>(m_adaptiveSamplingInput)->fullCompute((void *)&adaptiveSampling);
+    static_cast<piranha::NodeOutput *>(m_adaptiveMaxSamplesInput)->fullCompute((void *)&adaptiveMaxSamples);
+    static_cast<piranha::NodeOutput *>(m_adaptiveThresholdInput)->fullCompute((void *)&adaptiveThreshold);
+    static_cast<piranha::NodeOutput *>(m_packetTracingInput)->fullCompute((void *)&packetTracing);
+    static_cast<piranha::NodeOutput *>(m_wavefrontInput)->fullCompute((void *)&wavefront);
+    static_cast<piranha::NodeOutput *>(m_textureCacheBudgetInput)->fullCompute((void *)&textureCacheBudget);
+    static_cast<piranha::NodeOutput *>(m_hugePagesInput)->fullCompute((void *)&hugePages);
+    static_cast<piranha::NodeOutput *>(m_lightSamplingInput)->fullCompute((void *)&lightSampling);
     static_cast<VectorNodeOutput *>(m_backgroundColorInput)->sample(nullptr, (void *)&m_backgroundColor);
 
     m_directLightSampling = enableDirectLightSampling;
+    m_adaptiveSampling = adaptiveSampling;
+    m_adaptiveMaxSamples = (int)adaptiveMaxSamples;
+    m_adaptiveThreshold = (math::real)adaptiveThreshold;
+    m_packetTracing = packetTracing;
+    m_wavefront = wavefront;
+
+    if (lightSampling == "uniform") m_lightSamplingStrategy = LightSampler::Strategy::Uniform;
+    else if (lightSampling == "power") m_lightSamplingStrategy = LightSampler::Strategy::Power;
+    else if (lightSampling == "bvh") m_lightSamplingStrategy = LightSampler::Strategy::Spatial;
+    else {
+        Session::get().getConsole()->out("Unknown light sampling strategy, using bvh: " + lightSampling + "\n");
+        m_lightSamplingStrategy = LightSampler::Strategy::Spatial;
+    }
+
+    if (textureCacheBudget < 0) {
+        throwError("Texture cache budget can't be negative");
+        return;
+    }
+
+    // Tiles are only loaded while rendering so the budget only has to be set here
+    TextureCache::Global()->setBudget((mem_size)textureCacheBudget * MB);
+
+    // Only affects allocations made from here on, which covers the arenas and film
+    StandardAllocator::Global()->setHugePagesEnabled(hugePages);
 
     m_materialManager = getObject<MaterialLibrary>(m_materialLibraryInput);
     m_sampler = getObject<Sampler>(m_samplerInput);
@@ -336,7 +623,8 @@ void manta::RayTracer::_evaluate() {
     camera = getObject<CameraRayEmitterGroup>(m_cameraInput);
     scene = getObject<Scene>(m_sceneInput);
 
-    configure(200 * MB, 50 * MB, threadCount, multithreaded);
+    // These are only the initial chunk sizes, the arenas grow on demand
+    configure(16 * MB, 4 * MB, threadCount, multithreaded);
     setDeterministicSeedMode(deterministicSeed);
 
     traceAll(scene, camera, camera->getImagePlane());
@@ -345,6 +633,7 @@ void manta::RayTracer::_evaluate() {
     m_outputImage->copy(camera->getImagePlane());
 
     m_output.setMap(m_outputImage);
+    m_sampleCountOutput.setMap(m_sampleCountImage);
 }
 
 void manta::RayTracer::_initialize() {
@@ -366,10 +655,19 @@ void manta::RayTracer::registerInputs() {
     registerInput(&m_cameraInput, "camera");
     registerInput(&m_samplerInput, "sampler");
     registerInput(&m_directLightSamplingEnableInput, "direct_light_sampling");
+    registerInput(&m_adaptiveSamplingInput, "adaptive_sampling");
+    registerInput(&m_adaptiveMaxSamplesInput, "adaptive_max_samples");
+    registerInput(&m_adaptiveThresholdInput, "adaptive_threshold");
+    registerInput(&m_packetTracingInput, "packet_tracing");
+    registerInput(&m_wavefrontInput, "wavefront");
+    registerInput(&m_textureCacheBudgetInput, "texture_cache_budget");
+    registerInput(&m_hugePagesInput, "huge_pages");
+    registerInput(&m_lightSamplingInput, "light_sampling");
 }
 
 void manta::RayTracer::registerOutputs() {
     registerOutput(&m_output, "image");
+    registerOutput(&m_sampleCountOutput, "sample_count");
 }
 
 void manta::RayTracer::createWorkers() {
@@ -381,21 +679,24 @@ void manta::RayTracer::createWorkers() {
     }
 }
 
-void manta::RayTracer::startWorkers() {
+void manta::RayTracer::runWorkers() {
     const int workerCount = m_threadCount;
     std::stringstream ss;
     ss << "Starting " << workerCount << " workers" << std::endl;
     Session::get().getConsole()->out(ss.str());
 
-    for (int i = 0; i < workerCount; i++) {
-        m_workers[i].start(m_multithreaded);
-    }
-}
+    if (m_multithreaded) {
+        TaskGroup tasks;
+        for (int i = 0; i < workerCount; i++) {
+            m_workers[i].start(&tasks);
+        }
 
-void manta::RayTracer::waitForWorkers() {
-    const int workerCount = m_threadCount;
-    for (int i = 0; i < workerCount; i++) {
-        m_workers[i].join();
+        tasks.wait();
+    }
+    else {
+        for (int i = 0; i < workerCount; i++) {
+            m_workers[i].start();
+        }
     }
 }
 
@@ -423,36 +724,28 @@ void manta::RayTracer::depthCull(
     CoarseIntersection closestIntersection;
     closestIntersection.sceneObject = nullptr;
 
-    Light *light = nullptr;
+    PrimaryHit hit;
+    hit.intersection = &closestIntersection;
+    hit.light = nullptr;
     math::real closestDepth = startingDepth;
-    bool found = false;
 
-    const int lightCount = scene->getLightCount();
-    for (int i = 0; i < lightCount; ++i) {
-        const bool intersectLight = scene->getLight(i)->intersect(ray->getSource(), ray->getDirection(), &closestDepth);
+    // Find the closest intersection
+    hit.found = m_sceneBVH.findClosestIntersection(
+        ray, &closestIntersection, &hit.light, &closestDepth, s /**/ STATISTICS_PARAM_INPUT);
 
-        if (intersectLight) {
-            light = scene->getLight(i);
-            found = true;
-        }
-    }
+    resolveIntersection(ray, hit, closestObject, point, s);
+}
 
-    // Find the closest intersection
-    const int objectCount = scene->getSceneObjectCount();
-    for (int i = 0; i < objectCount; i++) {
-        SceneObject *object = scene->getSceneObject(i);
-        SceneGeometry *geometry = object->getGeometry();
-
-        if (!geometry->fastIntersection(ray)) continue;
-        if (geometry->findClosestIntersection(ray, &closestIntersection, (math::real)0.0, closestDepth, s /**/ STATISTICS_PARAM_INPUT)) {
-            found = true;
-            closestIntersection.sceneObject = object;
-            light = nullptr;
-            closestDepth = closestIntersection.depth;
-        }
-    }
+void manta::RayTracer::resolveIntersection(
+    const LightRay *ray,
+    const PrimaryHit &hit,
+    SceneObject **closestObject,
+    IntersectionPoint *point,
+    StackAllocator *s) const
+{
+    const CoarseIntersection &closestIntersection = *hit.intersection;
 
-    if (found) {
+    if (hit.found) {
         point->m_valid = true;
 
         if (closestIntersection.sceneObject != nullptr) {
@@ -461,9 +754,10 @@ void manta::RayTracer::depthCull(
             *closestObject = closestIntersection.sceneObject;
 
             refineContact(ray, closestIntersection.depth, point, closestObject, s);
+            point->calculateDifferentials(ray);
         }
-        else if (light != nullptr) {
-            point->m_light = light;
+        else if (hit.light != nullptr) {
+            point->m_light = hit.light;
             *closestObject = nullptr;
         }
     }
@@ -494,17 +788,7 @@ void manta::RayTracer::refineContact(
 }
 
 bool manta::RayTracer::occluded(const Scene *scene, const math::Vector &p0, const math::Vector &d, math::real maxDepth STATISTICS_PROTOTYPE) const {
-    const int objectCount = scene->getSceneObjectCount();
-    for (int i = 0; i < objectCount; i++) {
-        SceneObject *object = scene->getSceneObject(i);
-        SceneGeometry *geometry = object->getGeometry();
-
-        if (geometry->occluded(p0, d, maxDepth /**/ STATISTICS_PARAM_INPUT)) {
-            return true;
-        }
-    }
-
-    return false;
+    return m_sceneBVH.occluded(p0, d, maxDepth /**/ STATISTICS_PARAM_INPUT);
 }
 
 manta::math::Vector manta::RayTracer::traceRay(
@@ -516,6 +800,59 @@ manta::math::Vector manta::RayTracer::traceRay(
     StackAllocator *s /**/
     PATH_RECORDER_DECL /**/
     STATISTICS_PROTOTYPE) const 
+{
+    return tracePath(scene, ray, nullptr, manager, sampler, s /**/ PATH_RECORDER_VAR /**/ STATISTICS_PARAM_INPUT);
+}
+
+void manta::RayTracer::tracePacket(
+    const Scene *scene,
+    LightRay *const *rays,
+    int rayCount,
+    math::Vector *L,
+    IntersectionPointManager *manager,
+    Sampler *const *samplers,
+    StackAllocator *s /**/
+    PATH_RECORDER_DECL /**/
+    STATISTICS_PROTOTYPE) const
+{
+    CoarseIntersection intersections[RayPacket::Width];
+    Light *lights[RayPacket::Width];
+    math::real depths[RayPacket::Width];
+
+    for (int i = 0; i < rayCount; i++) {
+        rays[i]->resetCache();
+
+        intersections[i].sceneObject = nullptr;
+        lights[i] = nullptr;
+        depths[i] = math::constants::REAL_MAX;
+    }
+
+    RayPacket packet;
+    packet.initialize(rays, rayCount);
+
+    const int hitMask = m_sceneBVH.findClosestIntersectionPacket(
+        packet, intersections, lights, depths, s /**/ STATISTICS_PARAM_INPUT);
+
+    // Everything past the first intersection is traced one ray at a time
+    for (int i = 0; i < rayCount; i++) {
+        PrimaryHit hit;
+        hit.intersection = &intersections[i];
+        hit.light = lights[i];
+        hit.found = (hitMask & (0x1 << i)) != 0;
+
+        L[i] = tracePath(scene, rays[i], &hit, manager, samplers[i], s /**/ PATH_RECORDER_VAR /**/ STATISTICS_PARAM_INPUT);
+    }
+}
+
+manta::math::Vector manta::RayTracer::tracePath(
+    const Scene *scene,
+    LightRay *ray,
+    const PrimaryHit *primaryHit,
+    IntersectionPointManager *manager,
+    Sampler *sampler,
+    StackAllocator *s /**/
+    PATH_RECORDER_DECL /**/
+    STATISTICS_PROTOTYPE) const
 {
     int maxBounces = 4;
 
@@ -525,7 +862,11 @@ manta::math::Vector manta::RayTracer::traceRay(
     math::Vector L = math::constants::Zero;
 
     RayFlags flags = RayFlag::None;
+    ScatteringSample scattering;
     for (int bounces = 0; bounces < maxBounces; bounces++) {
+        // Nothing allocated for a bounce outlives it
+        StackScope bounceScope(s);
+
         currentRay->resetCache();
 
         SceneObject *sceneObject = nullptr;
@@ -536,94 +877,316 @@ manta::math::Vector manta::RayTracer::traceRay(
         point.m_threadId = manager->getThreadId();
         point.m_manager = manager;
 
-        depthCull(scene, currentRay, &sceneObject, &point, s, math::constants::REAL_MAX /**/ STATISTICS_PARAM_INPUT);
+        if (bounces == 0 && primaryHit != nullptr) {
+            resolveIntersection(currentRay, *primaryHit, &sceneObject, &point, s);
+        }
+        else {
+            depthCull(scene, currentRay, &sceneObject, &point, s, math::constants::REAL_MAX /**/ STATISTICS_PARAM_INPUT);
+        }
 
-        const bool geometryIntersection = (sceneObject != nullptr);
-        const bool lightIntersection = (point.m_light != nullptr);
-        if (geometryIntersection) {
-            material = (point.m_material == -1) 
-                ? sceneObject->getDefaultMaterial()
-                : m_materialManager->getMaterial(point.m_material);
+        if (!addEmission(point, sceneObject, beta, flags, scattering, bounces, &material, &L)) break;
 
-            const math::Vector emission = material->getEmission(point);
+        // Get the BSDF associated with this material
+        BSDF *bsdf = material->getBSDF();
+        if (bsdf == nullptr) break;
+        else point.m_bsdf = bsdf;
 
+        if (m_directLightSampling) {
             L = math::add(
                 L,
-                math::mul(beta, emission)
+                math::mul(beta, uniformSampleOneLight(&point, scene, sampler, manager, s /**/ STATISTICS_PARAM_INPUT)));
+        }
+
+        // Generate a new path
+        if (!scatter(&point, sampler, bounces, &maxBounces, &beta, &flags, &scattering, &localRay, s)) break;
+        currentRay = &localRay;
+    }
+
+    return L;
+}
+
+bool manta::RayTracer::addEmission(
+    const IntersectionPoint &point,
+    SceneObject *sceneObject,
+    const math::Vector &beta,
+    RayFlags flags,
+    const ScatteringSample &scattering,
+    int bounces,
+    Material **material,
+    math::Vector *L) const
+{
+    if (sceneObject != nullptr) {
+        *material = (point.m_material == -1)
+            ? sceneObject->getDefaultMaterial()
+            : m_materialManager->getMaterial(point.m_material);
+
+        math::Vector emission = (*material)->getEmission(point);
+
+        // Emissive faces that are also sampled as lights are weighted against the
+        // light samples taken at the previous vertex
+        if (m_directLightSampling && bounces > 0 && (flags & RayFlag::Delta) == 0) {
+            emission = math::mul(emission, math::loadScalar(emissionWeight(point, sceneObject, scattering)));
+        }
+
+        *L = math::add(
+            *L,
+            math::mul(beta, emission)
+        );
+
+        return true;
+    }
+    else {
+        if (point.m_light != nullptr) {
+            *L = math::add(
+                *L,
+                math::mul(beta, m_backgroundColor)
             );
         }
-        else {
+
+        if (bounces == 0 || (flags & RayFlag::Delta) > 0 || !m_directLightSampling) {
             if (point.m_light != nullptr) {
-                L = math::add(
-                    L,
-                    math::mul(beta, m_backgroundColor)
+                *L = math::add(
+                    *L,
+                    math::mul(beta, point.m_light->L(point, point.m_lightRay->getDirection()))
                 );
             }
+        }
 
-            if (bounces == 0 || (flags & RayFlag::Delta) > 0 || !m_directLightSampling) {
-                if (point.m_light != nullptr) {
-                    L = math::add(
-                        L,
-                        math::mul(beta, point.m_light->L(point, point.m_lightRay->getDirection()))
-                    );
-                }
-            }
+        return false;
+    }
+}
+
+bool manta::RayTracer::scatter(
+    IntersectionPoint *point,
+    Sampler *sampler,
+    int bounces,
+    int *maxBounces,
+    math::Vector *beta,
+    RayFlags *flags,
+    ScatteringSample *scattering,
+    LightRay *nextRay,
+    StackAllocator *s) const
+{
+    const math::Vector outgoingDir = math::negate(point->m_lightRay->getDirection());
+    math::Vector incomingDir;
+
+    math::Vector2 s_u = (sampler != nullptr)
+        ? sampler->generate2d()
+        : math::Vector2(math::uniformRandom(), math::uniformRandom());
+    math::real pdf;
+    *flags = RayFlag::None;
+    math::Vector f = point->m_bsdf->sampleF(point, s_u, outgoingDir, &incomingDir, &pdf, flags, s, true);
+    f = math::mask(f, math::constants::MaskOffW);
+
+    if ((*flags & RayFlag::Transmission) > 0) {
+        *maxBounces = std::max(*maxBounces, 16);
+    }
+
+    if (pdf == (math::real)0.0) return false;
+
+    scattering->position = point->m_position;
+    scattering->normal = point->m_vertexNormal;
+    scattering->pdf = pdf;
+
+    *beta = math::mul(*beta, f);
+    *beta = math::div(
+        *beta,
+        math::loadScalar(pdf)
+    );
+
+    assert(!std::isnan(math::getX(*beta)) && !std::isnan(math::getY(*beta)) && !std::isnan(math::getZ(*beta)));
+
+    // Differentials are only carried through perfectly specular bounces, any other
+    // bounce spreads the ray out far more than a pixel
+    if ((*flags & RayFlag::Delta) > 0 && point->m_hasDifferentials) {
+        specularDifferentials(point, incomingDir, *flags, nextRay);
+    }
+    else {
+        nextRay->clearDifferentials();
+    }
+
+    // The next ray may be the ray of the current intersection point so it is only
+    // overwritten once the point is no longer needed
+    nextRay->setDirection(incomingDir);
+    if ((*flags & RayFlag::Transmission) > 0) nextRay->setSource(point->m_inside);
+    else nextRay->setSource(point->m_outside);
+    nextRay->calculateTransformations();
+
+    if (bounces > 3) {
+        const math::real q = std::max((math::real)0.05, 1 - math::getScalar(math::maxComponent(*beta)));
+        const math::real d = (sampler != nullptr)
+            ? sampler->generate1d()
+            : math::uniformRandom();
+        if (d < q) return false;
+        *beta = math::div(*beta, math::loadScalar(1 - q));
+    }
+
+    return true;
+}
+
+void manta::RayTracer::specularDifferentials(
+    const IntersectionPoint *point,
+    const math::Vector &wi,
+    RayFlags flags,
+    LightRay *nextRay) const
+{
+    const LightRay *ray = point->m_lightRay;
+    const math::Vector wo = math::negate(ray->getDirection());
+    const math::Vector source = ((flags & RayFlag::Transmission) > 0)
+        ? point->m_inside
+        : point->m_outside;
+
+    const math::Vector dxSource = math::add(source, point->m_dpdx);
+    const math::Vector dySource = math::add(source, point->m_dpdy);
+
+    math::Vector dxDirection, dyDirection;
+    if ((flags & RayFlag::Transmission) == 0) {
+        // Mirror the offset rays, accounting for the change in the shading normal
+        const math::Vector n = point->m_vertexNormal;
+        const math::Vector wo_n = math::dot(wo, n);
+        const math::Vector two = math::loadScalar((math::real)2.0);
+
+        const math::Vector dwodx = math::sub(math::negate(ray->getDxDirection()), wo);
+        const math::Vector dwody = math::sub(math::negate(ray->getDyDirection()), wo);
+        const math::Vector dDNdx = math::add(math::dot(dwodx, n), math::dot(wo, point->m_dndx));
+        const math::Vector dDNdy = math::add(math::dot(dwody, n), math::dot(wo, point->m_dndy));
+
+        dxDirection = math::add(
+            math::sub(wi, dwodx),
+            math::mul(two, math::add(math::mul(wo_n, point->m_dndx), math::mul(dDNdx, n))));
+        dyDirection = math::add(
+            math::sub(wi, dwody),
+            math::mul(two, math::add(math::mul(wo_n, point->m_dndy), math::mul(dDNdy, n))));
+    }
+    else {
+        // The index of refraction is not known here so transmitted rays keep the
+        // spread they arrived with
+        dxDirection = math::add(wi, math::sub(ray->getDxDirection(), ray->getDirection()));
+        dyDirection = math::add(wi, math::sub(ray->getDyDirection(), ray->getDirection()));
+    }
+
+    nextRay->setDifferentials(
+        dxSource, math::normalize(dxDirection),
+        dySource, math::normalize(dyDirection));
+}
+
+void manta::RayTracer::traceWavefront(
+    const Scene *scene,
+    WavefrontQueue *queue,
+    IntersectionPointManager *manager,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    const int pathCount = queue->getPathCount();
+    for (int i = 0; i < pathCount; i++) {
+        PathState *path = queue->getPath(i);
+        path->beta = math::constants::One;
+        path->L = math::constants::Zero;
+        path->flags = RayFlag::None;
+        path->bounces = 0;
+        path->maxBounces = 4;
+    }
+
+    while (queue->getExtendQueue()->count > 0) {
+        // Nothing allocated for a bounce outlives it
+        StackScope bounceScope(s);
+
+        extendPaths(scene, queue, manager, s /**/ STATISTICS_PARAM_INPUT);
+        shadePaths(scene, queue, s);
+        castShadowRays(scene, queue /**/ STATISTICS_PARAM_INPUT);
+        accumulateDirectLighting(queue);
+    }
+}
 
-            break;
+void manta::RayTracer::extendPaths(
+    const Scene *scene,
+    WavefrontQueue *queue,
+    IntersectionPointManager *manager,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    PathQueue *extendQueue = queue->getExtendQueue();
+    PathQueue *shadeQueue = queue->getShadeQueue();
+
+    for (int i = 0; i < extendQueue->count; i++) {
+        const int index = extendQueue->indices[i];
+        PathState *path = queue->getPath(index);
+
+        path->ray.resetCache();
+
+        path->sceneObject = nullptr;
+        path->material = nullptr;
+        path->point = IntersectionPoint();
+        path->point.m_lightRay = &path->ray;
+        path->point.m_id = manager->generateId();
+        path->point.m_threadId = manager->getThreadId();
+        path->point.m_manager = manager;
+
+        depthCull(scene, &path->ray, &path->sceneObject, &path->point, s, math::constants::REAL_MAX /**/ STATISTICS_PARAM_INPUT);
+
+        if (addEmission(path->point, path->sceneObject, path->beta, path->flags, path->scattering, path->bounces, &path->material, &path->L)) {
+            shadeQueue->push(index);
         }
+    }
 
-        // Get the BSDF associated with this material
-        BSDF *bsdf = material->getBSDF();
-        if (bsdf == nullptr) break;
-        else point.m_bsdf = bsdf;
+    extendQueue->clear();
+}
+
+void manta::RayTracer::shadePaths(const Scene *scene, WavefrontQueue *queue, StackAllocator *s) const {
+    PathQueue *shadeQueue = queue->getShadeQueue();
+    PathQueue *extendQueue = queue->getExtendQueue();
+    PathQueue *shadowQueue = queue->getShadowQueue();
+
+    // Paths that share a material are shaded together
+    std::sort(
+        shadeQueue->indices,
+        shadeQueue->indices + shadeQueue->count,
+        [queue](int a, int b) {
+            return std::less<const Material *>()(queue->getPath(a)->material, queue->getPath(b)->material);
+        });
+
+    for (int i = 0; i < shadeQueue->count; i++) {
+        const int index = shadeQueue->indices[i];
+        PathState *path = queue->getPath(index);
+
+        BSDF *bsdf = path->material->getBSDF();
+        if (bsdf == nullptr) continue;
+        else path->point.m_bsdf = bsdf;
 
         if (m_directLightSampling) {
-            L = math::add(
-                L,
-                math::mul(beta, uniformSampleOneLight(&point, scene, sampler, manager, s)));
+            sampleOneLight(&path->point, scene, path->sampler, &path->directLighting, s);
+            path->directBeta = path->beta;
+            shadowQueue->push(index);
         }
 
-        // Generate a new path
-        const math::Vector outgoingDir = math::negate(currentRay->getDirection());
-        math::Vector incomingDir;
-
-        math::Vector2 s_u = (sampler != nullptr)
-            ? sampler->generate2d()
-            : math::Vector2(math::uniformRandom(), math::uniformRandom());
-        math::real pdf;
-        flags = RayFlag::None;
-        math::Vector f = bsdf->sampleF(&point, s_u, outgoingDir, &incomingDir, &pdf, &flags, s, true);
-        f = math::mask(f, math::constants::MaskOffW);
-
-        if ((flags & RayFlag::Transmission) > 0) {
-            maxBounces = std::max(maxBounces, 16);
+        if (scatter(&path->point, path->sampler, path->bounces, &path->maxBounces, &path->beta, &path->flags, &path->scattering, &path->ray, s)) {
+            if (++path->bounces < path->maxBounces) {
+                extendQueue->push(index);
+            }
         }
+    }
 
-        if (pdf == (math::real)0.0) break;
-        
-        beta = math::mul(beta, f);
-        beta = math::div(
-            beta,
-            math::loadScalar(pdf)
-        );
+    shadeQueue->clear();
+}
 
-        assert(!std::isnan(math::getX(beta)) && !std::isnan(math::getY(beta)) && !std::isnan(math::getZ(beta)));
-        
-        localRay.setDirection(incomingDir);
-        if ((flags & RayFlag::Transmission) > 0) localRay.setSource(point.m_inside);
-        else localRay.setSource(point.m_outside);
-        localRay.calculateTransformations();
-        currentRay = &localRay;
+void manta::RayTracer::castShadowRays(const Scene *scene, WavefrontQueue *queue /**/ STATISTICS_PROTOTYPE) const {
+    const PathQueue *shadowQueue = queue->getShadowQueue();
 
-        if (bounces > 3) {
-            const math::real q = std::max((math::real)0.05, 1 - math::getScalar(math::maxComponent(beta)));
-            const math::real d = (sampler != nullptr)
-                ? sampler->generate1d()
-                : math::uniformRandom();
-            if (d < q) break;
-            beta = math::div(beta, math::loadScalar(1 - q));
-        }
+    for (int i = 0; i < shadowQueue->count; i++) {
+        PathState *path = queue->getPath(shadowQueue->indices[i]);
+        path->occludedMask = traceShadowRays(scene, path->directLighting /**/ STATISTICS_PARAM_INPUT);
+    }
+}
+
+void manta::RayTracer::accumulateDirectLighting(WavefrontQueue *queue) const {
+    PathQueue *shadowQueue = queue->getShadowQueue();
+
+    for (int i = 0; i < shadowQueue->count; i++) {
+        PathState *path = queue->getPath(shadowQueue->indices[i]);
+        path->L = math::add(
+            path->L,
+            math::mul(path->directBeta, path->directLighting.evaluate(path->occludedMask)));
     }
 
-    return L;
+    shadowQueue->clear();
 }
@@ -1,5 +1,7 @@
 #include "../include/sampler.h"
 
+#include "../include/low_discrepancy.h"
+
 #include <float.h>
 
 manta::Sampler::Sampler() {
@@ -7,6 +9,10 @@ manta::Sampler::Sampler() {
     m_samplesPerPixel = 0;
 
     m_samplesPerPixelInput = nullptr;
+
+    m_seed = 0;
+    m_pixelKey = 0;
+    m_stream.seed(0);
 }
 
 manta::Sampler::~Sampler() {
@@ -15,31 +21,35 @@ manta::Sampler::~Sampler() {
 
 void manta::Sampler::startPixelSession() {
     m_currentPixelSample = 0;
+    m_stream.seed(m_pixelKey, 0);
 }
 
 bool manta::Sampler::startNextSample() {
-    return ++m_currentPixelSample != m_samplesPerPixel;
+    ++m_currentPixelSample;
+    m_stream.seed(m_pixelKey, (uint32_t)m_currentPixelSample);
+
+    return m_currentPixelSample != m_samplesPerPixel;
 }
 
 manta::math::real manta::Sampler::uniformRandom() {
-    uint32_t r = m_rng();
-    math::real f = r * 0x1p-32f;
-
-    if (f > 0.9999f) f = 0.9999f;
-
-    return f;
+    return fixedPointToReal(m_stream.next());
 }
 
 uint32_t manta::Sampler::uniformRandomInt(uint32_t range) {
     uint32_t threshold = (~range + 1u) % range;
     while (true) {
-        uint32_t r = m_rng();
+        uint32_t r = m_stream.next();
         if (r >= threshold) return r % range;
     }
 }
 
 void manta::Sampler::seed(unsigned int seed) {
-    m_rng.seed(seed);
+    m_seed = seed;
+    setPixelIndex(0);
+}
+
+void manta::Sampler::setPixelIndex(unsigned int pixelIndex) {
+    m_pixelKey = hashCombine32(m_seed, pixelIndex);
 }
 
 void manta::Sampler::_evaluate() {
@@ -0,0 +1,546 @@
+#include "../include/scene_bvh.h"
+
+#include "../include/scene.h"
+#include "../include/scene_object.h"
+#include "../include/scene_geometry.h"
+#include "../include/light.h"
+#include "../include/light_ray.h"
+#include "../include/coarse_intersection.h"
+#include "../include/ray_packet.h"
+
+#include <algorithm>
+
+namespace manta {
+
+    // Slab test against a node's bounds restricted to [0, maxDepth]
+    __forceinline bool boundsIntersect(
+        const AABB &bounds, const math::Vector &origin, const math::Vector &ood, math::real maxDepth)
+    {
+        const math::Vector t1 = math::mul(math::sub(bounds.minPoint, origin), ood);
+        const math::Vector t2 = math::mul(math::sub(bounds.maxPoint, origin), ood);
+
+        const math::Vector tNear = math::componentMin(t1, t2);
+        const math::Vector tFar = math::componentMax(t1, t2);
+
+        const math::real tmin = std::max(
+            std::max((math::real)0.0, math::getX(tNear)),
+            std::max(math::getY(tNear), math::getZ(tNear)));
+        const math::real tmax = std::min(
+            std::min(maxDepth, math::getX(tFar)),
+            std::min(math::getY(tFar), math::getZ(tFar)));
+
+        return tmin <= tmax;
+    }
+
+#if ENABLE_RAY_PACKETS
+    // Slab test of every packet lane against a node's bounds, restricted to [0, depths[lane]]
+    __forceinline int boundsIntersectPacket(
+        const AABB &bounds, const RayPacket &packet, const math::real *depths)
+    {
+        typedef RayPacketSimd Simd;
+        typedef Simd::Register Register;
+
+        Register tmin = Simd::zero();
+        Register tmax = Simd::load(depths);
+
+        for (int axis = 0; axis < 3; axis++) {
+            const Register origin = Simd::load(packet.origin[axis]);
+            const Register ood = Simd::load(packet.inverseDirection[axis]);
+
+            const Register t1 = Simd::mul(Simd::sub(Simd::set(math::get(bounds.minPoint, axis)), origin), ood);
+            const Register t2 = Simd::mul(Simd::sub(Simd::set(math::get(bounds.maxPoint, axis)), origin), ood);
+
+            tmin = Simd::max_(tmin, Simd::min_(t1, t2));
+            tmax = Simd::min_(tmax, Simd::max_(t1, t2));
+        }
+
+        return Simd::mask(Simd::le(tmin, tmax));
+    }
+#endif /* ENABLE_RAY_PACKETS */
+
+} /* namespace manta */
+
+manta::SceneBVH::SceneBVH() {
+    /* void */
+}
+
+manta::SceneBVH::~SceneBVH() {
+    /* void */
+}
+
+void manta::SceneBVH::build(const Scene *scene) {
+    destroy();
+
+    std::vector<BuildEntry> entries;
+
+    const int objectCount = scene->getSceneObjectCount();
+    for (int i = 0; i < objectCount; i++) {
+        SceneObject *object = scene->getSceneObject(i);
+
+        SceneBVHPrimitive primitive;
+        primitive.object = object;
+        primitive.light = nullptr;
+
+        BuildEntry entry;
+        if (object->getGeometry()->getBounds(&entry.bounds)) {
+            entry.primitive = primitive;
+            entry.centroid = math::mul(
+                math::add(entry.bounds.minPoint, entry.bounds.maxPoint), math::loadScalar((math::real)0.5));
+            entries.push_back(entry);
+        }
+        else {
+            m_unbounded.push_back(primitive);
+        }
+    }
+
+    const int lightCount = scene->getLightCount();
+    for (int i = 0; i < lightCount; i++) {
+        Light *light = scene->getLight(i);
+
+        SceneBVHPrimitive primitive;
+        primitive.object = nullptr;
+        primitive.light = light;
+
+        BuildEntry entry;
+        if (light->getBounds(&entry.bounds)) {
+            entry.primitive = primitive;
+            entry.centroid = math::mul(
+                math::add(entry.bounds.minPoint, entry.bounds.maxPoint), math::loadScalar((math::real)0.5));
+            entries.push_back(entry);
+        }
+        else {
+            m_unbounded.push_back(primitive);
+        }
+    }
+
+    if (entries.empty()) return;
+
+    m_nodes.reserve(2 * entries.size());
+    m_primitives.reserve(entries.size());
+
+    buildNode(entries, 0, (int)entries.size(), 0);
+}
+
+void manta::SceneBVH::destroy() {
+    m_nodes.clear();
+    m_primitives.clear();
+    m_unbounded.clear();
+}
+
+int manta::SceneBVH::buildNode(std::vector<BuildEntry> &entries, int start, int end, int depth) {
+    const int count = end - start;
+
+    AABB bounds = entries[start].bounds;
+    AABB centroidBounds;
+    centroidBounds.minPoint = centroidBounds.maxPoint = entries[start].centroid;
+    for (int i = start + 1; i < end; i++) {
+        bounds.merge(entries[i].bounds);
+        centroidBounds.minPoint = math::componentMin(centroidBounds.minPoint, entries[i].centroid);
+        centroidBounds.maxPoint = math::componentMax(centroidBounds.maxPoint, entries[i].centroid);
+    }
+
+    if (count == 1 || depth >= MaxDepth) {
+        return createLeaf(entries, start, end, bounds);
+    }
+
+    const int axis = math::maxDimension3(math::sub(centroidBounds.maxPoint, centroidBounds.minPoint));
+    const math::real cmin = math::get(centroidBounds.minPoint, axis);
+    const math::real cmax = math::get(centroidBounds.maxPoint, axis);
+
+    int mid;
+    if (cmax == cmin) {
+        // All centroids coincide so no split can separate them
+        if (count <= MaxLeafPrimitives) return createLeaf(entries, start, end, bounds);
+        else mid = (start + end) / 2;
+    }
+    else {
+        mid = findSplit(entries, start, end, axis, cmin, cmax, bounds.surfaceArea());
+        if (mid == -1) return createLeaf(entries, start, end, bounds);
+    }
+
+    const int nodeIndex = (int)m_nodes.size();
+    m_nodes.push_back(SceneBVHNode());
+    m_nodes[nodeIndex].bounds = bounds;
+    m_nodes[nodeIndex].axis = (short)axis;
+    m_nodes[nodeIndex].primitiveCount = 0;
+
+    buildNode(entries, start, mid, depth + 1);
+    const int secondChild = buildNode(entries, mid, end, depth + 1);
+    m_nodes[nodeIndex].offset = secondChild;
+
+    return nodeIndex;
+}
+
+int manta::SceneBVH::findSplit(
+    std::vector<BuildEntry> &entries, int start, int end, int axis,
+    math::real cmin, math::real cmax, math::real area)
+{
+    const int count = end - start;
+
+    // Binned surface area heuristic
+    struct Bucket {
+        int count;
+        AABB bounds;
+    } buckets[BucketCount];
+
+    for (int i = 0; i < BucketCount; i++) buckets[i].count = 0;
+
+    const math::real scale = BucketCount / (cmax - cmin);
+    for (int i = start; i < end; i++) {
+        int b = (int)((math::get(entries[i].centroid, axis) - cmin) * scale);
+        b = std::min(b, BucketCount - 1);
+
+        if (buckets[b].count == 0) buckets[b].bounds = entries[i].bounds;
+        else buckets[b].bounds.merge(entries[i].bounds);
+        buckets[b].count++;
+    }
+
+    math::real cost[BucketCount - 1];
+    for (int i = 0; i < BucketCount - 1; i++) {
+        AABB b0, b1;
+        int count0 = 0, count1 = 0;
+        for (int j = 0; j <= i; j++) {
+            if (buckets[j].count == 0) continue;
+            if (count0 == 0) b0 = buckets[j].bounds;
+            else b0.merge(buckets[j].bounds);
+            count0 += buckets[j].count;
+        }
+
+        for (int j = i + 1; j < BucketCount; j++) {
+            if (buckets[j].count == 0) continue;
+            if (count1 == 0) b1 = buckets[j].bounds;
+            else b1.merge(buckets[j].bounds);
+            count1 += buckets[j].count;
+        }
+
+        const math::real area0 = (count0 > 0) ? b0.surfaceArea() : (math::real)0.0;
+        const math::real area1 = (count1 > 0) ? b1.surfaceArea() : (math::real)0.0;
+        cost[i] = (math::real)0.125 + (count0 * area0 + count1 * area1) / area;
+    }
+
+    int minCostBucket = 0;
+    math::real minCost = cost[0];
+    for (int i = 1; i < BucketCount - 1; i++) {
+        if (cost[i] < minCost) {
+            minCost = cost[i];
+            minCostBucket = i;
+        }
+    }
+
+    // A leaf is cheaper than any split
+    if (count <= MaxLeafPrimitives && minCost >= (math::real)count) return -1;
+
+    BuildEntry *midEntry = std::partition(
+        entries.data() + start, entries.data() + end,
+        [=](const BuildEntry &entry) {
+            int b = (int)((math::get(entry.centroid, axis) - cmin) * scale);
+            b = std::min(b, BucketCount - 1);
+            return b <= minCostBucket;
+        });
+
+    const int mid = (int)(midEntry - entries.data());
+    return (mid == start || mid == end)
+        ? (start + end) / 2
+        : mid;
+}
+
+int manta::SceneBVH::createLeaf(std::vector<BuildEntry> &entries, int start, int end, const AABB &bounds) {
+    const int nodeIndex = (int)m_nodes.size();
+    m_nodes.push_back(SceneBVHNode());
+
+    SceneBVHNode &node = m_nodes[nodeIndex];
+    node.bounds = bounds;
+    node.axis = 0;
+    node.offset = (int)m_primitives.size();
+    node.primitiveCount = (short)(end - start);
+
+    for (int i = start; i < end; i++) {
+        m_primitives.push_back(entries[i].primitive);
+    }
+
+    return nodeIndex;
+}
+
+bool manta::SceneBVH::findClosestIntersection(
+    LightRay *ray,
+    CoarseIntersection *intersection,
+    Light **light,
+    math::real *depth,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    bool found = false;
+
+    const int unboundedCount = (int)m_unbounded.size();
+    for (int i = 0; i < unboundedCount; i++) {
+        found = intersectPrimitive(m_unbounded[i], ray, intersection, light, depth, s /**/ STATISTICS_PARAM_INPUT) || found;
+    }
+
+    if (m_nodes.empty()) return found;
+
+    const math::Vector origin = ray->getSource();
+    const math::Vector ood = ray->getInverseDirection();
+    const math::Vector direction = ray->getDirection();
+    const bool dirIsNeg[3] = {
+        math::getX(direction) < 0,
+        math::getY(direction) < 0,
+        math::getZ(direction) < 0
+    };
+
+    int stack[MaxDepth + 1];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const SceneBVHNode *node = &m_nodes[current];
+
+        INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvTests);
+        if (boundsIntersect(node->bounds, origin, ood, *depth)) {
+            INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
+
+            if (node->isLeaf()) {
+                for (int i = 0; i < node->primitiveCount; i++) {
+                    found = intersectPrimitive(
+                        m_primitives[node->offset + i], ray, intersection, light, depth, s /**/ STATISTICS_PARAM_INPUT) || found;
+                }
+            }
+            else {
+                // Visit the near child first so that the far child can be culled by the
+                // updated closest depth when it is popped
+                if (dirIsNeg[node->axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node->offset;
+                }
+                else {
+                    stack[stackSize++] = node->offset;
+                    current = current + 1;
+                }
+
+                continue;
+            }
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+    }
+
+    return found;
+}
+
+int manta::SceneBVH::findClosestIntersectionPacket(
+    const RayPacket &packet,
+    CoarseIntersection *intersections,
+    Light **lights,
+    math::real *depths,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    const int laneMask = packet.getLaneMask();
+    int found = 0;
+
+    const int unboundedCount = (int)m_unbounded.size();
+    for (int i = 0; i < unboundedCount; i++) {
+        found |= intersectPrimitivePacket(
+            m_unbounded[i], packet, laneMask, intersections, lights, depths, s /**/ STATISTICS_PARAM_INPUT);
+    }
+
+    if (m_nodes.empty()) return found;
+
+#if ENABLE_RAY_PACKETS
+    // Padding lanes must not extend the slab tests
+    alignas(RayPacket::Width * sizeof(math::real)) math::real laneDepths[RayPacket::Width];
+    for (int i = 0; i < RayPacket::Width; i++) {
+        laneDepths[i] = (i < packet.count) ? depths[i] : -math::constants::REAL_MAX;
+    }
+
+    // The first ray decides the child order, the packet is assumed to be mostly coherent
+    const bool dirIsNeg[3] = {
+        packet.isNegative(0, 0),
+        packet.isNegative(0, 1),
+        packet.isNegative(0, 2)
+    };
+
+    int stack[MaxDepth + 1];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const SceneBVHNode *node = &m_nodes[current];
+
+        INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvTests);
+        const int activeMask = boundsIntersectPacket(node->bounds, packet, laneDepths) & laneMask;
+        if (activeMask != 0) {
+            INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
+
+            if (node->isLeaf()) {
+                for (int i = 0; i < node->primitiveCount; i++) {
+                    found |= intersectPrimitivePacket(
+                        m_primitives[node->offset + i], packet, activeMask, intersections, lights, depths, s /**/ STATISTICS_PARAM_INPUT);
+                }
+
+                for (int i = 0; i < packet.count; i++) {
+                    laneDepths[i] = depths[i];
+                }
+            }
+            else {
+                if (dirIsNeg[node->axis]) {
+                    stack[stackSize++] = current + 1;
+                    current = node->offset;
+                }
+                else {
+                    stack[stackSize++] = node->offset;
+                    current = current + 1;
+                }
+
+                continue;
+            }
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+    }
+#else
+    for (int i = 0; i < packet.count; i++) {
+        Light *light = nullptr;
+        if (findClosestIntersection(packet.rays[i], &intersections[i], &light, &depths[i], s /**/ STATISTICS_PARAM_INPUT)) {
+            found |= (0x1 << i);
+            lights[i] = light;
+        }
+    }
+#endif /* ENABLE_RAY_PACKETS */
+
+    return found;
+}
+
+bool manta::SceneBVH::occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth STATISTICS_PROTOTYPE) const {
+    const int unboundedCount = (int)m_unbounded.size();
+    for (int i = 0; i < unboundedCount; i++) {
+        if (occludedPrimitive(m_unbounded[i], p0, d, maxDepth /**/ STATISTICS_PARAM_INPUT)) return true;
+    }
+
+    if (m_nodes.empty()) return false;
+
+    const math::Vector ood = math::div(math::constants::One, d);
+
+    int stack[MaxDepth + 1];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const SceneBVHNode *node = &m_nodes[current];
+
+        INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvTests);
+        if (boundsIntersect(node->bounds, p0, ood, maxDepth)) {
+            INCREMENT_COUNTER(RuntimeStatistics::Counter::TotalBvHits);
+
+            if (node->isLeaf()) {
+                for (int i = 0; i < node->primitiveCount; i++) {
+                    if (occludedPrimitive(m_primitives[node->offset + i], p0, d, maxDepth /**/ STATISTICS_PARAM_INPUT)) {
+                        return true;
+                    }
+                }
+            }
+            else {
+                // Any hit terminates the query so traversal order is irrelevant
+                stack[stackSize++] = node->offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+    }
+
+    return false;
+}
+
+bool manta::SceneBVH::intersectPrimitive(
+    const SceneBVHPrimitive &primitive,
+    LightRay *ray,
+    CoarseIntersection *intersection,
+    Light **light,
+    math::real *depth,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    if (primitive.light != nullptr) {
+        if (primitive.light->intersect(ray->getSource(), ray->getDirection(), depth)) {
+            *light = primitive.light;
+            intersection->sceneObject = nullptr;
+            return true;
+        }
+    }
+    else {
+        SceneGeometry *geometry = primitive.object->getGeometry();
+        if (!geometry->fastIntersection(ray)) return false;
+        if (geometry->findClosestIntersection(ray, intersection, (math::real)0.0, *depth, s /**/ STATISTICS_PARAM_INPUT)) {
+            intersection->sceneObject = primitive.object;
+            *light = nullptr;
+            *depth = intersection->depth;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int manta::SceneBVH::intersectPrimitivePacket(
+    const SceneBVHPrimitive &primitive,
+    const RayPacket &packet,
+    int laneMask,
+    CoarseIntersection *intersections,
+    Light **lights,
+    math::real *depths,
+    StackAllocator *s
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    if (primitive.light != nullptr) {
+        int hitMask = 0;
+        for (int i = 0; i < packet.count; i++) {
+            if ((laneMask & (0x1 << i)) == 0) continue;
+
+            if (intersectPrimitive(primitive, packet.rays[i], &intersections[i], &lights[i], &depths[i], s /**/ STATISTICS_PARAM_INPUT)) {
+                hitMask |= (0x1 << i);
+            }
+        }
+
+        return hitMask;
+    }
+
+    const SceneGeometry *geometry = primitive.object->getGeometry();
+
+    int fastMask = 0;
+    for (int i = 0; i < packet.count; i++) {
+        if ((laneMask & (0x1 << i)) == 0) continue;
+        if (geometry->fastIntersection(packet.rays[i])) fastMask |= (0x1 << i);
+    }
+
+    if (fastMask == 0) return 0;
+
+    const int hitMask = geometry->findClosestIntersectionPacket(
+        packet, fastMask, intersections, (math::real)0.0, depths, s /**/ STATISTICS_PARAM_INPUT);
+
+    for (int i = 0; i < packet.count; i++) {
+        if ((hitMask & (0x1 << i)) == 0) continue;
+
+        intersections[i].sceneObject = primitive.object;
+        lights[i] = nullptr;
+        depths[i] = intersections[i].depth;
+    }
+
+    return hitMask;
+}
+
+bool manta::SceneBVH::occludedPrimitive(
+    const SceneBVHPrimitive &primitive,
+    const math::Vector &p0,
+    const math::Vector &d,
+    math::real maxDepth
+    /**/ STATISTICS_PROTOTYPE) const
+{
+    // Lights never block shadow rays
+    if (primitive.object == nullptr) return false;
+
+    return primitive.object->getGeometry()->occluded(p0, d, maxDepth /**/ STATISTICS_PARAM_INPUT);
+}
@@ -3,6 +3,8 @@
 #include "../include/vector_node_output.h"
 #include "../include/material_library.h"
 #include "../include/material.h"
+#include "../include/ray_packet.h"
+#include "../include/coarse_intersection.h"
 
 manta::SceneGeometry::SceneGeometry() {
     m_id = -1;
@@ -27,6 +29,28 @@ void manta::SceneGeometry::setId(int id) {
     m_id = id;
 }
 
+bool manta::SceneGeometry::getBounds(AABB *bounds) const {
+    return false;
+}
+
+int manta::SceneGeometry::findClosestIntersectionPacket(const RayPacket &packet, int laneMask,
+    CoarseIntersection *intersections, math::real minDepth, const math::real *maxDepth,
+    StackAllocator *s /**/ STATISTICS_PROTOTYPE) const
+{
+    int hitMask = 0;
+    for (int i = 0; i < packet.count; i++) {
+        if ((laneMask & (0x1 << i)) == 0) continue;
+
+        if (findClosestIntersection(
+            packet.rays[i], &intersections[i], minDepth, maxDepth[i], s /**/ STATISTICS_PARAM_INPUT))
+        {
+            hitMask |= (0x1 << i);
+        }
+    }
+
+    return hitMask;
+}
+
 void manta::SceneGeometry::_initialize() {
     /* void */
 }
@@ -9,7 +9,8 @@ manta::Session::Session() {
 }
 
 manta::Session::~Session() {
-    /* void */
+    for (auto &image : m_imageCache) destroyImage(image.second);
+    for (const CachedImage &image : m_replacedImages) destroyImage(image);
 }
 
 manta::Session &manta::Session::get() {
@@ -54,6 +55,37 @@ void manta::Session::putCachedMesh(const std::string &key, Mesh *mesh) {
     m_meshCache.emplace(key, mesh);
 }
 
+bool manta::Session::getCachedImage(const std::string &key, __int64 writeTime, CachedImage *image) {
+    std::lock_guard<std::mutex> lock(m_imageCacheLock);
+
+    auto cached = m_imageCache.find(key);
+    if (cached == m_imageCache.end()) return false;
+    else if (cached->second.writeTime != writeTime) return false;
+
+    *image = cached->second;
+    return true;
+}
+
+void manta::Session::putCachedImage(const std::string &key, const CachedImage &image) {
+    std::lock_guard<std::mutex> lock(m_imageCacheLock);
+
+    auto cached = m_imageCache.find(key);
+    if (cached != m_imageCache.end()) {
+        m_replacedImages.push_back(cached->second);
+        cached->second = image;
+    }
+    else {
+        m_imageCache.emplace(key, image);
+    }
+}
+
+void manta::Session::destroyImage(const CachedImage &image) {
+    image.mipmap->destroy();
+    image.map->destroy();
+    delete image.mipmap;
+    delete image.map;
+}
+
 void manta::Session::registerPreview(PreviewNode *preview) {
     std::lock_guard<std::mutex> lock(m_previewLock);
     m_previews.push_back(preview);
@@ -2,6 +2,11 @@
 
 #include "../include/standard_allocator.h"
 
+#include <immintrin.h>
+#include <map>
+#include <mutex>
+#include <assert.h>
+
 void manta::NaiveFFT::fft(const math::Complex *input, math::Complex *target, int n) {
     fft_child(input, target, n, 1);
 }
@@ -61,3 +66,167 @@ void manta::NaiveFFT::fft_child(const math::Complex *input, math::Complex *targe
         target[k + n / 2].i = t.i - s2;
     }
 }
+
+manta::FFTPlan::FFTPlan() {
+    m_n = 0;
+    m_log2n = 0;
+
+    m_bitReverse = nullptr;
+    m_twiddles = nullptr;
+    m_inverseTwiddles = nullptr;
+}
+
+manta::FFTPlan::~FFTPlan() {
+    assert(m_bitReverse == nullptr);
+    assert(m_twiddles == nullptr);
+    assert(m_inverseTwiddles == nullptr);
+}
+
+const manta::FFTPlan *manta::FFTPlan::get(int n) {
+    static std::map<int, FFTPlan *> plans;
+    static std::mutex lock;
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    FFTPlan *&plan = plans[n];
+    if (plan == nullptr) {
+        plan = new FFTPlan;
+        plan->initialize(n);
+    }
+
+    return plan;
+}
+
+void manta::FFTPlan::initialize(int n) {
+    static constexpr math::real_d pi = 3.1415926535897932384626433832795028;
+
+    // Only power-of-two sizes are supported
+    assert(n > 0 && (n & (n - 1)) == 0);
+
+    m_n = n;
+    m_log2n = 0;
+    while ((1 << m_log2n) < n) ++m_log2n;
+
+    m_bitReverse = StandardAllocator::Global()->allocate<int>(n);
+    for (int i = 0; i < n; i++) {
+        int reversed = 0;
+        for (int b = 0; b < m_log2n; b++) {
+            reversed |= ((i >> b) & 0x1) << (m_log2n - 1 - b);
+        }
+
+        m_bitReverse[i] = reversed;
+    }
+
+    m_twiddles = StandardAllocator::Global()->allocate<math::Complex>(n, 16);
+    m_inverseTwiddles = StandardAllocator::Global()->allocate<math::Complex>(n, 16);
+    for (int m = 1; m < n; m *= 2) {
+        for (int k = 0; k < m; k++) {
+            const math::real_d angle = -pi * k / (math::real_d)m;
+            m_twiddles[m - 1 + k] = math::Complex(::cos(angle), ::sin(angle));
+            m_inverseTwiddles[m - 1 + k] = m_twiddles[m - 1 + k].conjugate();
+        }
+    }
+}
+
+void manta::FFTPlan::destroy() {
+    StandardAllocator::Global()->free(m_bitReverse, m_n);
+    StandardAllocator::Global()->aligned_free(m_twiddles, m_n);
+    StandardAllocator::Global()->aligned_free(m_inverseTwiddles, m_n);
+
+    m_bitReverse = nullptr;
+    m_twiddles = nullptr;
+    m_inverseTwiddles = nullptr;
+    m_n = 0;
+    m_log2n = 0;
+}
+
+void manta::FFTPlan::transform(const math::Complex *input, math::Complex *target, bool inverse) const {
+    if (input == target) {
+        for (int i = 0; i < m_n; i++) {
+            const int j = m_bitReverse[i];
+            if (i < j) {
+                const math::Complex temp = target[i];
+                target[i] = target[j];
+                target[j] = temp;
+            }
+        }
+    }
+    else {
+        for (int i = 0; i < m_n; i++) {
+            target[m_bitReverse[i]] = input[i];
+        }
+    }
+
+    execute(target, inverse);
+}
+
+void manta::FFTPlan::execute(math::Complex *data, bool inverse) const {
+    const int n = m_n;
+    const math::Complex *twiddles = inverse ? m_inverseTwiddles : m_twiddles;
+    double *d = (double *)data;
+
+    // Multiplying by W_4m^m is a quarter turn, -i for the forward transform and +i for the inverse
+    const __m128d quarterTurnSign = inverse
+        ? _mm_set_pd(0.0, -0.0)
+        : _mm_set_pd(-0.0, 0.0);
+
+    auto multiply = [](__m128d a, __m128d b) {
+        const __m128d t0 = _mm_mul_pd(a, _mm_unpacklo_pd(b, b));
+        const __m128d t1 = _mm_mul_pd(_mm_shuffle_pd(a, a, 0x1), _mm_unpackhi_pd(b, b));
+        return _mm_addsub_pd(t0, t1);
+    };
+
+    // A leftover radix-2 stage if the number of stages is odd, all of its twiddles are 1
+    int m = 1;
+    if ((m_log2n & 0x1) != 0) {
+        for (int j = 0; j < n; j += 2) {
+            const __m128d a = _mm_loadu_pd(d + 2 * j);
+            const __m128d b = _mm_loadu_pd(d + 2 * j + 2);
+            _mm_storeu_pd(d + 2 * j, _mm_add_pd(a, b));
+            _mm_storeu_pd(d + 2 * j + 2, _mm_sub_pd(a, b));
+        }
+
+        m = 2;
+    }
+
+    // Two radix-2 stages (m and 2m) fused into a single radix-4 pass over the data
+    for (; m < n; m *= 4) {
+        const double *w1Table = (const double *)(twiddles + m - 1);
+        const double *w2Table = (const double *)(twiddles + 2 * m - 1);
+
+        for (int j = 0; j < n; j += 4 * m) {
+            double *x0 = d + 2 * j;
+            double *x1 = x0 + 2 * m;
+            double *x2 = x1 + 2 * m;
+            double *x3 = x2 + 2 * m;
+
+            for (int k = 0; k < m; k++) {
+                const __m128d w1 = _mm_load_pd(w1Table + 2 * k);
+                const __m128d w2 = _mm_load_pd(w2Table + 2 * k);
+
+                const __m128d a = _mm_loadu_pd(x0 + 2 * k);
+                const __m128d b = multiply(_mm_loadu_pd(x1 + 2 * k), w1);
+                const __m128d c = _mm_loadu_pd(x2 + 2 * k);
+                const __m128d e = multiply(_mm_loadu_pd(x3 + 2 * k), w1);
+
+                const __m128d a1 = _mm_add_pd(a, b);
+                const __m128d b1 = _mm_sub_pd(a, b);
+                const __m128d c1 = multiply(_mm_add_pd(c, e), w2);
+                __m128d d1 = multiply(_mm_sub_pd(c, e), w2);
+                d1 = _mm_xor_pd(_mm_shuffle_pd(d1, d1, 0x1), quarterTurnSign);
+
+                _mm_storeu_pd(x0 + 2 * k, _mm_add_pd(a1, c1));
+                _mm_storeu_pd(x2 + 2 * k, _mm_sub_pd(a1, c1));
+                _mm_storeu_pd(x1 + 2 * k, _mm_add_pd(b1, d1));
+                _mm_storeu_pd(x3 + 2 * k, _mm_sub_pd(b1, d1));
+            }
+        }
+    }
+
+    if (inverse) {
+        const __m128d scale = _mm_set1_pd(1 / (math::real_d)n);
+        for (int i = 0; i < n; i++) {
+            _mm_storeu_pd(d + 2 * i, _mm_mul_pd(_mm_loadu_pd(d + 2 * i), scale));
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#include "../include/sobol_sampler.h"
+
+#include "../include/low_discrepancy.h"
+
+manta::SobolSampler::SobolSampler() {
+    m_pixelSeed = 0;
+    m_dimension = 0;
+}
+
+manta::SobolSampler::~SobolSampler() {
+    /* void */
+}
+
+void manta::SobolSampler::startPixelSession() {
+    Sampler::startPixelSession();
+
+    // Each pixel gets its own scramble which follows the seed of the sampler and the pixel
+    m_pixelSeed = getPixelKey();
+    m_dimension = 0;
+}
+
+bool manta::SobolSampler::startNextSample() {
+    m_dimension = 0;
+
+    return Sampler::startNextSample();
+}
+
+manta::math::real manta::SobolSampler::generate1d() {
+    const uint32_t seed = nextDimensionSeed();
+    const uint32_t index = shuffledIndex(seed);
+
+    return fixedPointToReal(owenScramble(sobolSample0(index), hashCombine32(seed, 1)));
+}
+
+manta::math::Vector2 manta::SobolSampler::generate2d() {
+    const uint32_t seed = nextDimensionSeed();
+    const uint32_t index = shuffledIndex(seed);
+
+    return math::Vector2(
+        fixedPointToReal(owenScramble(sobolSample0(index), hashCombine32(seed, 1))),
+        fixedPointToReal(owenScramble(sobolSample1(index), hashCombine32(seed, 2))));
+}
+
+manta::Sampler *manta::SobolSampler::clone() const {
+    SobolSampler *newSampler = new SobolSampler;
+    newSampler->setSamplesPerPixel(m_samplesPerPixel);
+
+    return newSampler;
+}
+
+uint32_t manta::SobolSampler::nextDimensionSeed() {
+    return hashCombine32(m_pixelSeed, (uint32_t)m_dimension++);
+}
+
+uint32_t manta::SobolSampler::shuffledIndex(uint32_t dimensionSeed) const {
+    // Scrambling the index decorrelates the dimensions. Each power-of-two prefix still
+    // maps onto an aligned block of the sequence which is itself a (0,m,2)-net
+    return owenScramble((uint32_t)m_currentPixelSample, dimensionSeed);
+}
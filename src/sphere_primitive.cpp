@@ -3,6 +3,7 @@
 #include "../include/light_ray.h"
 #include "../include/intersection_point.h"
 #include "../include/coarse_intersection.h"
+#include "../include/primitives.h"
 
 manta::SpherePrimitive::SpherePrimitive() {
     m_radius = (math::real)0.0;
@@ -16,6 +17,13 @@ bool manta::SpherePrimitive::fastIntersection(LightRay *ray) const {
     return true;
 }
 
+bool manta::SpherePrimitive::getBounds(AABB *bounds) const {
+    bounds->minPoint = math::sub(m_position, math::loadScalar(m_radius));
+    bounds->maxPoint = math::add(m_position, math::loadScalar(m_radius));
+
+    return true;
+}
+
 bool manta::SpherePrimitive::findClosestIntersection(LightRay *ray, 
         CoarseIntersection *intersection, math::real minDepth, 
         math::real maxDepth, StackAllocator *s /**/ STATISTICS_PROTOTYPE) const 
@@ -66,6 +74,23 @@ bool manta::SpherePrimitive::findClosestIntersection(LightRay *ray,
     }
 }
 
+bool manta::SpherePrimitive::occluded(const math::Vector &p0, const math::Vector &d, math::real maxDepth /**/ STATISTICS_PROTOTYPE) const {
+    const math::Vector d_pos = math::sub(p0, m_position);
+    const math::Vector d_dot_dir = math::dot(d_pos, d);
+    const math::Vector mag2 = math::magnitudeSquared3(d_pos);
+
+    const math::Vector radius2 = math::loadScalar(m_radius * m_radius);
+    math::Vector det = math::sub(math::mul(d_dot_dir, d_dot_dir), math::sub(mag2, radius2));
+
+    if (math::getScalar(det) < (math::real)0.0) return false;
+
+    det = math::sqrt(det);
+    const math::real t1_s = math::getScalar(math::sub(det, d_dot_dir));
+    const math::real t2_s = math::getScalar(math::sub(math::negate(det), d_dot_dir));
+
+    return (t1_s > (math::real)0.0 && t1_s < maxDepth) || (t2_s > (math::real)0.0 && t2_s < maxDepth);
+}
+
 manta::math::Vector manta::SpherePrimitive::getClosestPoint(
     const CoarseIntersection *hint, const math::Vector &p) const 
 {
@@ -2,30 +2,185 @@
 
 #include <malloc.h>
 
+#if ENABLE_GUARD_PAGES
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* _WIN32 */
+#endif /* ENABLE_GUARD_PAGES */
+
+namespace manta {
+
+    // Chunk headers are padded so that the first allocation of a chunk is well aligned
+    constexpr mem_size ChunkHeaderSize = 64;
+
+} /* namespace manta */
+
 manta::StackAllocator::StackAllocator() {
-    m_buffer = nullptr;
+    m_first = nullptr;
+    m_current = nullptr;
     m_stackPointer = nullptr;
 
-    m_size = 0;
+    m_chunkSize = DefaultChunkSize;
 
     m_allocationLedger = 0;
-    m_maxStackPointer = nullptr;
+    m_maxUsage = 0;
 }
 
 manta::StackAllocator::~StackAllocator() {
     assert(m_allocationLedger == 0);
 
-    // TODO: explicit release of memory is preferable
-    if (m_buffer != nullptr) {
-        ::free(m_buffer);
-    }
+    destroy();
 }
 
-void manta::StackAllocator::initialize(mem_size size) {
-    m_size = size;
+void manta::StackAllocator::initialize(mem_size chunkSize) {
+    destroy();
 
-    m_buffer = malloc(size);
-    m_stackPointer = m_buffer;
-    m_maxStackPointer = m_stackPointer;
+    m_chunkSize = chunkSize;
+    m_first = m_current = allocateChunk(chunkSize, nullptr);
+    m_stackPointer = m_current->base;
+    m_maxUsage = 0;
     m_allocationLedger = 0;
 }
+
+void manta::StackAllocator::destroy() {
+    Chunk *chunk = m_first;
+    while (chunk != nullptr) {
+        Chunk *next = chunk->next;
+        freeChunk(chunk);
+        chunk = next;
+    }
+
+    m_first = m_current = nullptr;
+    m_stackPointer = nullptr;
+}
+
+manta::mem_size manta::StackAllocator::getReservedSize() const {
+    mem_size size = 0;
+    for (const Chunk *chunk = m_first; chunk != nullptr; chunk = chunk->next) {
+        size += (mem_size)(chunk->end - chunk->base);
+    }
+
+    return size;
+}
+
+int manta::StackAllocator::getChunkCount() const {
+    int count = 0;
+    for (const Chunk *chunk = m_first; chunk != nullptr; chunk = chunk->next) {
+        ++count;
+    }
+
+    return count;
+}
+
+void *manta::StackAllocator::grow(mem_size size, unsigned int alignment) {
+    const mem_size required = size + alignment;
+
+    if (m_current == nullptr) {
+        // The allocator was never initialized
+        m_first = m_current = allocateChunk((required > m_chunkSize) ? required : m_chunkSize, nullptr);
+    }
+    else {
+        // Reuse the following chunks if they are large enough, otherwise a new chunk is
+        // inserted so that the chunks after it stay in order
+        Chunk *next = m_current->next;
+        while (next != nullptr && (mem_size)(next->end - next->base) < required) {
+            Chunk *tooSmall = next;
+            next = next->next;
+
+            m_current->next = next;
+            if (next != nullptr) next->previous = m_current;
+            freeChunk(tooSmall);
+        }
+
+        if (next == nullptr) {
+            const mem_size capacity = (required > m_chunkSize) ? required : m_chunkSize;
+            next = allocateChunk(capacity, m_current);
+        }
+
+        next->offset = m_current->offset + (mem_size)(m_current->end - m_current->base);
+        m_current = next;
+    }
+
+    mem_size basePtr = (mem_size)m_current->base;
+    unsigned int mod = (unsigned int)((alignment - basePtr % alignment) % alignment);
+
+    return (void *)(m_current->base + mod);
+}
+
+void manta::StackAllocator::rewindToAddress(void *memory) {
+    Chunk *chunk = m_current;
+    while (chunk != nullptr) {
+        if ((char *)memory >= chunk->base && (char *)memory <= chunk->end) break;
+        chunk = chunk->previous;
+    }
+
+    assert(chunk != nullptr);
+    if (chunk == nullptr) return;
+
+    m_current = chunk;
+    m_stackPointer = memory;
+}
+
+manta::StackAllocator::Chunk *manta::StackAllocator::allocateChunk(mem_size capacity, Chunk *previous) {
+    mem_size allocationSize = ChunkHeaderSize + capacity;
+
+#if ENABLE_GUARD_PAGES
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const mem_size pageSize = (mem_size)info.dwPageSize;
+#else
+    const mem_size pageSize = (mem_size)sysconf(_SC_PAGESIZE);
+#endif /* _WIN32 */
+
+    // The usable part of the chunk ends right where the guard page begins
+    allocationSize = ((allocationSize + pageSize - 1) / pageSize) * pageSize;
+
+#ifdef _WIN32
+    char *memory = (char *)VirtualAlloc(NULL, allocationSize + pageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    DWORD oldProtect;
+    VirtualProtect(memory + allocationSize, pageSize, PAGE_NOACCESS, &oldProtect);
+#else
+    char *memory = (char *)mmap(nullptr, allocationSize + pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mprotect(memory + allocationSize, pageSize, PROT_NONE);
+#endif /* _WIN32 */
+
+    Chunk *chunk = new (memory) Chunk;
+    chunk->end = memory + allocationSize;
+    chunk->allocationSize = allocationSize + pageSize;
+#else
+    char *memory = (char *)malloc(allocationSize);
+
+    Chunk *chunk = new (memory) Chunk;
+    chunk->end = memory + allocationSize;
+    chunk->allocationSize = allocationSize;
+#endif /* ENABLE_GUARD_PAGES */
+
+    chunk->base = memory + ChunkHeaderSize;
+    chunk->offset = 0;
+    chunk->previous = previous;
+    chunk->next = nullptr;
+
+    if (previous != nullptr) {
+        chunk->next = previous->next;
+        if (previous->next != nullptr) previous->next->previous = chunk;
+        previous->next = chunk;
+    }
+
+    return chunk;
+}
+
+void manta::StackAllocator::freeChunk(Chunk *chunk) {
+#if ENABLE_GUARD_PAGES
+#ifdef _WIN32
+    VirtualFree((void *)chunk, 0, MEM_RELEASE);
+#else
+    munmap((void *)chunk, chunk->allocationSize);
+#endif /* _WIN32 */
+#else
+    ::free((void *)chunk);
+#endif /* ENABLE_GUARD_PAGES */
+}
@@ -1,29 +1,115 @@
 #include "../include/standard_allocator.h"
 
 #include <malloc.h>
+#include <stdlib.h>
 
-manta::StandardAllocator *manta::StandardAllocator::s_global = nullptr;
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif /* _WIN32 */
 
 manta::StandardAllocator *manta::StandardAllocator::Global() {
-    if (s_global == nullptr) return s_global = new StandardAllocator;
-    else return s_global;
+    // Initialized exactly once even if several threads allocate first. The allocator is
+    // never destroyed since memory may still be freed from static destructors.
+    static StandardAllocator *const global = new StandardAllocator;
+    return global;
 }
 
 manta::StandardAllocator::StandardAllocator() {
-    m_allocationLedger = 0;
+    // Huge pages are opt-in, they waste memory on sparse buffers and can stall on
+    // compaction when the system is short on contiguous memory
+    m_hugePagesEnabled = false;
 
-    m_maxUsage = 0;
-    m_currentUsage = 0;
+    initialize();
 }
 
 manta::StandardAllocator::~StandardAllocator() {
-    assert(m_allocationLedger == 0);
-    assert(m_currentUsage == 0);
+    assert(m_total.allocationLedger == 0);
+    assert(m_total.currentUsage == 0);
 }
 
 void manta::StandardAllocator::initialize() {
-    m_allocationLedger = 0;
+    resetCounters(&m_total);
+    for (int i = 0; i < (int)MemoryTag::Count; i++) {
+        resetCounters(&m_tags[i]);
+    }
+}
+
+const char *manta::StandardAllocator::getTagName(MemoryTag tag) {
+    switch (tag) {
+    case MemoryTag::General: return "General";
+    case MemoryTag::Mesh: return "Meshes";
+    case MemoryTag::KDTree: return "KD-trees";
+    case MemoryTag::Texture: return "Textures";
+    case MemoryTag::Film: return "Film";
+    case MemoryTag::FFT: return "FFT maps";
+    default: return "";
+    }
+}
+
+void manta::StandardAllocator::recordAllocation(mem_size size, MemoryTag tag) {
+    Counters &tagCounters = m_tags[(int)tag];
+
+#if MANTA_STD_ALLOC_ENABLE_LEDGER
+    m_total.allocationLedger++;
+    tagCounters.allocationLedger++;
+#endif /* MANTA_STD_ALLOC_ENABLE_LEDGER */
+
+    updateMaximum(&m_total.maxUsage, m_total.currentUsage += size);
+    updateMaximum(&tagCounters.maxUsage, tagCounters.currentUsage += size);
+}
+
+void manta::StandardAllocator::recordFree(mem_size size, MemoryTag tag) {
+    Counters &tagCounters = m_tags[(int)tag];
+
+#if MANTA_STD_ALLOC_ENABLE_LEDGER
+    assert(m_total.allocationLedger > 0);
+    assert(tagCounters.allocationLedger > 0);
+    m_total.allocationLedger--;
+    tagCounters.allocationLedger--;
+#endif /* MANTA_STD_ALLOC_ENABLE_LEDGER */
+
+    assert(m_total.currentUsage >= size);
+    assert(tagCounters.currentUsage >= size);
+    m_total.currentUsage -= size;
+    tagCounters.currentUsage -= size;
+}
+
+void *manta::StandardAllocator::allocateAligned(mem_size size, unsigned int alignment) {
+#ifdef _WIN32
+    // Large pages on Windows need the lock pages privilege so they are not used here
+    return _aligned_malloc(size, alignment);
+#else
+    const bool hugePages = m_hugePagesEnabled && size >= HugePageSize;
+    if (hugePages && alignment < HugePageSize) alignment = (unsigned int)HugePageSize;
+    if (alignment < sizeof(void *)) alignment = sizeof(void *);
+
+    void *memory = nullptr;
+    if (posix_memalign(&memory, alignment, size) != 0) return nullptr;
+
+    // Only a hint, the kernel falls back to regular pages if none are available
+#ifdef MADV_HUGEPAGE
+    if (hugePages) madvise(memory, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    return memory;
+#endif /* _WIN32 */
+}
+
+void manta::StandardAllocator::freeAligned(void *memory) {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    ::free(memory);
+#endif /* _WIN32 */
+}
+
+void manta::StandardAllocator::resetCounters(Counters *counters) {
+    counters->allocationLedger = 0;
+    counters->currentUsage = 0;
+    counters->maxUsage = 0;
+}
 
-    m_maxUsage = 0;
-    m_currentUsage = 0;
+void manta::StandardAllocator::updateMaximum(std::atomic<mem_size> *maximum, mem_size value) {
+    mem_size current = maximum->load();
+    while (value > current && !maximum->compare_exchange_weak(current, value));
 }
@@ -20,8 +20,17 @@ void manta::StandardCameraRayEmitter::generateRay(LightRay *ray) const {
     math::Vector dir = math::sub(target, m_position);
     dir = math::normalize(dir);
 
+    const math::real scale = getDifferentialScale();
+    const math::Vector dxTarget = transformToImagePlane(
+        math::Vector2(p_u.x - (math::real)0.5 + scale, p_u.y - (math::real)0.5));
+    const math::Vector dyTarget = transformToImagePlane(
+        math::Vector2(p_u.x - (math::real)0.5, p_u.y - (math::real)0.5 + scale));
+
     ray->setDirection(dir);
     ray->setSource(m_position);
+    ray->setDifferentials(
+        m_position, math::normalize(math::sub(dxTarget, m_position)),
+        m_position, math::normalize(math::sub(dyTarget, m_position)));
     ray->setIntensity(math::constants::Zero);
     ray->setCameraWeight((math::real)1.0);
     ray->setImagePlaneLocation(
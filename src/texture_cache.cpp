@@ -0,0 +1,129 @@
+#include "../include/texture_cache.h"
+
+#include "../include/tiled_texture.h"
+#include "../include/vector_map_2d.h"
+
+manta::TextureCache *manta::TextureCache::Global() {
+    // Function-local statics are initialized exactly once even if several threads get
+    // here first, like ThreadPool::Global()
+    static TextureCache *const global = new TextureCache;
+    return global;
+}
+
+manta::TextureCache::TextureCache() {
+    for (int i = 0; i < ShardCount; i++) {
+        m_shards[i].usage = 0;
+    }
+
+    m_budget = DefaultBudget;
+    m_usage = 0;
+
+    resetStatistics();
+}
+
+manta::TextureCache::~TextureCache() {
+    clear();
+}
+
+std::shared_ptr<const manta::VectorMap2D> manta::TextureCache::getTile(const TiledTexture *texture, int tileIndex) {
+    const unsigned __int64 key = ((unsigned __int64)texture->getId() << 32) | (unsigned int)tileIndex;
+    Shard &shard = m_shards[(texture->getId() * 31 + tileIndex) % ShardCount];
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto cached = shard.entries.find(key);
+    if (cached != shard.entries.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, cached->second);
+        m_hits++;
+
+        return cached->second->tile;
+    }
+
+    m_misses++;
+
+    // Tiles are read while the shard is locked so that a tile is never loaded twice
+    VectorMap2D *tile = new VectorMap2D;
+    texture->readTile(tileIndex, tile);
+
+    Entry entry;
+    entry.key = key;
+    entry.size = tile->getMemoryUsage();
+    entry.tile = std::shared_ptr<const VectorMap2D>(tile, [](const VectorMap2D *map) {
+        VectorMap2D *mutableMap = const_cast<VectorMap2D *>(map);
+        mutableMap->destroy();
+        delete mutableMap;
+    });
+
+    shard.lru.push_front(entry);
+    shard.entries[key] = shard.lru.begin();
+    shard.usage += entry.size;
+    updateMaximum(m_usage += entry.size);
+
+    // Each shard is held to an even share of the budget
+    evict(&shard, m_budget / ShardCount);
+
+    return entry.tile;
+}
+
+void manta::TextureCache::purge(const TiledTexture *texture) {
+    for (int i = 0; i < ShardCount; i++) {
+        Shard &shard = m_shards[i];
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        for (auto entry = shard.lru.begin(); entry != shard.lru.end();) {
+            auto next = std::next(entry);
+            if ((entry->key >> 32) == texture->getId()) remove(&shard, entry);
+            entry = next;
+        }
+    }
+}
+
+void manta::TextureCache::clear() {
+    for (int i = 0; i < ShardCount; i++) {
+        Shard &shard = m_shards[i];
+        std::lock_guard<std::mutex> lock(shard.lock);
+
+        while (!shard.lru.empty()) {
+            remove(&shard, std::prev(shard.lru.end()));
+        }
+    }
+}
+
+manta::TextureCache::Statistics manta::TextureCache::getStatistics() const {
+    Statistics statistics;
+    statistics.hits = m_hits;
+    statistics.misses = m_misses;
+    statistics.evictions = m_evictions;
+    statistics.usage = m_usage;
+    statistics.maxUsage = m_maxUsage;
+
+    return statistics;
+}
+
+void manta::TextureCache::resetStatistics() {
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+    m_maxUsage = m_usage.load();
+}
+
+void manta::TextureCache::evict(Shard *shard, mem_size budget) {
+    // The most recent tile is always kept, even if it alone exceeds the budget
+    while (shard->usage > budget && shard->lru.size() > 1) {
+        remove(shard, std::prev(shard->lru.end()));
+        m_evictions++;
+    }
+}
+
+void manta::TextureCache::remove(Shard *shard, std::list<Entry>::iterator entry) {
+    shard->usage -= entry->size;
+    m_usage -= entry->size;
+
+    shard->entries.erase(entry->key);
+    shard->lru.erase(entry);
+}
+
+void manta::TextureCache::updateMaximum(mem_size value) {
+    mem_size current = m_maxUsage.load();
+    while (value > current && !m_maxUsage.compare_exchange_weak(current, value));
+}
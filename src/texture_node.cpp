@@ -34,6 +34,7 @@ void manta::TextureNode::_initialize() {
 void manta::TextureNode::_evaluate() {
     m_defaultNode.evaluate();
     m_textureOutput.setMap(m_defaultNode.getMap());
+    m_textureOutput.setMipmap(m_defaultNode.getMipmap());
 }
 
 void manta::TextureNode::_destroy() {
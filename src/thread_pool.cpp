@@ -0,0 +1,177 @@
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <assert.h>
+
+thread_local int manta::ThreadPool::s_threadIndex = -1;
+
+manta::ThreadPool *manta::ThreadPool::Global() {
+    // Nodes are evaluated in parallel so the first call can come from several threads
+    // at once, initialization of a local static only ever runs once. The pool is sized
+    // to the machine here and never resized since other nodes may be using it.
+    static ThreadPool *const global = [] {
+        ThreadPool *pool = new ThreadPool;
+        pool->initialize();
+
+        return pool;
+    }();
+
+    return global;
+}
+
+manta::ThreadPool::ThreadPool() {
+    m_stop = false;
+}
+
+manta::ThreadPool::~ThreadPool() {
+    destroy();
+}
+
+void manta::ThreadPool::initialize(int threadCount) {
+    if (threadCount <= 0) threadCount = getHardwareThreadCount();
+    if (threadCount == getThreadCount()) return;
+
+    destroy();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (int i = 0; i < threadCount; i++) {
+        m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+void manta::ThreadPool::destroy() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+        threads.swap(m_threads);
+    }
+
+    // A pool thread can't join itself
+    for (const std::thread &thread : threads) {
+        assert(thread.get_id() != std::this_thread::get_id());
+        (void)thread;
+    }
+
+    // Threads only exit once the queue is empty
+    m_taskAvailable.notify_all();
+    for (std::thread &thread : threads) thread.join();
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stop = false;
+}
+
+void manta::ThreadPool::parallelFor(int begin, int end, int grainSize, const std::function<void(int, int)> &body) {
+    if (end <= begin) return;
+
+    const int count = end - begin;
+    const int threadCount = std::max(getThreadCount(), 1);
+    const int rangeSize = std::max(grainSize, (count + threadCount - 1) / threadCount);
+
+    TaskGroup tasks(this);
+    for (int start = begin; start < end; start += rangeSize) {
+        const int rangeEnd = std::min(start + rangeSize, end);
+        tasks.run([&body, start, rangeEnd]() { body(start, rangeEnd); });
+    }
+
+    tasks.wait();
+}
+
+int manta::ThreadPool::getHardwareThreadCount() {
+    return std::max((int)std::thread::hardware_concurrency(), 1);
+}
+
+void manta::ThreadPool::push(const std::function<void()> &task, TaskGroup *group) {
+    group->m_pending++;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    if (m_threads.empty()) {
+        // There is nothing to hand the task to
+        lock.unlock();
+
+        QueuedTask inlineTask = { task, group };
+        execute(inlineTask);
+        return;
+    }
+
+    m_tasks.push_back({ task, group });
+    lock.unlock();
+
+    m_taskAvailable.notify_one();
+}
+
+void manta::ThreadPool::execute(QueuedTask &task) {
+    task.task();
+
+    // The group can be destroyed as soon as the last task is accounted for so it is
+    // not touched after the decrement
+    if (--task.group->m_pending == 0) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_taskCompleted.notify_all();
+    }
+}
+
+void manta::ThreadPool::workerLoop(int index) {
+    s_threadIndex = index;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true) {
+        m_taskAvailable.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+        if (m_tasks.empty()) break;
+
+        QueuedTask task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+
+        lock.unlock();
+        execute(task);
+        lock.lock();
+    }
+
+    s_threadIndex = -1;
+}
+
+bool manta::ThreadPool::takeTask(TaskGroup *group, QueuedTask *task) {
+    for (auto it = m_tasks.begin(); it != m_tasks.end(); ++it) {
+        if (it->group == group) {
+            *task = std::move(*it);
+            m_tasks.erase(it);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+manta::TaskGroup::TaskGroup() {
+    m_pool = ThreadPool::Global();
+    m_pending = 0;
+}
+
+manta::TaskGroup::TaskGroup(ThreadPool *pool) {
+    m_pool = pool;
+    m_pending = 0;
+}
+
+manta::TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void manta::TaskGroup::run(const std::function<void()> &task) {
+    m_pool->push(task, this);
+}
+
+void manta::TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(m_pool->m_lock);
+    while (m_pending > 0) {
+        // Run the group's own tasks rather than sitting idle
+        ThreadPool::QueuedTask task;
+        if (m_pool->takeTask(this, &task)) {
+            lock.unlock();
+            m_pool->execute(task);
+            lock.lock();
+        }
+        else {
+            m_pool->m_taskCompleted.wait(lock);
+        }
+    }
+}
@@ -0,0 +1,302 @@
+#include "../include/tiled_texture.h"
+
+#include "../include/texture_cache.h"
+#include "../include/mipmap.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif /* _WIN32 */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace manta {
+
+    constexpr char TiledTextureMagic[8] = { 'M', 'R', 'T', 'E', 'X', '0', '0', '0' };
+
+    static std::atomic<unsigned int> s_nextTextureId(0);
+    static std::atomic<unsigned int> s_nextTemporaryFile(0);
+
+    // Moves the file into place in one step. Other textures may have the old file
+    // mapped, they keep reading the old contents until they are closed.
+    static bool replaceFile(const char *source, const char *target) {
+#ifdef _WIN32
+        return MoveFileEx(source, target, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return rename(source, target) == 0;
+#endif /* _WIN32 */
+    }
+
+} /* namespace manta */
+
+manta::TiledTexture::TiledTexture() {
+    m_cache = nullptr;
+
+    m_tileCount = 0;
+    m_width = 0;
+    m_height = 0;
+    m_format = VectorMap2D::Format::Vector;
+
+    m_id = 0;
+}
+
+manta::TiledTexture::~TiledTexture() {
+    assert(!isOpen());
+}
+
+bool manta::TiledTexture::writeFile(const char *fname, const VectorMap2D *source,
+    unsigned __int64 sourceSize, __int64 sourceTime, unsigned int sourceFlags)
+{
+    VectorMipmap mipmap;
+    mipmap.initialize(source);
+
+    std::vector<Level> levels;
+    int tileCount;
+    computeLevels(source->getWidth(), source->getHeight(), mipmap.getLevels(), &levels, &tileCount);
+
+    const int texelSize = VectorMap2D::getTexelSize(source->getFormat());
+    const mem_size tileSize = (mem_size)TileSize * TileSize * texelSize;
+
+    TiledTextureHeader header;
+    memset(&header, 0, sizeof(TiledTextureHeader));
+    memcpy(header.magic, TiledTextureMagic, sizeof(TiledTextureMagic));
+    header.version = CacheVersion;
+    header.format = (int)source->getFormat();
+    header.tileSize = TileSize;
+    header.width = source->getWidth();
+    header.height = source->getHeight();
+    header.levels = mipmap.getLevels();
+    header.sourceSize = sourceSize;
+    header.sourceTime = sourceTime;
+    header.sourceFlags = sourceFlags;
+    header.fileSize = CacheHeaderSize + tileSize * tileCount;
+
+    // The file is written under a name that is unique to this writer and only moved
+    // over the target once complete, so a mapped copy is never truncated
+    const std::string temporaryName = std::string(fname) + "."
+        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + "."
+        + std::to_string(s_nextTemporaryFile++) + ".tmp";
+
+    std::ofstream file(temporaryName, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        mipmap.destroy();
+        return false;
+    }
+
+    char headerBlock[CacheHeaderSize];
+    memset(headerBlock, 0, CacheHeaderSize);
+    memcpy(headerBlock, &header, sizeof(TiledTextureHeader));
+    file.write(headerBlock, CacheHeaderSize);
+
+    std::vector<unsigned char> tile((size_t)tileSize);
+    for (int l = 0; l < (int)levels.size(); l++) {
+        const VectorMap2D *map = mipmap.getLevel(l);
+        const Level &level = levels[l];
+
+        for (int ty = 0; ty < level.tilesY; ty++) {
+            for (int tx = 0; tx < level.tilesX; tx++) {
+                const int x0 = tx * TileSize;
+                const int span = std::min(TileSize, level.width - x0);
+
+                for (int j = 0; j < TileSize; j++) {
+                    // Texels past the edge of the level repeat the edge texels
+                    const int y = std::min(ty * TileSize + j, level.height - 1);
+                    const unsigned char *row = map->getRawRow(y) + (mem_size)x0 * texelSize;
+                    unsigned char *target = tile.data() + (mem_size)j * TileSize * texelSize;
+
+                    memcpy(target, row, (size_t)span * texelSize);
+                    for (int i = span; i < TileSize; i++) {
+                        memcpy(target + i * texelSize, row + (span - 1) * texelSize, texelSize);
+                    }
+                }
+
+                file.write((const char *)tile.data(), tileSize);
+            }
+        }
+    }
+
+    mipmap.destroy();
+    file.close();
+
+    if (file.fail() || !replaceFile(temporaryName.c_str(), fname)) {
+        remove(temporaryName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+manta::TiledTexture::CacheStatus manta::TiledTexture::open(const char *fname,
+    unsigned __int64 sourceSize, __int64 sourceTime, unsigned int sourceFlags, TextureCache *cache)
+{
+    close();
+
+    if (!m_file.open(fname)) return CacheStatus::Missing;
+
+    const char *data = (const char *)m_file.getData();
+    const mem_size size = m_file.getSize();
+
+    if (size < CacheHeaderSize || memcmp(data, TiledTextureMagic, sizeof(TiledTextureMagic)) != 0) {
+        m_file.close();
+        return CacheStatus::Corrupt;
+    }
+
+    TiledTextureHeader header;
+    memcpy(&header, data, sizeof(TiledTextureHeader));
+
+    const bool stale =
+        header.version != CacheVersion ||
+        header.tileSize != TileSize ||
+        header.sourceSize != sourceSize ||
+        header.sourceTime != sourceTime ||
+        header.sourceFlags != sourceFlags;
+    if (stale) {
+        m_file.close();
+        return CacheStatus::Stale;
+    }
+
+    // The layout is fully determined by the format and the dimensions
+    const int texelSize = (header.format >= 0 && header.format <= (int)VectorMap2D::Format::Linear8Mono)
+        ? VectorMap2D::getTexelSize((VectorMap2D::Format)header.format)
+        : 0;
+    const bool validDimensions = texelSize > 0 && header.width > 0 && header.height > 0 &&
+        header.levels == VectorMipmap::calculateLevels(std::min(header.width, header.height));
+
+    int tileCount = 0;
+    if (validDimensions) computeLevels(header.width, header.height, header.levels, &m_levels, &tileCount);
+
+    const mem_size expectedSize = CacheHeaderSize + (mem_size)TileSize * TileSize * texelSize * tileCount;
+    if (!validDimensions || header.fileSize != size || expectedSize != size) {
+        m_levels.clear();
+        m_file.close();
+        return CacheStatus::Corrupt;
+    }
+
+    m_cache = cache;
+    m_tileCount = tileCount;
+    m_width = header.width;
+    m_height = header.height;
+    m_format = (VectorMap2D::Format)header.format;
+    m_id = s_nextTextureId++;
+
+    return CacheStatus::Loaded;
+}
+
+void manta::TiledTexture::close() {
+    if (!isOpen()) return;
+
+    m_cache->purge(this);
+    m_file.close();
+
+    m_levels.clear();
+    m_cache = nullptr;
+    m_tileCount = 0;
+    m_width = 0;
+    m_height = 0;
+}
+
+manta::math::Vector manta::TiledTexture::sample(math::real u, math::real v, math::real w) const {
+    const int levels = getLevels();
+    math::real level = levels - 1 + std::log2(std::fmax(w, (math::real)1E-8));
+
+    if (level < 0) {
+        return triangle(0, u, v);
+    }
+    else if (level >= levels - 1) {
+        return discreteSample(levels - 1, 0, 0);
+    }
+    else {
+        int iLevel = (int)std::floor(level);
+        math::real delta = level - iLevel;
+        return math::add(
+            math::mul(triangle(iLevel, u, v), math::loadScalar(1 - delta)),
+            math::mul(triangle(iLevel + 1, u, v), math::loadScalar(delta)));
+    }
+}
+
+manta::math::Vector manta::TiledTexture::triangle(int level, math::real u, math::real v) const {
+    if (level < 0) level = 0;
+    else if (level >= getLevels()) level = getLevels() - 1;
+
+    math::real s = u * m_levels[level].width - (math::real)0.5;
+    math::real t = v * m_levels[level].height - (math::real)0.5;
+    int s0 = (int)std::floor(s), t0 = (int)std::floor(t);
+    math::real ds = s - s0, dt = t - t0;
+
+    TileReference reference = { -1, nullptr };
+    const math::Vector t00 = texel(level, s0, t0, &reference);
+    const math::Vector t10 = texel(level, s0 + 1, t0, &reference);
+    const math::Vector t01 = texel(level, s0, t0 + 1, &reference);
+    const math::Vector t11 = texel(level, s0 + 1, t0 + 1, &reference);
+
+    return math::add(
+        math::add(
+            math::mul(t00, math::loadScalar((1 - ds) * (1 - dt))),
+            math::mul(t10, math::loadScalar(ds * (1 - dt)))),
+        math::add(
+            math::mul(t01, math::loadScalar((1 - ds) * dt)),
+            math::mul(t11, math::loadScalar(ds * dt))));
+}
+
+manta::math::Vector manta::TiledTexture::discreteSample(int level, int i, int j) const {
+    TileReference reference = { -1, nullptr };
+    return texel(level, i, j, &reference);
+}
+
+void manta::TiledTexture::readTile(int tileIndex, VectorMap2D *target) const {
+    assert(tileIndex >= 0 && tileIndex < m_tileCount);
+
+    const mem_size tileSize = (mem_size)TileSize * TileSize * VectorMap2D::getTexelSize(m_format);
+    const char *data = (const char *)m_file.getData() + CacheHeaderSize + tileSize * tileIndex;
+
+    target->initialize(TileSize, TileSize, m_format);
+    memcpy(target->getRawRow(0), data, (size_t)tileSize);
+}
+
+void manta::TiledTexture::computeLevels(
+    int width, int height, int levelCount, std::vector<Level> *levels, int *tileCount)
+{
+    levels->resize(levelCount);
+
+    // Level sizes follow VectorMap2D::boxDownsample
+    int firstTile = 0;
+    for (int i = 0; i < levelCount; i++) {
+        Level &level = (*levels)[i];
+        level.width = width;
+        level.height = height;
+        level.tilesX = (width + TileSize - 1) / TileSize;
+        level.tilesY = (height + TileSize - 1) / TileSize;
+        level.firstTile = firstTile;
+
+        firstTile += level.tilesX * level.tilesY;
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+    }
+
+    *tileCount = firstTile;
+}
+
+manta::math::Vector manta::TiledTexture::texel(int level, int i, int j, TileReference *reference) const {
+    const Level &l = m_levels[level];
+
+    // Texture coordinates wrap around
+    i %= l.width;
+    j %= l.height;
+    if (i < 0) i += l.width;
+    if (j < 0) j += l.height;
+
+    const int tileIndex = l.firstTile + (j / TileSize) * l.tilesX + (i / TileSize);
+    if (reference->index != tileIndex) {
+        reference->tile = m_cache->getTile(this, tileIndex);
+        reference->index = tileIndex;
+    }
+
+    return reference->tile->get(i % TileSize, j % TileSize);
+}
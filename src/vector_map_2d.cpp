@@ -3,11 +3,92 @@
 #include "../include/standard_allocator.h"
 #include "../include/image_byte_buffer.h"
 #include "../include/image_plane.h"
+#include "../include/rgb_space.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <string.h>
+
+namespace manta {
+
+    // Decoded values of every 8-bit sRGB code
+    struct SrgbTable {
+        SrgbTable() {
+            for (int i = 0; i < 256; i++) {
+                values[i] = (math::real)RgbSpace::inverseGammaSrgb(i / 255.0);
+            }
+        }
+
+        math::real values[256];
+    };
+
+    static const SrgbTable &srgbTable() {
+        static const SrgbTable table;
+        return table;
+    }
+
+    static unsigned char encodeLinear8(math::real value) {
+        value = std::min(std::max(value, (math::real)0.0), (math::real)1.0);
+        return (unsigned char)(value * 255 + (math::real)0.5);
+    }
+
+    static unsigned char encodeSrgb8(math::real value) {
+        value = std::min(std::max(value, (math::real)0.0), (math::real)1.0);
+        return (unsigned char)(RgbSpace::applyGammaSrgb(value) * 255 + 0.5);
+    }
+
+    static unsigned short floatToHalf(float value) {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(float));
+
+        const unsigned short sign = (unsigned short)((bits >> 16) & 0x8000);
+        unsigned int a = bits & 0x7FFFFFFF;
+
+        // Infinity and NaN
+        if (a >= 0x7F800000) return sign | 0x7C00 | ((a > 0x7F800000) ? 0x200 : 0);
+
+        // Too large, rounds to infinity
+        if (a >= 0x477FF000) return sign | 0x7C00;
+
+        // Subnormal, adding 0.5 lines the half mantissa up with the low bits of the float
+        if (a < 0x38800000) {
+            float f;
+            memcpy(&f, &a, sizeof(float));
+            f += 0.5f;
+            memcpy(&a, &f, sizeof(float));
+            return sign | (unsigned short)(a - 0x3F000000);
+        }
+
+        // Rebias the exponent and round to nearest even
+        const unsigned int odd = (a >> 13) & 1;
+        a += 0xC8000FFF + odd;
+        return sign | (unsigned short)(a >> 13);
+    }
+
+    static float halfToFloat(unsigned short value) {
+        const unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+        const unsigned int exponent = (value >> 10) & 0x1F;
+        const unsigned int mantissa = value & 0x3FF;
+
+        unsigned int bits;
+        if (exponent == 0) {
+            const float f = mantissa * (1.0f / 16777216.0f);
+            memcpy(&bits, &f, sizeof(float));
+            bits |= sign;
+        }
+        else if (exponent == 0x1F) bits = sign | 0x7F800000 | (mantissa << 13);
+        else bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+        float result;
+        memcpy(&result, &bits, sizeof(float));
+        return result;
+    }
+
+} /* namespace manta */
 
 manta::VectorMap2D::VectorMap2D() {
     m_data = nullptr;
+    m_format = Format::Vector;
     m_width = 0;
     m_height = 0;
 }
@@ -17,24 +98,34 @@ manta::VectorMap2D::~VectorMap2D() {
 }
 
 void manta::VectorMap2D::initialize(int width, int height, const math::Vector &value) {
+    initialize(width, height, Format::Vector, value);
+}
+
+void manta::VectorMap2D::initialize(int width, int height, Format format, const math::Vector &value) {
     assert(m_data == nullptr);
 
     m_width = width;
     m_height = height;
+    m_format = format;
 
-    m_data = StandardAllocator::Global()->allocate<math::Vector>(m_width * m_height, 16);
+    m_data = StandardAllocator::Global()->allocate<unsigned char>(getMemoryUsage(), 16, MemoryTag::Texture);
 
-    for (int j = 0; j < m_height; j++) {
-        for (int i = 0; i < m_width; i++) {
-            set(value, i, j);
-        }
+    // Encoding can be expensive so the value is only encoded once
+    alignas(16) unsigned char texel[sizeof(math::Vector)];
+    encode(value, texel);
+
+    const int texelSize = getTexelSize(m_format);
+    const mem_size texelCount = (mem_size)m_width * m_height;
+    for (mem_size i = 0; i < texelCount; i++) {
+        memcpy(m_data + i * texelSize, texel, texelSize);
     }
 }
 
 void manta::VectorMap2D::destroy() {
-    StandardAllocator::Global()->aligned_free(m_data, m_width * m_height);
+    StandardAllocator::Global()->aligned_free(m_data, getMemoryUsage(), MemoryTag::Texture);
 
     m_data = nullptr;
+    m_format = Format::Vector;
     m_width = 0;
     m_height = 0;
 }
@@ -76,7 +167,9 @@ manta::math::Vector manta::VectorMap2D::triangleSample(math::real u, math::real
 manta::math::Vector manta::VectorMap2D::get(int u, int v) const {
     assert(m_data != nullptr);
 
-    return m_data[v * m_width + u];
+    const mem_size index = (mem_size)v * m_width + u;
+    if (m_format == Format::Vector) return reinterpret_cast<const math::Vector *>(m_data)[index];
+    else return decode(m_data + index * getTexelSize(m_format));
 }
 
 manta::math::Vector manta::VectorMap2D::getClip(int u, int v) const {
@@ -85,44 +178,182 @@ manta::math::Vector manta::VectorMap2D::getClip(int u, int v) const {
     if (u < 0 || u >= m_width) return math::constants::Zero;
     if (v < 0 || v >= m_height) return math::constants::Zero;
 
-    return m_data[v * m_width + u];
+    return get(u, v);
 }
 
 void manta::VectorMap2D::set(const math::Vector &value, int u, int v) {
     assert(m_data != nullptr);
 
-    m_data[v * m_width + u] = value;
+    const mem_size index = (mem_size)v * m_width + u;
+    if (m_format == Format::Vector) reinterpret_cast<math::Vector *>(m_data)[index] = value;
+    else encode(value, m_data + index * getTexelSize(m_format));
+}
+
+void manta::VectorMap2D::setBytes(
+    unsigned char r, unsigned char g, unsigned char b, unsigned char a, int u, int v)
+{
+    assert(m_data != nullptr);
+    assert(
+        m_format == Format::Srgb8 || m_format == Format::Linear8 ||
+        m_format == Format::Srgb8Mono || m_format == Format::Linear8Mono);
+
+    const int texelSize = getTexelSize(m_format);
+    unsigned char *texel = m_data + ((mem_size)v * m_width + u) * texelSize;
+    texel[0] = r;
+    if (texelSize == 4) {
+        texel[1] = g;
+        texel[2] = b;
+        texel[3] = a;
+    }
+}
+
+int manta::VectorMap2D::getTexelSize(Format format) {
+    switch (format) {
+    case Format::Vector: return sizeof(math::Vector);
+    case Format::Half: return 4 * sizeof(unsigned short);
+    case Format::Srgb8: return 4;
+    case Format::Linear8: return 4;
+    case Format::HalfMono: return sizeof(unsigned short);
+    case Format::Srgb8Mono: return 1;
+    case Format::Linear8Mono: return 1;
+    default: return 0;
+    }
+}
+
+int manta::VectorMap2D::getChannelCount(Format format) {
+    switch (format) {
+    case Format::HalfMono:
+    case Format::Srgb8Mono:
+    case Format::Linear8Mono:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+manta::math::Vector manta::VectorMap2D::decode(const unsigned char *texel) const {
+    const math::real *srgb = srgbTable().values;
+    constexpr math::real inv255 = (math::real)(1 / 255.0);
+
+    switch (m_format) {
+    case Format::Half:
+    {
+        unsigned short h[4];
+        memcpy(h, texel, sizeof(h));
+        return math::loadVector(halfToFloat(h[0]), halfToFloat(h[1]), halfToFloat(h[2]), halfToFloat(h[3]));
+    }
+    case Format::Srgb8:
+        return math::loadVector(srgb[texel[0]], srgb[texel[1]], srgb[texel[2]], texel[3] * inv255);
+    case Format::Linear8:
+        return math::loadVector(texel[0] * inv255, texel[1] * inv255, texel[2] * inv255, texel[3] * inv255);
+    case Format::HalfMono:
+    {
+        unsigned short h;
+        memcpy(&h, texel, sizeof(h));
+        const math::real value = halfToFloat(h);
+        return math::loadVector(value, value, value);
+    }
+    case Format::Srgb8Mono:
+        return math::loadVector(srgb[texel[0]], srgb[texel[0]], srgb[texel[0]]);
+    case Format::Linear8Mono:
+    {
+        const math::real value = texel[0] * inv255;
+        return math::loadVector(value, value, value);
+    }
+    default:
+        return *reinterpret_cast<const math::Vector *>(texel);
+    }
+}
+
+void manta::VectorMap2D::encode(const math::Vector &value, unsigned char *texel) const {
+    switch (m_format) {
+    case Format::Half:
+    {
+        const unsigned short h[4] = {
+            floatToHalf((float)math::getX(value)),
+            floatToHalf((float)math::getY(value)),
+            floatToHalf((float)math::getZ(value)),
+            floatToHalf((float)math::getW(value)) };
+        memcpy(texel, h, sizeof(h));
+        break;
+    }
+    case Format::Srgb8:
+        texel[0] = encodeSrgb8(math::getX(value));
+        texel[1] = encodeSrgb8(math::getY(value));
+        texel[2] = encodeSrgb8(math::getZ(value));
+        texel[3] = encodeLinear8(math::getW(value));
+        break;
+    case Format::Linear8:
+        texel[0] = encodeLinear8(math::getX(value));
+        texel[1] = encodeLinear8(math::getY(value));
+        texel[2] = encodeLinear8(math::getZ(value));
+        texel[3] = encodeLinear8(math::getW(value));
+        break;
+    case Format::HalfMono:
+    {
+        const unsigned short h = floatToHalf((float)math::getX(value));
+        memcpy(texel, &h, sizeof(h));
+        break;
+    }
+    case Format::Srgb8Mono:
+        texel[0] = encodeSrgb8(math::getX(value));
+        break;
+    case Format::Linear8Mono:
+        texel[0] = encodeLinear8(math::getX(value));
+        break;
+    default:
+        *reinterpret_cast<math::Vector *>(texel) = value;
+        break;
+    }
 }
 
 void manta::VectorMap2D::fillByteBuffer(ImageByteBuffer *target, bool correctGamma) const {
-    target->initialize(m_data, m_width, m_height, correctGamma);
+    if (m_format == Format::Vector) {
+        target->initialize(reinterpret_cast<const math::Vector *>(m_data), m_width, m_height, correctGamma);
+        return;
+    }
+
+    // Compact formats are expanded into a temporary buffer first
+    const int pCount = m_width * m_height;
+    math::Vector *expanded = StandardAllocator::Global()->allocate<math::Vector>(pCount, 16, MemoryTag::Texture);
+    for (int j = 0; j < m_height; j++) {
+        for (int i = 0; i < m_width; i++) {
+            expanded[j * m_width + i] = get(i, j);
+        }
+    }
+
+    target->initialize(expanded, m_width, m_height, correctGamma);
+    StandardAllocator::Global()->aligned_free(expanded, pCount, MemoryTag::Texture);
 }
 
 void manta::VectorMap2D::scale(const math::Vector &s) {
-    int pCount = m_width * m_height;
-    for (int i = 0; i < pCount; i++) {
-        m_data[i] = math::mul(s, m_data[i]);
+    for (int j = 0; j < m_height; j++) {
+        for (int i = 0; i < m_width; i++) {
+            set(math::mul(s, get(i, j)), i, j);
+        }
     }
 }
 
 void manta::VectorMap2D::applyGamma(math::real gamma) {
-    int pCount = m_width * m_height;
-    for (int i = 0; i < pCount; i++) {
-        math::Vector fragment = m_data[i];
-        math::real r = pow(math::getX(fragment), gamma);
-        math::real g = pow(math::getY(fragment), gamma);
-        math::real b = pow(math::getZ(fragment), gamma);
-        m_data[i] = math::loadVector(r, g, b);
+    for (int j = 0; j < m_height; j++) {
+        for (int i = 0; i < m_width; i++) {
+            math::Vector fragment = get(i, j);
+            math::real r = pow(math::getX(fragment), gamma);
+            math::real g = pow(math::getY(fragment), gamma);
+            math::real b = pow(math::getZ(fragment), gamma);
+            set(math::loadVector(r, g, b), i, j);
+        }
     }
 }
 
 manta::math::real manta::VectorMap2D::getMaxMagnitude() const {
     math::real maxMagnitude = 0.0;
-    const int pCount = m_width * m_height;
-    for (int i = 0; i < pCount; i++) {
-        math::real mag = math::getScalar(math::magnitude(m_data[i]));
-        
-        if (mag > maxMagnitude) maxMagnitude = mag;
+    for (int j = 0; j < m_height; j++) {
+        for (int i = 0; i < m_width; i++) {
+            math::real mag = math::getScalar(math::magnitude(get(i, j)));
+
+            if (mag > maxMagnitude) maxMagnitude = mag;
+        }
     }
 
     return maxMagnitude;
@@ -189,14 +420,35 @@ void manta::VectorMap2D::roll(VectorMap2D *target) const {
     }
 }
 
-void manta::VectorMap2D::copy(const VectorMap2D *source) {
-    initialize(source->getWidth(), source->getHeight());
-    int pCount = m_width * m_height;
-    for (int i = 0; i < pCount; i++) {
-        m_data[i] = source->m_data[i];
+void manta::VectorMap2D::boxDownsample(VectorMap2D *target) const {
+    const int width = (m_width > 1) ? m_width / 2 : 1;
+    const int height = (m_height > 1) ? m_height / 2 : 1;
+    target->initialize(width, height, m_format);
+
+    const math::Vector quarter = math::loadScalar((math::real)0.25);
+    for (int j = 0; j < height; j++) {
+        // Clamped for maps that are only one texel wide or high
+        const int j0 = std::min(2 * j, m_height - 1);
+        const int j1 = std::min(2 * j + 1, m_height - 1);
+
+        for (int i = 0; i < width; i++) {
+            const int i0 = std::min(2 * i, m_width - 1);
+            const int i1 = std::min(2 * i + 1, m_width - 1);
+
+            const math::Vector sum = math::add(
+                math::add(get(i0, j0), get(i1, j0)),
+                math::add(get(i0, j1), get(i1, j1)));
+
+            target->set(math::mul(sum, quarter), i, j);
+        }
     }
 }
 
+void manta::VectorMap2D::copy(const VectorMap2D *source) {
+    initialize(source->getWidth(), source->getHeight(), source->getFormat());
+    memcpy(m_data, source->m_data, (size_t)getMemoryUsage());
+}
+
 void manta::VectorMap2D::copy(const ImagePlane *plane) {
     initialize(plane->getWidth(), plane->getHeight());
 
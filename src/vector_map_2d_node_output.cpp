@@ -1,11 +1,14 @@
 #include "../include/vector_map_2d_node_output.h"
 
 #include "../include/intersection_point.h"
+#include "../include/tiled_texture.h"
 
 const piranha::ChannelType manta::VectorMap2DNodeOutput::VectorMap2dType("VectorMap2dType", &VectorNodeOutput::VectorType);
 
 manta::VectorMap2DNodeOutput::VectorMap2DNodeOutput() : VectorNodeOutput(&VectorMap2dType) {
     m_map = nullptr;
+    m_mipmap = nullptr;
+    m_tiledTexture = nullptr;
 }
 
 manta::VectorMap2DNodeOutput::~VectorMap2DNodeOutput() {
@@ -18,13 +21,26 @@ void manta::VectorMap2DNodeOutput::sample(const IntersectionPoint *surfaceIntera
     const math::real u = math::getX(surfaceInteraction->m_textureCoodinates);
     const math::real v = 1 - math::getY(surfaceInteraction->m_textureCoodinates);
 
-    *target = m_map->triangleSample(u, v);
+    if (m_tiledTexture != nullptr) {
+        // Tiles are loaded on first access
+        const math::real footprint = surfaceInteraction->m_hasDifferentials
+            ? surfaceInteraction->getTextureFootprint()
+            : (math::real)0.0;
+        *target = m_tiledTexture->sample(u, v, footprint);
+    }
+    else if (m_mipmap != nullptr && surfaceInteraction->m_hasDifferentials) {
+        *target = m_mipmap->sample(u, v, surfaceInteraction->getTextureFootprint());
+    }
+    else {
+        *target = m_map->triangleSample(u, v);
+    }
 }
 
 void manta::VectorMap2DNodeOutput::discreteSample2d(int x, int y, void *_target) const {
     math::Vector *target = reinterpret_cast<math::Vector *>(_target);
 
-    *target = m_map->get(x, y);
+    if (m_tiledTexture != nullptr) *target = m_tiledTexture->get(x, y);
+    else *target = m_map->get(x, y);
 }
 
 void manta::VectorMap2DNodeOutput::fullOutput(const void **_target) const {
@@ -38,7 +54,14 @@ void manta::VectorMap2DNodeOutput::setMap(const VectorMap2D *map) {
 }
 
 void manta::VectorMap2DNodeOutput::_evaluateDimensions() {
-    setDimensions(2); 
-    setDimensionSize(0, m_map->getWidth()); 
-    setDimensionSize(1, m_map->getHeight());
+    setDimensions(2);
+
+    if (m_tiledTexture != nullptr) {
+        setDimensionSize(0, m_tiledTexture->getWidth());
+        setDimensionSize(1, m_tiledTexture->getHeight());
+    }
+    else {
+        setDimensionSize(0, m_map->getWidth());
+        setDimensionSize(1, m_map->getHeight());
+    }
 }
@@ -0,0 +1,72 @@
+#include "../include/wavefront_queue.h"
+
+#include "../include/standard_allocator.h"
+
+#include <assert.h>
+
+manta::WavefrontQueue::WavefrontQueue() {
+    m_paths = nullptr;
+    m_pathCount = 0;
+    m_capacity = 0;
+
+    m_extendQueue.indices = nullptr;
+    m_shadeQueue.indices = nullptr;
+    m_shadowQueue.indices = nullptr;
+
+    m_extendQueue.clear();
+    m_shadeQueue.clear();
+    m_shadowQueue.clear();
+}
+
+manta::WavefrontQueue::~WavefrontQueue() {
+    assert(m_paths == nullptr);
+}
+
+void manta::WavefrontQueue::initialize(int capacity) {
+    m_capacity = capacity;
+    m_paths = StandardAllocator::Global()->allocate<PathState>(capacity, 16);
+
+    m_extendQueue.indices = StandardAllocator::Global()->allocate<int>(capacity);
+    m_shadeQueue.indices = StandardAllocator::Global()->allocate<int>(capacity);
+    m_shadowQueue.indices = StandardAllocator::Global()->allocate<int>(capacity);
+
+    clear();
+}
+
+void manta::WavefrontQueue::destroy() {
+    if (m_paths == nullptr) return;
+
+    StandardAllocator::Global()->aligned_free(m_paths, m_capacity);
+    StandardAllocator::Global()->free(m_extendQueue.indices, m_capacity);
+    StandardAllocator::Global()->free(m_shadeQueue.indices, m_capacity);
+    StandardAllocator::Global()->free(m_shadowQueue.indices, m_capacity);
+
+    m_paths = nullptr;
+    m_extendQueue.indices = nullptr;
+    m_shadeQueue.indices = nullptr;
+    m_shadowQueue.indices = nullptr;
+    m_capacity = 0;
+
+    clear();
+}
+
+void manta::WavefrontQueue::clear() {
+    m_pathCount = 0;
+
+    m_extendQueue.clear();
+    m_shadeQueue.clear();
+    m_shadowQueue.clear();
+}
+
+int manta::WavefrontQueue::addPath(const LightRay &ray, Sampler *sampler) {
+    assert(!isFull());
+
+    const int index = m_pathCount++;
+    PathState &path = m_paths[index];
+    path.ray = ray;
+    path.sampler = sampler;
+
+    m_extendQueue.push(index);
+
+    return index;
+}
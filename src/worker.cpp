@@ -8,22 +8,28 @@
 #include "../include/camera_ray_emitter.h"
 #include "../include/image_plane.h"
 #include "../include/stratified_sampler.h"
+#include "../include/image_sample.h"
+#include "../include/thread_pool.h"
 
 #include <sstream>
 #include <time.h>
 
 manta::Worker::Worker() {
     m_stack = nullptr;
-    m_thread = nullptr;
 
     m_deterministicSeed = false;
 
     m_sampler = nullptr;
+    m_samples = nullptr;
+    m_sampleCount = 0;
+
+    for (int i = 0; i < MaxBatchWidth; i++) {
+        m_laneSamplers[i] = nullptr;
+    }
 }
 
 manta::Worker::~Worker() {
     assert(m_stack == nullptr);
-    assert(m_thread == nullptr);
 }
 
 void manta::Worker::initialize(mem_size stackSize, RayTracer *rayTracer, int workerId, 
@@ -42,9 +48,27 @@ void manta::Worker::initialize(mem_size stackSize, RayTracer *rayTracer, int wor
     m_workerId = workerId;
     m_pathRecorderOutputDirectory = pathRecorderOutputDirectory;
 
+    // Random numbers are keyed by pixel so with a shared seed the image no longer
+    // depends on which worker traced a pixel
+    if (deterministicSeed) seed = 0;
+
     m_sampler = m_rayTracer->getSampler()->clone();
     m_sampler->seed(seed);
 
+    const int batchWidth = getBatchWidth();
+    if (batchWidth > 1) {
+        for (int i = 0; i < batchWidth; i++) {
+            m_laneSamplers[i] = m_rayTracer->getSampler()->clone();
+            m_laneSamplers[i]->seed(deterministicSeed
+                ? seed
+                : seed + (unsigned int)(i + 1) * 0x9E3779B9);
+        }
+    }
+
+    if (m_rayTracer->isWavefront()) {
+        m_wavefront.initialize(WavefrontWidth);
+    }
+
     // Initialize all statistics
     m_statistics.reset();
 
@@ -52,32 +76,27 @@ void manta::Worker::initialize(mem_size stackSize, RayTracer *rayTracer, int wor
     m_ipManager.setThreadId(workerId);
 }
 
-void manta::Worker::start(bool multithreaded) {
-    if (multithreaded) {
-        m_thread = new std::thread(&Worker::work, this);
+void manta::Worker::start(TaskGroup *tasks) {
+    if (tasks != nullptr) {
+        tasks->run([this]() { work(); });
     }
     else {
-        m_thread = nullptr;
         work();
     }
 }
 
-void manta::Worker::join() {
-    if (m_thread != nullptr) {
-        m_thread->join();
-    }
-    else {
-        // This is part of the main thread so there is no reason to join
-    }
-}
-
 void manta::Worker::destroy() {
     if (m_stack != nullptr) {
         delete m_stack;
         m_stack = nullptr;
     }
-    delete m_thread;
-    m_thread = nullptr;
+
+    for (int i = 0; i < MaxBatchWidth; i++) {
+        delete m_laneSamplers[i];
+        m_laneSamplers[i] = nullptr;
+    }
+
+    m_wavefront.destroy();
 }
 
 std::string manta::Worker::getTreeName(int pixelIndex, int sample) const {
@@ -89,7 +108,7 @@ std::string manta::Worker::getTreeName(int pixelIndex, int sample) const {
 
 void manta::Worker::work() {
     Job currentJob;
-    while (m_rayTracer->getJobQueue()->pop(&currentJob) && !m_rayTracer->getProgram()->isKilled()) {
+    while (m_rayTracer->getJobQueue()->pop(&currentJob, m_workerId) && !m_rayTracer->getProgram()->isKilled()) {
         doJob(&currentJob);
     }
 
@@ -97,109 +116,297 @@ void manta::Worker::work() {
     PATH_RECORDER_OUTPUT(getObjFname());
 
     // Record statistics
-    if (m_stack != nullptr) m_maxMemoryUsage = m_stack->getMaxUsage();
-    else m_maxMemoryUsage = 0;
+    if (m_stack != nullptr) {
+        m_maxMemoryUsage = m_stack->getMaxUsage();
+        m_reservedMemory = m_stack->getReservedSize();
+        m_memoryChunkCount = m_stack->getChunkCount();
+    }
+    else {
+        m_maxMemoryUsage = 0;
+        m_reservedMemory = 0;
+        m_memoryChunkCount = 0;
+    }
 }
 
 void manta::Worker::doJob(const Job *job) {
-    constexpr int SAMPLE_BUFFER_CAPACITY = 0x1 << 7;
-
-    int sampleCount = 0;
     int pixelCounter = 0;
-    ImageSample *samples = (ImageSample *)m_stack->allocate(sizeof(ImageSample) * SAMPLE_BUFFER_CAPACITY, 16);
 
-    for (int y = job->startY; y <= job->endY; ++y) {
+    m_samples = (ImageSample *)m_stack->allocate(sizeof(ImageSample) * SampleBufferCapacity, 16);
+    m_sampleCount = 0;
+
+    // Samples are accumulated privately and merged into the image plane once at the end.
+    // The tile covers the whole job but only the rows actually splatted into are cleared
+    // and merged, rows stolen by other workers cost nothing here.
+    ImagePlaneTile tileStorage;
+    ImagePlaneTile *tile = job->target->createTile(
+        &tileStorage, job->startX, job->startY, job->endX, job->endY, m_stack)
+        ? &tileStorage
+        : nullptr;
+
+    const int batchWidth = getBatchWidth();
+
+    // Rows are claimed one at a time so that idle workers can split off the rest of the job
+    int y;
+    while (m_rayTracer->getJobQueue()->claimRow(m_workerId, &y)) {
         if (m_rayTracer->getProgram()->isKilled()) break;
 
-        for (int x = job->startX; x <= job->endX; ++x) {
+        for (int x = job->startX; x <= job->endX;) {
             if (m_rayTracer->getProgram()->isKilled()) break;
 
-            if (!job->target->inWindow(x, y)) {
-                ImageSample &sample = samples[sampleCount++];
-                sample.imagePlaneLocation = { (math::real)x, (math::real)y };
-                sample.intensity = math::constants::Zero;
+            const int pixelCount = std::min(batchWidth, job->endX - x + 1);
+            if (pixelCount > 1) tracePixelBatch(job, tile, x, y, pixelCount);
+            else tracePixel(job, tile, x, y);
 
-                if (sampleCount >= SAMPLE_BUFFER_CAPACITY) {
-                    job->target->processSamples(samples, sampleCount, m_stack);
-                    sampleCount = 0;
-                }
-            }
-            else {
-                const int pixelIndex = job->group->getResolutionX() * y + x;
+            x += pixelCount;
+            pixelCounter += pixelCount;
+
+            if (pixelCounter >= 1024) {
+                m_rayTracer->incrementRayCompletion(job, pixelCounter);
+                pixelCounter = 0;
+            } 
+        }
+    }
 
-                if (m_deterministicSeed) {
-                    // Seed the random number generator with the emitter index
-                    // This is useful for exactly replicating a run with a different number of pixels
+    if (m_sampleCount > 0) {
+        flushSamples(job, tile, m_samples, m_sampleCount);
+        m_sampleCount = 0;
+    }
 
-                    // Compute pseudorandom LCG
-                    constexpr __int64 a = 1664525;
-                    constexpr __int64 c = 1013904223;
-                    unsigned __int64 xn = (a * pixelIndex + c) % 0xFFFFFFFF;
-                    srand((unsigned int)xn);
-                    m_sampler->seed((unsigned int)xn);
-                }
+    if (tile != nullptr) {
+        job->target->mergeTile(tile);
+        job->target->freeTile(tile, m_stack);
+    }
 
-                m_sampler->startPixelSession();
+    m_rayTracer->incrementRayCompletion(job, pixelCounter);
 
-                CameraRayEmitter *emitter = job->group->createEmitter(x, y, m_stack);
-                emitter->setSampler(m_sampler);
-                emitter->initialize();
+    m_stack->free((void *)m_samples);
+    m_samples = nullptr;
+}
 
-                if (emitter != nullptr) {
-                    emitter->setStackAllocator(m_stack);
+void manta::Worker::tracePixel(const Job *job, ImagePlaneTile *tile, int x, int y) {
+    if (!job->target->inWindow(x, y)) {
+        addSample(job, tile, { (math::real)x, (math::real)y }, math::constants::Zero);
+        return;
+    }
 
-                    do {
-                        NEW_TREE(getTreeName(pixelIndex, samp), emitter->getPosition());
+    const int pixelIndex = job->group->getResolutionX() * y + x;
 
-                        LightRay ray;
-                        emitter->generateRay(&ray);
+    seedPixel(m_sampler, pixelIndex);
+    m_sampler->startPixelSession();
 
-                        if (ray.getCameraWeight() > 0) {
-                            ray.calculateTransformations();
+    CameraRayEmitter *emitter = job->group->createEmitter(x, y, m_stack);
+    if (emitter == nullptr) return;
 
-                            const math::Vector L = m_rayTracer->traceRay(
-                                job->scene,
-                                &ray,
-                                0,
-                                &m_ipManager,
-                                m_sampler,
-                                m_stack
-                                /**/ PATH_RECORDER_ARG
-                                /**/ STATISTICS_ROOT(&m_statistics));
+    emitter->setSampler(m_sampler);
+    emitter->initialize();
+    emitter->setStackAllocator(m_stack);
 
-                            ImageSample &sample = samples[sampleCount++];
-                            sample.imagePlaneLocation = ray.getImagePlaneLocation();
-                            sample.intensity = L;
+    PixelErrorEstimate estimate;
 
-                            if (sampleCount >= SAMPLE_BUFFER_CAPACITY) {
-                                job->target->processSamples(samples, sampleCount, m_stack);
-                                sampleCount = 0;
-                            }
-                        }
+    do {
+        NEW_TREE(getTreeName(pixelIndex, samp), emitter->getPosition());
 
-                        END_TREE();
+        LightRay ray;
+        emitter->generateRay(&ray);
 
-                    } while (emitter->getSampler()->startNextSample());
-                }
+        math::Vector L = math::constants::Zero;
+        if (ray.getCameraWeight() > 0) {
+            ray.calculateTransformations();
+
+            L = m_rayTracer->traceRay(
+                job->scene,
+                &ray,
+                0,
+                &m_ipManager,
+                m_sampler,
+                m_stack
+                /**/ PATH_RECORDER_ARG
+                /**/ STATISTICS_ROOT(&m_statistics));
+
+            addSample(job, tile, ray.getImagePlaneLocation(), L);
+        }
+
+        estimate.add(L);
+
+        END_TREE();
+
+    } while (startNextSample(m_sampler, estimate));
+
+    m_rayTracer->recordSampleCount(x, y, estimate.count);
+
+    job->group->freeEmitter(emitter, m_stack);
+}
+
+void manta::Worker::tracePixelBatch(const Job *job, ImagePlaneTile *tile, int startX, int y, int pixelCount) {
+    struct PixelLane {
+        CameraRayEmitter *emitter;
+        Sampler *sampler;
+        PixelErrorEstimate estimate;
+        LightRay ray;
+        int x;
+        bool active;
+    };
+
+    // Every pixel of the batch runs its own sampler session so that each one sees the
+    // same sample sequence as it would when traced on its own
+    PixelLane lanes[MaxBatchWidth];
+    int laneCount = 0;
+    for (int i = 0; i < pixelCount; i++) {
+        const int x = startX + i;
+        if (!job->target->inWindow(x, y)) {
+            addSample(job, tile, { (math::real)x, (math::real)y }, math::constants::Zero);
+            continue;
+        }
 
-                job->group->freeEmitter(emitter, m_stack);
+        Sampler *sampler = m_laneSamplers[laneCount];
+        seedPixel(sampler, job->group->getResolutionX() * y + x);
+        sampler->startPixelSession();
+
+        CameraRayEmitter *emitter = job->group->createEmitter(x, y, m_stack);
+        if (emitter == nullptr) continue;
+
+        emitter->setSampler(sampler);
+        emitter->initialize();
+        emitter->setStackAllocator(m_stack);
+
+        PixelLane &lane = lanes[laneCount++];
+        lane.emitter = emitter;
+        lane.sampler = sampler;
+        lane.estimate.reset();
+        lane.x = x;
+        lane.active = true;
+    }
+
+    int activeCount = laneCount;
+    while (activeCount > 0) {
+        LightRay *rays[MaxBatchWidth];
+        Sampler *samplers[MaxBatchWidth];
+        math::Vector L[MaxBatchWidth];
+        int rayCount = 0;
+
+        for (int i = 0; i < laneCount; i++) {
+            PixelLane &lane = lanes[i];
+            if (!lane.active) continue;
+
+            lane.emitter->generateRay(&lane.ray);
+            if (lane.ray.getCameraWeight() > 0) {
+                lane.ray.calculateTransformations();
+
+                rays[rayCount] = &lane.ray;
+                samplers[rayCount] = lane.sampler;
+                ++rayCount;
             }
+        }
 
-            if (++pixelCounter >= 1024) {
-                m_rayTracer->incrementRayCompletion(job, pixelCounter);
-                pixelCounter = 0;
-            } 
+        if (rayCount > 0) traceBatch(job, rays, samplers, rayCount, L);
+
+        int currentRay = 0;
+        for (int i = 0; i < laneCount; i++) {
+            PixelLane &lane = lanes[i];
+            if (!lane.active) continue;
+
+            math::Vector sampleL = math::constants::Zero;
+            if (currentRay < rayCount && rays[currentRay] == &lane.ray) {
+                sampleL = L[currentRay++];
+                addSample(job, tile, lane.ray.getImagePlaneLocation(), sampleL);
+            }
+
+            lane.estimate.add(sampleL);
+
+            if (!startNextSample(lane.sampler, lane.estimate)) {
+                lane.active = false;
+                --activeCount;
+
+                m_rayTracer->recordSampleCount(lane.x, y, lane.estimate.count);
+            }
         }
     }
 
-    if (sampleCount > 0) {
-        job->target->processSamples(samples, sampleCount, m_stack);
-        sampleCount = 0;
+    // Emitters live on the stack so they are released in reverse order
+    for (int i = laneCount - 1; i >= 0; i--) {
+        job->group->freeEmitter(lanes[i].emitter, m_stack);
     }
+}
 
-    m_rayTracer->incrementRayCompletion(job, pixelCounter);
+void manta::Worker::traceBatch(const Job *job, LightRay *const *rays, Sampler *const *samplers, int rayCount, math::Vector *L) {
+    if (m_rayTracer->isWavefront()) {
+        m_wavefront.clear();
+        for (int i = 0; i < rayCount; i++) {
+            m_wavefront.addPath(*rays[i], samplers[i]);
+        }
 
-    m_stack->free((void *)samples);
+        m_rayTracer->traceWavefront(
+            job->scene,
+            &m_wavefront,
+            &m_ipManager,
+            m_stack
+            /**/ STATISTICS_ROOT(&m_statistics));
+
+        for (int i = 0; i < rayCount; i++) {
+            L[i] = m_wavefront.getPath(i)->L;
+        }
+    }
+    else {
+        for (int i = 0; i < rayCount; i += RayPacket::Width) {
+            m_rayTracer->tracePacket(
+                job->scene,
+                rays + i,
+                std::min((int)RayPacket::Width, rayCount - i),
+                L + i,
+                &m_ipManager,
+                samplers + i,
+                m_stack
+                /**/ PATH_RECORDER_ARG
+                /**/ STATISTICS_ROOT(&m_statistics));
+        }
+    }
+}
+
+int manta::Worker::getBatchWidth() const {
+    // Path recording follows one ray at a time
+    if (ENABLE_PATH_RECORDING) return 1;
+    else if (m_rayTracer->isWavefront()) return WavefrontWidth;
+    else if (m_rayTracer->isPacketTracing()) return RayPacket::Width;
+    else return 1;
+}
+
+void manta::Worker::seedPixel(Sampler *sampler, int pixelIndex) {
+    // Key all random streams with the pixel index
+    // This is useful for exactly replicating a run with a different number of pixels
+    sampler->setPixelIndex((unsigned int)pixelIndex);
+    math::seedRandom(sampler->getPixelKey());
+}
+
+void manta::Worker::addSample(const Job *job, ImagePlaneTile *tile, const math::Vector2 &location, const math::Vector &intensity) {
+    ImageSample &sample = m_samples[m_sampleCount++];
+    sample.imagePlaneLocation = location;
+    sample.intensity = intensity;
+
+    if (m_sampleCount >= SampleBufferCapacity) {
+        flushSamples(job, tile, m_samples, m_sampleCount);
+        m_sampleCount = 0;
+    }
+}
+
+bool manta::Worker::startNextSample(Sampler *sampler, const PixelErrorEstimate &estimate) {
+    // Without extra samples the sampler decides when the pixel is done. Otherwise false
+    // only marks the end of the sampler's own sample count, which acts as the minimum.
+    const bool extraSamples = m_rayTracer->isAdaptiveSampling() && sampler->supportsExtraSamples();
+    if (!sampler->startNextSample() && !extraSamples) return false;
+    else if (estimate.count < sampler->getSamplesPerPixel()) return true;
+    else if (!extraSamples) return false;
+
+    return estimate.count < m_rayTracer->getAdaptiveMaxSamples()
+        && estimate.relativeError() > m_rayTracer->getAdaptiveThreshold();
+}
+
+void manta::Worker::flushSamples(const Job *job, ImagePlaneTile *tile, ImageSample *samples, int sampleCount) {
+    if (tile != nullptr) {
+        job->target->addSamples(tile, samples, sampleCount, m_stack);
+    }
+    else {
+        job->target->processSamples(samples, sampleCount, m_stack);
+    }
 }
 
 std::string manta::Worker::getObjFname() {
@@ -0,0 +1,201 @@
+#include <pch.h>
+
+#include "../include/geometry_instance.h"
+#include "../include/sphere_primitive.h"
+#include "../include/obj_file_loader.h"
+#include "../include/mesh.h"
+#include "../include/light_ray.h"
+#include "../include/coarse_intersection.h"
+#include "../include/intersection_point.h"
+#include "../include/primitives.h"
+
+#include <random>
+
+using namespace manta;
+
+TEST(GeometryInstanceTests, InstancedSphereTest) {
+    SpherePrimitive sphere;
+    sphere.setPosition(math::constants::Zero);
+    sphere.setRadius((math::real)1.0);
+
+    // Sphere of radius 2 centered at (10, 0, 0)
+    GeometryInstance instance;
+    instance.setGeometry(&sphere);
+    instance.setTransform(math::matMult(
+        math::translationTransform(math::loadVector((math::real)10.0, (math::real)0.0, (math::real)0.0)),
+        math::scaleTransform(math::loadVector((math::real)2.0, (math::real)2.0, (math::real)2.0))));
+
+    LightRay ray;
+    ray.setSource(math::constants::Zero);
+    ray.setDirection(math::loadVector((math::real)1.0, (math::real)0.0, (math::real)0.0));
+    ray.calculateTransformations();
+
+    CoarseIntersection intersection;
+    EXPECT_TRUE(instance.findClosestIntersection(
+        &ray, &intersection, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT));
+    EXPECT_NEAR(intersection.depth, 8.0, 1E-4);
+    EXPECT_EQ(intersection.sceneGeometry, &instance);
+    EXPECT_EQ(intersection.instancedGeometry, &sphere);
+
+    IntersectionPoint point;
+    instance.fineIntersection(
+        math::add(ray.getSource(), math::mul(ray.getDirection(), math::loadScalar(intersection.depth))),
+        &point, &intersection);
+    EXPECT_NEAR(math::getX(point.m_position), 8.0, 1E-4);
+    EXPECT_NEAR(math::getX(point.m_faceNormal), -1.0, 1E-4);
+    EXPECT_NEAR(point.m_depth, 8.0, 1E-4);
+
+    // Spheres don't write offset points so the instance has to generate them. Coming
+    // from outside, the outside point is towards the ray origin.
+    const math::Vector center = math::loadVector((math::real)10.0, (math::real)0.0, (math::real)0.0);
+    EXPECT_LT(math::getX(point.m_outside), 8.0);
+    EXPECT_GT(math::getX(point.m_inside), 8.0);
+    EXPECT_GT(math::getScalar(math::magnitude(math::sub(point.m_outside, center))), 2.0);
+    EXPECT_LT(math::getScalar(math::magnitude(math::sub(point.m_inside, center))), 2.0);
+    EXPECT_NEAR(math::getScalar(math::magnitude(math::sub(point.m_outside, point.m_position))), 1E-4, 1E-5);
+
+    // Coming from inside, the outside point is ahead of the ray
+    LightRay innerRay;
+    innerRay.setSource(center);
+    innerRay.setDirection(math::loadVector((math::real)1.0, (math::real)0.0, (math::real)0.0));
+    innerRay.calculateTransformations();
+
+    CoarseIntersection innerIntersection;
+    EXPECT_TRUE(instance.findClosestIntersection(
+        &innerRay, &innerIntersection, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT));
+    EXPECT_NEAR(innerIntersection.depth, 2.0, 1E-4);
+
+    IntersectionPoint innerPoint;
+    instance.fineIntersection(
+        math::add(innerRay.getSource(), math::mul(innerRay.getDirection(), math::loadScalar(innerIntersection.depth))),
+        &innerPoint, &innerIntersection);
+    EXPECT_NEAR(math::getX(innerPoint.m_position), 12.0, 1E-4);
+    EXPECT_GT(math::getX(innerPoint.m_outside), 12.0);
+    EXPECT_LT(math::getX(innerPoint.m_inside), 12.0);
+    EXPECT_GT(math::getScalar(math::magnitude(math::sub(innerPoint.m_outside, center))), 2.0);
+    EXPECT_LT(math::getScalar(math::magnitude(math::sub(innerPoint.m_inside, center))), 2.0);
+    EXPECT_EQ(innerPoint.m_mesh, nullptr);
+
+    EXPECT_TRUE(instance.occluded(ray.getSource(), ray.getDirection(), (math::real)9.0 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(instance.occluded(ray.getSource(), ray.getDirection(), (math::real)7.0 /**/ STATISTICS_NULL_INPUT));
+
+    AABB bounds;
+    EXPECT_TRUE(instance.getBounds(&bounds));
+    EXPECT_NEAR(math::getX(bounds.minPoint), 8.0, 1E-4);
+    EXPECT_NEAR(math::getX(bounds.maxPoint), 12.0, 1E-4);
+    EXPECT_NEAR(math::getY(bounds.maxPoint), 2.0, 1E-4);
+
+    // Ray that misses the instance but would hit the untransformed sphere
+    ray.setSource(math::loadVector((math::real)0.0, (math::real)0.0, (math::real)-5.0));
+    ray.setDirection(math::loadVector((math::real)0.0, (math::real)0.0, (math::real)1.0));
+    ray.calculateTransformations();
+
+    EXPECT_FALSE(instance.findClosestIntersection(
+        &ray, &intersection, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT));
+}
+
+TEST(GeometryInstanceTests, InstancedMeshMatchesTransformedMesh) {
+    ObjFileLoader twoCubesObj;
+    bool result = twoCubesObj.loadObjFile("../../../test/geometry/two_cubes.obj");
+
+    Mesh mesh;
+    mesh.loadObjFileData(&twoCubesObj);
+    mesh.setFastIntersectEnabled(false);
+
+    const math::Matrix transform = math::matMult(
+        math::translationTransform(math::loadVector((math::real)1.0, (math::real)-2.0, (math::real)0.5)),
+        math::matMult(
+            math::rotationTransform(math::loadVector((math::real)1.0, (math::real)1.0, (math::real)0.0), 0.7f),
+            math::scaleTransform(math::loadVector((math::real)1.5, (math::real)1.5, (math::real)1.5))));
+
+    GeometryInstance instance;
+    instance.setGeometry(&mesh);
+    instance.setTransform(transform);
+
+    // Reference mesh with the transform baked into its vertices
+    Mesh reference;
+    reference.loadObjFileData(&twoCubesObj);
+    reference.setFastIntersectEnabled(false);
+
+    for (int i = 0; i < reference.getVertexCount(); i++) {
+        reference.getVertices()[i] = instance.objectToWorldPoint(reference.getVertices()[i]);
+    }
+
+    for (int i = 0; i < reference.getNormalCount(); i++) {
+        reference.getNormals()[i] = math::normalize(instance.objectToWorldNormal(reference.getNormals()[i]));
+    }
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    int hits = 0;
+    for (int i = 0; i < 1000; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng) * 5, dist(rng) * 5, dist(rng) * 5));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng), dist(rng), dist(rng))));
+        ray.calculateTransformations();
+
+        CoarseIntersection expected, actual;
+        const bool expectedHit = reference.findClosestIntersection(
+            &ray, &expected, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+        const bool actualHit = instance.findClosestIntersection(
+            &ray, &actual, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(expectedHit, actualHit);
+        EXPECT_EQ(actualHit, instance.occluded(
+            ray.getSource(), ray.getDirection(), math::constants::REAL_MAX /**/ STATISTICS_NULL_INPUT));
+
+        if (!expectedHit || !actualHit) continue;
+        ++hits;
+
+        EXPECT_NEAR(expected.depth, actual.depth, 1E-3);
+
+        const math::Vector r = math::add(
+            ray.getSource(), math::mul(ray.getDirection(), math::loadScalar(actual.depth)));
+
+        IntersectionPoint expectedPoint, actualPoint;
+        reference.fineIntersection(r, &expectedPoint, &expected);
+        instance.fineIntersection(r, &actualPoint, &actual);
+
+        for (int j = 0; j < 3; j++) {
+            EXPECT_NEAR(math::get(expectedPoint.m_position, j), math::get(actualPoint.m_position, j), 1E-3);
+            EXPECT_NEAR(math::get(expectedPoint.m_faceNormal, j), math::get(actualPoint.m_faceNormal, j), 1E-3);
+            EXPECT_NEAR(math::get(expectedPoint.m_vertexNormal, j), math::get(actualPoint.m_vertexNormal, j), 1E-3);
+            EXPECT_NEAR(math::get(expectedPoint.u_basis, j), math::get(actualPoint.u_basis, j), 1E-3);
+            EXPECT_NEAR(math::get(expectedPoint.v_basis, j), math::get(actualPoint.v_basis, j), 1E-3);
+        }
+
+        EXPECT_NEAR(expectedPoint.u, actualPoint.u, 1E-3);
+        EXPECT_NEAR(expectedPoint.v, actualPoint.v, 1E-3);
+    }
+
+    EXPECT_GT(hits, 0);
+
+    twoCubesObj.destroy();
+    mesh.destroy();
+    reference.destroy();
+}
+
+TEST(GeometryInstanceTests, InverseTransformTest) {
+    GeometryInstance instance;
+    instance.setTransform(math::matMult(
+        math::translationTransform(math::loadVector((math::real)3.0, (math::real)1.0, (math::real)-2.0)),
+        math::matMult(
+            math::rotationTransform(math::loadVector((math::real)0.0, (math::real)0.0, (math::real)1.0), 1.2f),
+            math::scaleTransform(math::loadVector((math::real)1.0, (math::real)4.0, (math::real)0.5)))));
+
+    const math::Vector p = math::loadVector((math::real)0.3, (math::real)-1.7, (math::real)2.2);
+    const math::Vector p_round = instance.worldToObjectPoint(instance.objectToWorldPoint(p));
+    const math::Vector d_round = instance.worldToObjectDirection(instance.objectToWorldDirection(p));
+
+    for (int i = 0; i < 3; i++) {
+        EXPECT_NEAR(math::get(p, i), math::get(p_round, i), 1E-4);
+        EXPECT_NEAR(math::get(p, i), math::get(d_round, i), 1E-4);
+    }
+
+    // Transformed normals stay perpendicular to transformed tangents under non-uniform scale
+    const math::Vector n = math::loadVector((math::real)1.0, (math::real)1.0, (math::real)0.0);
+    const math::Vector t = math::loadVector((math::real)1.0, (math::real)-1.0, (math::real)0.0);
+    EXPECT_NEAR(math::getScalar(math::dot(
+        instance.objectToWorldNormal(n), instance.objectToWorldDirection(t))), 0.0, 1E-4);
+}
@@ -4,6 +4,9 @@
 
 #include "../include/image_plane.h"
 #include "../include/box_filter.h"
+#include "../include/triangle_filter.h"
+
+#include <random>
 
 using namespace manta;
 
@@ -31,3 +34,161 @@ TEST(ImagePlaneTests, ImagePlaneSanityCheck) {
 
     imagePlane.destroy();
 }
+
+TEST(ImagePlaneTests, ImagePlaneChunkBoundaryTest) {
+    constexpr int Width = 8;
+    constexpr int Height = 8;
+    constexpr int SampleCount = 4 * Width * Height;
+
+    ImagePlane imagePlane;
+    imagePlane.initialize(Width, Height);
+
+    BoxFilter filter;
+    filter.setExtents(math::Vector2(0.5f, 0.5f));
+    imagePlane.setFilter(&filter);
+
+    // Nearly fill the first chunk so that the blocks have to go in the next one
+    StackAllocator stack;
+    stack.initialize(1 * KB);
+    void *filler = stack.allocate(1000, 16);
+    EXPECT_EQ(stack.getChunkCount(), 1);
+
+    ImageSample samples[SampleCount];
+    for (int i = 0; i < SampleCount; i++) {
+        const int pixel = i % (Width * Height);
+        samples[i].imagePlaneLocation = math::Vector2((float)(pixel % Width), (float)(pixel / Width));
+        samples[i].intensity = math::loadVector((float)(pixel % Width), (float)(pixel / Width), (float)(i / (Width * Height)));
+    }
+
+    imagePlane.processSamples(samples, SampleCount, &stack);
+    EXPECT_GT(stack.getChunkCount(), 1);
+
+    // Every pixel averages the four samples centered on it
+    imagePlane.normalize();
+    for (int y = 0; y < Height; y++) {
+        for (int x = 0; x < Width; x++) {
+            const math::Vector v = imagePlane.getBuffer()[y * Width + x];
+            EXPECT_NEAR(math::getX(v), x, 1E-4);
+            EXPECT_NEAR(math::getY(v), y, 1E-4);
+            EXPECT_NEAR(math::getZ(v), 1.5, 1E-4);
+        }
+    }
+
+    stack.free(filler);
+    imagePlane.destroy();
+}
+
+TEST(ImagePlaneTests, ImagePlaneTileTest) {
+    constexpr int SampleCount = 2000;
+
+    TriangleFilter filter;
+    filter.setExtents(math::Vector2(1.5f, 1.5f));
+
+    ImagePlane reference, tiled;
+    reference.initialize(40, 30);
+    reference.setFilter(&filter);
+    tiled.initialize(40, 30);
+    tiled.setFilter(&filter);
+
+    StackAllocator stack;
+    stack.initialize(10 * MB);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+    std::uniform_int_distribution<int> pixelX(0, 15);
+    std::uniform_int_distribution<int> pixelY(2, 29);
+
+    ImageSample samples[SampleCount];
+    for (int i = 0; i < SampleCount; i++) {
+        samples[i].imagePlaneLocation = math::Vector2(pixelX(rng) + jitter(rng), pixelY(rng) + jitter(rng));
+        samples[i].intensity = math::loadVector((float)(i % 7), 1.0f, 0.5f);
+    }
+
+    // This sample's footprint falls outside of the tile
+    samples[0].imagePlaneLocation = math::Vector2(30.0f, 10.0f);
+
+    reference.processSamples(samples, SampleCount, &stack);
+
+    ImagePlaneTile tile;
+    EXPECT_TRUE(tiled.createTile(&tile, 0, 2, 15, 29, &stack));
+    EXPECT_EQ(tile.left, 0);
+    EXPECT_EQ(tile.top, 0);
+    EXPECT_EQ(tile.right, 19);
+    EXPECT_EQ(tile.bottom, 29);
+
+    tiled.addSamples(&tile, samples, SampleCount, &stack);
+    tiled.mergeTile(&tile);
+    tiled.freeTile(&tile, &stack);
+
+    reference.normalize();
+    tiled.normalize();
+
+    for (int y = 0; y < 30; y++) {
+        for (int x = 0; x < 40; x++) {
+            const math::Vector a = reference.getBuffer()[y * 40 + x];
+            const math::Vector b = tiled.getBuffer()[y * 40 + x];
+
+            EXPECT_NEAR(math::getX(a), math::getX(b), 1E-4);
+            EXPECT_NEAR(math::getY(a), math::getY(b), 1E-4);
+            EXPECT_NEAR(math::getZ(a), math::getZ(b), 1E-4);
+        }
+    }
+
+    reference.destroy();
+    tiled.destroy();
+}
+
+TEST(ImagePlaneTests, ImagePlaneTilePartialRowsTest) {
+    constexpr int SampleCount = 500;
+
+    TriangleFilter filter;
+    filter.setExtents(math::Vector2(1.5f, 1.5f));
+
+    ImagePlane reference, tiled;
+    reference.initialize(40, 30);
+    reference.setFilter(&filter);
+    tiled.initialize(40, 30);
+    tiled.setFilter(&filter);
+
+    StackAllocator stack;
+    stack.initialize(10 * MB);
+
+    // Only the first rows of the job are traced, the rest went to other workers
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+    std::uniform_int_distribution<int> pixelX(0, 15);
+    std::uniform_int_distribution<int> pixelY(10, 13);
+
+    ImageSample samples[SampleCount];
+    for (int i = 0; i < SampleCount; i++) {
+        samples[i].imagePlaneLocation = math::Vector2(pixelX(rng) + jitter(rng), pixelY(rng) + jitter(rng));
+        samples[i].intensity = math::loadVector(1.0f, (float)(i % 5), 0.25f);
+    }
+
+    reference.processSamples(samples, SampleCount, &stack);
+
+    ImagePlaneTile tile;
+    EXPECT_TRUE(tiled.createTile(&tile, 0, 10, 15, 29, &stack));
+    EXPECT_GT(tile.touchedTop, tile.touchedBottom);
+
+    tiled.addSamples(&tile, samples, SampleCount, &stack);
+    EXPECT_GE(tile.touchedTop, 8);
+    EXPECT_LE(tile.touchedBottom, 16);
+
+    tiled.mergeTile(&tile);
+    tiled.freeTile(&tile, &stack);
+
+    for (int y = 0; y < 30; y++) {
+        for (int x = 0; x < 40; x++) {
+            const math::Vector a = reference.getBuffer()[y * 40 + x];
+            const math::Vector b = tiled.getBuffer()[y * 40 + x];
+
+            EXPECT_NEAR(math::getX(a), math::getX(b), 1E-4);
+            EXPECT_NEAR(math::getY(a), math::getY(b), 1E-4);
+            EXPECT_NEAR(math::getZ(a), math::getZ(b), 1E-4);
+        }
+    }
+
+    reference.destroy();
+    tiled.destroy();
+}
@@ -0,0 +1,123 @@
+#include <pch.h>
+
+#include "../include/job_queue.h"
+
+#include <thread>
+#include <vector>
+#include <atomic>
+
+using namespace manta;
+
+TEST(JobQueueTests, JobQueueSingleWorkerTest) {
+    JobQueue queue;
+    queue.initialize(1);
+
+    for (int i = 0; i < 4; i++) {
+        Job job;
+        job.startX = 0;
+        job.endX = 7;
+        job.startY = i * 8;
+        job.endY = i * 8 + 7;
+        queue.push(job);
+    }
+
+    int rows = 0;
+    int expectedRow = 0;
+    Job job;
+    while (queue.pop(&job, 0)) {
+        int row;
+        while (queue.claimRow(0, &row)) {
+            EXPECT_EQ(row, expectedRow++);
+            ++rows;
+        }
+    }
+
+    EXPECT_EQ(rows, 32);
+
+    queue.destroy();
+}
+
+TEST(JobQueueTests, JobQueueSplitTest) {
+    JobQueue queue;
+    queue.initialize(2);
+
+    // Only one job so the second worker has nothing to steal
+    Job job;
+    job.startX = 0;
+    job.endX = 0;
+    job.startY = 0;
+    job.endY = 9;
+    queue.push(job);
+
+    Job first, second;
+    EXPECT_TRUE(queue.pop(&first, 0));
+
+    int row;
+    EXPECT_TRUE(queue.claimRow(0, &row));
+    EXPECT_EQ(row, 0);
+
+    // Rows 1-9 remain, the thief takes the bottom half
+    EXPECT_TRUE(queue.pop(&second, 1));
+    EXPECT_EQ(second.startY, 5);
+    EXPECT_EQ(second.endY, 9);
+
+    for (int i = 1; i <= 4; i++) {
+        EXPECT_TRUE(queue.claimRow(0, &row));
+        EXPECT_EQ(row, i);
+    }
+    EXPECT_FALSE(queue.claimRow(0, &row));
+
+    for (int i = 5; i <= 9; i++) {
+        EXPECT_TRUE(queue.claimRow(1, &row));
+        EXPECT_EQ(row, i);
+    }
+    EXPECT_FALSE(queue.claimRow(1, &row));
+
+    queue.destroy();
+}
+
+TEST(JobQueueTests, JobQueueMultithreadedTest) {
+    constexpr int WorkerCount = 8;
+    constexpr int JobCount = 37;
+    constexpr int RowsPerJob = 16;
+    constexpr int RowCount = JobCount * RowsPerJob;
+
+    JobQueue queue;
+    queue.initialize(WorkerCount);
+
+    for (int i = 0; i < JobCount; i++) {
+        Job job;
+        job.startX = 0;
+        job.endX = 0;
+        job.startY = i * RowsPerJob;
+        job.endY = (i + 1) * RowsPerJob - 1;
+        queue.push(job);
+    }
+
+    std::atomic<int> rowVisits[RowCount];
+    for (int i = 0; i < RowCount; i++) rowVisits[i] = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < WorkerCount; i++) {
+        threads.push_back(std::thread([&queue, &rowVisits, i]() {
+            Job job;
+            while (queue.pop(&job, i)) {
+                int row;
+                while (queue.claimRow(i, &row)) {
+                    EXPECT_GE(row, job.startY);
+                    EXPECT_LE(row, job.endY);
+                    rowVisits[row]++;
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) thread.join();
+
+    for (int i = 0; i < RowCount; i++) {
+        EXPECT_EQ(rowVisits[i], 1);
+    }
+
+    queue.destroy();
+}
@@ -6,9 +6,12 @@
 #include "../include/coarse_intersection.h"
 #include "../include/kd_tree.h"
 #include "../include/scene_object.h"
+#include "../include/ray_packet.h"
 
 #include <chrono>
+#include <cstddef>
 #include <fstream>
+#include <random>
 
 using namespace manta;
 
@@ -205,3 +208,295 @@ TEST(KDTreeTests, KDTreeDoubleCubeSideTest) {
 
     kdTree.destroy();
 }
+
+void generateHeightField(Mesh *mesh, int resolution) {
+    const int vertexCount = (resolution + 1) * (resolution + 1);
+    const int faceCount = 2 * resolution * resolution;
+    mesh->initialize(faceCount, vertexCount, 0, 0);
+
+    math::Vector *vertices = mesh->getVertices();
+    for (int i = 0; i <= resolution; i++) {
+        for (int j = 0; j <= resolution; j++) {
+            const math::real x = (math::real)i / resolution * 8 - 4;
+            const math::real z = (math::real)j / resolution * 8 - 4;
+            const math::real y = (math::real)(0.5 * std::sin(3 * x) * std::cos(2 * z));
+            vertices[i * (resolution + 1) + j] = math::loadVector(x, y, z);
+        }
+    }
+
+    Face *faces = mesh->getFaces();
+    AuxFaceData *auxData = mesh->getAuxFaceData();
+    for (int i = 0; i < resolution; i++) {
+        for (int j = 0; j < resolution; j++) {
+            const int v00 = i * (resolution + 1) + j;
+            const int v01 = v00 + 1;
+            const int v10 = v00 + resolution + 1;
+            const int v11 = v10 + 1;
+
+            Face &f0 = faces[2 * (i * resolution + j)];
+            Face &f1 = faces[2 * (i * resolution + j) + 1];
+            f0.u = v00; f0.v = v10; f0.w = v11;
+            f1.u = v00; f1.v = v11; f1.w = v01;
+
+            auxData[2 * (i * resolution + j)].material = -1;
+            auxData[2 * (i * resolution + j) + 1].material = -1;
+        }
+    }
+}
+
+TEST(KDTreeTests, KDTreeParallelBuildTest) {
+    Mesh mesh;
+    generateHeightField(&mesh, 96);
+    mesh.setFastIntersectEnabled(false);
+
+    KDTree sequentialTree;
+    sequentialTree.configure(10, math::constants::Zero);
+    sequentialTree.analyze(&mesh, 4);
+
+    KDTree parallelTree;
+    parallelTree.configure(10, math::constants::Zero);
+    parallelTree.analyzeParallel(&mesh, 4);
+
+    EXPECT_TRUE(parallelTree.isComplete());
+    EXPECT_NEAR(parallelTree.getProgress(), 1.0, 1E-5);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-3.5f, 3.5f);
+
+    int hits = 0;
+    for (int i = 0; i < 2000; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng), (math::real)5.0, dist(rng)));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng) * 0.1f, (math::real)-1.0, dist(rng) * 0.1f)));
+        ray.calculateTransformations();
+
+        CoarseIntersection reference, sequential, parallel;
+
+        ray.resetCache();
+        const bool referenceHit = mesh.findClosestIntersection(&ray, &reference, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+        ray.resetCache();
+        const bool sequentialHit = sequentialTree.findClosestIntersection(&ray, &sequential, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+        ray.resetCache();
+        const bool parallelHit = parallelTree.findClosestIntersection(&ray, &parallel, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(referenceHit, sequentialHit);
+        EXPECT_EQ(referenceHit, parallelHit);
+        if (referenceHit && parallelHit) {
+            EXPECT_NEAR(parallel.depth, reference.depth, 1E-4);
+            ++hits;
+        }
+    }
+
+    EXPECT_GT(hits, 0);
+
+    mesh.destroy();
+    sequentialTree.destroy();
+    parallelTree.destroy();
+}
+
+TEST(KDTreeTests, KDTreeDiskCacheTest) {
+    const char *cacheFile = "../../../workspace/test_results/kdtree_cache_test.kdcache";
+
+    Mesh mesh;
+    generateHeightField(&mesh, 32);
+    mesh.setFastIntersectEnabled(false);
+
+    KDTree builtTree;
+    builtTree.configure(10, math::constants::Zero);
+    builtTree.analyze(&mesh, 4);
+    EXPECT_TRUE(builtTree.writeCacheFile(cacheFile, 4));
+
+    // Round trip
+    KDTree loadedTree;
+    loadedTree.configure(10, math::constants::Zero);
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Loaded);
+    EXPECT_TRUE(loadedTree.isComplete());
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-3.5f, 3.5f);
+
+    for (int i = 0; i < 500; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng), (math::real)5.0, dist(rng)));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng) * 0.1f, (math::real)-1.0, dist(rng) * 0.1f)));
+        ray.calculateTransformations();
+
+        CoarseIntersection built, loaded;
+
+        ray.resetCache();
+        const bool builtHit = builtTree.findClosestIntersection(&ray, &built, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+        ray.resetCache();
+        const bool loadedHit = loadedTree.findClosestIntersection(&ray, &loaded, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(builtHit, loadedHit);
+        if (builtHit && loadedHit) {
+            EXPECT_EQ(built.depth, loaded.depth);
+        }
+    }
+
+    loadedTree.destroy();
+
+    // Different build parameters
+    EXPECT_NE(loadedTree.computeBuildHash(8), loadedTree.computeBuildHash(4));
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 8), KDTree::CacheStatus::Stale);
+
+    loadedTree.configure(12, math::constants::Zero);
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Stale);
+    loadedTree.configure(10, math::constants::Zero);
+
+    // Modified mesh
+    const math::Vector originalVertex = mesh.getVertices()[0];
+    mesh.getVertices()[0] = math::add(originalVertex, math::loadVector((math::real)0.0, (math::real)1.0, (math::real)0.0));
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Stale);
+    mesh.getVertices()[0] = originalVertex;
+
+    // Corrupted split position of the root
+    {
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(KDTree::CacheHeaderSize + 1);
+        const char original = (char)file.get();
+        file.seekp(KDTree::CacheHeaderSize + 1);
+        file.put(~original);
+    }
+
+    // The payload checksum is only computed on request
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4, true), KDTree::CacheStatus::Corrupt);
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Loaded);
+    loadedTree.destroy();
+
+    // Out of range face index, indices are always checked
+    EXPECT_TRUE(builtTree.writeCacheFile(cacheFile, 4));
+    {
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        const int badFace = mesh.getFaceCount();
+        file.seekp(-(std::streamoff)sizeof(int), std::ios::end);
+        file.write((const char *)&badFace, sizeof(int));
+    }
+
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Corrupt);
+
+    // Corrupted header
+    {
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekg(offsetof(KDTreeCacheHeader, nodeCount));
+        const char original = (char)file.get();
+        file.seekp(offsetof(KDTreeCacheHeader, nodeCount));
+        file.put(~original);
+    }
+
+    EXPECT_EQ(loadedTree.loadCacheFile(cacheFile, &mesh, 4), KDTree::CacheStatus::Corrupt);
+    EXPECT_EQ(loadedTree.loadCacheFile("../../../workspace/test_results/missing.kdcache", &mesh, 4), KDTree::CacheStatus::Missing);
+
+    loadedTree.destroy();
+    builtTree.destroy();
+    mesh.destroy();
+}
+
+TEST(KDTreeTests, KDTreeLargeLeafTest) {
+    Mesh mesh;
+    generateHeightField(&mesh, 32);
+    mesh.setFastIntersectEnabled(false);
+
+    // Large leaves span several triangle blocks, including partially filled ones
+    KDTree tree;
+    tree.configure(10, math::constants::Zero);
+    tree.analyze(&mesh, 19);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-3.5f, 3.5f);
+
+    int hits = 0;
+    for (int i = 0; i < 1000; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng), (math::real)5.0, dist(rng)));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng) * 0.1f, (math::real)-1.0, dist(rng) * 0.1f)));
+        ray.calculateTransformations();
+
+        CoarseIntersection reference, kdIntersection;
+
+        ray.resetCache();
+        const bool referenceHit = mesh.findClosestIntersection(&ray, &reference, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+        ray.resetCache();
+        const bool kdHit = tree.findClosestIntersection(&ray, &kdIntersection, (math::real)0.0, math::constants::REAL_MAX, nullptr /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(referenceHit, kdHit);
+        EXPECT_EQ(referenceHit, tree.occluded(ray.getSource(), ray.getDirection(), math::constants::REAL_MAX /**/ STATISTICS_NULL_INPUT));
+        if (referenceHit && kdHit) {
+            EXPECT_NEAR(kdIntersection.depth, reference.depth, 1E-4);
+            EXPECT_FALSE(tree.occluded(ray.getSource(), ray.getDirection(), reference.depth * (math::real)0.5 /**/ STATISTICS_NULL_INPUT));
+            ++hits;
+        }
+    }
+
+    EXPECT_GT(hits, 0);
+
+    mesh.destroy();
+    tree.destroy();
+}
+
+TEST(KDTreeTests, KDTreePacketTraversalTest) {
+    Mesh mesh;
+    generateHeightField(&mesh, 64);
+    mesh.setFastIntersectEnabled(false);
+
+    KDTree kdTree;
+    kdTree.configure(10, math::constants::Zero);
+    kdTree.analyze(&mesh, 4);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    int hits = 0;
+    for (int i = 0; i < 500; i++) {
+        // Every other packet is incoherent and has to fall back to single rays
+        const bool coherent = (i % 2) == 0;
+        const int rayCount = 1 + (i / 2) % RayPacket::Width;
+
+        const math::Vector origin = math::loadVector(dist(rng) * 3, (math::real)5.0, dist(rng) * 3);
+        const math::Vector target = math::loadVector(dist(rng) * 3, (math::real)0.0, dist(rng) * 3);
+
+        LightRay rays[RayPacket::Width];
+        LightRay *rayPointers[RayPacket::Width];
+        math::real maxDepth[RayPacket::Width];
+        for (int j = 0; j < rayCount; j++) {
+            const math::Vector offset = coherent
+                ? math::loadVector(dist(rng) * 0.2f, (math::real)0.0, dist(rng) * 0.2f)
+                : math::loadVector(dist(rng) * 4, dist(rng) * 6, dist(rng) * 4);
+
+            rays[j].setSource(origin);
+            rays[j].setDirection(math::normalize(math::sub(math::add(target, offset), origin)));
+            rays[j].calculateTransformations();
+            rays[j].resetCache();
+
+            rayPointers[j] = &rays[j];
+            maxDepth[j] = (j % 3 == 2) ? (math::real)5.0 : math::constants::REAL_MAX;
+        }
+
+        RayPacket packet;
+        packet.initialize(rayPointers, rayCount);
+
+        CoarseIntersection intersections[RayPacket::Width];
+        const int hitMask = kdTree.findClosestIntersectionPacket(
+            packet, packet.getLaneMask(), intersections, (math::real)0.0, maxDepth, nullptr /**/ STATISTICS_NULL_INPUT);
+
+        for (int j = 0; j < rayCount; j++) {
+            CoarseIntersection reference;
+            rays[j].resetCache();
+            const bool referenceHit = kdTree.findClosestIntersection(
+                &rays[j], &reference, (math::real)0.0, maxDepth[j], nullptr /**/ STATISTICS_NULL_INPUT);
+            const bool packetHit = (hitMask & (0x1 << j)) != 0;
+
+            EXPECT_EQ(referenceHit, packetHit);
+            if (referenceHit && packetHit) {
+                EXPECT_NEAR(intersections[j].depth, reference.depth, 1E-4);
+                EXPECT_EQ(intersections[j].faceHint, reference.faceHint);
+                ++hits;
+            }
+        }
+    }
+
+    EXPECT_GT(hits, 0);
+
+    mesh.destroy();
+    kdTree.destroy();
+}
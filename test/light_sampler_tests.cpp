@@ -0,0 +1,206 @@
+#include <pch.h>
+
+#include "utilities.h"
+
+#include "../include/alias_table.h"
+#include "../include/light_bvh.h"
+
+#include <vector>
+
+using namespace manta;
+
+namespace {
+
+    LightBounds createAreaLight(const math::Vector &center, const math::Vector &normal, math::real size, math::real phi) {
+        const math::Vector extents = math::loadVector(size, size, size);
+
+        LightBounds bounds;
+        bounds.bounds.minPoint = math::sub(center, extents);
+        bounds.bounds.maxPoint = math::add(center, extents);
+        bounds.phi = phi;
+        bounds.w = normal;
+        bounds.cosTheta_o = (math::real)1.0;
+        bounds.cosTheta_e = (math::real)0.0;
+        bounds.twoSided = false;
+
+        return bounds;
+    }
+
+} /* namespace */
+
+TEST(LightSamplerTests, AliasTableTest) {
+    const math::real weights[] = { 1, 0, 3, 6, 0.5, 9.5 };
+    const int count = sizeof(weights) / sizeof(weights[0]);
+
+    AliasTable table;
+    table.build(weights, count);
+
+    std::vector<int> histogram(count, 0);
+    const int samples = 200000;
+    for (int i = 0; i < samples; i++) {
+        math::real pmf;
+        const int index = table.sample((i + (math::real)0.5) / samples, &pmf);
+        ASSERT_GE(index, 0);
+        ASSERT_LT(index, count);
+        EXPECT_EQ(pmf, table.pmf(index));
+
+        histogram[index]++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        EXPECT_NEAR(table.pmf(i), weights[i] / 20, 1E-6);
+        EXPECT_NEAR((math::real)histogram[i] / samples, weights[i] / 20, 1E-3);
+    }
+
+    EXPECT_EQ(histogram[1], 0);
+}
+
+TEST(LightSamplerTests, AliasTableUniformTest) {
+    const math::real weights[] = { 0, 0, 0, 0 };
+
+    AliasTable table;
+    table.build(weights, 4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_NEAR(table.pmf(i), 0.25, 1E-6);
+    }
+
+    AliasTable empty;
+    empty.build(nullptr, 0);
+
+    math::real pmf;
+    EXPECT_EQ(empty.sample((math::real)0.5, &pmf), -1);
+    EXPECT_EQ(pmf, 0);
+}
+
+TEST(LightSamplerTests, AliasTableRemapTest) {
+    const math::real weights[] = { 2, 5, 1, 0 };
+    const int count = sizeof(weights) / sizeof(weights[0]);
+
+    AliasTable table;
+    table.build(weights, count);
+
+    // The remapped sample has to be uniform within each chosen index
+    const int buckets = 4;
+    std::vector<int> histogram(count * buckets, 0);
+    const int samples = 200000;
+    for (int i = 0; i < samples; i++) {
+        math::real pmf, uRemapped;
+        const int index = table.sample((i + (math::real)0.5) / samples, &pmf, &uRemapped);
+        ASSERT_GE(uRemapped, 0);
+        ASSERT_LT(uRemapped, 1);
+
+        histogram[index * buckets + (int)(uRemapped * buckets)]++;
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < buckets; j++) {
+            EXPECT_NEAR((math::real)histogram[i * buckets + j] / samples, weights[i] / 8 / buckets, 1E-3);
+        }
+    }
+}
+
+TEST(LightSamplerTests, LightBoundsImportanceTest) {
+    const LightBounds light = createAreaLight(math::constants::Zero, math::constants::YAxis, (math::real)0.5, 1);
+    const math::Vector up = math::constants::YAxis;
+
+    // Nothing is emitted below a one-sided light
+    EXPECT_GT(light.importance(math::loadVector(0, 5, 0), math::constants::Zero), 0);
+    EXPECT_EQ(light.importance(math::loadVector(0, -5, 0), math::constants::Zero), 0);
+
+    // Importance drops with distance
+    EXPECT_GT(
+        light.importance(math::loadVector(0, 2, 0), up),
+        light.importance(math::loadVector(0, 4, 0), up));
+
+    LightBounds twoSided = light;
+    twoSided.twoSided = true;
+    EXPECT_GT(twoSided.importance(math::loadVector(0, -5, 0), math::constants::Zero), 0);
+
+    // The merged cone contains both cones
+    const LightBounds other = createAreaLight(math::loadVector(3, 0, 0), math::constants::XAxis, (math::real)0.5, 2);
+    const LightBounds merged = LightBounds::merge(light, other);
+    EXPECT_NEAR(merged.phi, 3, 1E-6);
+    EXPECT_LE(merged.cosTheta_o, math::getScalar(math::dot(merged.w, math::constants::YAxis)) + 1E-5);
+    EXPECT_LE(merged.cosTheta_o, math::getScalar(math::dot(merged.w, math::constants::XAxis)) + 1E-5);
+}
+
+TEST(LightSamplerTests, LightBVHTest) {
+    std::vector<LightBounds> lights;
+    for (int i = 0; i < 40; i++) {
+        const math::Vector center = math::loadVector(
+            (math::real)(i % 5) * 3, (math::real)((i / 5) % 4) * 2, (math::real)(i / 20) * 4);
+        const math::Vector normal = (i % 3 == 0)
+            ? math::constants::YAxis
+            : math::normalize(math::loadVector(1, (math::real)(i % 7) - 3, 0.5));
+
+        lights.push_back(createAreaLight(center, normal, (math::real)0.25, (math::real)(1 + i % 4)));
+        lights.back().twoSided = (i % 4 == 1);
+    }
+
+    // A light without power is never picked
+    lights[7].phi = 0;
+
+    LightBVH bvh;
+    bvh.build(lights.data(), (int)lights.size());
+    EXPECT_EQ(bvh.getNodeCount(), 2 * 39 - 1);
+
+    const math::Vector p = math::loadVector(5, 3, 1);
+    const math::Vector n = math::normalize(math::loadVector(0.2, -1, 0.1));
+
+    // Subtrees that can't reach the point are never entered, so the pmf can sum to
+    // less than one
+    math::real sum = 0;
+    for (int i = 0; i < (int)lights.size(); i++) sum += bvh.pmf(p, n, i);
+    EXPECT_GT(sum, 0);
+    EXPECT_LE(sum, 1 + 1E-5);
+    EXPECT_EQ(bvh.pmf(p, n, 7), 0);
+
+    // Sampling frequency matches the pmf
+    std::vector<int> histogram(lights.size(), 0);
+    int misses = 0;
+    const int samples = 100000;
+    for (int i = 0; i < samples; i++) {
+        math::real pmf;
+        const int light = bvh.sample(p, n, (i + (math::real)0.5) / samples, &pmf);
+        if (light == -1) {
+            misses++;
+            continue;
+        }
+
+        EXPECT_NEAR(pmf, bvh.pmf(p, n, light), 1E-5);
+        histogram[light]++;
+    }
+
+    for (int i = 0; i < (int)lights.size(); i++) {
+        EXPECT_NEAR((math::real)histogram[i] / samples, bvh.pmf(p, n, i), 1E-3);
+    }
+
+    EXPECT_NEAR((math::real)misses / samples, 1 - sum, 1E-3);
+
+    // The point is at the center of a node's bounds
+    const math::Vector center = math::loadVector(0, 5, 0);
+    math::real pmf;
+    EXPECT_GE(bvh.sample(center, math::constants::Zero, (math::real)0.5, &pmf), 0);
+    EXPECT_GT(pmf, 0);
+
+    // Nearby lights that face the receiver are favored
+    const math::Vector q = math::loadVector(0, 1, 0);
+    const math::Vector down = math::negate(math::constants::YAxis);
+    EXPECT_GT(bvh.pmf(q, down, 0), bvh.pmf(q, down, 39));
+    EXPECT_GT(bvh.pmf(q, down, 0), bvh.pmf(q, down, 15));
+}
+
+TEST(LightSamplerTests, LightBVHSingleLightTest) {
+    const LightBounds light = createAreaLight(math::constants::Zero, math::constants::YAxis, (math::real)0.5, 1);
+
+    LightBVH bvh;
+    bvh.build(&light, 1);
+
+    math::real pmf;
+    EXPECT_EQ(bvh.sample(math::loadVector(0, 3, 0), math::constants::Zero, (math::real)0.3, &pmf), 0);
+    EXPECT_EQ(pmf, 1);
+
+    // The point is behind the light
+    EXPECT_EQ(bvh.sample(math::loadVector(0, -3, 0), math::constants::Zero, (math::real)0.3, &pmf), -1);
+    EXPECT_EQ(bvh.pmf(math::loadVector(0, -3, 0), math::constants::Zero, 0), 0);
+}
@@ -2,6 +2,10 @@
 #include "utilities.h"
 
 #include "../include/stack_allocator.h"
+#include "../include/standard_allocator.h"
+
+#include <thread>
+#include <vector>
 
 TEST(MemoryTests, StackSanityCheck) {
     manta::StackAllocator s;
@@ -60,3 +64,110 @@ TEST(MemoryTests, StackAlignedAllocate) {
     s.free(test8);
     s.free(test4);
 }
+
+TEST(MemoryTests, StackGrowPastChunk) {
+    manta::StackAllocator s;
+    s.initialize(256);
+
+    // Allocations larger than a chunk get a chunk of their own
+    int *small = (int *)s.allocate(200, 4);
+    int *large = (int *)s.allocate(1000 * sizeof(int), 16);
+    EXPECT_TRUE((unsigned __int64)large % 16 == 0);
+    EXPECT_EQ(s.getChunkCount(), 2);
+
+    for (int i = 0; i < 1000; i++) {
+        large[i] = i;
+    }
+
+    EXPECT_EQ(large[999], 999);
+    EXPECT_GE(s.getMaxUsage(), 200 + 1000 * sizeof(int));
+
+    s.free(large);
+    s.free(small);
+}
+
+TEST(MemoryTests, StackScopeRewind) {
+    manta::StackAllocator s;
+    s.initialize(256);
+
+    void *before = s.allocate(16, 16);
+    s.free(before);
+
+    for (int pass = 0; pass < 4; pass++) {
+        manta::StackScope scope(&s);
+        for (int i = 0; i < 64; i++) {
+            s.allocate(64, 16);
+        }
+    }
+
+    // Chunks are reused after every rewind rather than added again
+    const int chunkCount = s.getChunkCount();
+    {
+        manta::StackScope scope(&s);
+        for (int i = 0; i < 64; i++) {
+            s.allocate(64, 16);
+        }
+    }
+
+    EXPECT_EQ(s.getChunkCount(), chunkCount);
+
+    void *after = s.allocate(16, 16);
+    EXPECT_EQ(after, before);
+    s.free(after);
+}
+
+TEST(MemoryTests, StandardAllocatorTagTest) {
+    manta::StandardAllocator allocator;
+
+    float *texture = allocator.allocate<float>(1000, 16, manta::MemoryTag::Texture);
+    int *mesh = allocator.allocate<int>(10, 1, manta::MemoryTag::Mesh);
+    EXPECT_TRUE((unsigned __int64)texture % 16 == 0);
+
+    EXPECT_EQ(allocator.getCurrentUsage(manta::MemoryTag::Texture), 1000 * sizeof(float));
+    EXPECT_EQ(allocator.getCurrentUsage(manta::MemoryTag::Mesh), 10 * sizeof(int));
+    EXPECT_EQ(allocator.getCurrentUsage(), 1000 * sizeof(float) + 10 * sizeof(int));
+
+    allocator.aligned_free(texture, 1000, manta::MemoryTag::Texture);
+    allocator.free(mesh, 10, manta::MemoryTag::Mesh);
+
+    EXPECT_EQ(allocator.getCurrentUsage(), 0);
+    EXPECT_EQ(allocator.getLedger(), 0);
+    EXPECT_EQ(allocator.getMaxUsage(manta::MemoryTag::Texture), 1000 * sizeof(float));
+    EXPECT_EQ(allocator.getMaxUsage(manta::MemoryTag::Film), 0);
+}
+
+TEST(MemoryTests, StandardAllocatorThreadedTest) {
+    manta::StandardAllocator allocator;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++) {
+        threads.push_back(std::thread([&allocator]() {
+            for (int j = 0; j < 1000; j++) {
+                double *memory = allocator.allocate<double>(64, 16, manta::MemoryTag::FFT);
+                allocator.aligned_free(memory, 64, manta::MemoryTag::FFT);
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) thread.join();
+
+    EXPECT_EQ(allocator.getCurrentUsage(manta::MemoryTag::FFT), 0);
+    EXPECT_EQ(allocator.getLedger(), 0);
+    EXPECT_GE(allocator.getMaxUsage(), 64 * sizeof(double));
+    EXPECT_LE(allocator.getMaxUsage(), 8 * 64 * sizeof(double));
+}
+
+TEST(MemoryTests, StandardAllocatorLargeTest) {
+    manta::StandardAllocator allocator;
+    EXPECT_FALSE(allocator.getHugePagesEnabled());
+    allocator.setHugePagesEnabled(true);
+
+    // Large enough to be backed by huge pages
+    const manta::mem_size count = 3 * manta::StandardAllocator::HugePageSize;
+    char *memory = allocator.allocate<char>(count, 16, manta::MemoryTag::Texture);
+    memory[0] = memory[count - 1] = 1;
+
+    EXPECT_EQ(allocator.getCurrentUsage(), count);
+
+    allocator.aligned_free(memory, count, manta::MemoryTag::Texture);
+}
@@ -8,6 +8,7 @@
 
 #include <chrono>
 #include <fstream>
+#include <random>
 
 using namespace manta;
 
@@ -299,3 +300,53 @@ TEST(MeshIntersectionTests, MeshIntersectionQuadsObliqueCheck) {
     singleTriangleObj.destroy();
     mesh.destroy();
 }
+
+TEST(MeshIntersectionTests, MeshOcclusionTest) {
+    ObjFileLoader singleTriangleObj;
+    bool result = singleTriangleObj.loadObjFile("../../../test/geometry/single_triangle.obj");
+
+    Mesh mesh;
+    mesh.loadObjFileData(&singleTriangleObj);
+    mesh.setFastIntersectEnabled(false);
+
+    const math::Vector source = math::loadVector(0.5, 0.0, 1.0);
+    const math::Vector direction = math::loadVector(0.0, 0.0, -1.0);
+
+    EXPECT_TRUE(mesh.occluded(source, direction, (math::real)2.0 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(mesh.occluded(source, direction, (math::real)0.5 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(mesh.occluded(source, math::negate(direction), (math::real)2.0 /**/ STATISTICS_NULL_INPUT));
+
+    singleTriangleObj.destroy();
+    mesh.destroy();
+}
+
+TEST(MeshIntersectionTests, MeshOcclusionMatchesClosestHit) {
+    ObjFileLoader twoCubesObj;
+    bool result = twoCubesObj.loadObjFile("../../../test/geometry/two_cubes.obj");
+
+    Mesh mesh;
+    mesh.loadObjFileData(&twoCubesObj);
+    mesh.setFastIntersectEnabled(false);
+    mesh.findQuads();
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int i = 0; i < 1000; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng) * 3, dist(rng) * 3, dist(rng) * 3));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng), dist(rng), dist(rng))));
+        ray.calculateTransformations();
+
+        const math::real maxDepth = (math::real)(dist(rng) + 1.0f) * 2;
+
+        CoarseIntersection intersection;
+        const bool hit = mesh.findClosestIntersection(&ray, &intersection, (math::real)0.0, maxDepth, nullptr /**/ STATISTICS_NULL_INPUT);
+        const bool occluded = mesh.occluded(ray.getSource(), ray.getDirection(), maxDepth /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(hit, occluded);
+    }
+
+    twoCubesObj.destroy();
+    mesh.destroy();
+}
@@ -109,3 +109,94 @@ TEST(MeshProcessingTests, PlaneTest) {
     cubeObj.destroy();
     mesh.destroy();
 }
+
+TEST(MeshProcessingTests, BinaryCacheTest) {
+    const char *cacheFile = "../../../workspace/test_results/mesh_cache_test.mrmesh";
+
+    ObjFileLoader cubeObj;
+    bool result = cubeObj.loadObjFile("../../../test/geometry/cube.obj");
+
+    Mesh mesh;
+    mesh.loadObjFileData(&cubeObj);
+    cubeObj.destroy();
+
+    EXPECT_TRUE(mesh.writeCacheFile(cacheFile, 100, 200, 300));
+
+    Mesh cachedMesh;
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 200, 300), Mesh::CacheStatus::Loaded);
+    EXPECT_TRUE(cachedMesh.isCacheMapped());
+
+    EXPECT_EQ(cachedMesh.getTriangleFaceCount(), mesh.getTriangleFaceCount());
+    EXPECT_EQ(cachedMesh.getVertexCount(), mesh.getVertexCount());
+    EXPECT_EQ(cachedMesh.getNormalCount(), mesh.getNormalCount());
+    EXPECT_EQ(cachedMesh.getTexCoordCount(), mesh.getTexCoordCount());
+    EXPECT_EQ(cachedMesh.computeContentHash(), mesh.computeContentHash());
+
+    for (int i = 0; i < mesh.getTriangleFaceCount(); i++) {
+        EXPECT_EQ(cachedMesh.getFace(i)->u, mesh.getFace(i)->u);
+        EXPECT_EQ(cachedMesh.getFace(i)->v, mesh.getFace(i)->v);
+        EXPECT_EQ(cachedMesh.getFace(i)->w, mesh.getFace(i)->w);
+    }
+
+    // Quads can still be generated from a mapped mesh
+    cachedMesh.findQuads();
+    mesh.findQuads();
+    EXPECT_EQ(cachedMesh.getQuadFaceCount(), mesh.getQuadFaceCount());
+
+    cachedMesh.destroy();
+    EXPECT_FALSE(cachedMesh.isCacheMapped());
+
+    // Modified source file
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 101, 200, 300), Mesh::CacheStatus::Stale);
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 201, 300), Mesh::CacheStatus::Stale);
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 200, 301), Mesh::CacheStatus::Stale);
+
+    // Vertex index past the end of the vertex array
+    {
+        MeshCacheHeader header;
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.read((char *)&header, sizeof(MeshCacheHeader));
+
+        const int badVertex = header.vertexCount;
+        file.seekp((std::streamoff)header.offsets[0]);
+        file.write((const char *)&badVertex, sizeof(int));
+    }
+
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 200, 300), Mesh::CacheStatus::Corrupt);
+
+    // Out of range material
+    EXPECT_TRUE(mesh.writeCacheFile(cacheFile, 100, 200, 300));
+    {
+        MeshCacheHeader header;
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.read((char *)&header, sizeof(MeshCacheHeader));
+
+        const int badMaterial = header.materialCount;
+        file.seekp((std::streamoff)header.offsets[2]);
+        file.write((const char *)&badMaterial, sizeof(int));
+    }
+
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 200, 300), Mesh::CacheStatus::Corrupt);
+    EXPECT_TRUE(mesh.writeCacheFile(cacheFile, 100, 200, 300));
+
+    // Trailing bytes that the layout does not account for
+    {
+        std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(0, std::ios::end);
+        file.put(0);
+    }
+
+    EXPECT_EQ(cachedMesh.loadCacheFile(cacheFile, 100, 200, 300), Mesh::CacheStatus::Corrupt);
+    EXPECT_EQ(cachedMesh.loadCacheFile("../../../workspace/test_results/missing.mrmesh", 100, 200, 300), Mesh::CacheStatus::Missing);
+
+    cachedMesh.destroy();
+    mesh.destroy();
+}
+
+TEST(MeshProcessingTests, SourceHashTest) {
+    const hash_value cubeHash = Mesh::computeSourceHash("../../../test/geometry/cube.obj");
+    EXPECT_NE(cubeHash, 0u);
+    EXPECT_EQ(cubeHash, Mesh::computeSourceHash("../../../test/geometry/cube.obj"));
+    EXPECT_NE(cubeHash, Mesh::computeSourceHash("../../../test/geometry/two_cubes.obj"));
+    EXPECT_EQ(Mesh::computeSourceHash("../../../test/geometry/missing.obj"), 0u);
+}
@@ -4,6 +4,8 @@
 
 #include "../include/mipmap.h"
 #include "../include/scalar_map_2d.h"
+#include "../include/vector_map_2d.h"
+#include "../include/rgb_space.h"
 
 #include "../include/manta_math.h"
 
@@ -48,3 +50,124 @@ TEST(MipmapTests, MipmapSanityCheck) {
     map.destroy();
     source.destroy();
 }
+
+TEST(MipmapTests, VectorMipmapTest) {
+    Mipmap<VectorMap2D, math::Vector> map;
+    VectorMap2D source;
+
+    // Checkerboard of single texels
+    source.initialize(64, 32);
+    for (int i = 0; i < 64; i++) {
+        for (int j = 0; j < 32; j++) {
+            if ((i + j) % 2 == 0) {
+                source.set(math::loadVector(1.0f, 0.5f, 0.0f), i, j);
+            }
+        }
+    }
+
+    map.initialize(&source);
+
+    EXPECT_EQ(map.getLevels(), 6);
+
+    // A footprint smaller than a texel resolves individual texels
+    math::Vector fine = map.sample(0.5f / 64, 0.5f / 32, 1E-4f);
+    EXPECT_NEAR(math::getX(fine), 1.0f, 1E-4);
+
+    fine = map.sample(1.5f / 64, 0.5f / 32, 1E-4f);
+    EXPECT_NEAR(math::getX(fine), 0.0f, 1E-4);
+
+    // Larger footprints average the pattern out
+    for (int i = 0; i < 10; i++) {
+        const math::real u = i / (math::real)10;
+        math::Vector coarse = map.sample(u, 0.3f, 0.25f);
+        EXPECT_NEAR(math::getX(coarse), 0.5f, 1E-4);
+        EXPECT_NEAR(math::getY(coarse), 0.25f, 1E-4);
+    }
+
+    map.destroy();
+    source.destroy();
+}
+
+TEST(MipmapTests, CompactFormatTest) {
+    const VectorMap2D::Format formats[] = {
+        VectorMap2D::Format::Half,
+        VectorMap2D::Format::Srgb8,
+        VectorMap2D::Format::Linear8,
+        VectorMap2D::Format::HalfMono,
+        VectorMap2D::Format::Srgb8Mono,
+        VectorMap2D::Format::Linear8Mono
+    };
+
+    for (VectorMap2D::Format format : formats) {
+        VectorMap2D map;
+        map.initialize(4, 4, format);
+
+        const bool mono = VectorMap2D::getChannelCount(format) == 1;
+        for (int j = 0; j < 4; j++) {
+            for (int i = 0; i < 4; i++) {
+                const math::real v = (i + 4 * j) / (math::real)15.0;
+                map.set(math::loadVector(v, mono ? v : 1 - v, mono ? v : v * v, 0.5), i, j);
+            }
+        }
+
+        EXPECT_EQ(map.getMemoryUsage(), 16 * VectorMap2D::getTexelSize(format));
+
+        for (int j = 0; j < 4; j++) {
+            for (int i = 0; i < 4; i++) {
+                const math::real v = (i + 4 * j) / (math::real)15.0;
+                const math::Vector texel = map.get(i, j);
+
+                EXPECT_NEAR(math::getX(texel), v, 0.01);
+                EXPECT_NEAR(math::getY(texel), mono ? v : 1 - v, 0.01);
+                EXPECT_NEAR(math::getZ(texel), mono ? v : v * v, 0.01);
+                EXPECT_NEAR(math::getW(texel), mono ? 0.0 : 0.5, 0.01);
+            }
+        }
+
+        map.destroy();
+    }
+}
+
+TEST(MipmapTests, Srgb8DecodeTest) {
+    VectorMap2D map;
+    map.initialize(256, 1, VectorMap2D::Format::Srgb8);
+
+    for (int i = 0; i < 256; i++) {
+        map.setBytes(i, i, i, 255, i, 0);
+    }
+
+    math::real previous = -1;
+    for (int i = 0; i < 256; i++) {
+        const math::Vector texel = map.get(i, 0);
+        EXPECT_NEAR(math::getX(texel), RgbSpace::inverseGammaSrgb(i / 255.0), 1E-6);
+        EXPECT_GT(math::getX(texel), previous);
+        EXPECT_NEAR(math::getW(texel), 1.0, 1E-6);
+
+        // Encoding a decoded value returns the original code
+        map.set(texel, i, 0);
+        EXPECT_EQ(math::getX(map.get(i, 0)), math::getX(texel));
+
+        previous = math::getX(texel);
+    }
+
+    map.destroy();
+}
+
+TEST(MipmapTests, CompactMipmapTest) {
+    VectorMap2D source;
+    source.initialize(16, 16, VectorMap2D::Format::Srgb8Mono, math::loadScalar(0.5));
+
+    Mipmap<VectorMap2D, math::Vector> mipmap;
+    mipmap.initialize(&source);
+
+    EXPECT_EQ(mipmap.getLevels(), 5);
+
+    // Averaging happens in linear space so a constant map stays constant
+    for (int i = 0; i < 5; i++) {
+        const math::Vector v = mipmap.sample(0.5f, 0.5f, (math::real)(1 << i) / 16);
+        EXPECT_NEAR(math::getX(v), 0.5, 0.01);
+    }
+
+    mipmap.destroy();
+    source.destroy();
+}
@@ -0,0 +1,133 @@
+#include <pch.h>
+
+#include "../include/obj_file_loader.h"
+
+#include <string>
+#include <sstream>
+
+using namespace manta;
+
+TEST(ObjFileLoaderTests, ParseRealTest) {
+    const char *values[] = {
+        "1.000000", "-1.000000", "0.5", "+2", "-.25", "1e3", "1.5E-2", "123456789.125", "-0.000000", "3." };
+
+    for (const char *value : values) {
+        math::real result;
+        EXPECT_TRUE(ObjFileLoader::parseReal(value, value + strlen(value), &result));
+        EXPECT_NEAR(result, (math::real)std::strtod(value, nullptr), 1E-6 * std::abs(std::strtod(value, nullptr)));
+    }
+
+    const char *invalid[] = { "", "-", "1.0x", "e5", "1e", "1,5" };
+    for (const char *value : invalid) {
+        math::real result;
+        EXPECT_FALSE(ObjFileLoader::parseReal(value, value + strlen(value), &result));
+    }
+}
+
+TEST(ObjFileLoaderTests, ChunkedLoadTest) {
+    std::stringstream ss;
+    ss << "# Test file\n";
+    ss << "o Grid\n";
+    for (int i = 0; i < 200; i++) {
+        ss << "v " << i << " " << -i << " 0.5\n";
+        ss << "vn 0 0 1\r\n";
+        ss << "vt 0.25 0.75\n";
+
+        if (i % 50 == 0) ss << "usemtl Material" << i / 50 << "\n";
+        else if (i % 50 == 25) ss << "usemtl None\n";
+
+        if (i >= 2) ss << "f " << i - 1 << "/" << i - 1 << "/" << i - 1 << " " << i << "//" << i << " -1/-1/-1\n";
+    }
+
+    const std::string data = ss.str();
+
+    ObjFileLoader reference;
+    EXPECT_TRUE(reference.loadObjData(data.c_str(), data.size()));
+
+    // Small chunks split the file in many places
+    ObjFileLoader chunked;
+    EXPECT_TRUE(chunked.loadObjData(data.c_str(), data.size(), 64));
+
+    EXPECT_EQ(reference.getVertexCount(), 200);
+    EXPECT_EQ(reference.getNormalCount(), 200);
+    EXPECT_EQ(reference.getTexCoordCount(), 200);
+    EXPECT_EQ(reference.getFaceCount(), 198);
+    EXPECT_EQ(reference.getMaterialCount(), 4);
+
+    EXPECT_EQ(chunked.getVertexCount(), 200);
+    EXPECT_EQ(chunked.getFaceCount(), 198);
+    EXPECT_EQ(chunked.getMaterialCount(), 4);
+
+    for (unsigned int i = 0; i < chunked.getVertexCount(); i++) {
+        EXPECT_EQ(chunked.getVertex(i).x, (math::real)i);
+        EXPECT_EQ(chunked.getVertex(i).y, -(math::real)i);
+    }
+
+    for (unsigned int i = 0; i < chunked.getFaceCount(); i++) {
+        const ObjFileLoader::ObjFace face = chunked.getFace(i);
+        const int vertex = (int)i + 2;
+
+        EXPECT_EQ(face.v1, vertex - 1);
+        EXPECT_EQ(face.v2, vertex);
+        EXPECT_EQ(face.v3, vertex + 1);
+        EXPECT_EQ(face.vt2, 0);
+        EXPECT_EQ(face.vn3, vertex + 1);
+
+        const int expectedMaterial = (vertex % 50 < 25) ? vertex / 50 : -1;
+        EXPECT_EQ(face.material, expectedMaterial);
+        EXPECT_EQ(face.material, reference.getFace(i).material);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(chunked.getMaterial(i).name, "Material" + std::to_string(i));
+    }
+}
+
+TEST(ObjFileLoaderTests, InvalidLineTest) {
+    const std::string data = "v 1 2 3\nv 1 2\nf 1 1 1\n";
+
+    ObjFileLoader loader;
+    EXPECT_FALSE(loader.loadObjData(data.c_str(), data.size()));
+}
+
+TEST(ObjFileLoaderTests, PolygonTest) {
+    const std::string data =
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv -1 0.5 0\n"
+        "vt 0 0\nvt 1 1\n"
+        "f 1 2 3\n"
+        "usemtl Quad\n"
+        "f 1/1 2/2 3/1 4/2\n"
+        "f 1 2 3 4 5\n"
+        "f 1 2\n";
+
+    ObjFileLoader loader;
+    EXPECT_FALSE(loader.loadObjData(data.c_str(), data.size()));
+
+    // Polygons are fan triangulated around their first vertex
+    const std::string valid = data.substr(0, data.size() - strlen("f 1 2\n"));
+    EXPECT_TRUE(loader.loadObjData(valid.c_str(), valid.size()));
+    EXPECT_EQ(loader.getFaceCount(), 6);
+
+    const int expected[][3] = { { 1, 2, 3 }, { 1, 2, 3 }, { 1, 3, 4 }, { 1, 2, 3 }, { 1, 3, 4 }, { 1, 4, 5 } };
+    for (unsigned int i = 0; i < loader.getFaceCount(); i++) {
+        const ObjFileLoader::ObjFace face = loader.getFace(i);
+        EXPECT_EQ(face.v1, expected[i][0]);
+        EXPECT_EQ(face.v2, expected[i][1]);
+        EXPECT_EQ(face.v3, expected[i][2]);
+        EXPECT_EQ(face.material, (i == 0) ? -1 : 0);
+    }
+
+    EXPECT_EQ(loader.getFace(2).vt1, 1);
+    EXPECT_EQ(loader.getFace(2).vt2, 1);
+    EXPECT_EQ(loader.getFace(2).vt3, 2);
+}
+
+TEST(ObjFileLoaderTests, EmptyFileTest) {
+    const char *fname = "../../../workspace/test_results/empty.obj";
+    fclose(fopen(fname, "wb"));
+
+    ObjFileLoader loader;
+    EXPECT_TRUE(loader.loadObjFile(fname));
+    EXPECT_EQ(loader.getFaceCount(), 0);
+    EXPECT_EQ(loader.getVertexCount(), 0);
+}
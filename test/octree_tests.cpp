@@ -5,9 +5,11 @@
 #include "../include/light_ray.h"
 #include "../include/octree.h"
 #include "../include/scene_object.h"
+#include "../include/coarse_intersection.h"
 
 #include <chrono>
 #include <fstream>
+#include <random>
 
 using namespace manta;
 
@@ -25,3 +27,38 @@ TEST(OctreeTests, OctreeIntersectionTest) {
 TEST(OctreeTests, OctreeTestSanityCheck) {
     /* TODO */
 }
+
+TEST(OctreeTests, OctreeOcclusionTest) {
+    ObjFileLoader twoCubesObj;
+    bool result = twoCubesObj.loadObjFile("../../../test/geometry/two_cubes.obj");
+
+    Mesh mesh;
+    mesh.loadObjFileData(&twoCubesObj);
+    mesh.setFastIntersectEnabled(false);
+
+    Octree octree;
+    octree.initialize(10.0, math::constants::Zero);
+    octree.analyze(&mesh, 2);
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (int i = 0; i < 1000; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector(dist(rng) * 3, dist(rng) * 3, dist(rng) * 3));
+        ray.setDirection(math::normalize(math::loadVector(dist(rng), dist(rng), dist(rng))));
+        ray.calculateTransformations();
+
+        const math::real maxDepth = (math::real)(dist(rng) + 1.0f) * 2;
+
+        CoarseIntersection intersection;
+        const bool hit = mesh.findClosestIntersection(&ray, &intersection, (math::real)0.0, maxDepth, nullptr /**/ STATISTICS_NULL_INPUT);
+        const bool occluded = octree.occluded(ray.getSource(), ray.getDirection(), maxDepth /**/ STATISTICS_NULL_INPUT);
+
+        EXPECT_EQ(hit, occluded);
+    }
+
+    octree.destroy();
+    twoCubesObj.destroy();
+    mesh.destroy();
+}
@@ -58,6 +58,22 @@ TEST(PrimitiveTests, SphereIntersectionInside) {
     /* TODO */
 }
 
+TEST(PrimitiveTests, SphereOcclusion) {
+    SpherePrimitive sphere;
+    sphere.setRadius(1.0f);
+    sphere.setPosition(math::constants::Zero);
+
+    const math::Vector direction = math::loadVector(-1.0f, 0.0f, 0.0f);
+
+    EXPECT_TRUE(sphere.occluded(math::loadVector(10.0f, 0.0f, 0.0f), direction, (math::real)20.0 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(sphere.occluded(math::loadVector(10.0f, 0.0f, 0.0f), direction, (math::real)5.0 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(sphere.occluded(math::loadVector(10.0f, 2.0f, 0.0f), direction, (math::real)20.0 /**/ STATISTICS_NULL_INPUT));
+
+    // Shadow rays leaving from inside still hit the far side
+    EXPECT_TRUE(sphere.occluded(math::constants::Zero, direction, (math::real)20.0 /**/ STATISTICS_NULL_INPUT));
+    EXPECT_FALSE(sphere.occluded(math::constants::Zero, direction, (math::real)0.5 /**/ STATISTICS_NULL_INPUT));
+}
+
 TEST(PrimitiveTests, AABBSanityCheck) {
     LightRay ray;
     ray.setDirection(math::loadVector(-1.0, 0.0, 0.0));
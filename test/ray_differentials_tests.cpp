@@ -0,0 +1,123 @@
+#include <pch.h>
+
+#include "../include/intersection_point.h"
+#include "../include/light_ray.h"
+#include "../include/mesh.h"
+#include "../include/ray_tracer.h"
+#include "../include/bxdf.h"
+
+using namespace manta;
+
+namespace {
+
+    // Pinhole ray at the origin of the z = height plane looking straight down. The
+    // differentials spread out by the given angle per pixel in x and in y.
+    void createPinholeRay(LightRay *ray, math::real height, math::real spread) {
+        const math::Vector source = math::loadVector(0, 0, height);
+        const math::Vector direction = math::loadVector(0, 0, -1);
+
+        ray->setSource(source);
+        ray->setDirection(direction);
+        ray->setDifferentials(
+            source, math::normalize(math::loadVector(spread, 0, -1)),
+            source, math::normalize(math::loadVector(0, spread, -1)));
+    }
+
+    // Hit point on the plane z = height with texture coordinates following x and y
+    void createPlanarHit(IntersectionPoint *point, const Mesh *mesh, math::real height, const math::Vector &normal) {
+        point->m_position = math::loadVector(0, 0, height);
+        point->m_faceNormal = normal;
+        point->m_vertexNormal = normal;
+        point->m_outside = math::add(point->m_position, math::mul(normal, math::loadScalar((math::real)1E-4)));
+        point->m_inside = math::sub(point->m_position, math::mul(normal, math::loadScalar((math::real)1E-4)));
+        point->m_direction = MediaInterface::Direction::In;
+        point->m_mesh = mesh;
+
+        point->u_basis = math::constants::XAxis;
+        point->v_basis = math::constants::YAxis;
+        point->dtdu = math::constants::XAxis;
+        point->dtdv = math::constants::YAxis;
+        point->dndu = math::constants::Zero;
+        point->dndv = math::constants::Zero;
+    }
+
+} /* namespace */
+
+TEST(RayDifferentialsTests, PlanarFootprintTest) {
+    constexpr math::real Spread = (math::real)0.01;
+
+    Mesh mesh;
+
+    // The footprint of a pinhole ray grows linearly with the distance to the plane
+    for (int i = 1; i <= 8; i *= 2) {
+        const math::real distance = (math::real)i;
+
+        LightRay ray;
+        createPinholeRay(&ray, distance, Spread);
+
+        IntersectionPoint point;
+        createPlanarHit(&point, &mesh, 0, math::constants::ZAxis);
+        point.calculateDifferentials(&ray);
+
+        EXPECT_TRUE(point.m_hasDifferentials);
+        EXPECT_NEAR(math::getX(point.m_dpdx), Spread * distance, 1E-5);
+        EXPECT_NEAR(math::getY(point.m_dpdx), 0.0, 1E-5);
+        EXPECT_NEAR(math::getZ(point.m_dpdx), 0.0, 1E-5);
+        EXPECT_NEAR(math::getY(point.m_dpdy), Spread * distance, 1E-5);
+        EXPECT_NEAR(math::getX(point.m_dpdy), 0.0, 1E-5);
+
+        EXPECT_NEAR(math::getX(point.m_dtdx), Spread * distance, 1E-5);
+        EXPECT_NEAR(math::getY(point.m_dtdy), Spread * distance, 1E-5);
+        EXPECT_NEAR(point.getTextureFootprint(), 2 * Spread * distance, 1E-5);
+    }
+
+    // Rays without differentials have no footprint
+    LightRay ray;
+    ray.setSource(math::loadVector(0, 0, 1));
+    ray.setDirection(math::loadVector(0, 0, -1));
+
+    IntersectionPoint point;
+    createPlanarHit(&point, &mesh, 0, math::constants::ZAxis);
+    point.calculateDifferentials(&ray);
+    EXPECT_FALSE(point.m_hasDifferentials);
+    EXPECT_EQ(point.getTextureFootprint(), 0);
+}
+
+TEST(RayDifferentialsTests, MirrorReflectionTest) {
+    constexpr math::real Spread = (math::real)0.01;
+    constexpr math::real Height = (math::real)2.0;
+    constexpr math::real Ceiling = (math::real)3.0;
+
+    Mesh mesh;
+    RayTracer rayTracer;
+
+    LightRay ray;
+    createPinholeRay(&ray, Height, Spread);
+
+    IntersectionPoint mirror;
+    createPlanarHit(&mirror, &mesh, 0, math::constants::ZAxis);
+    mirror.m_lightRay = &ray;
+    mirror.calculateDifferentials(&ray);
+
+    // Mirror reflection straight back up
+    LightRay reflected;
+    rayTracer.specularDifferentials(
+        &mirror, math::constants::ZAxis, RayFlag::Reflection | RayFlag::Delta, &reflected);
+    reflected.setSource(mirror.m_outside);
+    reflected.setDirection(math::constants::ZAxis);
+
+    EXPECT_TRUE(reflected.hasDifferentials());
+    EXPECT_NEAR(math::getX(reflected.getDxDirection()), math::getX(math::normalize(math::loadVector(Spread, 0, 1))), 1E-5);
+    EXPECT_NEAR(math::getY(reflected.getDyDirection()), math::getY(math::normalize(math::loadVector(0, Spread, 1))), 1E-5);
+
+    // The reflected footprint keeps growing at the same rate, as if the ray had
+    // continued through the mirror
+    IntersectionPoint ceiling;
+    createPlanarHit(&ceiling, &mesh, Ceiling, math::negate(math::constants::ZAxis));
+    ceiling.calculateDifferentials(&reflected);
+
+    EXPECT_TRUE(ceiling.m_hasDifferentials);
+    EXPECT_NEAR(math::getX(ceiling.m_dpdx), Spread * (Height + Ceiling), 1E-4);
+    EXPECT_NEAR(math::getY(ceiling.m_dpdy), Spread * (Height + Ceiling), 1E-4);
+    EXPECT_NEAR(math::getZ(ceiling.m_dpdx), 0.0, 1E-5);
+}
@@ -0,0 +1,206 @@
+#include <pch.h>
+
+#include "../include/sobol_sampler.h"
+#include "../include/pmj02_sampler.h"
+#include "../include/random_sampler.h"
+#include "../include/stratified_sampler.h"
+#include "../include/pixel_error_estimate.h"
+
+#include <vector>
+
+using namespace manta;
+
+// Checks that every elementary interval of area 1/count holds exactly one sample
+bool isStratified02(const math::Vector2 *samples, int count) {
+    int log2Count = 0;
+    while ((1 << log2Count) < count) log2Count++;
+
+    for (int shape = 0; shape <= log2Count; shape++) {
+        const int xStrata = 1 << shape;
+        const int yStrata = count >> shape;
+
+        std::vector<int> occupancy(count, 0);
+        for (int i = 0; i < count; i++) {
+            const int x = (int)(samples[i].x * xStrata);
+            const int y = (int)(samples[i].y * yStrata);
+            if (++occupancy[x * yStrata + y] > 1) return false;
+        }
+    }
+
+    return true;
+}
+
+void checkSamplerStratification(Sampler *sampler, int sampleCount, int dimensionCount) {
+    std::vector<std::vector<math::Vector2>> samples2d(dimensionCount);
+    std::vector<std::vector<math::Vector2>> samples1d(dimensionCount);
+
+    sampler->seed(1);
+    sampler->startPixelSession();
+    do {
+        for (int i = 0; i < dimensionCount; i++) {
+            samples2d[i].push_back(sampler->generate2d());
+            samples1d[i].push_back(math::Vector2(sampler->generate1d(), (math::real)0.0));
+        }
+    } while (sampler->startNextSample());
+
+    for (int i = 0; i < dimensionCount; i++) {
+        ASSERT_EQ(samples2d[i].size(), sampleCount);
+        EXPECT_TRUE(isStratified02(samples2d[i].data(), sampleCount));
+
+        std::vector<int> occupancy(sampleCount, 0);
+        for (const math::Vector2 &s : samples1d[i]) {
+            EXPECT_GE(s.x, (math::real)0.0);
+            EXPECT_LT(s.x, (math::real)1.0);
+            ++occupancy[(int)(s.x * sampleCount)];
+        }
+
+        for (int count : occupancy) EXPECT_EQ(count, 1);
+    }
+
+    // Different dimensions should not repeat the same pattern
+    EXPECT_NE(samples2d[0][0].x, samples2d[1][0].x);
+}
+
+TEST(SamplerTests, Pmj02SequenceTest) {
+    constexpr int Count = 1024;
+
+    std::mt19937 rng(0);
+    std::vector<math::Vector2> samples(Count);
+    Pmj02Sampler::generateSequence(samples.data(), Count, rng);
+
+    // Every power of two prefix is stratified as well
+    for (int n = 1; n <= Count; n *= 2) {
+        EXPECT_TRUE(isStratified02(samples.data(), n));
+    }
+}
+
+TEST(SamplerTests, Pmj02SamplerTest) {
+    Pmj02Sampler sampler;
+    sampler.configure(64);
+
+    EXPECT_EQ(sampler.getSetSize(), 64);
+    checkSamplerStratification(&sampler, 64, 32);
+
+    // Clones use the same tables instead of generating them again
+    Pmj02Sampler *clone = static_cast<Pmj02Sampler *>(sampler.clone());
+    EXPECT_EQ(clone->getSetSize(), 64);
+    EXPECT_EQ(clone->getSet(0), sampler.getSet(0));
+    checkSamplerStratification(clone, 64, 32);
+
+    delete clone;
+}
+
+TEST(SamplerTests, SobolSamplerTest) {
+    SobolSampler sampler;
+    sampler.setSamplesPerPixel(64);
+
+    checkSamplerStratification(&sampler, 64, 32);
+}
+
+TEST(SamplerTests, NonPowerOfTwoTest) {
+    SobolSampler sobol;
+    sobol.setSamplesPerPixel(37);
+
+    Pmj02Sampler pmj;
+    pmj.configure(37);
+    EXPECT_EQ(pmj.getSetSize(), 64);
+
+    Sampler *samplers[] = { &sobol, &pmj };
+    for (Sampler *sampler : samplers) {
+        int count = 0;
+        sampler->startPixelSession();
+        do {
+            const math::Vector2 s = sampler->generate2d();
+            EXPECT_GE(s.x, (math::real)0.0);
+            EXPECT_LT(s.x, (math::real)1.0);
+            EXPECT_GE(s.y, (math::real)0.0);
+            EXPECT_LT(s.y, (math::real)1.0);
+            ++count;
+        } while (sampler->startNextSample());
+
+        EXPECT_EQ(count, 37);
+    }
+}
+
+TEST(SamplerTests, ExtraSamplesTest) {
+    SobolSampler sobol;
+    sobol.setSamplesPerPixel(4);
+
+    Pmj02Sampler pmj;
+    pmj.configure(4);
+
+    Sampler *samplers[] = { &sobol, &pmj };
+    for (Sampler *sampler : samplers) {
+        EXPECT_TRUE(sampler->supportsExtraSamples());
+
+        // Keep going well past the configured count, as adaptive sampling does
+        sampler->startPixelSession();
+        for (int i = 0; i < 64; i++) {
+            const math::Vector2 s = sampler->generate2d();
+            EXPECT_GE(s.x, (math::real)0.0);
+            EXPECT_LT(s.x, (math::real)1.0);
+            EXPECT_GE(s.y, (math::real)0.0);
+            EXPECT_LT(s.y, (math::real)1.0);
+            sampler->startNextSample();
+        }
+    }
+
+    StratifiedSampler stratified;
+    EXPECT_FALSE(stratified.supportsExtraSamples());
+}
+
+TEST(SamplerTests, PixelErrorEstimateTest) {
+    PixelErrorEstimate constant;
+    for (int i = 0; i < 16; i++) constant.add(math::loadScalar((math::real)2.0));
+
+    EXPECT_EQ(constant.count, 16);
+    EXPECT_NEAR(constant.mean, 2.0, 1E-5);
+    EXPECT_NEAR(constant.relativeError(), 0.0, 1E-5);
+
+    // Alternating 0 and 2: mean 1, sample variance 16/15
+    PixelErrorEstimate noisy;
+    for (int i = 0; i < 16; i++) noisy.add(math::loadScalar((math::real)(2 * (i % 2))));
+
+    EXPECT_NEAR(noisy.mean, 1.0, 1E-5);
+    EXPECT_NEAR(noisy.relativeError(), std::sqrt((16.0 / 15.0) / 16.0), 1E-4);
+
+    PixelErrorEstimate single;
+    single.add(math::loadScalar((math::real)1.0));
+    EXPECT_GT(single.relativeError(), (math::real)1.0);
+}
+
+TEST(SamplerTests, CounterStreamTest) {
+    RandomSampler a, b;
+    a.setSamplesPerPixel(4);
+    b.setSamplesPerPixel(4);
+    a.seed(7);
+    b.seed(7);
+
+    // b traces another pixel first, the streams only depend on the pixel and sample
+    b.setPixelIndex(12);
+    b.startPixelSession();
+    b.generate2d();
+
+    a.setPixelIndex(3);
+    b.setPixelIndex(3);
+    a.startPixelSession();
+    b.startPixelSession();
+    do {
+        for (int i = 0; i < 16; i++) {
+            EXPECT_EQ(a.generate1d(), b.generate1d());
+        }
+
+        b.startNextSample();
+    } while (a.startNextSample());
+
+    // Neighbouring pixels see different numbers
+    a.setPixelIndex(4);
+    a.startPixelSession();
+    b.startPixelSession();
+    EXPECT_NE(a.generate1d(), b.generate1d());
+
+    math::seedRandom(5);
+    const math::real r0 = math::uniformRandom();
+    math::seedRandom(5);
+    EXPECT_EQ(math::uniformRandom(), r0);
+}
@@ -0,0 +1,123 @@
+#include <pch.h>
+
+#include "../include/scene_bvh.h"
+#include "../include/scene.h"
+#include "../include/scene_object.h"
+#include "../include/sphere_primitive.h"
+#include "../include/light_ray.h"
+#include "../include/coarse_intersection.h"
+#include "../include/ray_packet.h"
+
+using namespace manta;
+
+TEST(SceneBVHTests, SceneBVHClosestHitTest) {
+    constexpr int SphereCount = 32;
+
+    Scene scene;
+    SpherePrimitive spheres[SphereCount];
+    SceneObject objects[SphereCount];
+
+    for (int i = 0; i < SphereCount; i++) {
+        spheres[i].setPosition(math::loadVector((math::real)(i * 4), (math::real)0.0, (math::real)0.0));
+        spheres[i].setRadius((math::real)1.0);
+
+        objects[i].setGeometry(&spheres[i]);
+        scene.addSceneObject(&objects[i]);
+    }
+
+    SceneBVH bvh;
+    bvh.build(&scene);
+
+    EXPECT_EQ(bvh.getPrimitiveCount(), SphereCount);
+    EXPECT_EQ(bvh.getUnboundedCount(), 0);
+
+    // Ray travelling down the row of spheres from the far end
+    LightRay ray;
+    ray.setSource(math::loadVector((math::real)1000.0, (math::real)0.0, (math::real)0.0));
+    ray.setDirection(math::loadVector((math::real)-1.0, (math::real)0.0, (math::real)0.0));
+    ray.calculateTransformations();
+
+    CoarseIntersection intersection;
+    intersection.sceneObject = nullptr;
+    Light *light = nullptr;
+    math::real depth = math::constants::REAL_MAX;
+
+    EXPECT_TRUE(bvh.findClosestIntersection(&ray, &intersection, &light, &depth, nullptr STATISTICS_NULL_INPUT));
+    EXPECT_EQ(intersection.sceneObject, &objects[SphereCount - 1]);
+    EXPECT_EQ(light, nullptr);
+    EXPECT_NEAR(depth, 1000.0 - (SphereCount - 1) * 4 - 1.0, 1E-3);
+
+    // Ray passing between the spheres
+    ray.setSource(math::loadVector((math::real)2.0, (math::real)100.0, (math::real)0.0));
+    ray.setDirection(math::loadVector((math::real)0.0, (math::real)-1.0, (math::real)0.0));
+    ray.calculateTransformations();
+
+    depth = math::constants::REAL_MAX;
+    EXPECT_FALSE(bvh.findClosestIntersection(&ray, &intersection, &light, &depth, nullptr STATISTICS_NULL_INPUT));
+
+    bvh.destroy();
+}
+
+TEST(SceneBVHTests, SceneBVHPacketTest) {
+    constexpr int SphereCount = 32;
+
+    Scene scene;
+    SpherePrimitive spheres[SphereCount];
+    SceneObject objects[SphereCount];
+
+    for (int i = 0; i < SphereCount; i++) {
+        spheres[i].setPosition(math::loadVector((math::real)(i * 4), (math::real)0.0, (math::real)0.0));
+        spheres[i].setRadius((math::real)1.0);
+
+        objects[i].setGeometry(&spheres[i]);
+        scene.addSceneObject(&objects[i]);
+    }
+
+    SceneBVH bvh;
+    bvh.build(&scene);
+
+    // Downward rays spread along the row so that some lanes pass between the spheres
+    for (int start = 0; start < SphereCount * 4; start += RayPacket::Width) {
+        LightRay rays[RayPacket::Width];
+        LightRay *rayPointers[RayPacket::Width];
+        for (int i = 0; i < RayPacket::Width; i++) {
+            rays[i].setSource(math::loadVector((math::real)(start + i) + (math::real)0.5, (math::real)100.0, (math::real)0.2));
+            rays[i].setDirection(math::loadVector((math::real)0.0, (math::real)-1.0, (math::real)0.0));
+            rays[i].calculateTransformations();
+            rayPointers[i] = &rays[i];
+        }
+
+        RayPacket packet;
+        packet.initialize(rayPointers, RayPacket::Width);
+
+        CoarseIntersection intersections[RayPacket::Width];
+        Light *lights[RayPacket::Width];
+        math::real depths[RayPacket::Width];
+        for (int i = 0; i < RayPacket::Width; i++) {
+            intersections[i].sceneObject = nullptr;
+            lights[i] = nullptr;
+            depths[i] = math::constants::REAL_MAX;
+        }
+
+        const int hitMask = bvh.findClosestIntersectionPacket(
+            packet, intersections, lights, depths, nullptr STATISTICS_NULL_INPUT);
+
+        for (int i = 0; i < RayPacket::Width; i++) {
+            CoarseIntersection reference;
+            reference.sceneObject = nullptr;
+            Light *light = nullptr;
+            math::real depth = math::constants::REAL_MAX;
+
+            const bool referenceHit = bvh.findClosestIntersection(
+                &rays[i], &reference, &light, &depth, nullptr STATISTICS_NULL_INPUT);
+
+            EXPECT_EQ(referenceHit, (hitMask & (0x1 << i)) != 0);
+            if (referenceHit) {
+                EXPECT_EQ(intersections[i].sceneObject, reference.sceneObject);
+                EXPECT_NEAR(depths[i], depth, 1E-3);
+            }
+        }
+    }
+
+    bvh.destroy();
+}
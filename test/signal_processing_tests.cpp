@@ -42,6 +42,78 @@ TEST(SignalProcessingTests, FourierTransformSanityCheck) {
     StandardAllocator::Global()->free(f_second_order, SIZE);
 }
 
+TEST(SignalProcessingTests, FFTPlanMatchesNaiveFFT) {
+    for (int n = 1; n <= 4096; n *= 2) {
+        math::Complex *data = StandardAllocator::Global()->allocate<math::Complex>(n, 16);
+        math::Complex *reference = StandardAllocator::Global()->allocate<math::Complex>(n, 16);
+        math::Complex *result = StandardAllocator::Global()->allocate<math::Complex>(n, 16);
+
+        for (int i = 0; i < n; i++) {
+            data[i] = math::Complex(rand() % 100 / 10.0, rand() % 100 / 10.0);
+        }
+
+        const FFTPlan *plan = FFTPlan::get(n);
+
+        NaiveFFT::fft(data, reference, n);
+        plan->transform(data, result, false);
+
+        for (int i = 0; i < n; i++) {
+            EXPECT_NEAR(result[i].r, reference[i].r, 1E-6 * n);
+            EXPECT_NEAR(result[i].i, reference[i].i, 1E-6 * n);
+        }
+
+        // In place inverse
+        NaiveFFT::fft_inverse(data, reference, n);
+        plan->transform(data, data, true);
+
+        for (int i = 0; i < n; i++) {
+            EXPECT_NEAR(data[i].r, reference[i].r, 1E-6);
+            EXPECT_NEAR(data[i].i, reference[i].i, 1E-6);
+        }
+
+        StandardAllocator::Global()->aligned_free(data, n);
+        StandardAllocator::Global()->aligned_free(reference, n);
+        StandardAllocator::Global()->aligned_free(result, n);
+    }
+}
+
+TEST(SignalProcessingTests, FourierTransform2DMatchesNaiveFFT) {
+    constexpr int WIDTH = 64;
+    constexpr int HEIGHT = 32;
+
+    ComplexMap2D input, output;
+    input.initialize(WIDTH, HEIGHT);
+
+    for (int i = 0; i < WIDTH; i++) {
+        for (int j = 0; j < HEIGHT; j++) {
+            input.set(math::Complex(rand() % 100, rand() % 100), i, j);
+        }
+    }
+
+    input.fft(&output);
+
+    // Reference: rows then columns with the recursive transform
+    math::Complex rows[HEIGHT][WIDTH];
+    math::Complex buffer[WIDTH], transformed[WIDTH];
+    for (int j = 0; j < HEIGHT; j++) {
+        for (int i = 0; i < WIDTH; i++) buffer[i] = input.get(i, j);
+        NaiveFFT::fft(buffer, rows[j], WIDTH);
+    }
+
+    for (int i = 0; i < WIDTH; i++) {
+        for (int j = 0; j < HEIGHT; j++) buffer[j] = rows[j][i];
+        NaiveFFT::fft(buffer, transformed, HEIGHT);
+
+        for (int j = 0; j < HEIGHT; j++) {
+            EXPECT_NEAR(output.get(i, j).r, transformed[j].r, 1E-6);
+            EXPECT_NEAR(output.get(i, j).i, transformed[j].i, 1E-6);
+        }
+    }
+
+    input.destroy();
+    output.destroy();
+}
+
 TEST(SignalProcessingTests, FourierTransform2D) {
     constexpr int SIZE = 1024;
 
@@ -84,8 +156,8 @@ TEST(SignalProcessingTests, FourierTransform2DMultithreaded) {
         }
     }
 
-    input.fft_multithreaded(&output, 12);
-    output.fft_multithreaded(&parity, 12, true);
+    input.fft_multithreaded(&output);
+    output.fft_multithreaded(&parity, true);
 
     for (int i = 0; i < SIZE; i++) {
         for (int j = 0; j < SIZE; j++) {
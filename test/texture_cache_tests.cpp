@@ -0,0 +1,200 @@
+#include <pch.h>
+
+#include "utilities.h"
+
+#include "../include/tiled_texture.h"
+#include "../include/texture_cache.h"
+#include "../include/mipmap.h"
+#include "../include/vector_map_2d.h"
+
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace manta;
+
+namespace {
+
+    void createTestMap(VectorMap2D *map, int width, int height) {
+        map->initialize(width, height, VectorMap2D::Format::Linear8);
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                map->setBytes(i % 256, j % 256, (i * 7 + j * 3) % 256, 255, i, j);
+            }
+        }
+    }
+
+} /* namespace */
+
+TEST(TextureCacheTests, TiledTextureTest) {
+    const std::string fname = std::string(TMP_PATH) + "tiled_texture_test.mrtex";
+
+    VectorMap2D source;
+    createTestMap(&source, 200, 130);
+
+    EXPECT_TRUE(TiledTexture::writeFile(fname.c_str(), &source, 1234, 5678, 1));
+
+    TextureCache cache;
+    TiledTexture texture;
+    EXPECT_EQ(texture.open(fname.c_str(), 1234, 5678, 1, &cache), TiledTexture::CacheStatus::Loaded);
+    EXPECT_EQ(texture.getWidth(), 200);
+    EXPECT_EQ(texture.getHeight(), 130);
+    EXPECT_EQ(texture.getFormat(), VectorMap2D::Format::Linear8);
+
+    for (int j = 0; j < 130; j++) {
+        for (int i = 0; i < 200; i++) {
+            CHECK_VEC_EQ(texture.get(i, j), source.get(i, j), 1E-6);
+        }
+    }
+
+    // Filtered lookups match an in-memory mip chain
+    VectorMipmap mipmap;
+    mipmap.initialize(&source);
+    EXPECT_EQ(texture.getLevels(), mipmap.getLevels());
+
+    for (int i = 0; i < 100; i++) {
+        const math::real u = (i * 37 % 100) / (math::real)100;
+        const math::real v = (i * 61 % 100) / (math::real)100;
+        const math::real w = (i % 10) / (math::real)20;
+        CHECK_VEC_EQ(texture.sample(u, v, w), mipmap.sample(u, v, w), 1E-5);
+    }
+
+    const TextureCache::Statistics statistics = cache.getStatistics();
+    EXPECT_EQ(statistics.evictions, 0u);
+    EXPECT_GT(statistics.hits, statistics.misses);
+    EXPECT_LE(statistics.misses, (unsigned __int64)texture.getTileCount());
+
+    mipmap.destroy();
+    texture.close();
+    source.destroy();
+
+    EXPECT_EQ(cache.getStatistics().usage, 0u);
+
+    remove(fname.c_str());
+}
+
+TEST(TextureCacheTests, TiledTextureValidationTest) {
+    const std::string fname = std::string(TMP_PATH) + "tiled_texture_validation_test.mrtex";
+
+    VectorMap2D source;
+    createTestMap(&source, 64, 64);
+    EXPECT_TRUE(TiledTexture::writeFile(fname.c_str(), &source, 1, 2, 0));
+    source.destroy();
+
+    TextureCache cache;
+    TiledTexture texture;
+    EXPECT_EQ(texture.open("missing_texture.mrtex", 1, 2, 0, &cache), TiledTexture::CacheStatus::Missing);
+    EXPECT_EQ(texture.open(fname.c_str(), 1, 3, 0, &cache), TiledTexture::CacheStatus::Stale);
+    EXPECT_EQ(texture.open(fname.c_str(), 1, 2, 1, &cache), TiledTexture::CacheStatus::Stale);
+
+    // Truncated file
+    FILE *file = fopen(fname.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fclose(file);
+
+    std::vector<char> data(size);
+    file = fopen(fname.c_str(), "rb");
+    fread(data.data(), 1, size, file);
+    fclose(file);
+
+    file = fopen(fname.c_str(), "wb");
+    fwrite(data.data(), 1, size - 1, file);
+    fclose(file);
+
+    EXPECT_EQ(texture.open(fname.c_str(), 1, 2, 0, &cache), TiledTexture::CacheStatus::Corrupt);
+    EXPECT_FALSE(texture.isOpen());
+
+    remove(fname.c_str());
+}
+
+TEST(TextureCacheTests, TiledTextureRewriteTest) {
+    const std::string fname = std::string(TMP_PATH) + "tiled_texture_rewrite_test.mrtex";
+
+    VectorMap2D source;
+    createTestMap(&source, 64, 64);
+    EXPECT_TRUE(TiledTexture::writeFile(fname.c_str(), &source, 1, 2, 0));
+
+    TextureCache cache;
+    TiledTexture texture;
+    ASSERT_EQ(texture.open(fname.c_str(), 1, 2, 0, &cache), TiledTexture::CacheStatus::Loaded);
+
+    // Replacing the file must not disturb a texture that still has it mapped
+    VectorMap2D other;
+    createTestMap(&other, 100, 20);
+    const bool rewritten = TiledTexture::writeFile(fname.c_str(), &other, 3, 4, 1);
+
+    EXPECT_EQ(texture.getWidth(), 64);
+    for (int j = 0; j < 64; j++) {
+        for (int i = 0; i < 64; i++) {
+            CHECK_VEC_EQ(texture.get(i, j), source.get(i, j), 1E-6);
+        }
+    }
+
+    texture.close();
+
+    if (rewritten) {
+        ASSERT_EQ(texture.open(fname.c_str(), 3, 4, 1, &cache), TiledTexture::CacheStatus::Loaded);
+        EXPECT_EQ(texture.getWidth(), 100);
+        EXPECT_EQ(texture.getHeight(), 20);
+        texture.close();
+    }
+
+    source.destroy();
+    other.destroy();
+
+    remove(fname.c_str());
+}
+
+TEST(TextureCacheTests, TextureCacheBudgetTest) {
+    const std::string fname = std::string(TMP_PATH) + "texture_cache_budget_test.mrtex";
+
+    VectorMap2D source;
+    createTestMap(&source, 512, 512);
+    EXPECT_TRUE(TiledTexture::writeFile(fname.c_str(), &source, 0, 0, 0));
+
+    // Budget of roughly two tiles per shard
+    const mem_size tileSize = TiledTexture::TileSize * TiledTexture::TileSize * 4;
+    TextureCache cache;
+    cache.setBudget(tileSize * 32);
+
+    TiledTexture texture;
+    ASSERT_EQ(texture.open(fname.c_str(), 0, 0, 0, &cache), TiledTexture::CacheStatus::Loaded);
+
+    std::vector<std::thread> threads;
+    std::vector<int> errors(4, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for (int n = 0; n < 20000; n++) {
+                const int i = (n * 131 + t * 17) % 512;
+                const int j = (n * 71 + t * 29) % 512;
+
+                const math::Vector a = texture.get(i, j);
+                const math::Vector b = source.get(i, j);
+                if (math::getX(a) != math::getX(b) || math::getZ(a) != math::getZ(b)) {
+                    errors[t]++;
+                }
+            }
+        }));
+    }
+
+    for (std::thread &thread : threads) thread.join();
+
+    for (int t = 0; t < 4; t++) {
+        EXPECT_EQ(errors[t], 0);
+    }
+
+    const TextureCache::Statistics statistics = cache.getStatistics();
+    EXPECT_GT(statistics.evictions, 0u);
+    EXPECT_EQ(statistics.hits + statistics.misses, 80000u);
+    EXPECT_LE(statistics.usage, cache.getBudget());
+
+    texture.close();
+    source.destroy();
+
+    EXPECT_EQ(cache.getStatistics().usage, 0u);
+
+    remove(fname.c_str());
+}
@@ -0,0 +1,101 @@
+#include <pch.h>
+
+#include "../include/thread_pool.h"
+
+#include <vector>
+#include <atomic>
+#include <thread>
+
+using namespace manta;
+
+TEST(ThreadPoolTests, ThreadPoolParallelForTest) {
+    ThreadPool pool;
+    pool.initialize(4);
+
+    EXPECT_EQ(pool.getThreadCount(), 4);
+
+    std::vector<int> visits(1000, 0);
+    pool.parallelFor(0, 1000, 16, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            visits[i]++;
+        }
+    });
+
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_EQ(visits[i], 1);
+    }
+
+    pool.destroy();
+}
+
+TEST(ThreadPoolTests, ThreadPoolNestedTaskTest) {
+    ThreadPool pool;
+    pool.initialize(2);
+
+    // More nested groups than threads, every waiting task has to help out
+    std::atomic<int> leaves(0);
+    TaskGroup outer(&pool);
+    for (int i = 0; i < 8; i++) {
+        outer.run([&]() {
+            TaskGroup inner(&pool);
+            for (int j = 0; j < 8; j++) {
+                inner.run([&]() { leaves++; });
+            }
+
+            inner.wait();
+        });
+    }
+
+    outer.wait();
+
+    EXPECT_EQ(leaves, 64);
+    EXPECT_EQ(outer.getPendingCount(), 0);
+    EXPECT_EQ(ThreadPool::getCurrentThreadIndex(), -1);
+
+    pool.destroy();
+}
+
+TEST(ThreadPoolTests, ThreadPoolReinitializeTest) {
+    ThreadPool pool;
+    pool.initialize(3);
+
+    std::atomic<int> completed(0);
+    TaskGroup tasks(&pool);
+    for (int i = 0; i < 32; i++) {
+        tasks.run([&]() { completed++; });
+    }
+
+    tasks.wait();
+    EXPECT_EQ(completed, 32);
+
+    // Resizing keeps the pool usable
+    pool.initialize(1);
+    EXPECT_EQ(pool.getThreadCount(), 1);
+
+    pool.parallelFor(0, 10, 1, [&](int start, int end) { completed += end - start; });
+    EXPECT_EQ(completed, 42);
+
+    pool.destroy();
+    EXPECT_EQ(pool.getThreadCount(), 0);
+}
+
+TEST(ThreadPoolTests, ThreadPoolGlobalConcurrentTest) {
+    // Nodes evaluated in parallel all share the global pool
+    const int threadCount = ThreadPool::Global()->getThreadCount();
+    EXPECT_EQ(threadCount, ThreadPool::getHardwareThreadCount());
+
+    std::atomic<int> completed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(std::thread([&]() {
+            ThreadPool::Global()->parallelFor(0, 100, 1, [&](int start, int end) {
+                completed += end - start;
+            });
+        }));
+    }
+
+    for (std::thread &thread : threads) thread.join();
+
+    EXPECT_EQ(completed, 400);
+    EXPECT_EQ(ThreadPool::Global()->getThreadCount(), threadCount);
+}
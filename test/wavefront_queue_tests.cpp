@@ -0,0 +1,209 @@
+#include <pch.h>
+
+#include "../include/wavefront_queue.h"
+#include "../include/direct_lighting_sample.h"
+#include "../include/ray_tracer.h"
+#include "../include/scene.h"
+#include "../include/scene_object.h"
+#include "../include/sphere_primitive.h"
+#include "../include/simple_bsdf_material.h"
+#include "../include/disney_diffuse_brdf.h"
+#include "../include/bsdf.h"
+#include "../include/area_light.h"
+#include "../include/sobol_sampler.h"
+#include "../include/intersection_point_manager.h"
+#include "../include/stack_allocator.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace manta;
+
+namespace {
+
+    // Pinhole camera looking down the z-axis, u jitters the ray within the pixel
+    LightRay generateCameraRay(int x, int y, int resolution, const math::Vector2 &u) {
+        const math::real px = ((x + u.x) / resolution - (math::real)0.5) * 2;
+        const math::real py = ((y + u.y) / resolution - (math::real)0.5) * 2;
+
+        LightRay ray;
+        ray.setSource(math::loadVector((math::real)0.0, (math::real)1.0, (math::real)-5.0));
+        ray.setDirection(math::normalize(math::loadVector(px, (math::real)1.0 - py, (math::real)3.0)));
+        ray.calculateTransformations();
+
+        return ray;
+    }
+
+} /* namespace */
+
+TEST(WavefrontQueueTests, WavefrontQueueAddPathTest) {
+    WavefrontQueue queue;
+    queue.initialize(16);
+
+    EXPECT_EQ(queue.getCapacity(), 16);
+    EXPECT_EQ(queue.getPathCount(), 0);
+
+    for (int i = 0; i < 16; i++) {
+        LightRay ray;
+        ray.setSource(math::loadVector((math::real)i, (math::real)0.0, (math::real)0.0));
+        ray.setDirection(math::loadVector((math::real)0.0, (math::real)0.0, (math::real)1.0));
+
+        EXPECT_EQ(queue.addPath(ray, nullptr), i);
+    }
+
+    EXPECT_TRUE(queue.isFull());
+
+    // New paths start out waiting for their first intersection
+    PathQueue *extendQueue = queue.getExtendQueue();
+    EXPECT_EQ(extendQueue->count, 16);
+    EXPECT_EQ(queue.getShadeQueue()->count, 0);
+    EXPECT_EQ(queue.getShadowQueue()->count, 0);
+
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(extendQueue->indices[i], i);
+        EXPECT_NEAR(math::getX(queue.getPath(i)->ray.getSource()), (math::real)i, 1E-6);
+    }
+
+    queue.clear();
+    EXPECT_EQ(queue.getPathCount(), 0);
+    EXPECT_EQ(extendQueue->count, 0);
+    EXPECT_FALSE(queue.isFull());
+
+    queue.destroy();
+}
+
+TEST(WavefrontQueueTests, DirectLightingSampleTest) {
+    DirectLightingSample sample;
+    sample.reset();
+
+    EXPECT_NEAR(math::getX(sample.evaluate(0)), 0.0, 1E-6);
+
+    sample.scale = (math::real)2.0;
+    sample.addShadowRay()->contribution = math::loadVector((math::real)1.0, (math::real)2.0, (math::real)3.0);
+    sample.addShadowRay()->contribution = math::loadVector((math::real)4.0, (math::real)5.0, (math::real)6.0);
+
+    const math::Vector unoccluded = sample.evaluate(0x0);
+    EXPECT_NEAR(math::getX(unoccluded), 10.0, 1E-6);
+    EXPECT_NEAR(math::getY(unoccluded), 14.0, 1E-6);
+    EXPECT_NEAR(math::getZ(unoccluded), 18.0, 1E-6);
+
+    // Only the second shadow ray reaches the light
+    const math::Vector partial = sample.evaluate(0x1);
+    EXPECT_NEAR(math::getX(partial), 8.0, 1E-6);
+    EXPECT_NEAR(math::getY(partial), 10.0, 1E-6);
+    EXPECT_NEAR(math::getZ(partial), 12.0, 1E-6);
+
+    EXPECT_NEAR(math::getX(sample.evaluate(0x3)), 0.0, 1E-6);
+}
+
+TEST(WavefrontQueueTests, WavefrontMatchesPathTracingTest) {
+    constexpr int Resolution = 4;
+    constexpr int PixelCount = Resolution * Resolution;
+    constexpr int SamplesPerPixel = 8;
+
+    DisneyDiffuseBRDF whiteBrdf, redBrdf;
+    whiteBrdf.setBaseColor(math::loadVector((math::real)0.8, (math::real)0.8, (math::real)0.8));
+    redBrdf.setBaseColor(math::loadVector((math::real)0.8, (math::real)0.2, (math::real)0.1));
+
+    BSDF whiteBsdf(&whiteBrdf), redBsdf(&redBrdf);
+
+    SimpleBSDFMaterial white, red, emitter;
+    white.setBSDF(&whiteBsdf);
+    white.setEmission(math::constants::Zero);
+    red.setBSDF(&redBsdf);
+    red.setEmission(math::constants::Zero);
+    emitter.setBSDF(&whiteBsdf);
+    emitter.setEmission(math::loadVector((math::real)4.0, (math::real)3.0, (math::real)2.0));
+
+    SpherePrimitive ground, ball, lamp;
+    ground.setPosition(math::loadVector((math::real)0.0, (math::real)-100.0, (math::real)0.0));
+    ground.setRadius((math::real)100.0);
+    ball.setPosition(math::loadVector((math::real)0.0, (math::real)1.0, (math::real)0.0));
+    ball.setRadius((math::real)1.0);
+    lamp.setPosition(math::loadVector((math::real)1.5, (math::real)0.5, (math::real)-1.0));
+    lamp.setRadius((math::real)0.3);
+
+    SceneObject objects[3];
+    objects[0].setGeometry(&ground);
+    objects[0].setDefaultMaterial(&white);
+    objects[1].setGeometry(&ball);
+    objects[1].setDefaultMaterial(&red);
+    objects[2].setGeometry(&lamp);
+    objects[2].setDefaultMaterial(&emitter);
+
+    AreaLight light;
+    light.setOrigin(math::loadVector((math::real)0.0, (math::real)5.0, (math::real)0.0));
+    light.setDirection(math::loadVector((math::real)0.0, (math::real)-1.0, (math::real)0.0));
+    light.setUp(math::loadVector((math::real)0.0, (math::real)0.0, (math::real)1.0));
+    light.setIntensity(math::loadVector((math::real)5.0, (math::real)5.0, (math::real)5.0));
+    light.setWidth((math::real)2.0);
+    light.setHeight((math::real)2.0);
+
+    Scene scene;
+    for (SceneObject &object : objects) scene.addSceneObject(&object);
+    scene.addLight(&light);
+
+    RayTracer rayTracer;
+    rayTracer.setBackgroundColor(math::loadVector((math::real)0.2, (math::real)0.3, (math::real)0.5));
+    rayTracer.prepareScene(&scene);
+
+    IntersectionPointManager manager;
+    StackAllocator stack;
+    stack.initialize(MB);
+
+    // Reference: every path traced on its own
+    std::vector<math::Vector> expected;
+    for (int i = 0; i < PixelCount; i++) {
+        SobolSampler sampler;
+        sampler.setSamplesPerPixel(SamplesPerPixel);
+        sampler.setPixelIndex(i);
+        sampler.startPixelSession();
+
+        do {
+            LightRay ray = generateCameraRay(i % Resolution, i / Resolution, Resolution, sampler.generate2d());
+            expected.push_back(rayTracer.traceRay(&scene, &ray, 0, &manager, &sampler, &stack /**/ STATISTICS_NULL_INPUT));
+        } while (sampler.startNextSample());
+    }
+
+    // Wavefront: one sample of every pixel is in flight at a time, as in a worker batch
+    SobolSampler samplers[PixelCount];
+    for (int i = 0; i < PixelCount; i++) {
+        samplers[i].setSamplesPerPixel(SamplesPerPixel);
+        samplers[i].setPixelIndex(i);
+        samplers[i].startPixelSession();
+    }
+
+    WavefrontQueue queue;
+    queue.initialize(PixelCount);
+
+    int nonZero = 0;
+    for (int sample = 0; sample < SamplesPerPixel; sample++) {
+        queue.clear();
+        for (int i = 0; i < PixelCount; i++) {
+            const LightRay ray = generateCameraRay(i % Resolution, i / Resolution, Resolution, samplers[i].generate2d());
+            queue.addPath(ray, &samplers[i]);
+        }
+
+        rayTracer.traceWavefront(&scene, &queue, &manager, &stack /**/ STATISTICS_NULL_INPUT);
+
+        for (int i = 0; i < PixelCount; i++) {
+            const math::Vector &L = queue.getPath(i)->L;
+            const math::Vector &reference = expected[i * SamplesPerPixel + sample];
+            const math::real tolerance = (math::real)1E-4 * std::max((math::real)1.0, math::getScalar(math::maxComponent(reference)));
+            EXPECT_NEAR(math::getX(L), math::getX(reference), tolerance);
+            EXPECT_NEAR(math::getY(L), math::getY(reference), tolerance);
+            EXPECT_NEAR(math::getZ(L), math::getZ(reference), tolerance);
+
+            if (math::getScalar(math::maxComponent(reference)) > 0) ++nonZero;
+
+            samplers[i].startNextSample();
+        }
+    }
+
+    // The scene has to actually produce light for the comparison to mean anything
+    EXPECT_GT(nonZero, PixelCount * SamplesPerPixel / 2);
+
+    queue.destroy();
+    stack.destroy();
+    rayTracer.destroy();
+}